@@ -0,0 +1,116 @@
+//
+// NumaMaps parsing: writes synthetic numa_maps and smaps files of the
+// requested number of memory ranges (a line per range in numa_maps, and a
+// header and several field lines per range in smaps) and times parsing them
+// with NumaMaps, which the tests use to check the backing of the regions.
+// Unlike the other benchmarks, it is linked against the mosalloc classes.
+//
+// usage: NumaMapsBenchmark [ranges] [repetitions] [directory]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "NumaMaps.h"
+
+#define RANGE_SIZE (2097152UL)
+#define FIRST_ADDRESS (0x7f0000000000UL)
+
+static double GetSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// the ranges alternate between the types of numa_maps lines
+static int WriteFiles(const char *numa_maps_path, const char *smaps_path,
+                      unsigned long ranges) {
+    FILE *numa_maps = fopen(numa_maps_path, "w");
+    FILE *smaps = fopen(smaps_path, "w");
+    if (numa_maps == NULL || smaps == NULL) {
+        perror("fopen");
+        return -1;
+    }
+    for (unsigned long i = 0; i < ranges; i++) {
+        unsigned long start = FIRST_ADDRESS + i * RANGE_SIZE;
+        switch (i % 4) {
+        case 0:
+            fprintf(numa_maps, "%lx default anon=%lu dirty=%lu active=0 "
+                    "N0=%lu N1=%lu kernelpagesize_kB=4\n",
+                    start, i % 512, i % 512, i % 256, i % 512 - i % 256);
+            break;
+        case 1:
+            fprintf(numa_maps, "%lx default file=/usr/lib/libsynthetic%lu.so "
+                    "mapped=%lu mapmax=3 N0=%lu kernelpagesize_kB=4\n",
+                    start, i, i % 512, i % 512);
+            break;
+        case 2:
+            fprintf(numa_maps, "%lx default file=/anon_hugepage\\040(deleted) "
+                    "huge anon=1 dirty=1 N0=1 kernelpagesize_kB=2048\n",
+                    start);
+            break;
+        default:
+            fprintf(numa_maps, "%lx default heap anon=%lu dirty=%lu "
+                    "N0=%lu kernelpagesize_kB=4\n",
+                    start, i % 512, i % 512, i % 512);
+            break;
+        }
+        fprintf(smaps, "%lx-%lx rw-p 00000000 00:00 0\n"
+                "Size:               2048 kB\n"
+                "KernelPageSize:        4 kB\n"
+                "Rss:               %4lu kB\n"
+                "Pss:               %4lu kB\n"
+                "Private_Dirty:     %4lu kB\n"
+                "AnonHugePages:     %4lu kB\n"
+                "Private_Hugetlb:   %4lu kB\n"
+                "VmFlags: rd wr mr mw me ac\n",
+                start, start + RANGE_SIZE, (i % 512) * 4, (i % 512) * 4,
+                (i % 512) * 4, (i % 2) * 2048, (i % 4 == 2) * 2048UL);
+    }
+    fclose(numa_maps);
+    fclose(smaps);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long ranges = (argc > 1) ? strtoul(argv[1], NULL, 10) : 100000;
+    unsigned long repetitions = (argc > 2) ? strtoul(argv[2], NULL, 10) : 10;
+    const char *directory = (argc > 3) ? argv[3] : "/tmp";
+
+    char numa_maps_path[PATH_MAX];
+    char smaps_path[PATH_MAX];
+    snprintf(numa_maps_path, sizeof(numa_maps_path),
+             "%s/numa_maps.bench.%d", directory, (int)getpid());
+    snprintf(smaps_path, sizeof(smaps_path), "%s/smaps.bench.%d",
+             directory, (int)getpid());
+    if (WriteFiles(numa_maps_path, smaps_path, ranges) != 0) {
+        return 1;
+    }
+
+    printf("files,ranges,repetitions,seconds,ranges-per-second\n");
+    size_t rss = 0;
+    for (int with_smaps = 0; with_smaps <= 1; with_smaps++) {
+        double start = GetSeconds();
+        for (unsigned long r = 0; r < repetitions; r++) {
+            NumaMaps numa_maps(numa_maps_path,
+                               with_smaps ? smaps_path : nullptr);
+            if (numa_maps.GetMemoryRanges().size() != ranges) {
+                fprintf(stderr, "parsed %lu ranges instead of %lu\n",
+                        (unsigned long)numa_maps.GetMemoryRanges().size(),
+                        ranges);
+                return 1;
+            }
+            rss += numa_maps.GetMemoryRanges().back()._rss;
+        }
+        double seconds = GetSeconds() - start;
+        printf("%s,%lu,%lu,%.6f,%.0f\n",
+               with_smaps ? "numa_maps+smaps" : "numa_maps", ranges,
+               repetitions, seconds, ranges * repetitions / seconds);
+    }
+    unlink(numa_maps_path);
+    unlink(smaps_path);
+    // keeps the parsing from being optimized out
+    return rss == (size_t)-1;
+}
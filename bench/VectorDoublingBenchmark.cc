@@ -0,0 +1,90 @@
+//
+// Vector-doubling workload: grows an mmap-backed buffer by doubling its size
+// until it reaches the requested maximal size, and writes every new page.
+// This is the access pattern of a std::vector-like container whose storage is
+// grown with mremap (or with mmap+memcpy+munmap when mremap is not used).
+//
+// usage: VectorDoublingBenchmark [mremap|copy] [max-size-in-MB] [repetitions]
+//
+
+#include <sys/mman.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MB (1048576UL)
+#define INITIAL_SIZE (4096UL)
+
+static double GetSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void TouchPages(char *start, size_t from, size_t to) {
+    for (size_t offset = from; offset < to; offset += INITIAL_SIZE) {
+        start[offset] = (char)offset;
+    }
+}
+
+static void *GrowWithMremap(void *buffer, size_t old_size, size_t new_size) {
+    return mremap(buffer, old_size, new_size, MREMAP_MAYMOVE);
+}
+
+static void *GrowWithCopy(void *buffer, size_t old_size, size_t new_size) {
+    void *new_buffer = mmap(NULL, new_size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (new_buffer == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+    memcpy(new_buffer, buffer, old_size);
+    munmap(buffer, old_size);
+    return new_buffer;
+}
+
+int main(int argc, char *argv[]) {
+    const char *mode = (argc > 1) ? argv[1] : "mremap";
+    size_t max_size = ((argc > 2) ? strtoul(argv[2], NULL, 10) : 1024) * MB;
+    unsigned long repetitions = (argc > 3) ? strtoul(argv[3], NULL, 10) : 10;
+
+    void *(*grow)(void *, size_t, size_t) = GrowWithMremap;
+    if (!strcmp(mode, "copy")) {
+        grow = GrowWithCopy;
+    } else if (strcmp(mode, "mremap")) {
+        fprintf(stderr, "unknown mode: %s (expected mremap or copy)\n", mode);
+        return 1;
+    }
+
+    printf("mode,max-size,repetitions,doublings,moves,seconds\n");
+    unsigned long doublings = 0, moves = 0;
+    double start_time = GetSeconds();
+    for (unsigned long r = 0; r < repetitions; r++) {
+        size_t size = INITIAL_SIZE;
+        void *buffer = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffer == MAP_FAILED) {
+            perror("mmap");
+            return 1;
+        }
+        TouchPages((char *)buffer, 0, size);
+        while (size < max_size) {
+            void *new_buffer = grow(buffer, size, 2 * size);
+            if (new_buffer == MAP_FAILED) {
+                perror(mode);
+                return 1;
+            }
+            moves += (new_buffer != buffer);
+            doublings++;
+            TouchPages((char *)new_buffer, size, 2 * size);
+            buffer = new_buffer;
+            size *= 2;
+        }
+        munmap(buffer, size);
+    }
+    double seconds = GetSeconds() - start_time;
+
+    printf("%s,%lu,%lu,%lu,%lu,%f\n",
+           mode, max_size, repetitions, doublings, moves, seconds);
+    return 0;
+}
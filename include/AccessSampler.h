@@ -0,0 +1,104 @@
+#ifndef _ACCESS_SAMPLER_H_
+#define _ACCESS_SAMPLER_H_
+
+#include <stdint.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <atomic>
+
+#define ACCESS_SAMPLER_PAGEMAP_PATH "/proc/self/pagemap"
+#define ACCESS_SAMPLER_IDLE_BITMAP_PATH "/sys/kernel/mm/page_idle/bitmap"
+#define ACCESS_SAMPLER_MAX_POOLS (32)
+#define ACCESS_SAMPLER_MAX_NAME_LENGTH (32)
+
+/*
+ * Samples the accesses to the pools through idle page tracking: each sample
+ * reads the idle bits of the pages that back the pools (their frames are
+ * found through the pagemap), counts the pages that were accessed since the
+ * previous sample (i.e., that are no longer idle) in 2MB chunks, and marks
+ * the pages idle again. On Close, the counts are written to
+ * @path_prefix.<pid> as csv, with a row per chunk that was accessed:
+ * pool,offset,samples,accessed-samples,accessed-pages.
+ * The kernel tracks only the pages on its LRU lists, so hugetlb pages always
+ * look accessed: the accesses should be sampled with a layout of 4KB pages.
+ * The samples are taken by the caller (the background thread of the
+ * allocator), which IsDue tells when one is due. The counters are allocated through the glibc functions when
+ * the pools are added, and a child process resets them and writes a file of
+ * its own.
+ * IsDue can be called concurrently; the other calls must be serialized by
+ * the caller.
+ */
+class AccessSampler {
+    public:
+        AccessSampler();
+        ~AccessSampler() {}
+
+        /*
+         * Starts sampling every @interval_ns nanoseconds (0 samples only
+         * when the caller forces it), through the pagemap and the idle
+         * bitmap files at the given paths.
+         * Returns 0 on success, or -1 and sets errno (e.g., EACCES when the
+         * process is not privileged to read the idle bitmap).
+         */
+        int Open(const char *path_prefix, uint64_t interval_ns,
+                 const char *pagemap_path = ACCESS_SAMPLER_PAGEMAP_PATH,
+                 const char *bitmap_path = ACCESS_SAMPLER_IDLE_BITMAP_PATH);
+        bool IsOpen() { return _bitmap_fd >= 0; }
+        void Close();
+
+        /*
+         * Adds a pool whose @capacity bytes from @base may be sampled; pools
+         * must be added before the first sample.
+         * Returns 0 on success, or -1 and sets errno.
+         */
+        int AddPool(const char *name, void *base, size_t capacity);
+
+        // returns true if a sample is due
+        bool IsDue();
+        // starts a sample, which the caller fills by SamplePool
+        void BeginSample();
+        // samples the first @size bytes of the pool at @index
+        void SamplePool(int index, size_t size);
+        uint64_t GetSamplesCount() { return _samples_count; }
+        // returns the pages of the 2MB @chunk of the pool at @index that
+        // were found accessed, summed over the samples
+        uint64_t GetAccessedPages(int index, size_t chunk);
+
+    private:
+        struct Chunk {
+            uint64_t accessed_samples;
+            uint64_t accessed_pages;
+        };
+        struct Pool {
+            char name[ACCESS_SAMPLER_MAX_NAME_LENGTH];
+            uint64_t base;
+            size_t chunks_count;
+            Chunk *chunks;
+        };
+
+        void FollowFork();
+        void ResetCounters();
+        bool IsIdle(uint64_t pfn);
+        void FlushIdleWord();
+        void Write();
+
+        pid_t _pid;
+        const char *_path_prefix;
+        const char *_pagemap_path;
+        int _pagemap_fd;
+        int _bitmap_fd;
+        uint64_t _interval_ns;
+        std::atomic<uint64_t> _next_sample_ns;
+        uint64_t _samples_count;
+        Pool _pools[ACCESS_SAMPLER_MAX_POOLS];
+        int _pools_count;
+        // the word of the idle bitmap that was read last, and the bits of
+        // its pages that should be marked idle
+        int64_t _idle_word_index;
+        uint64_t _idle_word;
+        uint64_t _idle_word_marks;
+        // the pagemap entries of a chunk
+        uint64_t *_entries;
+};
+
+#endif //_ACCESS_SAMPLER_H_
@@ -0,0 +1,45 @@
+#ifndef _CALL_SITE_H_
+#define _CALL_SITE_H_
+
+#include <cstddef>
+#include <stdint.h>
+
+#define MAX_CALL_SITE_DEPTH (16)
+#define CALL_SITE_CACHE_SIZE (4096)
+
+/*
+ * Walks the frame-pointer chain that starts at @frame (the frame of the
+ * hook, see __builtin_frame_address) and fills @frames with up to
+ * @max_depth return addresses, the first of which is the caller of the hook.
+ * The walk stops at the first frame pointer that does not point further up
+ * the stack of the calling thread, so frames of code compiled without frame
+ * pointers end the call site early instead of being dereferenced.
+ * Returns the number of return addresses.
+ */
+int CaptureCallSite(void *frame, void **frames, int max_depth);
+
+uint64_t HashCallSite(void *const *frames, int depth);
+
+/*
+ * A direct-mapped cache from call-site hashes to the routing rules whose
+ * origins match them (see PoolRoutingRules::MatchOrigins), so the modules
+ * and symbols of a call site are resolved only once.
+ */
+class CallSiteCache {
+    public:
+        CallSiteCache();
+        ~CallSiteCache() {}
+
+        bool Lookup(uint64_t hash, uint64_t *rules_mask) const;
+        void Insert(uint64_t hash, uint64_t rules_mask);
+
+    private:
+        struct Entry {
+            uint64_t hash;
+            uint64_t rules_mask;
+            bool is_valid;
+        };
+        Entry _entries[CALL_SITE_CACHE_SIZE];
+};
+
+#endif //_CALL_SITE_H_
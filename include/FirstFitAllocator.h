@@ -17,6 +17,8 @@ typedef void *(*FfaMemoryAllocator)(void *addr, size_t length, int prot,
 
 typedef int (*FfaMemoryDeallocator)(void *addr, size_t length);
 
+typedef void (*FfaRangeVisitor)(void *start, void *end, void *arg);
+
 class FirstFitAllocator {
 public:
 
@@ -33,10 +35,70 @@ public:
 
     int Free(void *start, size_t size);
 
+    /*
+     * Allocates exactly [start, start + size) if it is inside the managed
+     * range and entirely free.
+     * Returns @start on success, or NULL otherwise.
+     */
+    void *AllocateAt(void *start, size_t size);
+
+    /*
+     * Allocates the first fit of @size bytes inside [range_start, range_end).
+     * Returns the allocated address, or NULL if there is no such free range.
+     */
+    void *AllocateInRange(size_t size, void *range_start, void *range_end);
+
+    /*
+     * Frees every occupied byte in [start, start + size), like munmap does:
+     * the range may span several occupied regions, cover only parts of them
+     * (splitting a region when it is freed from its middle) and contain free
+     * gaps, which are ignored.
+     * Returns 0 on success, or a negative value if the list ran out of nodes.
+     */
+    int FreeRange(void *start, size_t size);
+
+    /*
+     * Allocates exactly [start, start + size), freeing every occupied byte
+     * in it first (like a MAP_FIXED mmap does). The list is left untouched
+     * if the range is outside the managed range or if the list may run out
+     * of nodes on the way.
+     * Returns @start on success, or NULL otherwise.
+     */
+    void *ReplaceAt(void *start, size_t size);
+
+    /*
+     * Extends or shrinks, in place, the tail of the occupied region
+     * [start, start + old_size) to [start, start + new_size).
+     * Extending succeeds only if the free region that directly follows the
+     * occupied one is large enough.
+     * Returns 0 on success and a negative value otherwise (in which case the
+     * data structure is left untouched).
+     */
+    int ResizeInPlace(void *start, size_t old_size, size_t new_size);
+
     size_t GetFreeSpace();
 
+    /*
+     * Returns the size of the occupied region that starts at @start, or 0 if
+     * no occupied region starts there.
+     */
+    size_t GetOccupiedSize(void *start);
+
+    /*
+     * Returns the number of list nodes in use (by the occupied and the free
+     * regions) and the capacity of the list.
+     */
+    unsigned int GetUsedNodes();
+    unsigned int GetCapacity() { return _len; }
+
     void *GetTopAddress();
 
+    /*
+     * Calls @visitor with every occupied region [start, end) (in no
+     * particular order) and @arg.
+     */
+    void ForEachOccupied(FfaRangeVisitor visitor, void *arg);
+
     bool IsValidDataStructure();
 
     bool IsAddressAllocated(void *addr);
@@ -66,6 +128,21 @@ private:
 
     int FreeOccupiedRegionNode(int node);
 
+    void RemoveFreeNode(int node, int prev_node);
+
+    int ExtendOccupiedRegionNode(int node, size_t size);
+
+    int ShrinkOccupiedRegionNode(int node, size_t size);
+
+    int AllocateFromFreeRegionNode(int node, int prev_node,
+                                   void *start, size_t size);
+
+    void *AllocateFreeRange(void *start, size_t size);
+
+    int FreeOccupiedRange(void *start, size_t size);
+
+    unsigned int CountUsedNodes();
+
     bool _is_initialized;
     MemoryChunk *_array;
     unsigned int _len;
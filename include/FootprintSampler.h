@@ -0,0 +1,71 @@
+#ifndef _FOOTPRINT_SAMPLER_H_
+#define _FOOTPRINT_SAMPLER_H_
+
+#include <stdint.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <atomic>
+
+#include "mosalloc_footprint.h"
+
+#define FOOTPRINT_SAMPLER_BUFFER_SIZE (65536)
+
+/*
+ * Writes samples of the footprints of the pools to a file (see
+ * mosalloc_footprint.h). The samples are taken by the caller (the background
+ * thread of the allocator) at the given interval, and the hooked calls are
+ * counted by CountOperation, which only bumps a counter and tells the caller
+ * when a sample is due by the number of calls.
+ * The samples are buffered in memory that is allocated through the glibc
+ * functions, and are written when the buffer is full and on Close. A child
+ * process writes its samples to a file of its own.
+ * CountOperation can be called concurrently; the other calls must be
+ * serialized by the caller.
+ */
+class FootprintSampler {
+    public:
+        FootprintSampler();
+        ~FootprintSampler() {}
+
+        /*
+         * Starts sampling to @path_prefix.<pid>, every @interval_ns
+         * nanoseconds and/or every @operations calls (0 disables each).
+         * Returns 0 on success, or -1 and sets errno.
+         */
+        int Open(const char *path_prefix, uint64_t interval_ns,
+                 uint64_t operations);
+        bool IsOpen() { return _fd >= 0; }
+        void Close();
+
+        /*
+         * Adds a pool to the samples; pools must be added before the first
+         * sample is written.
+         */
+        void AddPool(const char *name, void *base);
+
+        /*
+         * Counts a call, and returns true if a sample is due by the number
+         * of calls (in which case the caller should collect the footprints
+         * and call Write).
+         */
+        bool CountOperation();
+        void Write(const struct mosalloc_footprint_pool *pools);
+
+    private:
+        int OpenFile();
+        void FollowFork();
+        void Append(const void *data, size_t length);
+        void Flush();
+
+        int _fd;
+        pid_t _pid;
+        const char *_path_prefix;
+        struct mosalloc_footprint_header _header;
+        bool _is_header_written;
+        uint64_t _start_ns;
+        std::atomic<uint64_t> _operations;
+        char *_buffer;
+        size_t _buffer_used;
+};
+
+#endif //_FOOTPRINT_SAMPLER_H_
@@ -15,6 +15,8 @@ class GlibcAllocationFunctions {
         int CallGlibcMprotect(void *addr, size_t len, int prot);             
         void* CallGlibcMmap(void *, size_t, int, int,int, off_t);
         int CallGlibcMunmap(void *, size_t);
+        void* CallGlibcMremap(void *, size_t, size_t, int, void *);
+        int CallGlibcMadvise(void *, size_t, int);
         int CallGlibcBrk(void*);
         void* CallGlibcSbrk(intptr_t);
 
@@ -22,6 +24,8 @@ class GlibcAllocationFunctions {
         int (*_real_mprotect)(void *, size_t, int);
         void* (*_real_mmap)(void *, size_t, int, int, int, off_t);
         int (*_real_munmap)(void *, size_t);
+        void* (*_real_mremap)(void *, size_t, size_t, int, ...);
+        int (*_real_madvise)(void *, size_t, int);
         void* (*_real_calloc)(size_t, size_t);
         void* (*_real_malloc)(size_t);
         void* (*_real_realloc)(void*, size_t);
@@ -30,5 +34,18 @@ class GlibcAllocationFunctions {
         void* (*_real_sbrk)(intptr_t increment);
 };
 
+/*
+ * Wrappers with the signatures of the hooked calls that always call the
+ * glibc functions, to be used as allocators of the internal data structures
+ * and as the backend of the pools.
+ */
+void* GlibcMmap(void *addr, size_t length, int prot, int flags,
+                int fd, off_t offset);
+int GlibcMunmap(void *addr, size_t length);
+int GlibcMprotect(void *addr, size_t len, int prot);
+int GlibcMadvise(void *addr, size_t length, int advice);
+void* GlibcMremap(void *old_address, size_t old_size, size_t new_size,
+                  int flags, void *new_address);
+
 #endif //_GLIBC_ALLOCATION_FUNCTIONS_H_
 
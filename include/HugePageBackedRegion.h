@@ -2,10 +2,57 @@
 #define _HUGE_PAGE_BACKED_REGION_H
 
 #include <cstddef>
+#include <stdint.h>
+#include <stdio.h>
 #include <sys/types.h>
 #include <vector>
+#include <atomic>
+#include <sys/mman.h>
 #include "../include/globals.h"
 #include "../include/MemoryIntervalList.h"
+#include "../include/MemoryRangeSet.h"
+#include "../include/IntervalIndex.h"
+#include "../include/PageBackingVerifier.h"
+
+typedef int (*MprotectFuncPtr)(void *, size_t, int);
+typedef int (*MadviseFuncPtr)(void *, size_t, int);
+typedef void* (*MremapFuncPtr)(void *, size_t, size_t, int, void *);
+
+/*
+ * The utilization of an interval of a region (see GetIntervalUtilization);
+ * the high-water mark is the offset (from the interval start) of the end of
+ * the last page that was touched.
+ */
+struct IntervalUtilization {
+    size_t mapped_size;
+    size_t resident_size;
+    size_t touched_size;
+    size_t high_water_mark;
+};
+
+/*
+ * What a region does when the huge pages of an interval cannot be reserved
+ * as it is extended (see SetHugePagesFallback): exit the process (like any
+ * other mapping failure), back the rest of the interval with the next
+ * smaller page size (1GB, then 2MB, then 4KB), or fail the extension.
+ */
+enum class HugePagesFallback {
+    ABORT,
+    DEGRADE,
+    FAIL
+};
+
+/*
+ * The fallbacks of a region: the intervals that were degraded and their
+ * sizes by the page sizes they were configured with, and the extensions
+ * that failed for lack of huge pages.
+ */
+struct HugePagesFallbackCounters {
+    size_t downgrades;
+    size_t downgraded_2mb_size;
+    size_t downgraded_1gb_size;
+    size_t failures;
+};
 
 class HugePageBackedRegion {
     public:
@@ -14,28 +61,258 @@ class HugePageBackedRegion {
                     MemoryIntervalList& intervalList,
                     MmapFuncPtr allocator,
                     MunmapFuncPtr deallocator,
-                    void* region_base = nullptr);
+                    void* region_base = nullptr,
+                    MprotectFuncPtr protector = mprotect,
+                    MadviseFuncPtr advisor = madvise,
+                    MremapFuncPtr remapper = nullptr);
 
         HugePageBackedRegion();
         ~HugePageBackedRegion();
 
+        /*
+         * Returns 0 on success, or -ENOMEM if @new_size exceeds the region
+         * or if the huge pages of the extension cannot be reserved under
+         * HugePagesFallback::FAIL (in which case the region is extended up
+         * to the first interval that failed).
+         */
         int Resize(size_t new_size);
 
+        /*
+         * Sets the fallback policy for the huge pages that cannot be
+         * reserved, which may be called before Initialize (the region is
+         * mapped by Initialize). Unless the policy is ABORT, the free huge
+         * pages and the hugetlb limit of the cgroup are checked before the
+         * huge pages of each extension are mapped (see
+         * HugePagesAvailability), and each interval that is degraded is
+         * reported on stderr.
+         */
+        void SetHugePagesFallback(HugePagesFallback policy) {
+            _fallback_policy = policy;
+        }
+        const struct HugePagesFallbackCounters &GetFallbackCounters() {
+            return _fallback_counters;
+        }
+
         void *GetRegionBase();
 
         size_t GetRegionSize();
         
         size_t GetRegionMaxSize();
 
+        /*
+         * Returns the page size of the interval that contains @addr, or
+         * PageSize::UNKNOWN if @addr is outside of the region.
+         */
+        PageSize GetPageSize(void *addr);
+
+        /*
+         * Returns the intervals of the region (including the 4KB ones),
+         * sorted by their offsets.
+         */
+        MemoryIntervalList& GetIntervals() { return _region_intervals; }
+
+        /*
+         * Returns the index of the interval (in GetIntervals) that contains
+         * @addr, or -1 if @addr is outside of the region. This takes constant
+         * time and no locks, so it can be called from signal handlers. The
+         * intervals may change meanwhile (see GetIntervalsGeneration).
+         */
+        int FindInterval(void *addr);
+
+        /*
+         * The intervals are changed in place (by Migrate, Relayout and the
+         * huge-page fallback) under the lock of the pool, so the readers that
+         * take no locks check them like a seqlock: they read the generation
+         * before reading the intervals and retry if HaveIntervalsChanged
+         * afterwards (the generation is odd while a change is in progress).
+         */
+        uint32_t GetIntervalsGeneration() {
+            return _intervals_generation.load(std::memory_order_acquire);
+        }
+        bool HaveIntervalsChanged(uint32_t generation) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return (generation & 1) != 0 ||
+                _intervals_generation.load(std::memory_order_relaxed) !=
+                generation;
+        }
+
+        /*
+         * Returns true if all of [addr, addr + len) is backed with pages of
+         * @page_size.
+         */
+        bool IsUniformlyBacked(void *addr, size_t len, PageSize page_size);
+
+        /*
+         * Changes the protection of the pages in [addr, addr + len) to @prot.
+         * Only pages that are entirely inside the range are changed (a huge
+         * page that is partially covered keeps its protection). The changed
+         * ranges are recorded, so Protect(addr, len, MMAP_PROTECTION) only
+         * touches pages that were protected before.
+         * Returns 0 on success, or -1 if the protection was not changed.
+         */
+        int Protect(void *addr, size_t len, int prot);
+
+        /*
+         * Replaces the contents of [addr, addr + len) with zeros: whole 4KB
+         * pages are replaced with fresh pages, while huge pages (which may
+         * run out) and partially covered pages are cleared in place. The
+         * pages are made readable and writable.
+         */
+        void ClearRange(void *addr, size_t len);
+
+        /*
+         * Decommit releases the pages that are entirely inside
+         * [addr, addr + len) and backs them with inaccessible placeholders
+         * that do not consume memory (pages above the region top are mapped
+         * that way when the region is extended). Commit maps fresh pages in
+         * place of the decommitted pages that intersect [addr, addr + len).
+         * Both return 0 on success; Decommit returns -1 if the decommitted
+         * ranges cannot be tracked anymore, in which case (some of) the
+         * pages stay committed, and Commit returns -1 if the huge pages ran
+         * out, in which case (some of) the pages stay decommitted.
+         */
+        int Decommit(void *addr, size_t len);
+        int Commit(void *addr, size_t len);
+
+        /*
+         * Releases the memory of the committed pages in [addr, addr + len)
+         * while keeping them accessible, like madvise(@advice) does for
+         * MADV_DONTNEED and MADV_FREE. Huge pages can only be released
+         * whole, so partially covered huge pages are kept (and cleared for
+         * MADV_DONTNEED), and when the kernel rejects madvise on huge pages
+         * they are replaced with fresh ones.
+         * Returns the number of released bytes (the pages whose advice
+         * failed are not counted).
+         */
+        size_t Discard(void *addr, size_t len, int advice);
+
+        /*
+         * Moves [addr, addr + len) to pages of @page_size while keeping its
+         * contents: the mapped part of the range is copied to new pages,
+         * which are then moved in place of the old ones by mremap (or, if
+         * the kernel cannot move them, mapped in place with MAP_FIXED and
+         * copied back). The intervals are updated, so the pages of the
+         * range are mapped with @page_size from now on.
+         * The range must be aligned to @page_size and to the pages of the
+         * intervals that contain its bounds, it must not be protected or
+         * decommitted, and it must not be accessed during the migration.
+         * Returns 0 on success (and the number of copied bytes in
+         * @copied_size), -EINVAL for an invalid range, -EBUSY for a
+         * protected or decommitted range or when there is no room for more
+         * intervals, or
+         * -ENOMEM if the new pages cannot be allocated (in which case the
+         * range keeps its pages).
+         */
+        int Migrate(void *addr, size_t len, PageSize page_size,
+                    size_t *copied_size);
+
+        /*
+         * Replaces the layout of the region above its top (which is not
+         * mapped yet) with the huge-page intervals of @layout, which is
+         * expected to be validated by MemoryIntervalsValidator; the rest of
+         * the offsets above the top are backed with 4KB pages, and the
+         * offsets below the top keep their intervals. The region base is
+         * aligned only to the largest page size of the initial layout, so
+         * the huge pages of @layout must be aligned in the address space.
+         * Returns 0 on success, -EINVAL if @layout exceeds the region or is
+         * not aligned, or -EBUSY if there is no room for the intervals (in
+         * which case the layout is left unchanged). With @is_dry_run, only
+         * the checks are done.
+         */
+        int Relayout(MemoryIntervalList& layout, bool is_dry_run = false);
+
+        /*
+         * Returns the size of the region that is backed by accessible
+         * (committed) pages, and the size of the pages that are resident.
+         */
+        size_t GetCommittedSize();
+        size_t GetResidentSize();
+
+        /*
+         * Returns the committed size of the pages of @page_size (the offsets
+         * that are outside of the intervals are backed with 4KB pages).
+         */
+        size_t GetCommittedSize(PageSize page_size);
+
+        /*
+         * Starts tracking the 2MB chunks of the region that are touched
+         * (i.e., that have resident pages): the pages are checked by
+         * mincore before they are released by Resize, Discard and Decommit,
+         * and whenever the utilization is measured.
+         * Returns 0 on success, or -1 if the tracking bitmap cannot be
+         * allocated.
+         */
+        int EnableTouchTracking();
+
+        /*
+         * Fills @utilization with the part of the interval at @index that
+         * is mapped (below the top), the pages of the interval that are
+         * resident now, and the pages that were touched since the tracking
+         * started (see EnableTouchTracking). A huge page counts as a whole,
+         * and the 4KB pages are counted in 2MB chunks when they were
+         * released.
+         */
+        void GetIntervalUtilization(int index,
+                                    struct IntervalUtilization *utilization);
+
+        /*
+         * Writes the utilization of each interval as a csv row named
+         * @name (see WriteUtilizationHeader for the columns).
+         */
+        void WriteUtilization(const char *name, FILE *file);
+        static void WriteUtilizationHeader(FILE *file);
+
+        /*
+         * Verifies through @verifier that the committed pages below the top
+         * are backed by the page sizes of their intervals, and adds the
+         * results to @report. The region is walked in 2MB chunks, and a
+         * chunk whose pages were all found present and correctly backed is
+         * skipped by the next calls until its pages are mapped again (by
+         * Resize, Commit, ClearRange, Discard or Migrate), so the calls
+         * only walk the chunks that changed since they were verified.
+         * Returns 0 on success, or -1 if the bitmap of the verified chunks
+         * cannot be allocated.
+         */
+        int VerifyBacking(PageBackingVerifier &verifier,
+                          struct mosalloc_backing_report *report);
+
     private:
         size_t ExtendRegion(size_t new_size);
 
         size_t ShrinkRegion(size_t new_size);
 
-        void *AllocateMemory(void *start_address, size_t len, PageSize page_size);
+        int MapExtension(off_t start_offset, off_t end_offset,
+                         PageSize page_size);
+
+        bool DegradeInterval(off_t start_offset, off_t end_offset,
+                             PageSize page_size);
+
+        void BeginIntervalsChange();
+        void EndIntervalsChange();
+
+        void *AllocateMemory(void *start_address, size_t len, PageSize page_size,
+                             bool is_failure_allowed = false);
+
+        void AllocatePlaceholder(void *start_address, size_t len);
+
+        int MapRange(off_t start_offset, off_t end_offset);
+
+        template <typename Func>
+        void ForEachCommittedRange(off_t start_offset, off_t end_offset,
+                                   Func func);
 
         void DeallocateMemory(void *addr, size_t len);
 
+        void RecordTouchedChunks(off_t start_offset, off_t end_offset);
+        bool IsChunkTouched(size_t chunk) {
+            return (_touched_chunks[chunk / 64] & (1ull << (chunk % 64))) != 0;
+        }
+
+        void InvalidateVerifiedChunks(off_t start_offset, off_t end_offset);
+        bool IsChunkVerified(size_t chunk) {
+            return (_verified_chunks[chunk / 64] & (1ull << (chunk % 64))) != 0;
+        }
+
         void* RegionIntervalListMemAlloc(size_t s);
 
         int RegionIntervalListMemDealloc(void* addr, size_t s);
@@ -43,11 +320,28 @@ class HugePageBackedRegion {
         void *_region_start;
         size_t _region_max_size;
         MemoryIntervalList _region_intervals;
+        IntervalIndex _interval_index;
+        std::atomic<uint32_t> _intervals_generation;
         size_t _region_current_size;
         bool _initialized;
 
         MmapFuncPtr _memory_allocator;
         MunmapFuncPtr _memory_deallocator;
+        MprotectFuncPtr _memory_protector;
+        MadviseFuncPtr _memory_advisor;
+        MremapFuncPtr _memory_remapper;
+        MemoryRangeSet _protected_ranges;
+        MemoryRangeSet _uncommitted_ranges;
+        // a bit per 2MB chunk of the region, which is set once the chunk is
+        // touched (nullptr unless the touches are tracked)
+        uint64_t *_touched_chunks;
+        size_t _touched_chunks_count;
+        // a bit per 2MB chunk of the region, which is set once the backing
+        // of the chunk is verified (nullptr until the first verification)
+        uint64_t *_verified_chunks;
+        size_t _verified_chunks_count;
+        HugePagesFallback _fallback_policy;
+        struct HugePagesFallbackCounters _fallback_counters;
 };
 
 
@@ -0,0 +1,33 @@
+#ifndef _HUGE_PAGES_AVAILABILITY_H_
+#define _HUGE_PAGES_AVAILABILITY_H_
+
+#include <cstddef>
+#include "globals.h"
+
+#define HUGE_PAGES_SYSFS_DIR "/sys/kernel/mm/hugepages"
+#define HUGE_PAGES_CGROUP_DIR "/sys/fs/cgroup"
+
+/*
+ * Tells how many huge pages can still be reserved by the process: the free
+ * pages of the hugetlb pool of each size that are not reserved yet (plus the
+ * surplus pages that the pool may still allocate, see
+ * nr_overcommit_hugepages), capped by the room that is left under the
+ * hugetlb limit of the cgroup of the process (cgroup v1 or v2).
+ * The files are read without allocating memory, so the checks can be made
+ * from the hooked calls. The cgroup of the process is found once.
+ */
+class HugePagesAvailability {
+    public:
+        /*
+         * Returns the size of the huge pages of @page_size that can still be
+         * reserved, or 0 if the kernel does not support them.
+         */
+        static size_t GetAvailableSize(PageSize page_size);
+
+    private:
+        static void FindCgroup();
+        static size_t GetPoolAvailableSize(PageSize page_size);
+        static size_t GetCgroupAvailableSize(PageSize page_size);
+};
+
+#endif //_HUGE_PAGES_AVAILABILITY_H_
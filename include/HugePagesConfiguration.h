@@ -6,6 +6,7 @@
 #include "MemoryIntervalList.h"
 #include "ParseCsv.h"
 #include "MemoryIntervalsValidator.h"
+#include "HugePageBackedRegion.h"
 
 using namespace std;
 
@@ -16,6 +17,7 @@ public:
         MMAP_POOL,
         BRK_POOL,
         FILE_BACKED_POOL,
+        STACK_POOL,
         GENERAL
     };
 
@@ -27,6 +29,19 @@ public:
     struct GeneralParams {
         bool _analyze_hpbrs;
         unsigned long _verbose_level;
+        char* _routing_file;
+        int _call_site_depth;
+        char* _layout_control_file;
+        bool _statistics;
+        char* _sampling_file;
+        unsigned long _sampling_interval_ms;
+        unsigned long _sampling_operations;
+        char* _access_sampling_file;
+        unsigned long _access_sampling_interval_ms;
+        char* _latency_file;
+        char* _trace_file;
+        HugePagesFallback _huge_pages_fallback;
+        bool _learn_stack_lengths;
     };
 
     HugePagesConfiguration();
@@ -43,6 +58,8 @@ private:
 
     void ReadFileBackedPoolEnvParams(HugePagesConfigurationParams &params);
 
+    void ReadStackPoolEnvParams(HugePagesConfigurationParams &params);
+
     void ReadGeneralEnvParams(GeneralParams &params);
 
     char* GetEnvironmentVariable(const char *key) const;
@@ -51,6 +68,7 @@ private:
     HugePagesConfigurationParams _mmap_pool_params;
     HugePagesConfigurationParams _brk_pool_params;
     HugePagesConfigurationParams _file_backed_pool_params;
+    HugePagesConfigurationParams _stack_pool_params;
     GeneralParams _general_params;
 
     const size_t KB = 1024;
@@ -60,10 +78,29 @@ private:
     const char* MMAP_FFA_SIZE_ENV_VAR = "HPC_MMAP_FIRST_FIT_LIST_SIZE";
     const char* FILE_BACKED_FFA_SIZE_ENV_VAR =
           "HPC_FILE_BACKED_FIRST_FIT_LIST_SIZE";
+    const char* STACK_FFA_SIZE_ENV_VAR = "HPC_STACK_FIRST_FIT_LIST_SIZE";
+    const size_t DEFAULT_STACK_FFA_SIZE = 10*KB;
     const char* CONFIGURATION_FILE_ENV_VAR= "HPC_CONFIGURATION_FILE";
     const char* VERBOSE_LEVEL_ENV_VAR = "HPC_VERBOSE_LEVEL";
     const char* DEBUG_BREAK_ENV_VAR = "HPC_DEBUG_BREAK";
     const char* ANALYZE_HPBRS_ENV_VAR = "HPC_ANALYZE_HPBRS";
+    const char* ROUTING_FILE_ENV_VAR = "HPC_ROUTING_FILE";
+    const char* CALL_SITE_DEPTH_ENV_VAR = "HPC_CALL_SITE_DEPTH";
+    const int DEFAULT_CALL_SITE_DEPTH = 4;
+    const char* LAYOUT_CONTROL_FILE_ENV_VAR = "HPC_LAYOUT_CONTROL_FILE";
+    const char* STATISTICS_ENV_VAR = "HPC_STATISTICS";
+    const char* SAMPLING_FILE_ENV_VAR = "HPC_SAMPLING_FILE";
+    const char* SAMPLING_INTERVAL_ENV_VAR = "HPC_SAMPLING_INTERVAL_MS";
+    const char* SAMPLING_OPERATIONS_ENV_VAR = "HPC_SAMPLING_OPERATIONS";
+    const unsigned long DEFAULT_SAMPLING_INTERVAL_MS = 100;
+    const char* ACCESS_SAMPLING_FILE_ENV_VAR = "HPC_ACCESS_SAMPLING_FILE";
+    const char* ACCESS_SAMPLING_INTERVAL_ENV_VAR =
+          "HPC_ACCESS_SAMPLING_INTERVAL_MS";
+    const unsigned long DEFAULT_ACCESS_SAMPLING_INTERVAL_MS = 1000;
+    const char* LATENCY_FILE_ENV_VAR = "HPC_LATENCY_FILE";
+    const char* TRACE_FILE_ENV_VAR = "HPC_TRACE_FILE";
+    const char* HUGE_PAGES_FALLBACK_ENV_VAR = "HPC_HUGE_PAGES_FALLBACK";
+    const char* LEARN_STACK_LENGTHS_ENV_VAR = "HPC_LEARN_STACK_LENGTHS";
 };
 
 #endif //_HUGE_PAGES_CONFIGURATION_H
@@ -0,0 +1,47 @@
+#ifndef _INTERVAL_INDEX_H_
+#define _INTERVAL_INDEX_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "globals.h"
+#include "MemoryIntervalList.h"
+
+#define INTERVAL_INDEX_SLOT_SHIFT (21)
+
+/*
+ * A precomputed table that maps the offsets of a region, at 2MB granularity,
+ * to the (sorted) intervals of the region. Each 2MB slot holds the first
+ * interval that intersects it, so finding the interval of an offset takes a
+ * table lookup and a scan of the few 4KB intervals that may share the slot
+ * (huge intervals are aligned to their page size, so they never share it).
+ * Find does not allocate memory or take locks, so it can be called from
+ * signal handlers. Update must be called whenever the intervals change
+ * (Find may return a stale interval while they are being changed).
+ */
+class IntervalIndex {
+    public:
+        IntervalIndex();
+        ~IntervalIndex();
+
+        void Initialize(MmapFuncPtr allocator,
+                        MunmapFuncPtr deallocator,
+                        MemoryIntervalList &intervals,
+                        size_t region_size);
+        void Update();
+
+        /*
+         * Returns the index of the interval that contains @offset, or -1 if
+         * @offset is outside of the intervals.
+         */
+        int Find(off_t offset) const;
+
+    private:
+        uint32_t* _slots;
+        size_t _slots_count;
+        MemoryIntervalList* _intervals;
+        off_t _end_offset;
+        MmapFuncPtr _mmap;
+        MunmapFuncPtr _munmap;
+};
+
+#endif //_INTERVAL_INDEX_H_
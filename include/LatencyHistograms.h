@@ -0,0 +1,181 @@
+#ifndef _LATENCY_HISTOGRAMS_H_
+#define _LATENCY_HISTOGRAMS_H_
+
+#include <stdint.h>
+
+/*
+ * The operations whose latencies are measured: the hooked calls, and the
+ * resizing of the regions (which is also part of the latencies of the calls
+ * that resize them).
+ */
+enum class LatencyOperation {
+    MMAP = 0,
+    MUNMAP,
+    MREMAP,
+    MPROTECT,
+    MADVISE,
+    BRK,
+    SBRK,
+    RESIZE,
+    COUNT
+};
+
+/*
+ * The breakdown of the latencies: the total latency, and the parts of it that
+ * were spent waiting for locks, searching the first-fit lists and in the
+ * glibc calls (i.e., in the kernel).
+ */
+enum class LatencyComponent {
+    TOTAL = 0,
+    LOCK_WAIT,
+    FFA,
+    SYSCALL,
+    COUNT
+};
+
+#define LATENCY_OPERATIONS ((int)LatencyOperation::COUNT)
+#define LATENCY_COMPONENTS ((int)LatencyComponent::COUNT)
+
+// each power of 2 is split to 2^LATENCY_SUB_BUCKET_BITS buckets (so the
+// values are rounded up by at most 1/16), up to 2^LATENCY_MAX_BITS cycles
+#define LATENCY_SUB_BUCKET_BITS (4)
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_MAX_BITS (40)
+#define LATENCY_BUCKETS \
+    ((LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+/*
+ * A log-linear histogram of latencies in clock cycles. It is written by a
+ * single thread and may be read (merged) by other threads, so its counters
+ * are stored with relaxed atomic operations.
+ */
+class LatencyHistogram {
+    public:
+        LatencyHistogram();
+        ~LatencyHistogram() {}
+
+        void Record(uint64_t cycles);
+        void Merge(const LatencyHistogram &other);
+
+        uint64_t GetCount() const { return _count; }
+        uint64_t GetSum() const { return _sum; }
+        uint64_t GetMax() const { return _max; }
+        /*
+         * Returns the upper bound of the bucket of the value at @fraction
+         * (e.g., 0.99) of the recorded values, or 0 if there are none.
+         */
+        uint64_t GetPercentile(double fraction) const;
+
+        static int GetBucket(uint64_t cycles);
+        static uint64_t GetBucketUpperBound(int bucket);
+
+    private:
+        uint64_t _count;
+        uint64_t _sum;
+        uint64_t _max;
+        uint64_t _buckets[LATENCY_BUCKETS];
+};
+
+struct ThreadLatencies;
+
+/*
+ * Measures the latencies of the operations with the time-stamp counter
+ * (or CLOCK_MONOTONIC on other architectures) into histograms that are kept
+ * per thread, so the measurements take no locks; the histograms of all the
+ * threads (including the threads that exited) are merged when they are
+ * written. A child process starts with a copy of the histograms of its
+ * parent.
+ * Nested operations (e.g., the resizing of a region inside an mmap call) are
+ * measured both on their own and as part of the operations around them, and
+ * so are their components.
+ */
+class LatencyHistograms {
+    public:
+        static void Enable();
+        static bool IsEnabled() { return _is_enabled; }
+
+        static void Begin();
+        static void End(LatencyOperation operation);
+        static void AddComponent(LatencyComponent component, uint64_t cycles);
+        // whether the calling thread is inside a measured operation
+        static bool IsMeasuring();
+
+        static uint64_t ReadClock();
+        static double GetCyclesPerNs();
+
+        /*
+         * Merges the histograms of all the threads into @histograms.
+         */
+        static void Merge(
+            LatencyHistogram histograms[LATENCY_OPERATIONS][LATENCY_COMPONENTS]);
+        /*
+         * Writes the merged histograms to @path as csv, with the percentiles
+         * of each operation and component in nanoseconds.
+         * Returns 0 on success, or -1 and sets errno.
+         */
+        static int Write(const char *path);
+
+    private:
+        static ThreadLatencies *GetThreadLatencies();
+
+        static bool _is_enabled;
+        static uint64_t _start_cycles;
+        static uint64_t _start_ns;
+        static __thread ThreadLatencies *_thread_latencies;
+};
+
+class LatencyScope {
+    public:
+        explicit LatencyScope(LatencyOperation operation) :
+            _operation(operation) {
+            if (LatencyHistograms::IsEnabled()) {
+                LatencyHistograms::Begin();
+            }
+        }
+        ~LatencyScope() {
+            if (LatencyHistograms::IsEnabled()) {
+                LatencyHistograms::End(_operation);
+            }
+        }
+
+        LatencyScope(const LatencyScope&) = delete;
+        LatencyScope& operator=(const LatencyScope&) = delete;
+
+    private:
+        LatencyOperation _operation;
+};
+
+/*
+ * Adds the duration of its scope to @component of the operations that the
+ * thread is inside; the clock is read only inside measured operations.
+ */
+class LatencyComponentScope {
+    public:
+        explicit LatencyComponentScope(LatencyComponent component) :
+            _component(component),
+            _start_cycles(0) {
+            if (LatencyHistograms::IsMeasuring()) {
+                _start_cycles = LatencyHistograms::ReadClock();
+            }
+        }
+        ~LatencyComponentScope() {
+            if (_start_cycles != 0) {
+                LatencyHistograms::AddComponent(
+                    _component, LatencyHistograms::ReadClock() - _start_cycles);
+            }
+        }
+
+        LatencyComponentScope(const LatencyComponentScope&) = delete;
+        LatencyComponentScope& operator=(const LatencyComponentScope&) = delete;
+
+    private:
+        LatencyComponent _component;
+        uint64_t _start_cycles;
+};
+
+#define LATENCY_SCOPE(operation) \
+    LatencyScope latency_scope(LatencyOperation::operation)
+#define LATENCY_COMPONENT_SCOPE(component) \
+    LatencyComponentScope latency_component_scope(LatencyComponent::component)
+
+#endif //_LATENCY_HISTOGRAMS_H_
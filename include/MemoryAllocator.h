@@ -5,10 +5,24 @@
 #include <chrono>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <pthread.h>
+#include <sys/stat.h>
 #include "../include/GlibcAllocationFunctions.h"
 #include "../include/HugePageBackedRegion.h"
 #include "../include/FirstFitAllocator.h"
 #include "../include/HugePagesConfiguration.h"
+#include "../include/MemoryPool.h"
+#include "../include/PoolRoutingRules.h"
+#include "../include/RegionIndex.h"
+#include "../include/CallSite.h"
+#include "../include/StatisticsSegment.h"
+#include "../include/FootprintSampler.h"
+#include "../include/AccessSampler.h"
+#include "../include/PageBackingVerifier.h"
+#include "../include/LatencyHistograms.h"
+#include "../include/RegionProfile.h"
+#include "../include/TraceRecorder.h"
 #include "ParseCsv.h"
 
 #ifdef THREAD_SAFETY
@@ -19,18 +33,53 @@
 
 extern void *_brk_region_base;
 
+#define MAX_ANONYMOUS_MMAP_POOLS (16)
+#define DEFAULT_POOL_TYPE "mmap"
+#define STACK_POOL_TYPE "stack"
+#define MAX_STACK_LENGTHS (8)
+#define LAYOUT_CONTROL_POLL_INTERVAL_NS (1000000000ull)
+
 class MemoryAllocator {
     public:
         MemoryAllocator();
         ~MemoryAllocator();
 
-        void* AllocateFromAnonymousMmapRegion(size_t);
+        void* AllocateFromAnonymousMmapRegion(void *, size_t, int, int,
+                                              void *hook_frame = nullptr);
         void* AllocateFromFileMmapRegion(void *, size_t, int, int, int, off_t);
         int DeallocateFromMmapRegion(void*, size_t);
+        void* RemapMmapRegion(void *old_address, size_t old_size,
+                              size_t new_size, int flags, void *new_address);
+        int ProtectMmapRegion(void *addr, size_t len, int prot);
+        int AdviseMmapRegion(void *addr, size_t length, int advice);
+        int MigrateRange(void *addr, size_t length, PageSize page_size,
+                         size_t *copied_size);
+        int Relayout(const char *config_file);
+        void* AllocatePages(size_t length, PageSize page_size,
+                            bool is_strict);
+        MemoryPool* GetAnonymousMmapPool(int index, const char **name);
+        int GetRegionsCount();
+        HugePageBackedRegion* GetRegion(int index, const char **name);
+        int FindRegion(void *addr);
         int ChangeProgramBreak(void *addr);
         void* GetBrkRegionBase();
         bool IsAddressInHugePageRegions(void *addr);
         void AnalyzeRegions();
+        int SampleAccesses(bool is_forced = false);
+        int WriteUtilization(const char *path);
+        int VerifyBacking(struct mosalloc_backing_report *report);
+
+        /*
+         * The live statistics (see StatisticsSegment), which are published
+         * only when HPC_STATISTICS is set: the hooks count their calls, and
+         * GetHooksLockStatistics returns the counters of the lock of the
+         * hook of @call (or nullptr if the statistics are disabled).
+         */
+        void CountCall(enum mosalloc_stats_call call) {
+            _statistics.CountCall(call);
+        }
+        struct mosalloc_lock_stats* GetHooksLockStatistics(
+                enum mosalloc_stats_call call);
         
         /*
          * IsInitialized is used to detect when the library is already 
@@ -52,32 +101,118 @@ class MemoryAllocator {
 
     private:
         void InitRegions(void *brk_region_base);
-        int DeallocateFromAnonymousMmapRegion(void*, size_t);
+        void AddAnonymousMmapPool(const char *config_file,
+                                  const char *pool_type,
+                                  size_t ffa_list_size, bool is_mandatory);
+        MemoryPool* FindAnonymousMmapPool(void *addr);
+        MemoryPool* RouteAnonymousMmap(size_t length, int flags,
+                                       void *hook_frame,
+                                       PageSize *page_size);
+        bool IsRangeOverlappingPools(void *addr, size_t length);
+        void LearnStackGuard(MemoryPool *pool, void *addr,
+                             size_t guard_length);
+        bool IsStackLength(size_t length);
+        int RelayoutRegion(int index, MemoryIntervalList& layout,
+                           bool is_dry_run);
+#ifdef THREAD_SAFETY
+        std::mutex& GetRegionMutex(int index);
+#endif // THREAD_SAFETY
+        void PollLayoutControlFile();
+        void InitStatistics();
+        void RefreshStatistics();
+        void PublishBrkStatistics(size_t old_size);
+        void PublishFileStatistics();
+        void InitSampling(const char *sampling_file, uint64_t interval_ns,
+                          uint64_t operations);
+        void CountFootprintOperation();
+        void SampleFootprint();
+        void InitTracing(const char *trace_file);
+        void CollectFootprints(struct mosalloc_footprint_pool *footprints);
+        void InitAccessSampling(const char *sampling_file,
+                                uint64_t interval_ns);
+        void StartBackgroundThread();
+        void StopBackgroundThread();
+        static void* RunBackgroundThread(void *arg);
+        void WakeBackgroundThread();
+        void WaitForBackgroundTasks(uint64_t wakeup_ns);
+        static void RestartBackgroundThreadInChild();
+        void InitProfiles();
+        void SampleBrkOccupancy(bool is_forced = false);
+        void WriteProfiles(const std::string& pid_str);
         int DeallocateFromFileMmapRegion(void*, size_t);
+        void* RemapFileMmapRegion(void *old_address, size_t old_size,
+                                  size_t new_size, int flags);
         void SetIntervalConfigList(PoolConfigurationData &configurationData, const char *config_file,
                                    const char *pool_type);
 
 
         bool _isInitialized = false;
-        FirstFitAllocator _mmap_anon_ffa;
+        // the registry of the anonymous mmap pools, where the first one is
+        // the default pool
+        MemoryPool _mmap_pools[MAX_ANONYMOUS_MMAP_POOLS];
+        char _mmap_pool_names[MAX_ANONYMOUS_MMAP_POOLS][MAX_POOL_NAME_LENGTH];
+        int _mmap_pools_count;
+        int _stack_pool_index;
+        // the lengths of the stacks that were recognized by their guards
+        // (see LearnStackGuard), where 0 marks an unused entry
+        std::atomic<size_t> _stack_lengths[MAX_STACK_LENGTHS];
+        PoolRoutingRules _routing_rules;
+        CallSiteCache _call_site_cache;
+        int _call_site_depth;
+        HugePagesFallback _huge_pages_fallback;
+        bool _learn_stack_lengths;
+        char *_layout_control_file;
+        struct timespec _layout_control_mtime;
         FirstFitAllocator _mmap_file_ffa;
-        HugePageBackedRegion _mmap_anon_hpbr;
         HugePageBackedRegion _mmap_file_hpbr;
         HugePageBackedRegion _brk_hpbr;
+        // the regions (see GetRegion) by their addresses, for FindRegion
+        RegionIndex _region_index;
         MemoryIntervalsValidator _intervals_configuration_validator;
+        StatisticsSegment _statistics;
+        struct mosalloc_pool_stats *_brk_stats;
+        struct mosalloc_pool_stats *_file_stats;
+        FootprintSampler _sampler;
+        AccessSampler _access_sampler;
+        PageBackingVerifier _backing_verifier;
+        const char *_latency_file;
+        RegionProfile _brk_profile;
+        RegionProfile _file_profile;
 
         GlibcAllocationFunctions _glibc_funcs;
 
 #ifdef THREAD_SAFETY
-        std::mutex _anon_mmap_mutex;
         std::mutex _file_mmap_mutex;
         std::mutex _brk_mutex;
+        std::mutex _access_sampling_mutex;
+        std::mutex _backing_verification_mutex;
 #endif // THREAD_SAFETY
 
+        /*
+         * The periodic tasks that are run by the background thread, so the
+         * hooks never run them (see RunBackgroundThread), with their periods
+         * (0 disables a task).
+         */
+        enum BackgroundTask {
+            ACCESS_SAMPLING_TASK,
+            FOOTPRINT_SAMPLING_TASK,
+            LAYOUT_POLLING_TASK,
+            BACKGROUND_TASKS_COUNT
+        };
+        uint64_t _background_periods_ns[BACKGROUND_TASKS_COUNT];
+        bool _is_background_thread_running;
+        pthread_t _background_thread;
+        // an eventfd that wakes the background thread up
+        int _background_wakeup_fd;
+        std::atomic<bool> _is_background_thread_stopping;
+        // set by the hooks when a footprint sample is due by their count
+        std::atomic<bool> _is_footprint_sample_due;
+        static MemoryAllocator *_forked_allocator;
+
         bool _analyze_hpbrs;
-        size_t _anon_mmap_max_size;
         size_t _file_mmap_max_size;
         size_t _brk_max_size;
+        size_t _brk_discarded_size;
 
 };
 
@@ -31,6 +31,7 @@ class MemoryIntervalList {
         ~MemoryIntervalList();
 
         size_t GetLength();
+        size_t GetCapacity() { return _list_capcaity; }
         MemoryInterval& At(int i);
 
         void AddInterval(off_t start_offset, off_t end_offset, PageSize page_size);
@@ -40,6 +41,19 @@ class MemoryIntervalList {
         void CopyMemoryIntervalsOf2MBTo(MemoryIntervalList &listToFillWith2MBIntervals);
         off_t FindMaxEndOffset();
 
+        /*
+         * Replaces [start_offset, end_offset) of the (sorted and contiguous)
+         * intervals with an interval of @page_size: the intervals that
+         * contain the range bounds are split, the intervals inside it are
+         * removed, and the new interval is merged with its neighbours of
+         * the same page size. This adds at most two intervals.
+         * Returns 0 on success, or -1 if the range is not covered by the
+         * intervals or if the list is too short (in which case the list is
+         * left unchanged).
+         */
+        int ReplaceRange(off_t start_offset, off_t end_offset,
+                         PageSize page_size);
+
     private:
         void SwapIntetrvals(int i, int j);
         void* AllocateMemory(size_t size);
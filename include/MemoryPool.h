@@ -0,0 +1,141 @@
+#ifndef _MEMORY_POOL_H_
+#define _MEMORY_POOL_H_
+
+#include <cstddef>
+#include <sys/types.h>
+#ifdef THREAD_SAFETY
+#include <mutex>
+#endif //THREAD_SAFETY
+
+#include "FirstFitAllocator.h"
+#include "GlibcAllocationFunctions.h"
+#include "HugePageBackedRegion.h"
+#include "PoolConfigurationData.h"
+#include "StatisticsSegment.h"
+#include "RegionProfile.h"
+#include "mosalloc_footprint.h"
+
+// the mappings that are recognized as stacks by their guards (see
+// MemoryPool::GetGuardedStackLength): at least PTHREAD_STACK_MIN and at most
+// 1GB, with guards of at most 64KB
+#define MIN_STACK_LENGTH (16384ul)
+#define MAX_STACK_LENGTH (1ul << 30)
+#define MAX_STACK_GUARD_LENGTH (65536ul)
+
+/*
+ * A pool of anonymous mappings: a HugePageBackedRegion that backs the pool
+ * with the configured page sizes, and a FirstFitAllocator that places the
+ * mappings inside it. The region follows the top of the allocated mappings,
+ * and the peak sizes of the pool are recorded for the analysis.
+ * The calls below expect page-aligned addresses and lengths that were
+ * validated by the caller, and ranges that are inside the pool.
+ * The pages of the region are mapped through the given backend functions
+ * (the glibc functions by default), so the pool can be simulated; the
+ * first-fit list is always allocated through glibc.
+ */
+class MemoryPool {
+    public:
+        MemoryPool();
+        ~MemoryPool() {}
+
+        void Initialize(PoolConfigurationData &configurationData,
+                        size_t ffa_list_size,
+                        MmapFuncPtr mapper = GlibcMmap,
+                        MunmapFuncPtr unmapper = GlibcMunmap,
+                        MprotectFuncPtr protector = GlibcMprotect,
+                        MadviseFuncPtr advisor = GlibcMadvise,
+                        MremapFuncPtr remapper = GlibcMremap);
+        bool IsInitialized() { return _is_initialized; }
+        void ResetRegion();
+
+        bool Contains(void *addr);
+        bool ContainsRange(void *addr, size_t length);
+        void *GetRegionBase();
+        size_t GetRegionMaxSize();
+
+        void* Allocate(void *addr, size_t length, int prot, int flags,
+                       PageSize page_size = PageSize::UNKNOWN);
+        void* AllocatePages(size_t length, PageSize page_size);
+        int Deallocate(void *addr, size_t length);
+        void* Remap(void *old_address, size_t old_size, size_t new_size,
+                    int flags);
+        int Protect(void *addr, size_t len, int prot);
+        int Advise(void *addr, size_t length, int advice);
+        int Migrate(void *addr, size_t length, PageSize page_size,
+                    size_t *copied_size);
+        int Relayout(MemoryIntervalList& layout, bool is_dry_run = false);
+        size_t GetGuardedStackLength(void *addr, size_t guard_length);
+#ifdef THREAD_SAFETY
+        std::mutex& GetMutex() { return _mutex; }
+#endif // THREAD_SAFETY
+
+        size_t GetMaxSize() { return _max_size; }
+        size_t GetMaxCommittedSize() { return _max_committed_size; }
+        size_t GetDiscardedSize() { return _discarded_size; }
+        size_t GetResidentSize();
+        size_t GetRegionSize();
+        size_t GetCommittedSize();
+        size_t GetBackedSize(PageSize page_size);
+
+        // see HugePagesFallback, before Initialize
+        void SetHugePagesFallback(HugePagesFallback policy) {
+            _hpbr.SetHugePagesFallback(policy);
+        }
+
+        // the region of the pool, for lock-free introspection
+        HugePageBackedRegion& GetRegion() { return _hpbr; }
+
+        /*
+         * Publishes the counters of the pool in @stats (see
+         * StatisticsSegment) from now on. RefreshStatistics updates the
+         * counters that are expensive to collect.
+         */
+        void SetStatistics(struct mosalloc_pool_stats *stats);
+        void RefreshStatistics();
+
+        // the current footprint of the pool, for the footprint samples
+        void GetFootprint(struct mosalloc_footprint_pool *footprint);
+
+        /*
+         * Profiles the sizes, the lifetimes and the offsets of the mappings
+         * of the pool for the analysis (see RegionProfile) from now on.
+         * Returns 0 on success, or -1 and sets errno.
+         */
+        int EnableProfile();
+        void WriteUtilization(const char *name, FILE *file);
+        int VerifyBacking(PageBackingVerifier &verifier,
+                          struct mosalloc_backing_report *report);
+        void WriteProfile(const char *name, FILE *sizes_file,
+                          FILE *lifetimes_file, FILE *heatmap_file);
+
+    private:
+        void ReleaseRange(void *addr, size_t length);
+        void* AllocateInIntervalsOf(size_t length, PageSize page_size);
+        int ExtendRegion(void *ptr, size_t length);
+        int ShrinkRegion();
+        void UpdateCommittedSize();
+        void MovePages(void *from, void *to, size_t length);
+        void CountAllocation(void *addr, size_t length);
+        void CountDeallocation(void *addr, size_t length);
+        void PublishSizes();
+        void SampleOccupancy(bool is_forced = false);
+
+        bool _is_initialized;
+        FirstFitAllocator _ffa;
+        HugePageBackedRegion _hpbr;
+        MmapFuncPtr _mapper;
+        MadviseFuncPtr _advisor;
+        MremapFuncPtr _remapper;
+
+#ifdef THREAD_SAFETY
+        std::mutex _mutex;
+#endif // THREAD_SAFETY
+
+        size_t _max_size;
+        size_t _max_committed_size;
+        size_t _discarded_size;
+        struct mosalloc_pool_stats *_stats;
+        RegionProfile _profile;
+};
+
+#endif //_MEMORY_POOL_H_
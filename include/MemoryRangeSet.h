@@ -0,0 +1,58 @@
+#ifndef _MEMORY_RANGE_SET_H_
+#define _MEMORY_RANGE_SET_H_
+
+#include <sys/types.h>
+#include "globals.h"
+#include "MemoryIntervalList.h"
+
+class OffsetRange {
+    public:
+        off_t _start_offset;
+        off_t _end_offset;
+};
+
+/*
+ * A set of disjoint [start, end) offset ranges that is kept sorted by the
+ * start offsets. Adjacent and overlapping ranges are merged on insertion, and
+ * removing a sub-range splits the ranges that contain it.
+ * Like MemoryIntervalList, the set has a fixed capacity and its storage is
+ * allocated through the given allocator to prevent recursive calls to the
+ * hooked allocation APIs.
+ */
+class MemoryRangeSet {
+    public:
+        MemoryRangeSet();
+        ~MemoryRangeSet();
+
+        void Initialize(MmapFuncPtr allocator,
+                        MunmapFuncPtr deallocator,
+                        size_t capacity);
+
+        /*
+         * Add/Remove return 0 on success, or -1 if the set is full (in which
+         * case the set is left unchanged).
+         */
+        int Add(off_t start_offset, off_t end_offset);
+        int Remove(off_t start_offset, off_t end_offset);
+        void Clear();
+
+        bool Contains(off_t offset);
+        bool Intersects(off_t start_offset, off_t end_offset);
+        size_t GetIntersectionSize(off_t start_offset, off_t end_offset);
+        size_t GetTotalSize();
+
+        size_t GetLength() { return _length; }
+        OffsetRange& At(int i) { return _ranges[i]; }
+
+    private:
+        size_t FindFirstEndingAfter(off_t offset);
+        void MoveRanges(size_t from, size_t to);
+
+        OffsetRange* _ranges;
+        size_t _capacity;
+        size_t _length;
+        MmapFuncPtr _mmap;
+        MunmapFuncPtr _munmap;
+};
+
+#endif //_MEMORY_RANGE_SET_H_
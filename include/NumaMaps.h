@@ -1,6 +1,7 @@
 #ifndef _NUMA_MAPS_H
 #define _NUMA_MAPS_H
 
+#include <limits.h>
 #include <sys/types.h>
 #include <vector>
 #include "../include/globals.h"
@@ -36,12 +37,23 @@ public:
         PageSize _page_size;
         size_t _total_size;
         std::vector<unsigned long> _pages_in_node;
+        // the sizes of the smaps fields (Rss, AnonHugePages and
+        // Private_Hugetlb) in bytes, when smaps is parsed
+        size_t _rss;
+        size_t _anon_huge_pages;
+        size_t _private_hugetlb;
     };
 
     /**********************************************
     * Public methods
     **********************************************/
-    NumaMaps(pid_t pid);
+    NumaMaps(pid_t pid, bool is_smaps_parsed = false);
+
+    /*
+     * Parses the given files instead of the files of a process (e.g., saved
+     * copies of them); @smaps_path may be nullptr.
+     */
+    NumaMaps(const char *numa_maps_path, const char *smaps_path = nullptr);
 
     ~NumaMaps();
 
@@ -53,6 +65,8 @@ public:
 
     const MemoryRange &GetMemoryRange(void *start_address);
 
+    const std::vector<MemoryRange> &GetMemoryRanges() { return _numa_maps; }
+
 private:
 
     /**********************************************
@@ -64,12 +78,17 @@ private:
     **********************************************/
     void ParseNumaMapsFile();
 
+    void ParseNumaMapsLine(const char *line, const char *end);
+
+    void ParseSmapsFile();
+
     unsigned long GetNumaNodesCount();
 
     /**********************************************
     * Data members
     **********************************************/
-    pid_t _pid;
+    char _numa_maps_path[PATH_MAX];
+    char _smaps_path[PATH_MAX];
     unsigned long _numa_nodes;
     std::vector<MemoryRange> _numa_maps;
 };
@@ -0,0 +1,73 @@
+#ifndef _PAGE_BACKING_VERIFIER_H_
+#define _PAGE_BACKING_VERIFIER_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "globals.h"
+#include "mosalloc.h"
+
+#define PAGE_BACKING_PAGEMAP_PATH "/proc/self/pagemap"
+#define PAGE_BACKING_KPAGEFLAGS_PATH "/proc/kpageflags"
+// the pages that are walked by each read of the pagemap (a 2MB chunk)
+#define PAGE_BACKING_BATCH_PAGES (512)
+// the frame flags that are read together from kpageflags
+#define PAGE_BACKING_FLAGS_BATCH (64)
+
+/*
+ * Verifies the backing of ranges page by page through the pagemap: a page
+ * is present if its entry says so, and its backing size is confirmed by its
+ * frame. The frames of a huge page are contiguous and aligned to its size,
+ * so a present page of a huge-page range must have a frame whose offset in
+ * the huge page matches the offset of the page; and when kpageflags can be
+ * read (it requires CAP_SYS_ADMIN), the frames of huge-page ranges must be
+ * hugetlb frames and the frames of 4KB ranges must be neither hugetlb nor
+ * THP frames. The frame numbers are hidden from unprivileged processes, so
+ * their pages can only be verified to be present.
+ * The ranges are checked by mincore first, so the pagemap is read only for
+ * the batches that have resident pages.
+ * The calls must be serialized by the caller; a child process reopens the
+ * pagemap (which was opened for the address space of its parent).
+ */
+class PageBackingVerifier {
+    public:
+        PageBackingVerifier();
+        ~PageBackingVerifier() { Close(); }
+
+        /*
+         * Opens the pagemap, and kpageflags if it can be read.
+         * Returns 0 on success, or -1 and sets errno if the pagemap cannot
+         * be opened.
+         */
+        int Open(const char *pagemap_path = PAGE_BACKING_PAGEMAP_PATH,
+                 const char *kpageflags_path = PAGE_BACKING_KPAGEFLAGS_PATH);
+        bool IsOpen() { return _pagemap_fd >= 0; }
+        bool HasPageFlags() { return _kpageflags_fd >= 0; }
+        void Close();
+
+        /*
+         * Verifies that the pages of [addr, addr + len) are present and
+         * backed by pages of @page_size, and adds the results to @report.
+         * Returns true if all of the pages are present and none of them is
+         * mismatched.
+         */
+        bool VerifyRange(void *addr, size_t len, PageSize page_size,
+                         struct mosalloc_backing_report *report);
+
+    private:
+        void FollowFork();
+        uint64_t GetPageFlags(uint64_t pfn);
+        bool IsFrameMismatched(uint64_t pfn, PageSize page_size);
+
+        pid_t _pid;
+        const char *_pagemap_path;
+        int _pagemap_fd;
+        int _kpageflags_fd;
+        uint64_t _entries[PAGE_BACKING_BATCH_PAGES];
+        unsigned char _residency[PAGE_BACKING_BATCH_PAGES];
+        // the flags of the frames from _flags_first_pfn
+        uint64_t _flags[PAGE_BACKING_FLAGS_BATCH];
+        uint64_t _flags_first_pfn;
+};
+
+#endif //_PAGE_BACKING_VERIFIER_H_
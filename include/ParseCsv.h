@@ -5,9 +5,31 @@
 #ifndef MOSALLOC_PARSECSV_H
 #define MOSALLOC_PARSECSV_H
 #include "PoolConfigurationData.h"
+#include "PoolRoutingRules.h"
 
 #include "globals.h"
 
+/*
+ * The errors of the configuration files. The Try* variants of the parsing
+ * functions return them (and set errno) instead of exiting, so a file that
+ * is read at runtime (see mosalloc_relayout) may be invalid.
+ */
+enum class ParseCsvError {
+    SUCCESS,
+    OPEN_FAILED,
+    STAT_FAILED,
+    EMPTY_FILE,
+    MMAP_FAILED,
+    UNKNOWN_PAGE_SIZE,
+    POOL_SIZE_EXISTS,
+    NEGATIVE_START_OFFSET,
+    NEGATIVE_END_OFFSET,
+    CORRUPTED_FILE,
+    TOO_MANY_INTERVALS,
+    TOO_MANY_POOL_TYPES,
+    POOL_TYPE_TOO_LONG
+};
+
 class parseCsv {
 public:
     parseCsv() {}
@@ -23,13 +45,46 @@ public:
         |"brk", 2097152, ?, ?                           |
         |"brk", 2097152, ?, ?                           |
         |"file", -1 , 0 , ?                             |
+        |"stack", -1 , 0 , ?                            |
 
      * @param configurationData -- allocated object to put result inside.
      * @param path -- path to configuration file (csv)
-     * @param poolType -- the pool type, support {"mmap", "brk", file")
+     * @param poolType -- the pool type, support {"mmap", "brk", "file", "stack"}
      */
     static void ParseCsv(PoolConfigurationData& configurationData, const char* path, const char* poolType);
+    static ParseCsvError TryParseCsv(PoolConfigurationData& configurationData, const char* path, const char* poolType);
     static int GetConfigFileMaxWindows(const char* path);
+    static ParseCsvError TryGetConfigFileMaxWindows(const char* path, int* count);
+    /***
+     Collects the distinct pool types of the configuration file (see
+     ParseCsv) in their order of appearance.
+     * @param types -- array to put the types inside.
+     * @return the number of types.
+     */
+    static int GetPoolTypes(const char* path, char (*types)[MAX_POOL_NAME_LENGTH], int max_types);
+    static ParseCsvError TryGetPoolTypes(const char* path, char (*types)[MAX_POOL_NAME_LENGTH], int max_types, int* count);
+    /***
+     This function parse csv file of routing rules in the following format:
+         ____________________________________________________________
+        |"pool", "minSize", "maxSize", "flags", "origin", "pageSize" |
+        |"small", 0, 65536, *, *                                     |
+        |"large", 1073741824, -1, *, *                               |
+        |"stack", 0, -1, MAP_STACK, *                                |
+        |"graph", 0, -1, *, libgraph.so                              |
+        |"mmap", 0, -1, *, app+0x1234, 1073741824                    |
+        |"mmap", 0, -1, *, @build_hash_table, 2097152                |
+     maxSize -1 stands for unlimited size, flags are '|'-separated mmap flag
+     names (or a number) that must all be set, origin is one of the forms of
+     PoolRoutingRule, the optional pageSize selects the intervals of that
+     page size in the pool, and '*' matches everything.
+
+     * @param rules -- object to add the rules to (in the file order).
+     * @param path -- path to routing rules file (csv)
+     */
+    static void ParseRoutingRules(PoolRoutingRules& rules, const char* path);
+
+private:
+    static void ThrowError(ParseCsvError error);
 };
 
 #endif //MOSALLOC_PARSECSV_H
@@ -0,0 +1,77 @@
+#ifndef _POOL_ROUTING_RULES_H_
+#define _POOL_ROUTING_RULES_H_
+
+#include <cstddef>
+#include <stdint.h>
+
+#include "globals.h"
+
+#define MAX_POOL_NAME_LENGTH (32)
+#define MAX_ORIGIN_LENGTH (256)
+#define MAX_ROUTING_RULES (64)
+
+/*
+ * A rule that routes the anonymous mmap requests of sizes in
+ * [_min_size, _max_size], which have all of _flags set and which come from
+ * _origin, to the pool named _pool_name (and, if _page_size is known, to the
+ * intervals of that page size in the pool).
+ * The origin is matched against the return addresses of the call site:
+ *   "<module>"          any return address in a module whose path contains
+ *                       <module>
+ *   "<module>+0x<hex>"  the return address at offset 0x<hex> from the load
+ *                       address of such a module (other '+' are part of
+ *                       the module, e.g., "libstdc++.so.6")
+ *   "@<symbol>"         any return address in the function <symbol> (which
+ *                       must be in the dynamic symbol table)
+ *   ""                  anywhere
+ */
+class PoolRoutingRule {
+    public:
+        enum class OriginKind {
+            ANY,
+            MODULE,
+            MODULE_OFFSET,
+            SYMBOL
+        };
+
+        char _pool_name[MAX_POOL_NAME_LENGTH];
+        int _pool_index;
+        PageSize _page_size;
+        size_t _min_size;
+        size_t _max_size;
+        int _flags;
+        OriginKind _origin_kind;
+        char _origin[MAX_ORIGIN_LENGTH];
+        size_t _origin_offset;
+};
+
+/*
+ * An ordered list of routing rules, where the first matching rule wins.
+ * The rules are kept in a fixed-size array, so they can be loaded and
+ * matched without allocating memory. Rule i is represented by bit i in the
+ * masks of the rules that match a call site.
+ */
+class PoolRoutingRules {
+    public:
+        PoolRoutingRules();
+        ~PoolRoutingRules() {}
+
+        int AddRule(const char *pool_name, size_t min_size, size_t max_size,
+                    int flags, const char *origin,
+                    PageSize page_size = PageSize::UNKNOWN);
+        void BindPools(const char (*pool_names)[MAX_POOL_NAME_LENGTH],
+                       int pools_count);
+        uint64_t MatchOrigins(void *const *frames, int depth) const;
+        const PoolRoutingRule* Match(size_t length, int flags,
+                                     uint64_t origins_mask) const;
+        bool HasOriginRules() const { return _has_origin_rules; }
+        int GetLength() const { return _length; }
+        const PoolRoutingRule& At(int i) const { return _rules[i]; }
+
+    private:
+        PoolRoutingRule _rules[MAX_ROUTING_RULES];
+        int _length;
+        bool _has_origin_rules;
+};
+
+#endif //_POOL_ROUTING_RULES_H_
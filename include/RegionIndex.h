@@ -0,0 +1,58 @@
+#ifndef _REGION_INDEX_H_
+#define _REGION_INDEX_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "globals.h"
+#include "MemoryIntervalList.h"
+
+#define REGION_INDEX_SLOT_SHIFT (21)
+#define MAX_INDEXED_REGIONS (32)
+
+/*
+ * A precomputed table that maps the addresses of a set of disjoint regions,
+ * at 2MB granularity, to the regions that contain them. The table spans the
+ * addresses from the lowest region to the highest one, and only its slots
+ * that intersect the regions are written (the rest of it is never backed with
+ * memory). Each 2MB slot holds the first region that intersects it, so
+ * finding the region of an address takes a table lookup and a scan of the
+ * few unaligned regions that may share the slot.
+ * The regions must not move once the index is initialized. Find does not
+ * allocate memory or take locks, so it can be called from signal handlers.
+ */
+class RegionIndex {
+    public:
+        RegionIndex();
+        ~RegionIndex();
+
+        /*
+         * Indexes the @count regions [bases[i], bases[i] + sizes[i]), where
+         * the empty regions are skipped.
+         */
+        void Initialize(MmapFuncPtr allocator,
+                        MunmapFuncPtr deallocator,
+                        void **bases,
+                        size_t *sizes,
+                        int count);
+
+        /*
+         * Returns the index of the region that contains @addr, or -1 if
+         * @addr is outside of the regions.
+         */
+        int Find(const void *addr) const;
+
+    private:
+        uint8_t* _slots;
+        size_t _slots_count;
+        size_t _start;
+        size_t _end;
+        // the non-empty regions sorted by their addresses
+        int _count;
+        int _regions[MAX_INDEXED_REGIONS];
+        size_t _starts[MAX_INDEXED_REGIONS];
+        size_t _ends[MAX_INDEXED_REGIONS];
+        MmapFuncPtr _mmap;
+        MunmapFuncPtr _munmap;
+};
+
+#endif //_REGION_INDEX_H_
@@ -0,0 +1,106 @@
+#ifndef _REGION_PROFILE_H_
+#define _REGION_PROFILE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+// the histograms have a bucket per power of 2 (of bytes or of nanoseconds)
+#define REGION_PROFILE_BUCKETS (64)
+// the live mappings whose lifetimes are tracked
+#define REGION_PROFILE_LIVE_CAPACITY (65536)
+// the resolution of the occupancy heatmap
+#define REGION_PROFILE_CHUNK_SIZE (2097152ul)
+// the heatmap keeps up to this many time windows; when they are used up,
+// every two adjacent windows are merged and the windows are doubled
+#define REGION_PROFILE_WINDOWS (64)
+#define REGION_PROFILE_FIRST_WINDOW_NS (100000000ull)
+
+/*
+ * The profile of the mappings of a region for the analysis (see
+ * HPC_ANALYZE_HPBRS): histograms of the sizes and the lifetimes of the
+ * mappings, and a heatmap of the occupied bytes of each 2MB chunk of the
+ * region over time.
+ * All the buffers are allocated (through glibc) by Initialize, so counting
+ * allocates no memory; a mapping that does not fit in the table of the live
+ * mappings is counted in the sizes but not in the lifetimes.
+ * The occupancy is sampled from the occupied ranges of the region (e.g., of
+ * its first-fit list) at most once per window, so it costs nothing per
+ * mapping: the caller asks BeginOccupancySample whether a sample is due and
+ * then adds the occupied ranges.
+ * The calls must be serialized by the caller (e.g., under the pool lock).
+ */
+class RegionProfile {
+    public:
+        RegionProfile();
+        ~RegionProfile() {}
+
+        /*
+         * Starts profiling the region [base, base + capacity).
+         * Returns 0 on success, or -1 and sets errno.
+         */
+        int Initialize(void *base, size_t capacity);
+        bool IsInitialized() { return _live != nullptr; }
+
+        void CountAllocation(void *addr, size_t length);
+        /*
+         * Ends the lifetimes of the live mappings that start at @addr and
+         * follow each other up to @addr + @length; a mapping that is freed
+         * only in part lives on in its remaining part.
+         */
+        void CountDeallocation(void *addr, size_t length);
+        // a mapping that was resized or moved keeps its lifetime
+        void CountRemap(void *old_addr, void *new_addr, size_t new_length);
+
+        /*
+         * Returns true if the occupancy of the current window was not
+         * sampled yet (or if @is_forced), in which case the caller should
+         * add all the occupied ranges of the region with AddOccupiedRange.
+         */
+        bool BeginOccupancySample(bool is_forced = false);
+        static void AddOccupiedRange(void *start, void *end, void *profile);
+
+        /*
+         * Appends the rows of the region @name to the csv files of the
+         * analysis (see WriteHeaders).
+         */
+        void Write(const char *name, FILE *sizes_file, FILE *lifetimes_file,
+                   FILE *heatmap_file);
+        static void WriteHeaders(FILE *sizes_file, FILE *lifetimes_file,
+                                 FILE *heatmap_file);
+
+    private:
+        struct LiveMapping {
+            void *addr;
+            size_t length;
+            uint64_t start_ns;
+        };
+
+        static int GetBucket(uint64_t value);
+        static uint64_t GetTimeNs();
+        static size_t Hash(void *addr);
+        LiveMapping *FindLive(void *addr);
+        void InsertLive(void *addr, size_t length, uint64_t start_ns);
+        void RemoveLive(LiveMapping *mapping);
+        uint32_t *GetWindow(int window) {
+            return &_heatmap[(size_t)window * _chunks_count];
+        }
+        void MergeWindows();
+
+        void *_base;
+        uint64_t _start_ns;
+        uint64_t _sizes[REGION_PROFILE_BUCKETS];
+        uint64_t _lifetimes[REGION_PROFILE_BUCKETS];
+
+        LiveMapping *_live;
+        size_t _live_count;
+
+        uint32_t *_heatmap;
+        size_t _chunks_count;
+        // the chunks below the highest occupied chunk so far
+        size_t _used_chunks_count;
+        uint64_t _window_ns;
+        int _sampled_window;
+};
+
+#endif //_REGION_PROFILE_H_
@@ -0,0 +1,138 @@
+#ifndef _STATISTICS_SEGMENT_H_
+#define _STATISTICS_SEGMENT_H_
+
+#include <stdint.h>
+#include <time.h>
+#ifdef THREAD_SAFETY
+#include <mutex>
+#endif //THREAD_SAFETY
+
+#include "mosalloc_stats.h"
+#include "HugePageBackedRegion.h"
+#include "LatencyHistograms.h"
+
+/*
+ * The live statistics of the process (see mosalloc_stats.h), which are
+ * published in a shared-memory segment so they can be watched from other
+ * processes (e.g., by mosalloc-top).
+ * The counters are updated with relaxed atomic operations and without locks,
+ * so the calls below can be made from any thread.
+ * A child process gets its own segment on fork, with a copy of the counters
+ * of its parent (like its copy of the pools).
+ */
+class StatisticsSegment {
+    public:
+        StatisticsSegment();
+        ~StatisticsSegment() {}
+
+        /*
+         * Creates (or replaces) the segment of the process.
+         * Returns 0 on success, or -1 and sets errno.
+         */
+        int Create();
+        /*
+         * Removes the name of the segment, so it is no longer listed. The
+         * counters stay mapped until the process exits, since other threads
+         * may still update them.
+         */
+        void Unlink();
+
+        struct mosalloc_stats *Get() { return _stats; }
+        /*
+         * Returns the counters of a new pool, or nullptr if the segment is
+         * not created or has no room for more pools.
+         */
+        struct mosalloc_pool_stats *AddPool(const char *name,
+                                            size_t capacity);
+
+        void CountCall(enum mosalloc_stats_call call) {
+            if (_stats != nullptr) {
+                Add(&_stats->calls[call], 1);
+            }
+        }
+
+        /*
+         * Returns true if a reader requested a refresh of the counters that
+         * are expensive to collect (and the number of the request in
+         * @request); the caller should then update them and call
+         * EndRefresh(@request).
+         */
+        bool IsRefreshRequested(uint32_t *request);
+        void EndRefresh(uint32_t request);
+
+        static void Add(uint64_t *counter, uint64_t value) {
+            __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+        }
+        static void Set(uint64_t *counter, uint64_t value) {
+            __atomic_store_n(counter, value, __ATOMIC_RELAXED);
+        }
+        static void Max(uint64_t *counter, uint64_t value);
+        static uint64_t GetTimeNs();
+
+        /*
+         * Adds the sizes of the parts of [addr, addr + len) that are backed
+         * with each page size (by the intervals of @region) to @counters,
+         * which are indexed by mosalloc_stats_page_size.
+         */
+        static void AddBackedSizes(uint64_t *counters,
+                                   HugePageBackedRegion &region,
+                                   void *addr, size_t len);
+
+        // publishes the fallbacks of the huge pages of @region in @stats
+        static void SetFallbackCounters(struct mosalloc_pool_stats *stats,
+                                        HugePageBackedRegion &region);
+
+    private:
+        static void ReopenInChild();
+        void Reopen();
+        void SetName(pid_t pid);
+
+        static StatisticsSegment *_forked_segment;
+        struct mosalloc_stats *_stats;
+        size_t _length;
+        char _name[64];
+};
+
+#ifdef THREAD_SAFETY
+/*
+ * A lock guard that records the acquisitions of @lock in @stats (when it is
+ * not null) and the waiting for it in the latency histograms (when they are
+ * enabled). The clock is read only when the lock is contended, so the
+ * uncontended acquisitions cost a single try_lock.
+ */
+class TimedLockGuard {
+    public:
+        TimedLockGuard(std::mutex &lock, struct mosalloc_lock_stats *stats) :
+            _lock(lock) {
+            if (stats != nullptr) {
+                StatisticsSegment::Add(&stats->acquisitions, 1);
+            }
+            if (_lock.try_lock()) {
+                return;
+            }
+            LATENCY_COMPONENT_SCOPE(LOCK_WAIT);
+            if (stats == nullptr) {
+                _lock.lock();
+                return;
+            }
+            uint64_t start_ns = StatisticsSegment::GetTimeNs();
+            _lock.lock();
+            StatisticsSegment::Add(&stats->contentions, 1);
+            StatisticsSegment::Add(&stats->wait_ns,
+                                   StatisticsSegment::GetTimeNs() - start_ns);
+        }
+        ~TimedLockGuard() { _lock.unlock(); }
+
+        TimedLockGuard(const TimedLockGuard&) = delete;
+        TimedLockGuard& operator=(const TimedLockGuard&) = delete;
+
+    private:
+        std::mutex &_lock;
+};
+
+#define TIMED_MUTEX_GUARD(lock, stats) TimedLockGuard guard(lock, stats)
+#else //THREAD_SAFETY
+#define TIMED_MUTEX_GUARD(lock, stats)
+#endif //THREAD_SAFETY
+
+#endif //_STATISTICS_SEGMENT_H_
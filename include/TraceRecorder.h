@@ -0,0 +1,135 @@
+#ifndef _TRACE_RECORDER_H_
+#define _TRACE_RECORDER_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <atomic>
+
+#include "mosalloc_trace.h"
+
+// the records that each thread buffers before it writes them
+#define TRACE_BUFFER_RECORDS (1024)
+
+struct ThreadTrace;
+
+/*
+ * Records the hooked calls to a binary trace file (see mosalloc_trace.h).
+ * Each thread buffers its records in memory of its own, which is allocated
+ * through the glibc functions, and writes them (with a single write to the
+ * file, which is opened with O_APPEND) when the buffer is full; the calls
+ * are ordered by a sequence number that is taken with an atomic increment.
+ * So recording takes no locks, allocates no memory from the pools and uses
+ * only async-signal-safe functions. A call that interrupts the recording of
+ * another call on the same thread (i.e., in a signal handler) is dropped
+ * and counted in the end record.
+ * The buffers are never freed, so the records of the threads that exited
+ * are written on Close. A child process drops the records of its parent and
+ * starts a file of its own.
+ */
+class TraceRecorder {
+    public:
+        /*
+         * Starts recording to @path_prefix.<pid>.
+         * Returns 0 on success, or -1 and sets errno.
+         */
+        static int Open(const char *path_prefix);
+        static bool IsEnabled() { return _is_enabled; }
+        /*
+         * Adds a pool to the header; pools must be added before Open.
+         */
+        static void AddPool(const char *name, void *base, size_t capacity);
+        /*
+         * Writes the records of all the threads and the end record, and
+         * stops recording.
+         */
+        static void Close();
+
+        static ThreadTrace *Begin();
+        static void End(ThreadTrace *trace);
+        static void Append(ThreadTrace *trace,
+                           struct mosalloc_trace_record *record);
+        // the time since the trace file was opened
+        static uint64_t GetElapsedNs();
+
+    private:
+        static int OpenFile();
+        static void FollowFork();
+        static ThreadTrace *GetThreadTrace();
+        static void Flush(ThreadTrace *trace);
+        static void Write(const void *data, size_t length);
+
+        static bool _is_enabled;
+        static int _fd;
+        static const char *_path_prefix;
+        static uint64_t _start_ns;
+        static struct mosalloc_trace_header _header;
+        static std::atomic<uint64_t> _sequence;
+        static std::atomic<uint64_t> _dropped;
+        static __thread ThreadTrace *_thread_trace;
+};
+
+/*
+ * Records a hooked call: it is created once the call holds the lock of its
+ * hook, and its Return records the result before the lock is released, so
+ * the sequence numbers follow the order in which the pools served the calls.
+ */
+class TraceCall {
+    public:
+        explicit TraceCall(enum mosalloc_trace_call call) :
+            _trace(nullptr) {
+            if (TraceRecorder::IsEnabled()) {
+                Begin(call);
+            }
+        }
+        ~TraceCall() {
+            if (_trace != nullptr) {
+                TraceRecorder::End(_trace);
+            }
+        }
+
+        void SetArguments(void *addr, uint64_t length, int prot = 0,
+                          int flags = 0, int fd = -1, off_t offset = 0,
+                          uint64_t new_length = 0,
+                          void *new_address = nullptr) {
+            if (_trace == nullptr) {
+                return;
+            }
+            _record.addr = (uint64_t)addr;
+            _record.length = length;
+            _record.prot = prot;
+            _record.flags = flags;
+            _record.fd = fd;
+            _record.offset = offset;
+            _record.new_length = new_length;
+            _record.new_address = (uint64_t)new_address;
+        }
+
+        void *Return(void *result) {
+            if (_trace != nullptr) {
+                // mmap and mremap return MAP_FAILED and sbrk returns
+                // (void*)-1
+                Finish((uint64_t)result, result == (void*)-1);
+            }
+            return result;
+        }
+        int Return(int result) {
+            if (_trace != nullptr) {
+                Finish((uint64_t)(int64_t)result, result == -1);
+            }
+            return result;
+        }
+
+        TraceCall(const TraceCall&) = delete;
+        TraceCall& operator=(const TraceCall&) = delete;
+
+    private:
+        void Begin(enum mosalloc_trace_call call);
+        void Finish(uint64_t result, bool is_failed);
+
+        ThreadTrace *_trace;
+        struct mosalloc_trace_record _record;
+};
+
+#define TRACE_CALL(call) TraceCall trace_call(MOSALLOC_TRACE_##call)
+
+#endif //_TRACE_RECORDER_H_
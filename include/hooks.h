@@ -17,9 +17,12 @@
 #endif /* __cplusplus */
 
 int mprotect(void *addr, size_t len, int prot) __THROW_EXCEPTION;
+int madvise(void *addr, size_t length, int advice) __THROW_EXCEPTION;
 void *mmap(void *addr, size_t length, int prot, int flags, int fd, 
            off_t offset) __THROW_EXCEPTION;
 int munmap(void *addr, size_t length) __THROW_EXCEPTION;
+void *mremap(void *old_address, size_t old_size, size_t new_size,
+             int flags, ...) __THROW_EXCEPTION;
 
 int brk(void *addr) __THROW_EXCEPTION;
 void *sbrk(ptrdiff_t increment) __THROW_EXCEPTION;
@@ -0,0 +1,219 @@
+#ifndef _MOSALLOC_H_
+#define _MOSALLOC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Explicit page-size allocation API of Mosalloc.
+ * The memory is allocated from the anonymous mmap pools of the
+ * configuration file (see HPC_CONFIGURATION_FILE), either through the
+ * pools of the preloaded library or, when the library is linked without
+ * the hooks (e.g., the mosalloc-api target), through pools that are
+ * initialized by the first call.
+ */
+
+/* fail instead of falling back to other page sizes */
+#define MOSALLOC_STRICT (0x1)
+
+#define MOSALLOC_MAX_POOL_NAME_LENGTH (32)
+
+struct mosalloc_pool_info {
+    char name[MOSALLOC_MAX_POOL_NAME_LENGTH];
+    void *base;
+    size_t capacity;        /* the size of the address range of the pool */
+    size_t size;            /* the mapped size, up to the top allocation */
+    size_t committed_size;  /* the mapped size without the reservations */
+    size_t size_4kb;        /* the sizes of the intervals of each page size */
+    size_t size_2mb;
+    size_t size_1gb;
+};
+
+/*
+ * Allocates @size bytes (rounded up to 4KB), readable and writable, from the
+ * intervals of @page_size (4KB, 2MB or 1GB) of the first pool that has room
+ * in them; @page_size 0 stands for any page size (the first fit of the
+ * first pool that has room).
+ * If no interval of @page_size has room, the first fit of the default pool
+ * is returned, unless @flags has MOSALLOC_STRICT.
+ * Returns NULL (and sets errno) on failure, e.g., ENOMEM when the pools are
+ * full (where mmap would exit).
+ */
+void *mosalloc_alloc(size_t size, size_t page_size, int flags);
+
+/*
+ * Frees [ptr, ptr + size), like munmap does.
+ * Returns 0 on success, or -1 (and sets errno) on failure.
+ */
+int mosalloc_free(void *ptr, size_t size);
+
+/*
+ * Fills @info with the state of the anonymous mmap pool at @pool_index,
+ * where pool 0 is the default ("mmap") pool.
+ * Returns 0 on success, or -1 (and sets errno to ENOENT) if there is no
+ * such pool.
+ */
+int mosalloc_pool_info(int pool_index, struct mosalloc_pool_info *info);
+
+struct mosalloc_migration_stats {
+    size_t copied_size;     /* the mapped part of the range, which is copied */
+    uint64_t elapsed_ns;    /* the duration of the migration */
+    double bandwidth;       /* the copied bytes per second */
+};
+
+/*
+ * Moves [addr, addr + size) of an anonymous mmap pool or of the brk pool to
+ * pages of @page_size (4KB, 2MB or 1GB) while keeping its contents, e.g., to
+ * promote a hot range to huge pages or to demote a cold one. The range must
+ * be aligned to @page_size and must not split the pages at its bounds; it
+ * must not be protected (or reserved with PROT_NONE), and it must not be
+ * accessed by other threads until the call returns. Unmapped parts of the
+ * range (above the top of the pool) are mapped with @page_size when the pool
+ * grows.
+ * Fills @stats (if not NULL) with the copied size and the bandwidth of the
+ * migration.
+ * Returns 0 on success, or -1 and sets errno: EINVAL for an invalid range,
+ * EBUSY for a protected or reserved range, or ENOMEM if there are no free
+ * pages of @page_size (in which case the range keeps its pages).
+ */
+int mosalloc_migrate(void *addr, size_t size, size_t page_size,
+                     struct mosalloc_migration_stats *stats);
+
+/*
+ * Changes the page-size layouts of the pools above their tops (i.e., the
+ * parts of the pools that were not used yet) to the layouts of
+ * @config_file, which has the format of HPC_CONFIGURATION_FILE. This allows
+ * running each phase of a program with a different layout. Pools that do
+ * not appear in the file keep their layouts, the pool sizes of the file are
+ * ignored, and the parts of the layouts below the tops are ignored too.
+ * The layouts are validated like the initial ones; since the pools are
+ * aligned to the largest page size of their initial layouts, their huge
+ * pages must be aligned in the address space as well.
+ * Returns 0 on success, or -1 and sets errno (EINVAL for an invalid layout,
+ * in which case no pool is changed).
+ */
+int mosalloc_relayout(const char *config_file);
+
+/*
+ * The pool indices of the introspection calls below are the indices of
+ * mosalloc_pool_info, followed by the brk pool and the file-backed pool.
+ */
+struct mosalloc_address_info {
+    int pool_index;
+    const char *pool_name;
+    int interval_index;     /* the index of the interval in its pool */
+    void *interval_start;
+    size_t interval_size;
+    size_t page_size;       /* the page size of the interval */
+    size_t offset;          /* the offset of the address in its pool */
+    int is_mapped;          /* whether the address is below the pool top */
+};
+
+/*
+ * Fills @info with the pool and the interval that back @addr.
+ * The lookup takes constant time (through a table of the pools at 2MB
+ * granularity, and a table of the intervals of each pool), allocates no
+ * memory, takes no locks and does not set errno, so it can be called from
+ * signal handlers (e.g., of sampling profilers). The intervals that change
+ * meanwhile (by mosalloc_migrate, mosalloc_relayout or a huge-page fallback)
+ * are read again, a bounded number of times.
+ * Returns 0 on success, or -1 if @addr is outside of the pools or its
+ * interval kept changing (e.g., when the call interrupted a change).
+ */
+int mosalloc_query(const void *addr, struct mosalloc_address_info *info);
+
+struct mosalloc_interval {
+    int pool_index;
+    const char *pool_name;
+    int interval_index;
+    void *start;
+    size_t size;
+    size_t page_size;
+    size_t mapped_size;     /* the size of the interval below the pool top */
+};
+
+/* the position of an iteration over the intervals of all the pools */
+struct mosalloc_interval_iterator {
+    int pool_index;
+    int interval_index;
+};
+
+#define MOSALLOC_INTERVAL_ITERATOR_INIT {0, 0}
+
+/*
+ * Fills @interval with the interval at @iterator and advances @iterator to
+ * the next interval (of the same pool, or of the next pool). The intervals
+ * that change meanwhile are read again (see mosalloc_query).
+ * Returns 1 on success, or 0 when there are no more intervals (or when they
+ * kept changing).
+ */
+int mosalloc_next_interval(struct mosalloc_interval_iterator *iterator,
+                           struct mosalloc_interval *interval);
+
+/*
+ * Writes the latency histograms of the hooked calls (merged over all the
+ * threads) to @path as csv, like the file that is written on exit when
+ * HPC_LATENCY_FILE is set. Each call has a row of percentiles for its total
+ * latency and for its parts that were spent waiting for locks, in the
+ * first-fit lists and in the kernel.
+ * Returns 0 on success, or -1 and sets errno (ENODATA if HPC_LATENCY_FILE
+ * is not set, so the latencies are not measured).
+ */
+int mosalloc_write_latencies(const char *path);
+
+/*
+ * Takes a sample of the accesses to the pools now, like the samples that
+ * are taken by the hooked calls every HPC_ACCESS_SAMPLING_INTERVAL_MS when
+ * HPC_ACCESS_SAMPLING_FILE is set; programs that stop calling mmap() after
+ * their initialization can call it periodically (e.g., once per iteration).
+ * Returns 0 on success, or -1 and sets errno (ENODATA if
+ * HPC_ACCESS_SAMPLING_FILE is not set, so the accesses are not sampled).
+ */
+int mosalloc_sample_accesses(void);
+
+/*
+ * Writes the utilization of the page-size intervals of the pools to @path as
+ * csv, like mosalloc_hpbrs_windows.<pid>.csv that is written on exit when
+ * HPC_ANALYZE_HPBRS is set: for each interval, its mapped size, its
+ * resident size and, in analyze mode, the size and the high-water mark of
+ * the pages that were touched during the run.
+ * Returns 0 on success, or -1 and sets errno.
+ */
+int mosalloc_write_utilization(const char *path);
+
+/*
+ * The results of verifying the backing of the pools (in bytes): the pages
+ * that were walked, the pages that are present, the present pages that are
+ * backed by pages of another size than their intervals, and the present
+ * pages whose backing size cannot be told (their frames are hidden from
+ * unprivileged processes, or /proc/kpageflags cannot be read for a 4KB
+ * interval).
+ */
+struct mosalloc_backing_report {
+    size_t checked_size;
+    size_t present_size;
+    size_t mismatched_size;
+    size_t unverified_size;
+    void *first_mismatch;   /* the lowest mismatched address, or NULL */
+};
+
+/*
+ * Verifies that the pages of the anonymous and the brk pools are backed by
+ * the page sizes of their intervals, through /proc/self/pagemap (and
+ * /proc/kpageflags when it can be read), and fills @report with the results.
+ * The checks are incremental: a 2MB chunk whose pages were all found
+ * present and correctly backed is skipped by the next calls until its pages
+ * are mapped again, so the call is cheap enough to be made periodically.
+ * Returns 0 on success, or -1 and sets errno.
+ */
+int mosalloc_verify_backing(struct mosalloc_backing_report *report);
+
+#ifdef __cplusplus
+}  /* end of extern "C" */
+#endif /* __cplusplus */
+
+#endif //_MOSALLOC_H_
@@ -0,0 +1,54 @@
+#ifndef _MOSALLOC_FOOTPRINT_H_
+#define _MOSALLOC_FOOTPRINT_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * The format of the footprint samples files of Mosalloc.
+ * When HPC_SAMPLING_FILE is set, each process writes the footprints of its
+ * pools to HPC_SAMPLING_FILE.<pid>: a header, followed by the samples, each
+ * of which is a record followed by the footprints of the pools (in the order
+ * of the header). All the fields are in the byte order of the host.
+ * Use mosalloc-footprint-csv to convert the files to csv.
+ */
+
+#define MOSALLOC_FOOTPRINT_MAGIC (0x544e5250544f4f46ull) /* "FOOTPRNT" */
+#define MOSALLOC_FOOTPRINT_VERSION (1)
+#define MOSALLOC_FOOTPRINT_MAX_POOLS (18)
+#define MOSALLOC_FOOTPRINT_MAX_NAME_LENGTH (32)
+
+struct mosalloc_footprint_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t pools_count;
+    int32_t pid;
+    uint32_t reserved;
+    /* the sampling policy: a sample every interval_ns nanoseconds and/or
+     * every operations calls (0 if not used) */
+    uint64_t interval_ns;
+    uint64_t operations;
+    char names[MOSALLOC_FOOTPRINT_MAX_POOLS][MOSALLOC_FOOTPRINT_MAX_NAME_LENGTH];
+    uint64_t bases[MOSALLOC_FOOTPRINT_MAX_POOLS];
+};
+
+struct mosalloc_footprint_record {
+    uint64_t time_ns;       /* since the header was written */
+    uint64_t operations;    /* the number of calls so far */
+};
+
+struct mosalloc_footprint_pool {
+    uint64_t size;          /* the size up to the pool top */
+    /* the committed sizes of the 4KB, 2MB and 1GB pages */
+    uint64_t committed[3];
+    uint64_t ffa_top;       /* the top address of the allocations */
+};
+
+#ifdef __cplusplus
+}  /* end of extern "C" */
+#endif /* __cplusplus */
+
+#endif //_MOSALLOC_FOOTPRINT_H_
@@ -0,0 +1,106 @@
+#ifndef _MOSALLOC_STATS_H_
+#define _MOSALLOC_STATS_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * The layout of the live statistics segment of Mosalloc.
+ * When HPC_STATISTICS is set, each process publishes its counters in the
+ * POSIX shared-memory object MOSALLOC_STATS_NAME_PREFIX<pid> (i.e., in
+ * /dev/shm), which is removed when the process exits. The counters are
+ * updated with relaxed atomic operations, so readers (e.g., mosalloc-top)
+ * may see a slightly inconsistent snapshot, and they should read them with
+ * relaxed atomic loads as well.
+ */
+
+#define MOSALLOC_STATS_NAME_PREFIX "/mosalloc-stats."
+#define MOSALLOC_STATS_MAGIC (0x4d4f53414c4c4f43ull) /* "MOSALLOC" */
+#define MOSALLOC_STATS_VERSION (2)
+
+/* the anonymous mmap pools, the brk pool and the file-backed pool */
+#define MOSALLOC_STATS_MAX_POOLS (18)
+#define MOSALLOC_STATS_MAX_NAME_LENGTH (32)
+
+enum mosalloc_stats_call {
+    MOSALLOC_STATS_MMAP,
+    MOSALLOC_STATS_MUNMAP,
+    MOSALLOC_STATS_MREMAP,
+    MOSALLOC_STATS_MPROTECT,
+    MOSALLOC_STATS_MADVISE,
+    MOSALLOC_STATS_BRK,
+    MOSALLOC_STATS_SBRK,
+    MOSALLOC_STATS_CALLS
+};
+
+enum mosalloc_stats_page_size {
+    MOSALLOC_STATS_4KB,
+    MOSALLOC_STATS_2MB,
+    MOSALLOC_STATS_1GB,
+    MOSALLOC_STATS_PAGE_SIZES
+};
+
+struct mosalloc_lock_stats {
+    uint64_t acquisitions;
+    uint64_t contentions;   /* acquisitions that had to wait */
+    uint64_t wait_ns;       /* the total waiting time */
+};
+
+struct mosalloc_pool_stats {
+    char name[MOSALLOC_STATS_MAX_NAME_LENGTH];
+    uint64_t capacity;
+    uint64_t allocations;
+    uint64_t deallocations;
+    /* the bytes of the allocated and freed ranges, by their page sizes */
+    uint64_t allocated_bytes[MOSALLOC_STATS_PAGE_SIZES];
+    uint64_t freed_bytes[MOSALLOC_STATS_PAGE_SIZES];
+    uint64_t mapped_size;       /* the size up to the pool top */
+    uint64_t peak_mapped_size;
+    uint64_t committed_size;    /* the mapped size without reservations */
+    uint64_t extends;           /* the number of times the top was raised */
+    uint64_t shrinks;           /* the number of times the top was lowered */
+    /*
+     * the intervals whose huge pages ran out and were backed with smaller
+     * pages (see HPC_HUGE_PAGES_FALLBACK), their sizes by the page sizes
+     * they were configured with, and the extensions that failed instead
+     */
+    uint64_t downgrades;
+    uint64_t downgraded_bytes[MOSALLOC_STATS_PAGE_SIZES];
+    uint64_t fallback_failures;
+    /* the nodes of the first-fit list, updated on refresh requests */
+    uint64_t ffa_used_nodes;
+    uint64_t ffa_capacity;
+    struct mosalloc_lock_stats lock;
+};
+
+struct mosalloc_stats {
+    uint64_t magic;
+    uint32_t version;
+    int32_t pid;
+    char command[64];
+    uint64_t start_time;        /* seconds since the epoch */
+    uint32_t pools_count;
+    /*
+     * Readers increment refresh_requests to ask for the counters that are
+     * expensive to collect; the process updates them (on its next mmap or
+     * brk call) and then sets refreshes to refresh_requests.
+     */
+    uint32_t refresh_requests;
+    uint32_t refreshes;
+    uint32_t reserved;
+    /* the calls of the hooks (sbrk calls brk, so brk counts them too) */
+    uint64_t calls[MOSALLOC_STATS_CALLS];
+    /* the locks of the mmap-family hooks and of the brk and sbrk hooks */
+    struct mosalloc_lock_stats mmap_hooks_lock;
+    struct mosalloc_lock_stats brk_hooks_lock;
+    struct mosalloc_pool_stats pools[MOSALLOC_STATS_MAX_POOLS];
+};
+
+#ifdef __cplusplus
+}  /* end of extern "C" */
+#endif /* __cplusplus */
+
+#endif //_MOSALLOC_STATS_H_
@@ -0,0 +1,79 @@
+#ifndef _MOSALLOC_TRACE_H_
+#define _MOSALLOC_TRACE_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * The format of the trace files of Mosalloc.
+ * When HPC_TRACE_FILE is set, each process records the hooked calls that are
+ * served by its pools to HPC_TRACE_FILE.<pid>: a header, followed by the
+ * records of the calls. The records of each thread are written in chunks, so
+ * the file is not ordered; sort the records by their sequence numbers to get
+ * the order in which the pools served the calls. The last record of a trace
+ * that was closed on exit is a MOSALLOC_TRACE_END record.
+ * All the fields are in the byte order of the host.
+ * Use mosalloc-replay to replay a trace against the pools, and
+ * mosalloc-whatif to evaluate layouts against it.
+ */
+
+#define MOSALLOC_TRACE_MAGIC (0x4543415254534f4dull) /* "MOSTRACE" */
+#define MOSALLOC_TRACE_VERSION (1)
+#define MOSALLOC_TRACE_MAX_POOLS (18)
+#define MOSALLOC_TRACE_MAX_NAME_LENGTH (32)
+
+enum mosalloc_trace_call {
+    MOSALLOC_TRACE_MMAP,
+    MOSALLOC_TRACE_MUNMAP,
+    MOSALLOC_TRACE_MREMAP,
+    MOSALLOC_TRACE_MPROTECT,
+    MOSALLOC_TRACE_MADVISE,
+    MOSALLOC_TRACE_BRK,
+    MOSALLOC_TRACE_SBRK,
+    /* closes the trace; its result is the number of dropped records */
+    MOSALLOC_TRACE_END
+};
+
+struct mosalloc_trace_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t pools_count;
+    int32_t pid;
+    uint32_t record_size;
+    /* the pools when the trace was opened, so the addresses of the calls
+     * can be translated to other runs */
+    char names[MOSALLOC_TRACE_MAX_POOLS][MOSALLOC_TRACE_MAX_NAME_LENGTH];
+    uint64_t bases[MOSALLOC_TRACE_MAX_POOLS];
+    uint64_t capacities[MOSALLOC_TRACE_MAX_POOLS];
+};
+
+struct mosalloc_trace_record {
+    uint64_t sequence;      /* the order of the call in the process */
+    uint64_t time_ns;       /* the start of the call, since the header */
+    uint32_t duration_ns;
+    int32_t tid;
+    uint16_t call;          /* enum mosalloc_trace_call */
+    /* the calls that were made inside other calls (e.g., the brk calls of
+     * sbrk) have a depth above 0 */
+    uint16_t depth;
+    int32_t error;          /* errno if the call failed, otherwise 0 */
+    uint64_t addr;          /* mremap: the old address */
+    uint64_t length;        /* mremap: the old size; sbrk: the increment */
+    uint64_t new_length;    /* mremap */
+    uint64_t new_address;   /* mremap with MREMAP_FIXED */
+    int64_t offset;         /* mmap */
+    int32_t prot;           /* mmap, mprotect; madvise: the advice */
+    int32_t flags;          /* mmap, mremap */
+    int32_t fd;             /* mmap */
+    int32_t reserved;
+    uint64_t result;        /* the returned address or value */
+};
+
+#ifdef __cplusplus
+}  /* end of extern "C" */
+#endif /* __cplusplus */
+
+#endif //_MOSALLOC_TRACE_H_
@@ -37,6 +37,11 @@ def convert_size_string_to_bytes(size_string: str):
     return size
 
 
+def get_region_types(csv_config_file: str) -> List[str]:
+    config_data = pd.read_csv(csv_config_file)
+    return list(dict.fromkeys(config_data.type))
+
+
 def validate_region_offsets(start_offset, end_offset, page_size):
     region_size = end_offset - start_offset
     # validate that end >= start
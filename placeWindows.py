@@ -0,0 +1,183 @@
+#! /usr/bin/env python3
+
+# Places windows of 2MB and 1GB pages over the hottest offsets of the pools:
+# the accesses are sampled with idle page tracking (HPC_ACCESS_SAMPLING_FILE)
+# under a layout of 4KB pages, and the windows of a budget of pages are
+# placed over the 2MB chunks that were accessed the most. The pool sizes are
+# taken from the configuration file of the sampled run, and the layout is
+# written in the same format.
+
+import sys
+import os
+import argparse
+
+from memory_region import MemoryRegion, get_region_types, LARGE_PAGE_SIZE, HUGE_PAGE_SIZE
+
+FILE_REGION_TYPE = 'file'
+STACK_REGION_TYPE = 'stack'
+CHUNKS_PER_HUGE_PAGE = HUGE_PAGE_SIZE // LARGE_PAGE_SIZE
+
+
+def parse_arguments():
+    parser = argparse.ArgumentParser(description='A tool to place windows of\
+             large/huge pages over the hottest offsets of the mosalloc pools')
+    parser.add_argument('-cpf', '--configuration_pools_file', required=True,
+                        help="the pools configuration of the sampled run (the pool sizes are kept)")
+    parser.add_argument('-b2', '--large_pages', type=int, default=0,
+                        help="the budget of 2MB pages")
+    parser.add_argument('-b1', '--huge_pages', type=int, default=0,
+                        help="the budget of 1GB pages")
+    parser.add_argument('-m', '--metric', default='accessed-pages',
+                        choices=['accessed-pages', 'accessed-samples'],
+                        help="the hotness of a chunk: its accessed pages or the samples in which it was accessed")
+    parser.add_argument('-o', '--output', default='mosalloc_layout.csv',
+                        help="the layout file to write")
+    parser.add_argument('access_files', nargs='+',
+                        help="the sampled accesses (<HPC_ACCESS_SAMPLING_FILE>.<pid>), which are summed")
+    args = parser.parse_args()
+
+    for path in args.access_files + [args.configuration_pools_file]:
+        if not os.path.isfile(path):
+            sys.exit("Error: " + path + " cannot be found")
+    if args.large_pages < 0 or args.huge_pages < 0:
+        sys.exit("Error: the budgets must not be negative")
+    return args
+
+
+def read_hotness(paths, metric):
+    """
+    Returns the hotness of the 2MB chunks of each pool, as {pool: {chunk:
+    hotness}}, summed over the files.
+    """
+    hotness = {}
+    for path in paths:
+        with open(path, 'r') as file:
+            header = file.readline().strip().split(',')
+            for line in file:
+                row = dict(zip(header, line.strip().split(',')))
+                if 'pool' not in row or metric not in row:
+                    continue
+                chunks = hotness.setdefault(row['pool'], {})
+                chunk = int(row['offset']) // LARGE_PAGE_SIZE
+                chunks[chunk] = chunks.get(chunk, 0) + int(row[metric])
+    return hotness
+
+
+class Window:
+    """
+    A window of a pool over the units [start, end) (chunks of 2MB or blocks
+    of 1GB), which grows over the hottest units next to it and never
+    overlaps the @blocked units.
+    """
+
+    def __init__(self, weights, units_count, blocked):
+        self.weights = weights
+        self.units_count = units_count
+        self.blocked = blocked
+        self.start = self.end = None
+
+    def is_free(self, unit):
+        return 0 <= unit < self.units_count and unit not in self.blocked
+
+    def get_best_move(self, budget):
+        """
+        Returns the best move as (gain per page, new start, new end): the
+        hottest unit if the window is empty, or else an extension up to
+        the next hot unit on either side (the cold units in between are
+        covered as well).
+        """
+        if self.start is None:
+            free = [unit for unit in self.weights if self.weights[unit] > 0 and self.is_free(unit)]
+            if not free:
+                return None
+            unit = max(free, key=lambda u: self.weights[u])
+            return self.weights[unit], unit, unit + 1
+        best = None
+        for step, first in [(-1, self.start - 1), (1, self.end)]:
+            unit = first
+            while self.is_free(unit) and abs(unit - first) < budget and self.weights.get(unit, 0) == 0:
+                unit += step
+            if not self.is_free(unit) or abs(unit - first) >= budget:
+                continue
+            pages = abs(unit - first) + 1
+            move = (self.weights[unit] / pages,
+                    min(self.start, unit), max(self.end, unit + 1))
+            if best is None or move[0] > best[0]:
+                best = move
+        return best
+
+    def get_pages(self):
+        return 0 if self.start is None else self.end - self.start
+
+
+def place_windows(windows, budget):
+    """
+    Spends @budget pages on the @windows (of all the pools), one move at a
+    time, by the best gain per page.
+    """
+    while budget > 0:
+        moves = [(window.get_best_move(budget), window) for window in windows]
+        moves = [(move, window) for move, window in moves if move is not None]
+        if not moves:
+            break
+        (gain, start, end), window = max(moves, key=lambda m: m[0][0])
+        budget -= (end - start) - window.get_pages()
+        window.start, window.end = start, end
+
+
+def get_block_weights(chunks):
+    blocks = {}
+    for chunk, weight in chunks.items():
+        block = chunk // CHUNKS_PER_HUGE_PAGE
+        blocks[block] = blocks.get(block, 0) + weight
+    return blocks
+
+
+args = parse_arguments()
+hotness = read_hotness(args.access_files, args.metric)
+pools = [pool for pool in get_region_types(args.configuration_pools_file)]
+pool_sizes = {pool: MemoryRegion(args.configuration_pools_file, pool).pool_size for pool in pools}
+# the file pool is not backed by the layouts, and the stack pool is backed
+# with 4KB pages only
+placed_pools = [pool for pool in pools if pool in hotness and
+                pool not in [FILE_REGION_TYPE, STACK_REGION_TYPE]]
+
+huge_windows = {pool: Window(get_block_weights(hotness[pool]),
+                             pool_sizes[pool] // HUGE_PAGE_SIZE, set())
+                for pool in placed_pools}
+place_windows(list(huge_windows.values()), args.huge_pages)
+large_windows = {}
+for pool in placed_pools:
+    huge_window = huge_windows[pool]
+    blocked = set()
+    if huge_window.start is not None:
+        blocked = set(range(huge_window.start * CHUNKS_PER_HUGE_PAGE,
+                            huge_window.end * CHUNKS_PER_HUGE_PAGE))
+    large_windows[pool] = Window(hotness[pool], pool_sizes[pool] // LARGE_PAGE_SIZE, blocked)
+place_windows(list(large_windows.values()), args.large_pages)
+
+with open(args.output, 'w') as file:
+    file.write('type,pageSize,startOffset,endOffset\n')
+    for pool in pools:
+        file.write('{},-1,0,{}\n'.format(pool, pool_sizes[pool]))
+        if pool not in placed_pools:
+            continue
+        for window, page_size in [(huge_windows[pool], HUGE_PAGE_SIZE),
+                                  (large_windows[pool], LARGE_PAGE_SIZE)]:
+            if window.start is not None:
+                file.write('{},{},{},{}\n'.format(pool, page_size, window.start * page_size,
+                                                  window.end * page_size))
+# the layout must be a valid configuration file
+for pool in pools:
+    MemoryRegion(args.output, pool)
+
+print('pool,pool-size,hotness,covered-1gb,covered-2mb')
+for pool in placed_pools:
+    total = sum(hotness[pool].values())
+    covered = []
+    for window, weights in [(huge_windows[pool], huge_windows[pool].weights),
+                            (large_windows[pool], hotness[pool])]:
+        covered.append(0 if window.start is None else
+                       sum(weights.get(unit, 0) for unit in range(window.start, window.end)))
+    print('{},{},{},{},{}'.format(pool, pool_sizes[pool], total, covered[0], covered[1]))
+print('The layout was written to ' + args.output)
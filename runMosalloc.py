@@ -7,6 +7,7 @@ import subprocess
 
 ANON_REGION_TYPE = 'mmap'
 BRK_REGION_TYPE = 'brk'
+FILE_REGION_TYPE = 'file'
 
 
 def parse_arguments():
@@ -15,12 +16,36 @@ def parse_arguments():
              redirect them to pre-allocated regions backed with mixed pages sizes')
     parser.add_argument('-z', '--analyze', action='store_true',
                         help="analyze the pool sizes and write them to new file called mosalloc_hpbrs.csv.<pid>")
+    parser.add_argument('-s', '--statistics', action='store_true',
+                        help="publish live statistics of the pools in shared memory (watch them with mosalloc-top)")
+    parser.add_argument('-sf', '--sampling_file',
+                        help="sample the footprints of the pools to files called <sampling_file>.<pid> (convert them with mosalloc-footprint-csv)")
+    parser.add_argument('-si', '--sampling_interval', type=int,
+                        help="the interval between the footprint samples in milliseconds (defaults to 100 unless --sampling_operations is given)")
+    parser.add_argument('-so', '--sampling_operations', type=int,
+                        help="take a footprint sample every given number of hooked calls")
+    parser.add_argument('-af', '--access_sampling_file',
+                        help="sample the accesses to the pools with idle page tracking and write them to <access_sampling_file>.<pid> (place windows over them with placeWindows.py)")
+    parser.add_argument('-ai', '--access_sampling_interval', type=int,
+                        help="the interval between the access samples in milliseconds (defaults to 1000)")
+    parser.add_argument('-lf', '--latency_file',
+                        help="measure the latencies of the hooked calls and write their histograms to <latency_file>.<pid> on exit")
+    parser.add_argument('-tf', '--trace_file',
+                        help="record the hooked calls to binary files called <trace_file>.<pid> (replay them with mosalloc-replay)")
+    parser.add_argument('-hpf', '--huge_pages_fallback', choices=['abort', 'degrade', 'fail'],
+                        help="what to do when the huge pages of a pool run out (defaults to abort)")
+    parser.add_argument('-lsl', '--learn_stack_lengths', action='store_true',
+                        help="route the later mappings of the lengths of guarded stack-sized mappings to the stack pool")
     parser.add_argument('-d', '--debug', action='store_true',
                         help="run in debug mode and don't run preparation scripts (e.g., disable THP)")
     parser.add_argument('-l', '--library', default='src/morecore/lib_morecore.so',
                         help="mosalloc library path to preload.")
     parser.add_argument('-cpf', '--configuration_pools_file', required=True,
                         help="path to csv file with pools configuration")
+    parser.add_argument('-rf', '--routing_file',
+                        help="path to csv file with rules that route anonymous mmap calls to pools")
+    parser.add_argument('-lcf', '--layout_control_file',
+                        help="path to csv file whose pool layouts are applied above the pool tops whenever it is modified")
     parser.add_argument('dispatch_program', help="program to execute")
     parser.add_argument('dispatch_args', nargs=argparse.REMAINDER,
                         help="program arguments")
@@ -31,6 +56,8 @@ def parse_arguments():
         sys.exit("Error: the mosalloc library cannot be found")
     if not os.path.isfile(args.configuration_pools_file):
         sys.exit("Error: the configuration pools file cannot be found")
+    if args.routing_file is not None and not os.path.isfile(args.routing_file):
+        sys.exit("Error: the routing file cannot be found")
 
     return args
 
@@ -59,9 +86,9 @@ def update_config_file():
 def run_benchmark(environ):
     # reserve an additional large/huge page so we can pad the pools with this
     # extra page and allow proper alignment of large/huge pages inside the pools
-    large_pages = anon_region.get_num_of_large_pages() + brk_region.get_num_of_large_pages()
+    large_pages = sum([region.get_num_of_large_pages() for region in regions])
     large_pages = large_pages + 1 if large_pages > 0 else large_pages
-    huge_pages = anon_region.get_num_of_huge_pages() + brk_region.get_num_of_huge_pages()
+    huge_pages = sum([region.get_num_of_huge_pages() for region in regions])
     huge_pages = huge_pages + 1 if huge_pages > 0 else huge_pages
 
     try:
@@ -86,18 +113,47 @@ def run_benchmark(environ):
 
 args = parse_arguments()
 
-from memory_region import MemoryRegion, convert_size_string_to_bytes
+from memory_region import MemoryRegion, convert_size_string_to_bytes, get_region_types
 
-anon_region = MemoryRegion(args.configuration_pools_file, ANON_REGION_TYPE)
-brk_region = MemoryRegion(args.configuration_pools_file, BRK_REGION_TYPE)
+# every region type other than the file-backed one (i.e., brk, mmap and the
+# additional anonymous mmap pools) may be backed with large/huge pages
+region_types = [ANON_REGION_TYPE, BRK_REGION_TYPE] + \
+    [region_type for region_type in get_region_types(args.configuration_pools_file)
+     if region_type not in [ANON_REGION_TYPE, BRK_REGION_TYPE, FILE_REGION_TYPE]]
+regions = [MemoryRegion(args.configuration_pools_file, region_type) for region_type in region_types]
 
 # build the environment variables
 environ = {"HPC_CONFIGURATION_FILE": args.configuration_pools_file,
            "HPC_MMAP_FIRST_FIT_LIST_SIZE": str(convert_size_string_to_bytes("1MB")),
-           "HPC_FILE_BACKED_FIRST_FIT_LIST_SIZE": str(convert_size_string_to_bytes("10KB"))}
+           "HPC_FILE_BACKED_FIRST_FIT_LIST_SIZE": str(convert_size_string_to_bytes("10KB")),
+           "HPC_STACK_FIRST_FIT_LIST_SIZE": str(convert_size_string_to_bytes("10KB"))}
 
 if args.analyze:
     environ["HPC_ANALYZE_HPBRS"] = "1"
+if args.statistics:
+    environ["HPC_STATISTICS"] = "1"
+if args.sampling_file is not None:
+    environ["HPC_SAMPLING_FILE"] = os.path.abspath(args.sampling_file)
+    if args.sampling_interval is not None:
+        environ["HPC_SAMPLING_INTERVAL_MS"] = str(args.sampling_interval)
+    if args.sampling_operations is not None:
+        environ["HPC_SAMPLING_OPERATIONS"] = str(args.sampling_operations)
+if args.access_sampling_file is not None:
+    environ["HPC_ACCESS_SAMPLING_FILE"] = os.path.abspath(args.access_sampling_file)
+    if args.access_sampling_interval is not None:
+        environ["HPC_ACCESS_SAMPLING_INTERVAL_MS"] = str(args.access_sampling_interval)
+if args.latency_file is not None:
+    environ["HPC_LATENCY_FILE"] = os.path.abspath(args.latency_file)
+if args.trace_file is not None:
+    environ["HPC_TRACE_FILE"] = os.path.abspath(args.trace_file)
+if args.huge_pages_fallback is not None:
+    environ["HPC_HUGE_PAGES_FALLBACK"] = args.huge_pages_fallback
+if args.learn_stack_lengths:
+    environ["HPC_LEARN_STACK_LENGTHS"] = "1"
+if args.routing_file is not None:
+    environ["HPC_ROUTING_FILE"] = os.path.abspath(args.routing_file)
+if args.layout_control_file is not None:
+    environ["HPC_LAYOUT_CONTROL_FILE"] = os.path.abspath(args.layout_control_file)
 
 environ.update(os.environ)
 
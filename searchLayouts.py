@@ -0,0 +1,493 @@
+#! /usr/bin/env python3
+
+# Searches layouts for an application under a budget of 2MB and 1GB pages:
+# the candidate layouts are generated from the pool sizes that were measured
+# in analyze mode (mosalloc_hpbrs_sizes.<pid>.csv), the application is run
+# under each of them with runMosalloc.py, and the runtimes are fitted against
+# the coverage of the pools by huge pages. The layouts, the models and the
+# best layout are written to a single report.
+
+import sys
+import os
+import argparse
+import json
+import random
+import subprocess
+import time
+
+from memory_region import MemoryRegion, LARGE_PAGE_SIZE, HUGE_PAGE_SIZE
+
+ANON_REGION_TYPE = 'mmap'
+FILE_REGION_TYPE = 'file'
+STACK_REGION_TYPE = 'stack'
+PAGE_SIZES = [HUGE_PAGE_SIZE, LARGE_PAGE_SIZE]
+
+
+def parse_arguments():
+    parser = argparse.ArgumentParser(description='A tool to search the layouts of\
+             the mosalloc pools for an application under a budget of large/huge pages')
+    parser.add_argument('-p', '--profile', required=True,
+                        help="the pool sizes of the application (mosalloc_hpbrs_sizes.<pid>.csv of analyze mode)")
+    parser.add_argument('-b2', '--large_pages', type=int, default=0,
+                        help="the budget of 2MB pages")
+    parser.add_argument('-b1', '--huge_pages', type=int, default=0,
+                        help="the budget of 1GB pages")
+    parser.add_argument('-st', '--strategies', default='grid,random,greedy',
+                        help="comma-separated strategies to generate the layouts with (grid, random and greedy)")
+    parser.add_argument('-gp', '--grid_points', type=int, default=5,
+                        help="the page counts of each page size in the grid, evenly spaced from 0 to the budget")
+    parser.add_argument('-rs', '--random_samples', type=int, default=10,
+                        help="the number of random layouts, one for each of the equal coverage ranges")
+    parser.add_argument('-gs', '--greedy_steps', type=int, default=5,
+                        help="the moves of windows that the greedy search makes from the best layout")
+    parser.add_argument('-r', '--repeats', type=int, default=3,
+                        help="the runs of the application under each layout")
+    parser.add_argument('-sd', '--seed', type=int, default=0,
+                        help="the seed of the random layouts")
+    parser.add_argument('-w', '--work_directory', default='layout_search',
+                        help="the directory of the layouts and of the report (layout_search.json)")
+    parser.add_argument('-d', '--debug', action='store_true',
+                        help="pass the debug mode to runMosalloc.py (don't run the preparation scripts)")
+    parser.add_argument('-l', '--library', default='src/morecore/lib_morecore.so',
+                        help="mosalloc library path to preload.")
+    parser.add_argument('dispatch_program', help="program to execute")
+    parser.add_argument('dispatch_args', nargs=argparse.REMAINDER,
+                        help="program arguments")
+    args = parser.parse_args()
+
+    if not os.path.isfile(args.profile):
+        sys.exit("Error: the profile cannot be found")
+    if args.large_pages < 0 or args.huge_pages < 0:
+        sys.exit("Error: the budgets must not be negative")
+    if args.grid_points < 2 or args.random_samples < 0 or args.repeats < 1:
+        sys.exit("Error: invalid search parameters")
+    for strategy in args.strategies.split(','):
+        if strategy not in ['grid', 'random', 'greedy']:
+            sys.exit("Error: unknown strategy " + strategy)
+    return args
+
+
+def round_up(size, alignment):
+    return ((size + alignment - 1) // alignment) * alignment
+
+
+def read_profile(profile_file):
+    """
+    Returns the peak sizes of the pools by their types; the regions of the
+    profile are named after the pools (e.g., anon-mmap for mmap and
+    stack-mmap for stack).
+    """
+    footprints = {}
+    with open(profile_file, 'r') as file:
+        header = file.readline().strip().split(',')
+        for line in file:
+            row = dict(zip(header, line.strip().split(',')))
+            if 'region' not in row or 'max-size' not in row:
+                continue
+            region = row['region']
+            if region == 'anon-mmap':
+                pool_type = ANON_REGION_TYPE
+            elif region == 'file-mmap':
+                pool_type = FILE_REGION_TYPE
+            elif region.endswith('-mmap'):
+                pool_type = region[:-len('-mmap')]
+            else:
+                pool_type = region
+            footprints[pool_type] = int(row['max-size'])
+    if ANON_REGION_TYPE not in footprints:
+        sys.exit("Error: the profile has no anonymous mmap pool")
+    return footprints
+
+
+class Layout:
+    """
+    The windows of huge pages of each pool: a window of 1GB pages and a
+    window of 2MB pages, as (start_offset, pages) by the page sizes.
+    """
+
+    def __init__(self, footprints):
+        self.footprints = footprints
+        self.windows = {pool: {page_size: (0, 0) for page_size in PAGE_SIZES}
+                        for pool in get_searched_pools(footprints)}
+
+    def copy(self):
+        layout = Layout(self.footprints)
+        layout.windows = {pool: dict(windows) for pool, windows in self.windows.items()}
+        return layout
+
+    def key(self):
+        return json.dumps(sorted((pool, sorted(windows.items()))
+                                 for pool, windows in self.windows.items()))
+
+    def get_pages(self, page_size):
+        return sum(windows[page_size][1] for windows in self.windows.values())
+
+    def get_window_range(self, pool, page_size):
+        start, pages = self.windows[pool][page_size]
+        return start, start + pages * page_size
+
+    def is_valid(self, budgets):
+        for page_size in PAGE_SIZES:
+            if self.get_pages(page_size) > budgets[page_size]:
+                return False
+        for pool, windows in self.windows.items():
+            limit = get_window_limit(self.footprints[pool])
+            ranges = [self.get_window_range(pool, page_size) for page_size in PAGE_SIZES]
+            for (start, end), page_size in zip(ranges, PAGE_SIZES):
+                if start < 0 or end > limit or start % page_size != 0:
+                    return False
+            (start_1gb, end_1gb), (start_2mb, end_2mb) = ranges
+            if start_1gb < end_1gb and start_2mb < end_2mb and \
+                    start_1gb < end_2mb and start_2mb < end_1gb:
+                return False
+        return True
+
+    def get_coverage(self, page_size=None):
+        """
+        Returns the part of the pool footprints that is backed by huge pages
+        (of @page_size, or of both).
+        """
+        covered = 0
+        for pool in self.windows:
+            for size in PAGE_SIZES:
+                if page_size is not None and size != page_size:
+                    continue
+                start, end = self.get_window_range(pool, size)
+                covered += max(0, min(end, self.footprints[pool]) - start)
+        total = sum(self.footprints[pool] for pool in self.windows)
+        return covered / total if total > 0 else 0.0
+
+    def write(self, path):
+        with open(path, 'w') as file:
+            file.write('type,pageSize,startOffset,endOffset\n')
+            for pool, footprint in self.footprints.items():
+                file.write('{},-1,0,{}\n'.format(pool, get_pool_size(footprint)))
+                for page_size in PAGE_SIZES:
+                    if pool in self.windows:
+                        start, end = self.get_window_range(pool, page_size)
+                        if end > start:
+                            file.write('{},{},{},{}\n'.format(pool, page_size, start, end))
+        # the generated layouts must be valid configuration files
+        for pool in self.windows:
+            MemoryRegion(path, pool)
+
+
+def get_searched_pools(footprints):
+    # the file pool is not backed by the layouts, and the stack pool is
+    # backed with 4KB pages only
+    return [pool for pool in footprints
+            if pool not in [FILE_REGION_TYPE, STACK_REGION_TYPE] and footprints[pool] > 0]
+
+
+def get_window_limit(footprint):
+    # the windows beyond the footprint (rounded up to 1GB) cover nothing
+    return round_up(footprint, HUGE_PAGE_SIZE)
+
+
+def get_pool_size(footprint):
+    # leave room for the pools to grow beyond the profiled peak
+    return round_up(footprint, HUGE_PAGE_SIZE) + HUGE_PAGE_SIZE
+
+
+def distribute_pages(footprints, pools, pages, page_size, used):
+    """
+    Distributes @pages of @page_size over @pools in proportion to their
+    footprints (up to the pages that fit in their footprints, without the
+    @used bytes of each pool). Returns the pages of each pool.
+    """
+    capacities = {pool: max(0, round_up(footprints[pool], page_size) - used.get(pool, 0)) // page_size
+                  for pool in pools}
+    total = sum(footprints[pool] for pool in pools)
+    counts = {pool: min(capacities[pool], (pages * footprints[pool]) // total) for pool in pools}
+    # give the pages that were rounded away to the largest pools
+    left = pages - sum(counts.values())
+    for pool in sorted(pools, key=lambda p: footprints[p], reverse=True):
+        extra = min(left, capacities[pool] - counts[pool])
+        counts[pool] += extra
+        left -= extra
+    return counts
+
+
+def make_layout(footprints, large_pages, huge_pages):
+    """
+    Returns a layout with @huge_pages 1GB pages at the start of the pools and
+    @large_pages 2MB pages right after them.
+    """
+    layout = Layout(footprints)
+    pools = list(layout.windows)
+    counts_1gb = distribute_pages(footprints, pools, huge_pages, HUGE_PAGE_SIZE, {})
+    used = {pool: count * HUGE_PAGE_SIZE for pool, count in counts_1gb.items()}
+    counts_2mb = distribute_pages(footprints, pools, large_pages, LARGE_PAGE_SIZE, used)
+    for pool in pools:
+        layout.windows[pool][HUGE_PAGE_SIZE] = (0, counts_1gb[pool])
+        layout.windows[pool][LARGE_PAGE_SIZE] = (used[pool], counts_2mb[pool])
+    return layout
+
+
+def generate_grid(footprints, budgets, grid_points):
+    layouts = []
+    for i in range(grid_points):
+        for j in range(grid_points):
+            huge_pages = (budgets[HUGE_PAGE_SIZE] * i) // (grid_points - 1)
+            large_pages = (budgets[LARGE_PAGE_SIZE] * j) // (grid_points - 1)
+            layouts.append(make_layout(footprints, large_pages, huge_pages))
+    return layouts
+
+
+def generate_random(footprints, budgets, samples, rng):
+    """
+    Samples a layout in each of @samples equal ranges of the coverage, so the
+    layouts span all the coverages that the budget can reach; the pages are
+    split randomly between the page sizes and the pools, and the windows are
+    placed at random offsets.
+    """
+    max_coverage = make_layout(footprints, budgets[LARGE_PAGE_SIZE],
+                               budgets[HUGE_PAGE_SIZE]).get_coverage()
+    layouts = []
+    for i in range(samples):
+        low = max_coverage * i / samples
+        high = max_coverage * (i + 1) / samples
+        for attempt in range(1000):
+            layout = make_random_layout(footprints, budgets, rng)
+            if low <= layout.get_coverage() <= high:
+                layouts.append(layout)
+                break
+        else:
+            print("Warning: no random layout was found with coverage in [{:.3f}, {:.3f}]".format(low, high))
+    return layouts
+
+
+def make_random_layout(footprints, budgets, rng):
+    layout = Layout(footprints)
+    pools = list(layout.windows)
+    total = rng.random()
+    for pool in pools:
+        limit = get_window_limit(footprints[pool])
+        huge_pages = rng.randint(0, min(budgets[HUGE_PAGE_SIZE] - layout.get_pages(HUGE_PAGE_SIZE),
+                                        int(total * limit) // HUGE_PAGE_SIZE))
+        start_1gb = rng.randint(0, limit // HUGE_PAGE_SIZE - huge_pages) * HUGE_PAGE_SIZE
+        layout.windows[pool][HUGE_PAGE_SIZE] = (start_1gb, huge_pages)
+        # the 2MB window is placed before or after the 1GB window
+        end_1gb = start_1gb + huge_pages * HUGE_PAGE_SIZE
+        space_before = start_1gb // LARGE_PAGE_SIZE
+        space_after = (limit - end_1gb) // LARGE_PAGE_SIZE
+        is_after = rng.random() < space_after / max(1, space_before + space_after)
+        space = space_after if is_after else space_before
+        large_pages = rng.randint(0, min(budgets[LARGE_PAGE_SIZE] - layout.get_pages(LARGE_PAGE_SIZE),
+                                         int(total * space)))
+        first = end_1gb // LARGE_PAGE_SIZE if is_after else 0
+        start_2mb = (first + rng.randint(0, space - large_pages)) * LARGE_PAGE_SIZE
+        layout.windows[pool][LARGE_PAGE_SIZE] = (start_2mb, large_pages)
+    return layout
+
+
+def get_neighbors(layout, budgets):
+    """
+    Returns the layouts that are a single move of a window away: growing or
+    shrinking it by a page, shifting it by a page, or moving a page of it to
+    the window of another pool.
+    """
+    neighbors = []
+    pools = list(layout.windows)
+    for pool in pools:
+        for page_size in PAGE_SIZES:
+            start, pages = layout.windows[pool][page_size]
+            moves = [(start, pages + 1), (start, pages - 1),
+                     (start + page_size, pages), (start - page_size, pages)]
+            for new_start, new_pages in moves:
+                if new_pages < 0:
+                    continue
+                neighbor = layout.copy()
+                neighbor.windows[pool][page_size] = (new_start, new_pages)
+                neighbors.append(neighbor)
+            for other in pools:
+                if other == pool or pages == 0:
+                    continue
+                neighbor = layout.copy()
+                neighbor.windows[pool][page_size] = (start, pages - 1)
+                other_start, other_pages = neighbor.windows[other][page_size]
+                neighbor.windows[other][page_size] = (other_start, other_pages + 1)
+                neighbors.append(neighbor)
+    return [neighbor for neighbor in neighbors if neighbor.is_valid(budgets)]
+
+
+class Searcher:
+    """
+    Runs the application under the layouts, and keeps their results.
+    """
+
+    def __init__(self, args, footprints):
+        self.args = args
+        self.footprints = footprints
+        self.results = {}
+        # the evaluated layouts, by their files
+        self.layouts = {}
+
+    def evaluate(self, layout, strategy):
+        """
+        Returns the mean runtime of the application under @layout in
+        seconds, or None if any of its runs failed; the layouts that were
+        already evaluated are not run again.
+        """
+        key = layout.key()
+        if key in self.results:
+            return self.results[key]['runtime']
+        index = len(self.results)
+        path = os.path.join(self.args.work_directory, 'layout_{}.csv'.format(index))
+        layout.write(path)
+        self.layouts[path] = layout
+        runtimes = []
+        for repeat in range(self.args.repeats):
+            runtime = self.run(path)
+            if runtime is None:
+                runtimes = None
+                break
+            runtimes.append(runtime)
+        mean = sum(runtimes) / len(runtimes) if runtimes else None
+        self.results[key] = {
+            'layout': path,
+            'strategy': strategy,
+            'large_pages': layout.get_pages(LARGE_PAGE_SIZE),
+            'huge_pages': layout.get_pages(HUGE_PAGE_SIZE),
+            'coverage_2mb': layout.get_coverage(LARGE_PAGE_SIZE),
+            'coverage_1gb': layout.get_coverage(HUGE_PAGE_SIZE),
+            'coverage': layout.get_coverage(),
+            'runtimes': runtimes,
+            'runtime': mean,
+        }
+        print('{}: {} coverage={:.3f} runtime={}'.format(
+            strategy, path, layout.get_coverage(),
+            'failed' if mean is None else '{:.3f}'.format(mean)))
+        return mean
+
+    def run(self, config_file):
+        scripts_home_directory = sys.path[0]
+        command_line = [sys.executable, os.path.join(scripts_home_directory, 'runMosalloc.py'),
+                        '-cpf', config_file, '-l', self.args.library]
+        if self.args.debug:
+            command_line.append('-d')
+        command_line += ['--', self.args.dispatch_program] + self.args.dispatch_args
+        start = time.monotonic()
+        returncode = subprocess.call(command_line)
+        runtime = time.monotonic() - start
+        return runtime if returncode == 0 else None
+
+    def get_best(self):
+        succeeded = [result for result in self.results.values() if result['runtime'] is not None]
+        if not succeeded:
+            return None
+        return min(succeeded, key=lambda result: result['runtime'])
+
+    def search_greedy(self, layout, budgets, steps):
+        best_runtime = self.evaluate(layout, 'greedy')
+        for step in range(steps):
+            best_neighbor = None
+            for neighbor in get_neighbors(layout, budgets):
+                runtime = self.evaluate(neighbor, 'greedy')
+                if runtime is not None and (best_runtime is None or runtime < best_runtime):
+                    best_runtime = runtime
+                    best_neighbor = neighbor
+            if best_neighbor is None:
+                break
+            layout = best_neighbor
+
+
+def solve_least_squares(rows, values):
+    """
+    Returns the coefficients that minimize the squared errors of
+    rows * coefficients = values (by the normal equations), or None if they
+    are underdetermined.
+    """
+    columns = len(rows[0])
+    matrix = [[sum(row[i] * row[j] for row in rows) for j in range(columns)] +
+              [sum(row[i] * value for row, value in zip(rows, values))]
+              for i in range(columns)]
+    for column in range(columns):
+        pivot = max(range(column, columns), key=lambda r: abs(matrix[r][column]))
+        if abs(matrix[pivot][column]) < 1e-12:
+            return None
+        matrix[column], matrix[pivot] = matrix[pivot], matrix[column]
+        for row in range(columns):
+            if row != column:
+                factor = matrix[row][column] / matrix[column][column]
+                matrix[row] = [a - factor * b for a, b in zip(matrix[row], matrix[column])]
+    return [matrix[i][columns] / matrix[i][i] for i in range(columns)]
+
+
+def fit_models(results):
+    """
+    Fits the runtimes against the coverages: linear and quadratic models of
+    the total coverage, and a linear model of the coverages of each page
+    size. Returns the coefficients (from the constant term up) and the R^2
+    of each model.
+    """
+    succeeded = [result for result in results if result['runtime'] is not None]
+    models = {
+        'linear': lambda r: [1.0, r['coverage']],
+        'quadratic': lambda r: [1.0, r['coverage'], r['coverage'] ** 2],
+        'linear_by_page_size': lambda r: [1.0, r['coverage_2mb'], r['coverage_1gb']],
+    }
+    fitted = []
+    runtimes = [result['runtime'] for result in succeeded]
+    for name, features in models.items():
+        rows = [features(result) for result in succeeded]
+        # a model needs more layouts than coefficients
+        if not rows or len(rows) <= len(rows[0]):
+            continue
+        coefficients = solve_least_squares(rows, runtimes)
+        if coefficients is None:
+            continue
+        predictions = [sum(c * x for c, x in zip(coefficients, row)) for row in rows]
+        mean = sum(runtimes) / len(runtimes)
+        total = sum((runtime - mean) ** 2 for runtime in runtimes)
+        residual = sum((runtime - prediction) ** 2
+                       for runtime, prediction in zip(runtimes, predictions))
+        fitted.append({'model': name, 'coefficients': coefficients,
+                       'r2': 1.0 - residual / total if total > 0 else 1.0})
+    return fitted
+
+
+args = parse_arguments()
+footprints = read_profile(args.profile)
+budgets = {LARGE_PAGE_SIZE: args.large_pages, HUGE_PAGE_SIZE: args.huge_pages}
+os.makedirs(args.work_directory, exist_ok=True)
+searcher = Searcher(args, footprints)
+
+strategies = args.strategies.split(',')
+if 'grid' in strategies:
+    for layout in generate_grid(footprints, budgets, args.grid_points):
+        searcher.evaluate(layout, 'grid')
+if 'random' in strategies:
+    rng = random.Random(args.seed)
+    for layout in generate_random(footprints, budgets, args.random_samples, rng):
+        searcher.evaluate(layout, 'random')
+if 'greedy' in strategies:
+    # the greedy moves start from the best layout so far (or from the
+    # layout that uses the whole budget)
+    best = searcher.get_best()
+    if best is not None:
+        start = searcher.layouts[best['layout']]
+    else:
+        start = make_layout(footprints, args.large_pages, args.huge_pages)
+    searcher.search_greedy(start, budgets, args.greedy_steps)
+
+results = list(searcher.results.values())
+best = searcher.get_best()
+report = {
+    'program': [args.dispatch_program] + args.dispatch_args,
+    'profile': args.profile,
+    'footprints': footprints,
+    'budget': {'large_pages': args.large_pages, 'huge_pages': args.huge_pages},
+    'layouts': results,
+    'models': fit_models(results) if results else [],
+    'best': None,
+}
+if best is not None:
+    with open(best['layout'], 'r') as file:
+        report['best'] = dict(best, configuration=file.read())
+report_file = os.path.join(args.work_directory, 'layout_search.json')
+with open(report_file, 'w') as file:
+    json.dump(report, file, indent=2)
+print('the report was written to ' + report_file)
+if best is None:
+    sys.exit("Error: the application failed under all the layouts")
@@ -0,0 +1,153 @@
+#! /usr/bin/env python3
+
+# Sizes the mosalloc pools of an application from the pool sizes that were
+# measured in analyze mode (mosalloc_hpbrs_sizes.<pid>.csv): writes a minimal
+# layout whose pools fit the peaks of all the profiled processes, and prints
+# the 2MB/1GB page counts that reserveHugePages.sh must reserve for it.
+
+import sys
+import os
+import argparse
+
+from memory_region import MemoryRegion, BASE_PAGE_SIZE, LARGE_PAGE_SIZE, HUGE_PAGE_SIZE
+
+ANON_REGION_TYPE = 'mmap'
+FILE_REGION_TYPE = 'file'
+STACK_REGION_TYPE = 'stack'
+
+
+def parse_arguments():
+    parser = argparse.ArgumentParser(description='A tool to size the mosalloc\
+             pools of an application from the pool sizes of analyze mode')
+    parser.add_argument('-sh', '--size_histograms', nargs='+', default=[],
+                        help="the mapping sizes of the application (mosalloc_hpbrs_size_histograms.<pid>.csv of analyze mode)")
+    parser.add_argument('-l2', '--large_pools', default='',
+                        help="comma-separated pools to back with 2MB pages")
+    parser.add_argument('-l1', '--huge_pools', default='',
+                        help="comma-separated pools to back with 1GB pages")
+    parser.add_argument('-m', '--margin', type=int, default=0,
+                        help="the percents to add to the profiled peaks")
+    parser.add_argument('-np', '--processes', type=int, default=1,
+                        help="the processes that run under the layout at the same time")
+    parser.add_argument('-o', '--output', default='mosalloc_layout.csv',
+                        help="the layout file to write")
+    parser.add_argument('profiles', nargs='+',
+                        help="the pool sizes of the application (mosalloc_hpbrs_sizes.<pid>.csv of analyze mode)")
+    args = parser.parse_args()
+
+    for path in args.profiles + args.size_histograms:
+        if not os.path.isfile(path):
+            sys.exit("Error: " + path + " cannot be found")
+    if args.margin < 0 or args.processes < 1:
+        sys.exit("Error: invalid sizing parameters")
+    args.large_pools = [pool for pool in args.large_pools.split(',') if pool]
+    args.huge_pools = [pool for pool in args.huge_pools.split(',') if pool]
+    if set(args.large_pools) & set(args.huge_pools):
+        sys.exit("Error: a pool cannot be backed with both 2MB and 1GB pages")
+    for pool in [FILE_REGION_TYPE, STACK_REGION_TYPE]:
+        if pool in args.large_pools + args.huge_pools:
+            sys.exit("Error: the " + pool + " pool is backed with 4KB pages only")
+    return args
+
+
+def round_up(size, alignment):
+    return ((size + alignment - 1) // alignment) * alignment
+
+
+def get_pool_type(region):
+    # the regions of the profiles are named after the pools (e.g.,
+    # anon-mmap for mmap and stack-mmap for stack)
+    if region == 'anon-mmap':
+        return ANON_REGION_TYPE
+    if region == 'file-mmap':
+        return FILE_REGION_TYPE
+    if region.endswith('-mmap'):
+        return region[:-len('-mmap')]
+    return region
+
+
+def read_max_column(paths, column):
+    """
+    Returns the maximum of @column over the rows of all the @paths, by the
+    pool types of their regions.
+    """
+    maximums = {}
+    for path in paths:
+        with open(path, 'r') as file:
+            header = file.readline().strip().split(',')
+            for line in file:
+                row = dict(zip(header, line.strip().split(',')))
+                if 'region' not in row or column not in row:
+                    continue
+                pool_type = get_pool_type(row['region'])
+                maximums[pool_type] = max(maximums.get(pool_type, 0), int(row[column]))
+    return maximums
+
+
+def get_page_size(args, pool):
+    if pool in args.huge_pools:
+        return HUGE_PAGE_SIZE
+    if pool in args.large_pools:
+        return LARGE_PAGE_SIZE
+    return BASE_PAGE_SIZE
+
+
+def get_pool_size(peak, largest_mapping, margin, page_size):
+    """
+    Returns the size of a pool that fits @peak (plus @margin percents) and
+    one more of its largest mappings: the first-fit placement of a run may
+    differ from the profiled one by a hole that is as large as the largest
+    mapping. The pools are rounded up to 2MB, and to whole windows of their
+    page size.
+    """
+    size = peak + (peak * margin + 99) // 100 + largest_mapping
+    return round_up(size, max(page_size, LARGE_PAGE_SIZE))
+
+
+def write_layout(path, pool_sizes, page_sizes):
+    with open(path, 'w') as file:
+        file.write('type,pageSize,startOffset,endOffset\n')
+        for pool, size in pool_sizes.items():
+            file.write('{},-1,0,{}\n'.format(pool, size))
+            if page_sizes[pool] != BASE_PAGE_SIZE:
+                # a single window of huge pages covers the whole pool
+                file.write('{},{},0,{}\n'.format(pool, page_sizes[pool], size))
+    # the layout must be a valid configuration file
+    for pool in pool_sizes:
+        MemoryRegion(path, pool)
+
+
+args = parse_arguments()
+peaks = read_max_column(args.profiles, 'max-size')
+if ANON_REGION_TYPE not in peaks:
+    sys.exit("Error: the profiles have no anonymous mmap pool")
+for pool in args.large_pools + args.huge_pools:
+    if pool not in peaks:
+        sys.exit("Error: the profiles have no " + pool + " pool")
+largest_mappings = read_max_column(args.size_histograms, 'max-size')
+if not args.size_histograms:
+    print("Warning: without size histograms the pools are not padded for their largest mappings")
+
+pool_sizes = {}
+page_sizes = {}
+for pool, peak in peaks.items():
+    page_sizes[pool] = get_page_size(args, pool)
+    pool_sizes[pool] = get_pool_size(peak, largest_mappings.get(pool, 0),
+                                     args.margin, page_sizes[pool])
+write_layout(args.output, pool_sizes, page_sizes)
+
+# the windows are mapped as a whole by each process, and runMosalloc.py
+# reserves an additional page of each size to pad the pools for alignment
+large_pages = sum(size // LARGE_PAGE_SIZE for pool, size in pool_sizes.items()
+                  if page_sizes[pool] == LARGE_PAGE_SIZE) * args.processes
+large_pages = large_pages + 1 if large_pages > 0 else large_pages
+huge_pages = sum(size // HUGE_PAGE_SIZE for pool, size in pool_sizes.items()
+                 if page_sizes[pool] == HUGE_PAGE_SIZE) * args.processes
+huge_pages = huge_pages + 1 if huge_pages > 0 else huge_pages
+
+print('pool,peak-size,largest-mapping,page-size,pool-size')
+for pool, size in pool_sizes.items():
+    print('{},{},{},{},{}'.format(pool, peaks[pool], largest_mappings.get(pool, 0),
+                                  page_sizes[pool], size))
+print('The layout was written to ' + args.output)
+print('reserveHugePages.sh -l{} -h{}'.format(large_pages, huge_pages))
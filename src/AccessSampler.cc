@@ -0,0 +1,263 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "globals.h"
+#include "GlibcAllocationFunctions.h"
+#include "AccessSampler.h"
+
+#define CHUNK_SIZE ((size_t)PageSize::HUGE_2MB)
+#define PAGE_SIZE_4KB ((size_t)PageSize::BASE_4KB)
+#define PAGES_PER_CHUNK (CHUNK_SIZE / PAGE_SIZE_4KB)
+#define ENTRIES_SIZE (PAGES_PER_CHUNK * sizeof(uint64_t))
+// the bits of a pagemap entry (see Documentation/admin-guide/mm/pagemap.rst)
+#define PAGEMAP_PRESENT (1ull << 63)
+#define PAGEMAP_PFN_MASK ((1ull << 55) - 1)
+
+static uint64_t GetTimeNs(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+AccessSampler::AccessSampler() :
+    _pid(0),
+    _path_prefix(nullptr),
+    _pagemap_path(nullptr),
+    _pagemap_fd(-1),
+    _bitmap_fd(-1),
+    _interval_ns(0),
+    _next_sample_ns(0),
+    _samples_count(0),
+    _pools_count(0),
+    _idle_word_index(-1),
+    _idle_word(0),
+    _idle_word_marks(0),
+    _entries(nullptr) {
+        memset(_pools, 0, sizeof(_pools));
+    }
+
+int AccessSampler::Open(const char *path_prefix, uint64_t interval_ns,
+                        const char *pagemap_path, const char *bitmap_path) {
+    void *ptr = GlibcMmap(NULL, ENTRIES_SIZE, MMAP_PROTECTION, MMAP_FLAGS,
+                          -1, 0);
+    if (ptr == MAP_FAILED) {
+        return -1;
+    }
+    _entries = static_cast<uint64_t*>(ptr);
+    _pagemap_fd = open(pagemap_path, O_RDONLY | O_CLOEXEC);
+    if (_pagemap_fd >= 0) {
+        _bitmap_fd = open(bitmap_path, O_RDWR | O_CLOEXEC);
+    }
+    if (_bitmap_fd < 0) {
+        int saved_errno = errno;
+        if (_pagemap_fd >= 0) {
+            close(_pagemap_fd);
+            _pagemap_fd = -1;
+        }
+        GlibcMunmap(_entries, ENTRIES_SIZE);
+        _entries = nullptr;
+        errno = saved_errno;
+        return -1;
+    }
+    _pid = getpid();
+    _path_prefix = path_prefix;
+    _pagemap_path = pagemap_path;
+    _interval_ns = interval_ns;
+    _next_sample_ns.store(GetTimeNs(CLOCK_MONOTONIC) + interval_ns,
+                          std::memory_order_relaxed);
+    return 0;
+}
+
+int AccessSampler::AddPool(const char *name, void *base, size_t capacity) {
+    if (_pools_count == ACCESS_SAMPLER_MAX_POOLS) {
+        THROW_EXCEPTION("too many pools to sample");
+    }
+    Pool &pool = _pools[_pools_count];
+    pool.chunks_count = ROUND_UP(capacity, CHUNK_SIZE) / CHUNK_SIZE;
+    if (pool.chunks_count != 0) {
+        void *ptr = GlibcMmap(NULL, pool.chunks_count * sizeof(Chunk),
+                              MMAP_PROTECTION, MMAP_FLAGS, -1, 0);
+        if (ptr == MAP_FAILED) {
+            return -1;
+        }
+        pool.chunks = static_cast<Chunk*>(ptr);
+    }
+    strncpy(pool.name, name, ACCESS_SAMPLER_MAX_NAME_LENGTH - 1);
+    pool.base = (uint64_t)base;
+    _pools_count++;
+    return 0;
+}
+
+bool AccessSampler::IsDue() {
+    return (_interval_ns != 0 &&
+            GetTimeNs(CLOCK_MONOTONIC_COARSE) >=
+            _next_sample_ns.load(std::memory_order_relaxed));
+}
+
+void AccessSampler::ResetCounters() {
+    _samples_count = 0;
+    for (int i = 0; i < _pools_count; i++) {
+        if (_pools[i].chunks != nullptr) {
+            memset(_pools[i].chunks, 0,
+                   _pools[i].chunks_count * sizeof(Chunk));
+        }
+    }
+}
+
+/*
+ * After fork, the child drops the counters (they belong to its parent) and
+ * reopens the pagemap, which was opened for the address space of the
+ * parent.
+ */
+void AccessSampler::FollowFork() {
+    if (getpid() == _pid) {
+        return;
+    }
+    _pid = getpid();
+    close(_pagemap_fd);
+    _pagemap_fd = open(_pagemap_path, O_RDONLY | O_CLOEXEC);
+    if (_pagemap_fd < 0) {
+        THROW_EXCEPTION("failed to open the pagemap");
+    }
+    ResetCounters();
+}
+
+void AccessSampler::BeginSample() {
+    FollowFork();
+    _next_sample_ns.store(GetTimeNs(CLOCK_MONOTONIC) + _interval_ns,
+                          std::memory_order_relaxed);
+    _samples_count++;
+}
+
+/*
+ * Returns whether the frame @pfn is still idle, and marks it to be set idle
+ * again. The bitmap is read and written in 64-bit words (a bit per frame),
+ * so the frames of a word are marked together; the bits that are written
+ * as 0 are ignored by the kernel.
+ */
+bool AccessSampler::IsIdle(uint64_t pfn) {
+    int64_t word_index = (int64_t)(pfn / 64);
+    if (word_index != _idle_word_index) {
+        FlushIdleWord();
+        off_t offset = (off_t)word_index * sizeof(uint64_t);
+        if (pread(_bitmap_fd, &_idle_word, sizeof(_idle_word), offset) !=
+            sizeof(_idle_word)) {
+            _idle_word = 0;
+        }
+        _idle_word_index = word_index;
+    }
+    uint64_t bit = 1ull << (pfn % 64);
+    _idle_word_marks |= bit;
+    return (_idle_word & bit) != 0;
+}
+
+void AccessSampler::FlushIdleWord() {
+    if (_idle_word_index >= 0 && _idle_word_marks != 0) {
+        off_t offset = (off_t)_idle_word_index * sizeof(uint64_t);
+        if (pwrite(_bitmap_fd, &_idle_word_marks, sizeof(_idle_word_marks),
+                   offset) != sizeof(_idle_word_marks)) {
+            THROW_EXCEPTION("failed to write the idle bitmap");
+        }
+    }
+    _idle_word_index = -1;
+    _idle_word_marks = 0;
+}
+
+/*
+ * Counts the pages of [base, base + @size) of the pool that are backed by
+ * frames which were accessed since they were marked idle, and marks them
+ * idle. The pages that are not present (and the frames that the pagemap
+ * hides from unprivileged processes) are skipped.
+ */
+void AccessSampler::SamplePool(int index, size_t size) {
+    Pool &pool = _pools[index];
+    size_t pages_count = ROUND_UP(size, PAGE_SIZE_4KB) / PAGE_SIZE_4KB;
+    if (pages_count > pool.chunks_count * PAGES_PER_CHUNK) {
+        pages_count = pool.chunks_count * PAGES_PER_CHUNK;
+    }
+    uint64_t first_page = pool.base / PAGE_SIZE_4KB;
+    for (size_t chunk = 0; chunk * PAGES_PER_CHUNK < pages_count; chunk++) {
+        size_t first = chunk * PAGES_PER_CHUNK;
+        size_t count = pages_count - first;
+        if (count > PAGES_PER_CHUNK) {
+            count = PAGES_PER_CHUNK;
+        }
+        off_t offset = (off_t)((first_page + first) * sizeof(uint64_t));
+        ssize_t res = pread(_pagemap_fd, _entries, count * sizeof(uint64_t),
+                            offset);
+        if (res < 0) {
+            break;
+        }
+        count = (size_t)res / sizeof(uint64_t);
+        uint64_t accessed_pages = 0;
+        for (size_t i = 0; i < count; i++) {
+            uint64_t pfn = _entries[i] & PAGEMAP_PFN_MASK;
+            if ((_entries[i] & PAGEMAP_PRESENT) == 0 || pfn == 0) {
+                continue;
+            }
+            if (!IsIdle(pfn)) {
+                accessed_pages++;
+            }
+        }
+        if (accessed_pages != 0) {
+            pool.chunks[chunk].accessed_samples++;
+            pool.chunks[chunk].accessed_pages += accessed_pages;
+        }
+    }
+    FlushIdleWord();
+}
+
+uint64_t AccessSampler::GetAccessedPages(int index, size_t chunk) {
+    return _pools[index].chunks[chunk].accessed_pages;
+}
+
+void AccessSampler::Write() {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s.%d", _path_prefix, (int)_pid);
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        THROW_EXCEPTION("failed to open the access sampling file");
+    }
+    fprintf(file, "pool,offset,samples,accessed-samples,accessed-pages\n");
+    for (int i = 0; i < _pools_count; i++) {
+        for (size_t chunk = 0; chunk < _pools[i].chunks_count; chunk++) {
+            const Chunk &counters = _pools[i].chunks[chunk];
+            if (counters.accessed_samples == 0) {
+                continue;
+            }
+            fprintf(file, "%s,%lu,%lu,%lu,%lu\n", _pools[i].name,
+                    (unsigned long)(chunk * CHUNK_SIZE),
+                    (unsigned long)_samples_count,
+                    (unsigned long)counters.accessed_samples,
+                    (unsigned long)counters.accessed_pages);
+        }
+    }
+    fclose(file);
+}
+
+void AccessSampler::Close() {
+    if (!IsOpen()) {
+        return;
+    }
+    FollowFork();
+    Write();
+    close(_pagemap_fd);
+    _pagemap_fd = -1;
+    close(_bitmap_fd);
+    _bitmap_fd = -1;
+    for (int i = 0; i < _pools_count; i++) {
+        if (_pools[i].chunks != nullptr) {
+            GlibcMunmap(_pools[i].chunks,
+                        _pools[i].chunks_count * sizeof(Chunk));
+            _pools[i].chunks = nullptr;
+        }
+    }
+    _pools_count = 0;
+    GlibcMunmap(_entries, ENTRIES_SIZE);
+    _entries = nullptr;
+}
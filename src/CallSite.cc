@@ -0,0 +1,92 @@
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "CallSite.h"
+
+extern void *__libc_stack_end;
+
+// initial-exec TLS is accessed without calling __tls_get_addr, which may
+// allocate memory (and hence recurse into the hooks)
+static __thread void *t_stack_top __attribute__((tls_model("initial-exec")));
+
+/*
+ * Returns the top of the stack of the calling thread, or nullptr if it is
+ * unknown. This is called from the hooks, so it must not allocate memory
+ * (pthread_getattr_np does, for the affinity of the thread).
+ */
+static void *GetStackTop() {
+    if (t_stack_top != nullptr) {
+        return t_stack_top;
+    }
+    if (getpid() == syscall(SYS_gettid)) {
+        // all the frames of the main thread are below the initial stack
+        // pointer
+        t_stack_top = __libc_stack_end;
+        return t_stack_top;
+    }
+    // glibc places the descriptor of a thread (which pthread_self points to)
+    // at the top of its stack, above all of its frames. Otherwise (e.g., for
+    // threads that were not created by pthread_create), the top stays
+    // unknown and only the caller of the hook is collected.
+    void *descriptor = (void *)pthread_self();
+    if (descriptor > __builtin_frame_address(0)) {
+        t_stack_top = descriptor;
+    }
+    return t_stack_top;
+}
+
+int CaptureCallSite(void *frame, void **frames, int max_depth) {
+    void *stack_top = GetStackTop();
+    void **fp = (void **)frame;
+    int depth = 0;
+    while (depth < max_depth) {
+        // the return address is stored right above the saved frame pointer
+        frames[depth++] = fp[1];
+        void **next_fp = (void **)fp[0];
+        if (stack_top == nullptr || next_fp <= fp ||
+            (void *)(next_fp + 2) > stack_top ||
+            ((size_t)next_fp % sizeof(void *)) != 0) {
+            break;
+        }
+        fp = next_fp;
+    }
+    return depth;
+}
+
+/*
+ * FNV-1a hash of the return addresses.
+ */
+uint64_t HashCallSite(void *const *frames, int depth) {
+    uint64_t hash = 14695981039346656037ull;
+    for (int i = 0; i < depth; i++) {
+        uint64_t address = (uint64_t)(size_t)frames[i];
+        for (int j = 0; j < 8; j++) {
+            hash ^= (address >> (8 * j)) & 0xff;
+            hash *= 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+CallSiteCache::CallSiteCache() {
+    for (int i = 0; i < CALL_SITE_CACHE_SIZE; i++) {
+        _entries[i].is_valid = false;
+    }
+}
+
+bool CallSiteCache::Lookup(uint64_t hash, uint64_t *rules_mask) const {
+    const Entry& entry = _entries[hash % CALL_SITE_CACHE_SIZE];
+    if (!entry.is_valid || entry.hash != hash) {
+        return false;
+    }
+    *rules_mask = entry.rules_mask;
+    return true;
+}
+
+void CallSiteCache::Insert(uint64_t hash, uint64_t rules_mask) {
+    Entry& entry = _entries[hash % CALL_SITE_CACHE_SIZE];
+    entry.hash = hash;
+    entry.rules_mask = rules_mask;
+    entry.is_valid = true;
+}
@@ -11,6 +11,7 @@
 #include <fstream>
 
 #include "FirstFitAllocator.h"
+#include "LatencyHistograms.h"
 
 // TODO: add the following features: 
 // 1) defragmentation of memory region list
@@ -30,6 +31,9 @@
         fflush(_log_file);      \
 }}
 
+// the nodes that ReplaceAt may take
+#define REPLACE_NODES_COUNT (4)
+
 #define RUN_VALIDATION() {              \
     if (_enable_validation) {           \
         assert(IsValidDataStructure()); \
@@ -189,6 +193,7 @@ int FirstFitAllocator::MoveNodeFromFeeListToOccupied(int free_node, int prev_fre
 }
 
 void *FirstFitAllocator::Allocate(size_t size) {
+    LATENCY_COMPONENT_SCOPE(FFA);
     MUTEX_GUARD(_ffa_mutex);
    
     TRACE("Allocate - size: %lu --> ", size); 
@@ -348,6 +353,7 @@ int FirstFitAllocator::FreeOccupiedRegionNode(int node) {
 }
 
 int FirstFitAllocator::Free(void *start, size_t size) {
+    LATENCY_COMPONENT_SCOPE(FFA);
     MUTEX_GUARD(_ffa_mutex);
    
     int res = -100;
@@ -381,6 +387,284 @@ int FirstFitAllocator::Free(void *start, size_t size) {
     return res;
 }
 
+void FirstFitAllocator::RemoveFreeNode(int node, int prev_node) {
+    assert(_is_initialized == true);
+    if (prev_node == -1) {
+        _free_head = _array[node].next;
+    } else {
+        _array[prev_node].next = _array[node].next;
+    }
+    _array[node].start = _array[node].end = NULL;
+    _array[node].next = -1;
+}
+
+int FirstFitAllocator::ExtendOccupiedRegionNode(int node, size_t size) {
+    assert(_is_initialized == true);
+    // find the free region that starts exactly where the occupied one ends
+    int i = -1, prev_i = -1;
+    for (i = _free_head;
+         i >= 0;
+         prev_i = i, i = _array[i].next) {
+        if (_array[i].start >= _array[node].end) {
+            break;
+        }
+    }
+    if (i == -1 || _array[i].start != _array[node].end) {
+        return -1;
+    }
+    size_t slot_size = (size_t) (PTR_SUB(_array[i].end, _array[i].start));
+    if (slot_size < size) {
+        return -1;
+    }
+    _array[node].end = PTR_ADD(_array[node].end, size);
+    if (slot_size == size) {
+        RemoveFreeNode(i, prev_i);
+    } else {
+        _array[i].start = PTR_ADD(_array[i].start, size);
+    }
+    return 0;
+}
+
+int FirstFitAllocator::ShrinkOccupiedRegionNode(int node, size_t size) {
+    assert(_is_initialized == true);
+    void *freed_start = PTR_SUB(_array[node].end, size);
+    _array[node].end = freed_start;
+    int res = AddFreedRegionToFreeList(freed_start, size);
+    if (res < 0) {
+        // there is no room in the list for the freed tail, so keep it
+        _array[node].end = PTR_ADD(freed_start, size);
+    }
+    return res;
+}
+
+int FirstFitAllocator::ResizeInPlace(void *start, size_t old_size,
+                                     size_t new_size) {
+    LATENCY_COMPONENT_SCOPE(FFA);
+    MUTEX_GUARD(_ffa_mutex);
+
+    TRACE("ResizeInPlace - start: %p , old_size: %lu , new_size: %lu\n",
+          start, old_size, new_size);
+
+    assert(_is_initialized == true);
+    if (old_size == 0 || new_size == 0) {
+        return -1;
+    }
+    int node = FindOccupiedMemoryRegionNode(start);
+    if (node < 0) {
+        return node;
+    }
+    // only the tail of an occupied region can be resized in place
+    if (PTR_ADD(start, old_size) != _array[node].end) {
+        return -2;
+    }
+    int res = 0;
+    if (new_size > old_size) {
+        res = ExtendOccupiedRegionNode(node, new_size - old_size);
+    } else if (new_size < old_size) {
+        res = ShrinkOccupiedRegionNode(node, old_size - new_size);
+    }
+    RUN_VALIDATION();
+    return res;
+}
+
+int FirstFitAllocator::AllocateFromFreeRegionNode(int node, int prev_node,
+                                                  void *start, size_t size) {
+    assert(_is_initialized == true);
+    void *end = PTR_ADD(start, size);
+    void *node_start = _array[node].start;
+    void *node_end = _array[node].end;
+    if (start == node_start && end == node_end) {
+        return MoveNodeFromFeeListToOccupied(node, prev_node);
+    }
+    if (start == node_start || end == node_end) {
+        int occupied = AllocateMemoryRegionNode(-1, start, size);
+        if (occupied < 0) {
+            return occupied;
+        }
+        if (start == node_start) {
+            _array[node].start = end;
+        } else {
+            _array[node].end = start;
+        }
+        return occupied;
+    }
+    // the allocated region splits the free region into two, so reserve
+    // a node for the tail before the occupied node is taken
+    int tail = FindFreeNode();
+    if (tail < 0) {
+        return tail;
+    }
+    _array[tail].start = end;
+    int occupied = AllocateMemoryRegionNode(-1, start, size);
+    if (occupied < 0) {
+        _array[tail].start = NULL;
+        return occupied;
+    }
+    _array[tail].end = node_end;
+    _array[tail].next = _array[node].next;
+    _array[node].next = tail;
+    _array[node].end = start;
+    return occupied;
+}
+
+void *FirstFitAllocator::AllocateAt(void *start, size_t size) {
+    LATENCY_COMPONENT_SCOPE(FFA);
+    MUTEX_GUARD(_ffa_mutex);
+
+    TRACE("AllocateAt - start: %p , size: %lu\n", start, size);
+
+    assert(_is_initialized == true);
+    void *res = AllocateFreeRange(start, size);
+    RUN_VALIDATION();
+    return res;
+}
+
+void *FirstFitAllocator::AllocateFreeRange(void *start, size_t size) {
+    if (size == 0 || start < _start || PTR_ADD(start, size) > _end) {
+        return NULL;
+    }
+    // find the free region that contains the requested one
+    int i = -1, prev_i = -1;
+    for (i = _free_head;
+         i >= 0;
+         prev_i = i, i = _array[i].next) {
+        if (_array[i].start > start) {
+            i = -1;
+            break;
+        }
+        if (PTR_ADD(start, size) <= _array[i].end) {
+            break;
+        }
+    }
+    if (i >= 0 &&
+        AllocateFromFreeRegionNode(i, prev_i, start, size) >= 0) {
+        return start;
+    }
+    return NULL;
+}
+
+void *FirstFitAllocator::AllocateInRange(size_t size, void *range_start,
+                                         void *range_end) {
+    LATENCY_COMPONENT_SCOPE(FFA);
+    MUTEX_GUARD(_ffa_mutex);
+
+    TRACE("AllocateInRange - size: %lu , range: [%p, %p) --> ", size,
+          range_start, range_end);
+
+    assert(_is_initialized == true);
+    if (size == 0) {
+        return NULL;
+    }
+    void *res = NULL;
+    int prev_i = -1;
+    for (int i = _free_head;
+         i >= 0 && _array[i].start < range_end;
+         prev_i = i, i = _array[i].next) {
+        void *start = (_array[i].start > range_start) ?
+            _array[i].start : range_start;
+        void *end = (_array[i].end < range_end) ? _array[i].end : range_end;
+        if (start < end && (size_t)PTR_SUB(end, start) >= size) {
+            if (AllocateFromFreeRegionNode(i, prev_i, start, size) >= 0) {
+                res = start;
+            }
+            break;
+        }
+    }
+    TRACE("%p\n", res);
+    RUN_VALIDATION();
+    return res;
+}
+
+int FirstFitAllocator::FreeRange(void *start, size_t size) {
+    LATENCY_COMPONENT_SCOPE(FFA);
+    MUTEX_GUARD(_ffa_mutex);
+
+    TRACE("FreeRange - start: %p , size: %lu\n", start, size);
+
+    assert(_is_initialized == true);
+    int res = FreeOccupiedRange(start, size);
+    RUN_VALIDATION();
+    return res;
+}
+
+int FirstFitAllocator::FreeOccupiedRange(void *start, size_t size) {
+    void *end = PTR_ADD(start, size);
+    int res = 0;
+    int i = _occupied_head, prev_i = -1;
+    while (i >= 0 && _array[i].start < end) {
+        int next = _array[i].next;
+        void *node_start = _array[i].start;
+        void *node_end = _array[i].end;
+        if (node_end <= start) {
+            prev_i = i;
+            i = next;
+            continue;
+        }
+        void *freed_start = (node_start > start) ? node_start : start;
+        void *freed_end = (node_end < end) ? node_end : end;
+        if (freed_start == node_start && freed_end == node_end) {
+            // the whole region is freed (prev_i is kept)
+            if (prev_i == -1) {
+                _occupied_head = next;
+            } else {
+                _array[prev_i].next = next;
+            }
+            _array[i].start = _array[i].end = NULL;
+            _array[i].next = -1;
+        } else if (freed_start == node_start) {
+            _array[i].start = freed_end;
+            prev_i = i;
+        } else if (freed_end == node_end) {
+            _array[i].end = freed_start;
+            prev_i = i;
+        } else {
+            // the freed range is in the middle of the region, so split it
+            int tail = AllocateMemoryRegionNode(-1, freed_end,
+                                                (size_t)PTR_SUB(node_end, freed_end));
+            if (tail < 0) {
+                res = tail;
+                break;
+            }
+            _array[i].end = freed_start;
+            prev_i = i;
+            next = tail;
+        }
+        if (AddFreedRegionToFreeList(freed_start,
+                    (size_t)PTR_SUB(freed_end, freed_start)) < 0) {
+            res = -1;
+        }
+        i = next;
+    }
+    return res;
+}
+
+/*
+ * Freeing the range takes at most two nodes (to split a region that
+ * contains it, or to trim the regions at its ends and add the freed parts),
+ * and allocating it inside a free region takes at most two more, so the
+ * range is replaced only if four nodes are left.
+ */
+void *FirstFitAllocator::ReplaceAt(void *start, size_t size) {
+    LATENCY_COMPONENT_SCOPE(FFA);
+    MUTEX_GUARD(_ffa_mutex);
+
+    TRACE("ReplaceAt - start: %p , size: %lu\n", start, size);
+
+    assert(_is_initialized == true);
+    if (size == 0 || start < _start || PTR_ADD(start, size) > _end) {
+        return NULL;
+    }
+    if (_len - CountUsedNodes() < REPLACE_NODES_COUNT) {
+        return NULL;
+    }
+    void *res = NULL;
+    if (FreeOccupiedRange(start, size) == 0) {
+        res = AllocateFreeRange(start, size);
+    }
+    RUN_VALIDATION();
+    return res;
+}
+
 FirstFitAllocator::FirstFitAllocator(bool enable_validation, 
                                      bool enable_tracing) 
     : _is_initialized(false), 
@@ -403,12 +687,16 @@ FirstFitAllocator::FirstFitAllocator(bool enable_validation,
 }
 
 FirstFitAllocator::~FirstFitAllocator() {
-    _is_initialized = false;
-    
     if (_enable_tracing && _log_file) {
         fclose(_log_file);
     }
 
+    // optional pools (e.g., the stack pool) may never be initialized
+    if (!_is_initialized) {
+        return;
+    }
+    _is_initialized = false;
+
     size_t aligned_array_size = _len * sizeof(MC);
     aligned_array_size = (4096 - (aligned_array_size % 4096))
                          + aligned_array_size;
@@ -430,7 +718,27 @@ size_t FirstFitAllocator::GetFreeSpace() {
     return sum;
 }
 
+unsigned int FirstFitAllocator::GetUsedNodes() {
+    MUTEX_GUARD(_ffa_mutex);
+
+    assert(_is_initialized == true);
+    return CountUsedNodes();
+}
+
+unsigned int FirstFitAllocator::CountUsedNodes() {
+    unsigned int count = 0;
+    for (int i = _occupied_head; i >= 0; i = _array[i].next) {
+        count++;
+    }
+    for (int i = _free_head; i >= 0; i = _array[i].next) {
+        count++;
+    }
+    return count;
+}
+
 void *FirstFitAllocator::GetTopAddress() {
+    // the top is found by walking the list, so it is a part of the search
+    LATENCY_COMPONENT_SCOPE(FFA);
     MUTEX_GUARD(_ffa_mutex);
     
     assert(_is_initialized == true);
@@ -445,11 +753,31 @@ void *FirstFitAllocator::GetTopAddress() {
     return top_addr;
 }
 
+void FirstFitAllocator::ForEachOccupied(FfaRangeVisitor visitor, void *arg) {
+    MUTEX_GUARD(_ffa_mutex);
+
+    assert(_is_initialized == true);
+    for (int i = _occupied_head; i >= 0; i = _array[i].next) {
+        visitor(_array[i].start, _array[i].end, arg);
+    }
+}
+
 bool FirstFitAllocator::Contains(void *addr) {
     assert(_is_initialized == true);
     return (addr >= _start && addr < _end);
 }
 
+size_t FirstFitAllocator::GetOccupiedSize(void *start) {
+    MUTEX_GUARD(_ffa_mutex);
+
+    assert(_is_initialized == true);
+    int node = FindOccupiedMemoryRegionNode(start);
+    if (node < 0 || _array[node].start != start) {
+        return 0;
+    }
+    return (size_t)(PTR_SUB(_array[node].end, start));
+}
+
 bool FirstFitAllocator::IsAddressAllocated(void *addr) {
     MUTEX_GUARD(_ffa_mutex);
     
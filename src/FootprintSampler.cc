@@ -0,0 +1,146 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "globals.h"
+#include "GlibcAllocationFunctions.h"
+#include "FootprintSampler.h"
+
+static uint64_t GetTimeNs(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+FootprintSampler::FootprintSampler() :
+    _fd(-1),
+    _pid(0),
+    _path_prefix(nullptr),
+    _is_header_written(false),
+    _start_ns(0),
+    _operations(0),
+    _buffer(nullptr),
+    _buffer_used(0) {
+        memset(&_header, 0, sizeof(_header));
+    }
+
+int FootprintSampler::OpenFile() {
+    char path[PATH_MAX];
+    _pid = getpid();
+    snprintf(path, sizeof(path), "%s.%d", _path_prefix, (int)_pid);
+    _fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (_fd < 0) {
+        return -1;
+    }
+    _header.pid = _pid;
+    _is_header_written = false;
+    _start_ns = GetTimeNs(CLOCK_MONOTONIC);
+    _buffer_used = 0;
+    return 0;
+}
+
+int FootprintSampler::Open(const char *path_prefix, uint64_t interval_ns,
+                           uint64_t operations) {
+    void *ptr = GlibcMmap(NULL, FOOTPRINT_SAMPLER_BUFFER_SIZE,
+                          MMAP_PROTECTION, MMAP_FLAGS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return -1;
+    }
+    _buffer = static_cast<char*>(ptr);
+    _path_prefix = path_prefix;
+    _header.magic = MOSALLOC_FOOTPRINT_MAGIC;
+    _header.version = MOSALLOC_FOOTPRINT_VERSION;
+    _header.interval_ns = interval_ns;
+    _header.operations = operations;
+    if (OpenFile() != 0) {
+        GlibcMunmap(_buffer, FOOTPRINT_SAMPLER_BUFFER_SIZE);
+        _buffer = nullptr;
+        return -1;
+    }
+    return 0;
+}
+
+void FootprintSampler::AddPool(const char *name, void *base) {
+    if (_header.pools_count == MOSALLOC_FOOTPRINT_MAX_POOLS) {
+        THROW_EXCEPTION("too many pools to sample");
+    }
+    strncpy(_header.names[_header.pools_count], name,
+            MOSALLOC_FOOTPRINT_MAX_NAME_LENGTH - 1);
+    _header.bases[_header.pools_count] = (uint64_t)base;
+    _header.pools_count++;
+}
+
+bool FootprintSampler::CountOperation() {
+    uint64_t operations = _operations.fetch_add(1, std::memory_order_relaxed)
+                          + 1;
+    return (_header.operations != 0 && operations % _header.operations == 0);
+}
+
+/*
+ * After fork, the child drops the buffered samples (they belong to its
+ * parent) and starts a file of its own.
+ */
+void FootprintSampler::FollowFork() {
+    if (getpid() == _pid) {
+        return;
+    }
+    close(_fd);
+    if (OpenFile() != 0) {
+        THROW_EXCEPTION("failed to open the sampling file");
+    }
+}
+
+void FootprintSampler::Write(const struct mosalloc_footprint_pool *pools) {
+    FollowFork();
+    uint64_t now_ns = GetTimeNs(CLOCK_MONOTONIC);
+    struct mosalloc_footprint_record record;
+    record.time_ns = now_ns - _start_ns;
+    record.operations = _operations.load(std::memory_order_relaxed);
+    Append(&record, sizeof(record));
+    Append(pools, _header.pools_count * sizeof(*pools));
+}
+
+void FootprintSampler::Append(const void *data, size_t length) {
+    if (_buffer_used + length > FOOTPRINT_SAMPLER_BUFFER_SIZE) {
+        Flush();
+    }
+    memcpy(_buffer + _buffer_used, data, length);
+    _buffer_used += length;
+}
+
+void FootprintSampler::Flush() {
+    if (!_is_header_written) {
+        if (write(_fd, &_header, sizeof(_header)) != sizeof(_header)) {
+            THROW_EXCEPTION("failed to write the sampling file");
+        }
+        _is_header_written = true;
+    }
+    size_t written = 0;
+    while (written < _buffer_used) {
+        ssize_t res = write(_fd, _buffer + written, _buffer_used - written);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res <= 0) {
+            THROW_EXCEPTION("failed to write the sampling file");
+        }
+        written += res;
+    }
+    _buffer_used = 0;
+}
+
+void FootprintSampler::Close() {
+    if (_fd < 0) {
+        return;
+    }
+    FollowFork();
+    Flush();
+    close(_fd);
+    _fd = -1;
+    GlibcMunmap(_buffer, FOOTPRINT_SAMPLER_BUFFER_SIZE);
+    _buffer = nullptr;
+}
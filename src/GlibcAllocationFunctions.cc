@@ -11,6 +11,7 @@
 
 #include "GlibcAllocationFunctions.h"
 #include "globals.h"
+#include "LatencyHistograms.h"
 
 #define ASSERT_TRUE(exp) { \
     if (!(exp)) { \
@@ -49,6 +50,14 @@ GlibcAllocationFunctions::GlibcAllocationFunctions() {
             void *, size_t)>(dlsym(RTLD_NEXT, "munmap"));
     ASSERT_TRUE(NULL != _real_munmap);
 
+    _real_mremap = reinterpret_cast<void *(*)(
+            void *, size_t, size_t, int, ...)>(dlsym(RTLD_NEXT, "mremap"));
+    ASSERT_TRUE(NULL != _real_mremap);
+
+    _real_madvise = reinterpret_cast<int (*)(
+            void *, size_t, int)>(dlsym(RTLD_NEXT, "madvise"));
+    ASSERT_TRUE(NULL != _real_madvise);
+
     _real_brk = reinterpret_cast<int(*)(void*)>(
             dlsym(RTLD_NEXT, "brk"));
     ASSERT_TRUE(NULL != _real_brk);
@@ -76,6 +85,7 @@ void GlibcAllocationFunctions::CallGlibcFree(void* ptr) {
 int GlibcAllocationFunctions::CallGlibcMprotect(void *addr,
         size_t length,
         int prot) {
+    LATENCY_COMPONENT_SCOPE(SYSCALL);
     return _real_mprotect(addr, length, prot);
 }
 
@@ -85,19 +95,65 @@ void * GlibcAllocationFunctions::CallGlibcMmap(void *addr,
         int flags,
         int fd,
         off_t offset) {
+    LATENCY_COMPONENT_SCOPE(SYSCALL);
     return _real_mmap(addr, length, prot, flags, fd, offset);
 }
 
 int GlibcAllocationFunctions::CallGlibcMunmap(void *addr, size_t length) {
+    LATENCY_COMPONENT_SCOPE(SYSCALL);
     return _real_munmap(addr, length);
 }
 
+void* GlibcAllocationFunctions::CallGlibcMremap(void *old_address,
+        size_t old_size,
+        size_t new_size,
+        int flags,
+        void *new_address) {
+    LATENCY_COMPONENT_SCOPE(SYSCALL);
+    return _real_mremap(old_address, old_size, new_size, flags, new_address);
+}
+
+int GlibcAllocationFunctions::CallGlibcMadvise(void *addr,
+        size_t length,
+        int advice) {
+    LATENCY_COMPONENT_SCOPE(SYSCALL);
+    return _real_madvise(addr, length, advice);
+}
+
 int GlibcAllocationFunctions::CallGlibcBrk(void* addr) {
+    LATENCY_COMPONENT_SCOPE(SYSCALL);
     return _real_brk(addr);
 }
 
 void* GlibcAllocationFunctions::CallGlibcSbrk(intptr_t increment) {
+    LATENCY_COMPONENT_SCOPE(SYSCALL);
     return _real_sbrk(increment);
 }
 
+void* GlibcMmap(void *addr, size_t length, int prot, int flags,
+                int fd, off_t offset) {
+    static GlibcAllocationFunctions glibc_funcs;
+    return glibc_funcs.CallGlibcMmap(addr, length, prot, flags, fd, offset);
+}
+
+int GlibcMunmap(void *addr, size_t length) {
+    static GlibcAllocationFunctions glibc_funcs;
+    return glibc_funcs.CallGlibcMunmap(addr, length);
+}
+
+int GlibcMprotect(void *addr, size_t len, int prot) {
+    static GlibcAllocationFunctions glibc_funcs;
+    return glibc_funcs.CallGlibcMprotect(addr, len, prot);
+}
+
+int GlibcMadvise(void *addr, size_t length, int advice) {
+    static GlibcAllocationFunctions glibc_funcs;
+    return glibc_funcs.CallGlibcMadvise(addr, length, advice);
+}
 
+void* GlibcMremap(void *old_address, size_t old_size, size_t new_size,
+                  int flags, void *new_address) {
+    static GlibcAllocationFunctions glibc_funcs;
+    return glibc_funcs.CallGlibcMremap(old_address, old_size, new_size,
+                                       flags, new_address);
+}
@@ -6,6 +6,21 @@
 #include <functional> // fot std::bind
 
 #include "HugePageBackedRegion.h"
+#include "HugePagesAvailability.h"
+#include "LatencyHistograms.h"
+
+#define RANGE_SET_CAPACITY (4096)
+// the room for the intervals that are added by migrations
+#define MIGRATED_INTERVALS_CAPACITY (1024)
+#define TOUCHED_CHUNK_SIZE (static_cast<size_t>(PageSize::HUGE_2MB))
+#define VERIFIED_CHUNK_SIZE (static_cast<size_t>(PageSize::HUGE_2MB))
+// the 4KB pages that are checked by each mincore call
+#define MINCORE_BATCH_PAGES (4096)
+
+static void *KernelMremap(void *old_address, size_t old_size,
+                          size_t new_size, int flags, void *new_address) {
+    return mremap(old_address, old_size, new_size, flags, new_address);
+}
 
 
 void* HugePageBackedRegion::RegionIntervalListMemAlloc(size_t s) {
@@ -22,7 +37,8 @@ int HugePageBackedRegion::RegionIntervalListMemDealloc(void* addr, size_t s) {
 
 void *HugePageBackedRegion::AllocateMemory(void *start_address,
                                            size_t len,
-                                           PageSize page_size) {
+                                           PageSize page_size,
+                                           bool is_failure_allowed) {
     if (len == 0) {
         return start_address;
     }
@@ -36,14 +52,96 @@ void *HugePageBackedRegion::AllocateMemory(void *start_address,
         mmap_flags |= MAP_HUGETLB | MAP_HUGE_2MB;
     }
     void *ptr = _memory_allocator(start_address, len, MMAP_PROTECTION, mmap_flags, -1, 0);
+    if (ptr == MAP_FAILED && is_failure_allowed) {
+        return MAP_FAILED;
+    }
     if (ptr == MAP_FAILED) {
         std::error_code ec(errno, std::generic_category());
         THROW_EXCEPTION("failed to allocate memory by mmap");
     }
+    if (_verified_chunks != nullptr) {
+        off_t start_offset = (off_t) ((size_t) ptr - (size_t) _region_start);
+        InvalidateVerifiedChunks(start_offset, start_offset + (off_t) len);
+    }
 
     return ptr;
 }
 
+void HugePageBackedRegion::AllocatePlaceholder(void *start_address,
+                                               size_t len) {
+    if (len == 0) {
+        return;
+    }
+    void *ptr = _memory_allocator(start_address, len, PROT_NONE,
+                                  MMAP_FLAGS | MAP_FIXED | MAP_NORESERVE,
+                                  -1, 0);
+    if (ptr == MAP_FAILED) {
+        THROW_EXCEPTION("failed to map placeholder memory by mmap");
+    }
+}
+
+/*
+ * Calls @func(start, end) for each sub-range of [start_offset, end_offset)
+ * that is not decommitted
+ */
+template <typename Func>
+void HugePageBackedRegion::ForEachCommittedRange(off_t start_offset,
+                                                 off_t end_offset,
+                                                 Func func) {
+    off_t offset = start_offset;
+    for (size_t i = 0; i < _uncommitted_ranges.GetLength(); i++) {
+        OffsetRange& range = _uncommitted_ranges.At(i);
+        if (range._start_offset >= end_offset) {
+            break;
+        }
+        if (range._end_offset <= offset) {
+            continue;
+        }
+        if (range._start_offset > offset) {
+            func(offset, range._start_offset);
+        }
+        offset = range._end_offset;
+    }
+    if (offset < end_offset) {
+        func(offset, end_offset);
+    }
+}
+
+/*
+ * Maps fresh pages in [start_offset, end_offset) according to the page sizes
+ * of the intervals, up to the region top. Unless the fallback policy is
+ * ABORT, the huge pages are checked to be available first. The pages below
+ * the top cannot be degraded in place, so if they cannot be mapped, the
+ * range is backed with placeholders again and -1 is returned.
+ */
+int HugePageBackedRegion::MapRange(off_t start_offset, off_t end_offset) {
+    end_offset = std::min(end_offset, (off_t) _region_current_size);
+    size_t intervals_length = _region_intervals.GetLength();
+    for (unsigned int i=0; i<intervals_length; i++) {
+        MemoryInterval& interval = _region_intervals.At(i);
+        off_t start = std::max(interval._start_offset, start_offset);
+        off_t end = std::min(interval._end_offset, end_offset);
+        if (start >= end) {
+            continue;
+        }
+        size_t len = end - start;
+        bool is_checked = (_fallback_policy != HugePagesFallback::ABORT &&
+                           interval._page_size != PageSize::BASE_4KB);
+        if ((is_checked &&
+             HugePagesAvailability::GetAvailableSize(interval._page_size) <
+             len) ||
+            AllocateMemory((void *) ((size_t) _region_start + start), len,
+                           interval._page_size, true) == MAP_FAILED) {
+            AllocatePlaceholder((void *) ((size_t) _region_start +
+                                          start_offset),
+                                end_offset - start_offset);
+            _fallback_counters.failures++;
+            return -1;
+        }
+    }
+    return 0;
+}
+
 void HugePageBackedRegion::DeallocateMemory(void *addr, size_t len) {
     if (len == 0) {
         return;
@@ -55,10 +153,90 @@ void HugePageBackedRegion::DeallocateMemory(void *addr, size_t len) {
     }
 }
 
+/*
+ * Maps the pages of [start_offset, end_offset) with @page_size (decommitted
+ * ranges are backed with placeholders). Unless the fallback policy is ABORT,
+ * the huge pages are checked to be available first, and a failure unmaps
+ * the range and returns -1 instead of exiting.
+ */
+int HugePageBackedRegion::MapExtension(off_t start_offset, off_t end_offset,
+                                       PageSize page_size) {
+    void *start_address = (void *) ((size_t) _region_start + start_offset);
+    size_t len = end_offset - start_offset;
+    bool is_failure_allowed = (_fallback_policy != HugePagesFallback::ABORT &&
+                               page_size != PageSize::BASE_4KB);
+    if (is_failure_allowed &&
+        HugePagesAvailability::GetAvailableSize(page_size) < len) {
+        return -1;
+    }
+    if (!_uncommitted_ranges.Intersects(start_offset, end_offset)) {
+        if (AllocateMemory(start_address, len, page_size,
+                           is_failure_allowed) == MAP_FAILED) {
+            return -1;
+        }
+        return 0;
+    }
+    AllocatePlaceholder(start_address, len);
+    bool is_failed = false;
+    ForEachCommittedRange(start_offset, end_offset,
+                          [&](off_t start, off_t end) {
+        if (!is_failed &&
+            AllocateMemory((void *) ((size_t) _region_start + start),
+                           end - start, page_size,
+                           is_failure_allowed) == MAP_FAILED) {
+            is_failed = true;
+        }
+    });
+    if (is_failed) {
+        DeallocateMemory(start_address, len);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Backs [start_offset, end_offset) of an interval of @page_size, which is
+ * above the top, with the next smaller page size. Returns false if the
+ * intervals have no room for the split.
+ */
+bool HugePageBackedRegion::DegradeInterval(off_t start_offset,
+                                           off_t end_offset,
+                                           PageSize page_size) {
+    if (_region_intervals.GetCapacity() - _region_intervals.GetLength() < 2) {
+        return false;
+    }
+    PageSize smaller_page_size = (page_size == PageSize::HUGE_1GB) ?
+        PageSize::HUGE_2MB : PageSize::BASE_4KB;
+    BeginIntervalsChange();
+    _region_intervals.ReplaceRange(start_offset, end_offset,
+                                   smaller_page_size);
+    _interval_index.Update();
+    EndIntervalsChange();
+    size_t size = end_offset - start_offset;
+    _fallback_counters.downgrades++;
+    if (page_size == PageSize::HUGE_1GB) {
+        _fallback_counters.downgraded_1gb_size += size;
+    } else {
+        _fallback_counters.downgraded_2mb_size += size;
+    }
+    char message[160];
+    int length = snprintf(message, sizeof(message),
+                          "mosalloc: out of %luKB huge pages, backing "
+                          "[%p, %p) with %luKB pages\n",
+                          (unsigned long) page_size / 1024,
+                          (void *) ((size_t) _region_start + start_offset),
+                          (void *) ((size_t) _region_start + end_offset),
+                          (unsigned long) smaller_page_size / 1024);
+    if (write(STDERR_FILENO, message, length) < 0) {
+        // the report is best effort
+    }
+    return true;
+}
+
 size_t HugePageBackedRegion::ExtendRegion(size_t new_size) {
     size_t updated_region_size = _region_current_size;
-    size_t intervals_length = _region_intervals.GetLength();
-    for (unsigned int i=0; i<intervals_length; i++) {
+    // the intervals may be degraded on the way, so their length is re-read
+    for (unsigned int i=0; i<_region_intervals.GetLength(); i++) {
         MemoryInterval& interval = _region_intervals.At(i);
         // check if current interval should be extended
         if ((_region_current_size >= (size_t) interval._start_offset
@@ -81,9 +259,19 @@ size_t HugePageBackedRegion::ExtendRegion(size_t new_size) {
             } else {
                 end_offset = interval._end_offset;
             }
-            AllocateMemory((void *) ((size_t) _region_start + start_offset),
-                           end_offset - start_offset,
-                           interval._page_size);
+            PageSize page_size = interval._page_size;
+            if (MapExtension(start_offset, end_offset, page_size) != 0) {
+                if (_fallback_policy == HugePagesFallback::FAIL ||
+                    !DegradeInterval(start_offset, interval._end_offset,
+                                     page_size)) {
+                    _fallback_counters.failures++;
+                    break;
+                }
+                // extend the degraded intervals from the current top
+                _region_current_size = updated_region_size;
+                i = (unsigned int) -1;
+                continue;
+            }
             updated_region_size = (size_t) end_offset;
         }
     }
@@ -117,6 +305,7 @@ size_t HugePageBackedRegion::ShrinkRegion(size_t new_size) {
             } else {
                 start_offset = interval._start_offset;
             }
+            RecordTouchedChunks(start_offset, end_offset);
             DeallocateMemory((void *) ((size_t) _region_start + start_offset),
                              end_offset - start_offset);
             if (start_offset < (off_t) updated_region_size) {
@@ -127,21 +316,38 @@ size_t HugePageBackedRegion::ShrinkRegion(size_t new_size) {
     return updated_region_size;
 }
 
-HugePageBackedRegion::HugePageBackedRegion() : _initialized(false) {}
+HugePageBackedRegion::HugePageBackedRegion() :
+    _intervals_generation(0),
+    _initialized(false),
+    _fallback_policy(HugePagesFallback::ABORT) {}
 
 void HugePageBackedRegion::Initialize(size_t region_size,
                                       MemoryIntervalList& intervalList,
                                       MmapFuncPtr allocator,
                                       MunmapFuncPtr deallocator,
-                                      void* region_base) {
+                                      void* region_base,
+                                      MprotectFuncPtr protector,
+                                      MadviseFuncPtr advisor,
+                                      MremapFuncPtr remapper) {
     _region_start = nullptr;
     _region_max_size = region_size;
     _region_current_size = 0;
     _memory_allocator = allocator;
     _memory_deallocator = deallocator;
+    _memory_protector = protector;
+    _memory_advisor = advisor;
+    _memory_remapper = (remapper != nullptr) ? remapper : KernelMremap;
+    _touched_chunks = nullptr;
+    _touched_chunks_count = 0;
+    _verified_chunks = nullptr;
+    _verified_chunks_count = 0;
+    memset(&_fallback_counters, 0, sizeof(_fallback_counters));
 
     size_t max_size = (2 * intervalList.GetLength()) + 1; //In worst case there will be 4KB area between each interval
+    max_size += MIGRATED_INTERVALS_CAPACITY;
     _region_intervals.Initialize(allocator, deallocator, max_size);
+    _protected_ranges.Initialize(allocator, deallocator, RANGE_SET_CAPACITY);
+    _uncommitted_ranges.Initialize(allocator, deallocator, RANGE_SET_CAPACITY);
 
     _initialized = true;
     
@@ -227,9 +433,19 @@ void HugePageBackedRegion::Initialize(size_t region_size,
     _region_current_size = 0;
 
     //Reallocate region with exact pages sizes (call Resize(size))
-    Resize(_region_max_size);
-    _region_max_size = _region_current_size;
+    // (under the fail policy, the huge pages that are missing now may be
+    // available when the region is extended again, so keep its size, and
+    // reserve the rest of it so the next regions are not placed inside it)
+    if (Resize(_region_max_size) == 0) {
+        _region_max_size = _region_current_size;
+    } else {
+        AllocatePlaceholder((void *) ((size_t) _region_start +
+                                      _region_current_size),
+                            _region_max_size - _region_current_size);
+    }
 
+    _interval_index.Initialize(allocator, deallocator, _region_intervals,
+                               _region_max_size);
 }
 
 HugePageBackedRegion::~HugePageBackedRegion() {
@@ -247,6 +463,7 @@ HugePageBackedRegion::~HugePageBackedRegion() {
 }
 
 int HugePageBackedRegion::Resize(size_t new_size) {
+    LATENCY_SCOPE(RESIZE);
     assert(_initialized);
 
     if (new_size > _region_max_size) {
@@ -255,9 +472,17 @@ int HugePageBackedRegion::Resize(size_t new_size) {
 
     if (new_size > _region_current_size) {
         _region_current_size = ExtendRegion(new_size);
+        if (_region_current_size < new_size) {
+            return -ENOMEM;
+        }
     }
     else if (new_size < _region_current_size) {
         _region_current_size = ShrinkRegion(new_size);
+        // the unmapped pages will be mapped again with the default protection
+        _protected_ranges.Remove((off_t) _region_current_size,
+                                 (off_t) _region_max_size);
+        _uncommitted_ranges.Remove((off_t) _region_current_size,
+                                   (off_t) _region_max_size);
     }
     return 0;
 }
@@ -276,3 +501,692 @@ size_t HugePageBackedRegion::GetRegionMaxSize() {
     assert(_initialized);
     return _region_max_size;
 }
+
+PageSize HugePageBackedRegion::GetPageSize(void *addr) {
+    assert(_initialized);
+    off_t offset = (off_t) ((size_t) addr - (size_t) _region_start);
+    if (addr < _region_start || (size_t) offset >= _region_max_size) {
+        return PageSize::UNKNOWN;
+    }
+    int i = _interval_index.Find(offset);
+    return (i == -1) ? PageSize::UNKNOWN : _region_intervals.At(i)._page_size;
+}
+
+int HugePageBackedRegion::FindInterval(void *addr) {
+    assert(_initialized);
+    if (addr < _region_start) {
+        return -1;
+    }
+    return _interval_index.Find((off_t) ((size_t) addr -
+                                         (size_t) _region_start));
+}
+
+bool HugePageBackedRegion::IsUniformlyBacked(void *addr, size_t len,
+                                             PageSize page_size) {
+    assert(_initialized);
+    if (len == 0) {
+        return false;
+    }
+    off_t start_offset = (off_t) ((size_t) addr - (size_t) _region_start);
+    off_t end_offset = start_offset + (off_t) len;
+    if (addr < _region_start || (size_t) end_offset > _region_max_size) {
+        return false;
+    }
+    size_t intervals_length = _region_intervals.GetLength();
+    for (unsigned int i=0; i<intervals_length; i++) {
+        MemoryInterval& interval = _region_intervals.At(i);
+        if (interval._end_offset > start_offset
+            && interval._start_offset < end_offset
+            && interval._page_size != page_size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int HugePageBackedRegion::Protect(void *addr, size_t len, int prot) {
+    assert(_initialized);
+    size_t region_start = (size_t) _region_start;
+    off_t start_offset = (off_t) ((size_t) addr - region_start);
+    off_t end_offset = start_offset + (off_t) len;
+
+    if (prot == MMAP_PROTECTION) {
+        // restore only the pages that were protected before
+        for (size_t i = 0; i < _protected_ranges.GetLength(); i++) {
+            OffsetRange& range = _protected_ranges.At(i);
+            off_t start = std::max(range._start_offset, start_offset);
+            off_t end = std::min(range._end_offset, end_offset);
+            if (start < end) {
+                _memory_protector((void *) (region_start + start),
+                                  end - start, prot);
+            }
+        }
+        return _protected_ranges.Remove(start_offset, end_offset);
+    }
+
+    if (addr < _region_start || (size_t) end_offset > _region_current_size) {
+        return -1;
+    }
+
+    size_t intervals_length = _region_intervals.GetLength();
+    for (unsigned int i=0; i<intervals_length; i++) {
+        MemoryInterval& interval = _region_intervals.At(i);
+        off_t start = std::max(interval._start_offset, start_offset);
+        off_t end = std::min(interval._end_offset, end_offset);
+        size_t page_size = static_cast<size_t>(interval._page_size);
+        size_t start_addr = ROUND_UP(region_start + start, page_size);
+        size_t end_addr = ROUND_DOWN(region_start + end, page_size);
+        if (start >= end || start_addr >= end_addr) {
+            continue;
+        }
+        if (_memory_protector((void *) start_addr,
+                              end_addr - start_addr, prot) != 0) {
+            return -1;
+        }
+        if (_protected_ranges.Add((off_t) (start_addr - region_start),
+                                  (off_t) (end_addr - region_start)) != 0) {
+            // the range cannot be tracked, so leave it accessible
+            _memory_protector((void *) start_addr, end_addr - start_addr,
+                              MMAP_PROTECTION);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void HugePageBackedRegion::ClearRange(void *addr, size_t len) {
+    assert(_initialized);
+    size_t region_start = (size_t) _region_start;
+    off_t start_offset = (off_t) ((size_t) addr - region_start);
+    off_t end_offset = start_offset + (off_t) len;
+    // pages above the region top will be mapped with fresh pages anyway
+    end_offset = std::min(end_offset, (off_t) _region_current_size);
+
+    size_t intervals_length = _region_intervals.GetLength();
+    for (unsigned int i=0; i<intervals_length; i++) {
+        MemoryInterval& interval = _region_intervals.At(i);
+        off_t interval_start = std::max(interval._start_offset, start_offset);
+        off_t interval_end = std::min(interval._end_offset, end_offset);
+        size_t page_size = static_cast<size_t>(interval._page_size);
+        // decommitted pages are mapped with fresh pages when committed
+        ForEachCommittedRange(interval_start, interval_end,
+                              [&](off_t start, off_t end) {
+            size_t start_addr = region_start + start;
+            size_t end_addr = region_start + end;
+            size_t pages_start = ROUND_UP(start_addr, page_size);
+            size_t pages_end = ROUND_DOWN(end_addr, page_size);
+            if (pages_start >= pages_end) {
+                memset((void *) start_addr, 0, end_addr - start_addr);
+                return;
+            }
+            if (interval._page_size == PageSize::BASE_4KB) {
+                AllocateMemory((void *) pages_start, pages_end - pages_start,
+                               interval._page_size);
+            } else {
+                // fresh huge pages may not be available, so clear the
+                // current ones in place
+                _memory_protector((void *) pages_start,
+                                  pages_end - pages_start, MMAP_PROTECTION);
+                memset((void *) pages_start, 0, pages_end - pages_start);
+            }
+            _protected_ranges.Remove((off_t) (pages_start - region_start),
+                                     (off_t) (pages_end - region_start));
+            memset((void *) start_addr, 0, pages_start - start_addr);
+            memset((void *) pages_end, 0, end_addr - pages_end);
+        });
+    }
+}
+
+int HugePageBackedRegion::Decommit(void *addr, size_t len) {
+    assert(_initialized);
+    size_t region_start = (size_t) _region_start;
+    off_t start_offset = (off_t) ((size_t) addr - region_start);
+    off_t end_offset = start_offset + (off_t) len;
+    if (addr < _region_start || (size_t) end_offset > _region_max_size) {
+        return -1;
+    }
+
+    size_t region_top = region_start + _region_current_size;
+    size_t intervals_length = _region_intervals.GetLength();
+    for (unsigned int i=0; i<intervals_length; i++) {
+        MemoryInterval& interval = _region_intervals.At(i);
+        off_t start = std::max(interval._start_offset, start_offset);
+        off_t end = std::min(interval._end_offset, end_offset);
+        size_t page_size = static_cast<size_t>(interval._page_size);
+        size_t start_addr = ROUND_UP(region_start + start, page_size);
+        size_t end_addr = ROUND_DOWN(region_start + end, page_size);
+        if (start >= end || start_addr >= end_addr) {
+            continue;
+        }
+        if (_uncommitted_ranges.Add((off_t) (start_addr - region_start),
+                                    (off_t) (end_addr - region_start)) != 0) {
+            return -1;
+        }
+        if (start_addr < region_top) {
+            end_addr = std::min(end_addr, region_top);
+            RecordTouchedChunks((off_t) (start_addr - region_start),
+                                (off_t) (end_addr - region_start));
+            AllocatePlaceholder((void *) start_addr, end_addr - start_addr);
+            _protected_ranges.Remove((off_t) (start_addr - region_start),
+                                     (off_t) (end_addr - region_start));
+        }
+    }
+    return 0;
+}
+
+int HugePageBackedRegion::Commit(void *addr, size_t len) {
+    assert(_initialized);
+    if (len == 0 || _uncommitted_ranges.GetLength() == 0) {
+        return 0;
+    }
+    size_t region_start = (size_t) _region_start;
+    void *last_addr = (void *) ((size_t) addr + len - 1);
+    PageSize first_page_size = GetPageSize(addr);
+    PageSize last_page_size = GetPageSize(last_addr);
+    if (first_page_size == PageSize::UNKNOWN ||
+        last_page_size == PageSize::UNKNOWN) {
+        return -1;
+    }
+    // decommitted ranges consist of whole pages, so commit whole pages too
+    off_t start_offset = (off_t) (ROUND_DOWN((size_t) addr,
+                                             first_page_size) - region_start);
+    off_t end_offset = (off_t) (ROUND_UP((size_t) last_addr + 1,
+                                         last_page_size) - region_start);
+
+    while (_uncommitted_ranges.Intersects(start_offset, end_offset)) {
+        size_t i = 0;
+        while (_uncommitted_ranges.At(i)._end_offset <= start_offset) {
+            i++;
+        }
+        OffsetRange range = _uncommitted_ranges.At(i);
+        off_t start = std::max(range._start_offset, start_offset);
+        off_t end = std::min(range._end_offset, end_offset);
+        if (_uncommitted_ranges.Remove(start, end) != 0) {
+            // there is no room to split the range, so commit all of it
+            start = range._start_offset;
+            end = range._end_offset;
+            _uncommitted_ranges.Remove(start, end);
+        }
+        if (MapRange(start, end) != 0) {
+            // the range stays decommitted
+            _uncommitted_ranges.Add(start, end);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+size_t HugePageBackedRegion::Discard(void *addr, size_t len, int advice) {
+    assert(_initialized);
+    size_t region_start = (size_t) _region_start;
+    off_t start_offset = (off_t) ((size_t) addr - region_start);
+    off_t end_offset = start_offset + (off_t) len;
+    end_offset = std::min(end_offset, (off_t) _region_current_size);
+
+    size_t discarded = 0;
+    size_t intervals_length = _region_intervals.GetLength();
+    for (unsigned int i=0; i<intervals_length; i++) {
+        MemoryInterval& interval = _region_intervals.At(i);
+        off_t interval_start = std::max(interval._start_offset, start_offset);
+        off_t interval_end = std::min(interval._end_offset, end_offset);
+        size_t page_size = static_cast<size_t>(interval._page_size);
+        // decommitted pages do not use memory anyway
+        ForEachCommittedRange(interval_start, interval_end,
+                              [&](off_t start, off_t end) {
+            size_t start_addr = region_start + start;
+            size_t end_addr = region_start + end;
+            size_t pages_start = ROUND_UP(start_addr, page_size);
+            size_t pages_end = ROUND_DOWN(end_addr, page_size);
+            if (pages_start >= pages_end) {
+                pages_start = pages_end = end_addr;
+            }
+            if (pages_start < pages_end) {
+                RecordTouchedChunks((off_t) (pages_start - region_start),
+                                    (off_t) (pages_end - region_start));
+                InvalidateVerifiedChunks((off_t) (pages_start - region_start),
+                                         (off_t) (pages_end - region_start));
+                void *pages = (void *) pages_start;
+                size_t pages_len = pages_end - pages_start;
+                bool is_protected = _protected_ranges.Intersects(
+                        (off_t) (pages_start - region_start),
+                        (off_t) (pages_end - region_start));
+                // only the pages that were actually released are counted
+                bool is_released = true;
+                if (interval._page_size == PageSize::BASE_4KB) {
+                    is_released = (_memory_advisor(pages, pages_len,
+                                                   advice) == 0);
+                } else if (_memory_advisor(pages, pages_len,
+                                           MADV_DONTNEED) != 0) {
+                    // the protected pages cannot be replaced either
+                    is_released = !is_protected;
+                    if (is_released) {
+                        AllocateMemory(pages, pages_len,
+                                       interval._page_size);
+                    }
+                }
+                if (is_released) {
+                    discarded += pages_len;
+                }
+            }
+            if (advice != MADV_DONTNEED) {
+                return;
+            }
+            // the partially covered pages must read as zeros afterwards
+            if (!_protected_ranges.Intersects(start, end)) {
+                memset((void *) start_addr, 0, pages_start - start_addr);
+                memset((void *) pages_end, 0, end_addr - pages_end);
+            }
+        });
+    }
+    return discarded;
+}
+
+int HugePageBackedRegion::Migrate(void *addr, size_t len, PageSize page_size,
+                                  size_t *copied_size) {
+    assert(_initialized);
+    *copied_size = 0;
+    size_t region_start = (size_t) _region_start;
+    off_t start_offset = (off_t) ((size_t) addr - region_start);
+    off_t end_offset = start_offset + (off_t) len;
+    if (page_size == PageSize::UNKNOWN || len == 0 ||
+        addr < _region_start || (size_t) end_offset > _region_max_size ||
+        !IS_ALIGNED(addr, page_size) || !IS_ALIGNED(len, page_size)) {
+        return -EINVAL;
+    }
+    // the range must not split the pages at its bounds
+    void *last_addr = (void *) ((size_t) addr + len - 1);
+    PageSize first_page_size = GetPageSize(addr);
+    PageSize last_page_size = GetPageSize(last_addr);
+    if (first_page_size == PageSize::UNKNOWN ||
+        last_page_size == PageSize::UNKNOWN ||
+        !IS_ALIGNED(addr, first_page_size) ||
+        !IS_ALIGNED((size_t) last_addr + 1, last_page_size)) {
+        return -EINVAL;
+    }
+    // the decommitted pages are reservations, which are not migrated (they
+    // would be committed and lose their protection)
+    if (_protected_ranges.Intersects(start_offset, end_offset) ||
+        _uncommitted_ranges.Intersects(start_offset, end_offset) ||
+        _region_intervals.GetCapacity() - _region_intervals.GetLength() < 2) {
+        return -EBUSY;
+    }
+
+    // pages above the region top are mapped when the region is extended
+    size_t mapped_len = 0;
+    if ((size_t) start_offset < _region_current_size) {
+        mapped_len = std::min(len, _region_current_size - start_offset);
+    }
+    size_t new_len = ROUND_UP(mapped_len, page_size);
+    if (new_len > 0) {
+        int mmap_flags = MMAP_FLAGS;
+        if (page_size == PageSize::HUGE_1GB) {
+            mmap_flags |= MAP_HUGETLB | MAP_HUGE_1GB;
+        } else if (page_size == PageSize::HUGE_2MB) {
+            mmap_flags |= MAP_HUGETLB | MAP_HUGE_2MB;
+        }
+        void *new_pages = _memory_allocator(nullptr, new_len, MMAP_PROTECTION,
+                                            mmap_flags, -1, 0);
+        if (new_pages == MAP_FAILED) {
+            return -ENOMEM;
+        }
+        memcpy(new_pages, addr, mapped_len);
+        if (_memory_remapper(new_pages, new_len, new_len,
+                             MREMAP_MAYMOVE | MREMAP_FIXED,
+                             addr) == MAP_FAILED) {
+            // e.g., kernels that cannot move huge pages
+            void *ptr = _memory_allocator(addr, new_len, MMAP_PROTECTION,
+                                          mmap_flags | MAP_FIXED, -1, 0);
+            if (ptr == MAP_FAILED) {
+                // restore the old pages
+                MapRange(start_offset, start_offset + (off_t) mapped_len);
+                memcpy(addr, new_pages, mapped_len);
+                DeallocateMemory(new_pages, new_len);
+                return -ENOMEM;
+            }
+            memcpy(addr, new_pages, mapped_len);
+            DeallocateMemory(new_pages, new_len);
+        }
+        *copied_size = mapped_len;
+        if (_region_current_size < (size_t) start_offset + new_len) {
+            _region_current_size = (size_t) start_offset + new_len;
+        }
+    }
+
+    BeginIntervalsChange();
+    _region_intervals.ReplaceRange(start_offset, end_offset, page_size);
+    _interval_index.Update();
+    EndIntervalsChange();
+    InvalidateVerifiedChunks(start_offset, end_offset);
+    return 0;
+}
+
+int HugePageBackedRegion::Relayout(MemoryIntervalList& layout,
+                                   bool is_dry_run) {
+    assert(_initialized);
+    size_t intervals_length = _region_intervals.GetLength();
+    off_t top_offset = (off_t) _region_current_size;
+    off_t end_offset = (intervals_length == 0) ? 0 :
+        _region_intervals.At(intervals_length - 1)._end_offset;
+    if (layout.FindMaxEndOffset() > end_offset) {
+        return -EINVAL;
+    }
+    if (top_offset >= end_offset) {
+        return 0;
+    }
+
+    size_t region_start = (size_t) _region_start;
+    size_t huge_intervals = 0;
+    for (size_t i = 0; i < layout.GetLength(); i++) {
+        MemoryInterval& interval = layout.At(i);
+        off_t start = std::max(interval._start_offset, top_offset);
+        if (start >= interval._end_offset) {
+            continue;
+        }
+        if (!IS_ALIGNED(region_start + start, interval._page_size) ||
+            !IS_ALIGNED(region_start + interval._end_offset,
+                        interval._page_size)) {
+            return -EINVAL;
+        }
+        huge_intervals++;
+    }
+    // the intervals below the top, the 4KB interval above it, and up to two
+    // more intervals for each huge interval
+    size_t kept_intervals = 0;
+    while (kept_intervals < intervals_length &&
+           _region_intervals.At(kept_intervals)._start_offset < top_offset) {
+        kept_intervals++;
+    }
+    if (kept_intervals + 1 + 2 * huge_intervals >
+        _region_intervals.GetCapacity()) {
+        return -EBUSY;
+    }
+    if (is_dry_run) {
+        return 0;
+    }
+
+    BeginIntervalsChange();
+    _region_intervals.ReplaceRange(top_offset, end_offset, PageSize::BASE_4KB);
+    for (size_t i = 0; i < layout.GetLength(); i++) {
+        MemoryInterval& interval = layout.At(i);
+        off_t start = std::max(interval._start_offset, top_offset);
+        if (start < interval._end_offset) {
+            _region_intervals.ReplaceRange(start, interval._end_offset,
+                                           interval._page_size);
+        }
+    }
+    _interval_index.Update();
+    EndIntervalsChange();
+    return 0;
+}
+
+void HugePageBackedRegion::BeginIntervalsChange() {
+    _intervals_generation.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void HugePageBackedRegion::EndIntervalsChange() {
+    _intervals_generation.fetch_add(1, std::memory_order_release);
+}
+
+size_t HugePageBackedRegion::GetCommittedSize() {
+    assert(_initialized);
+    return _region_current_size -
+        _uncommitted_ranges.GetIntersectionSize(0, (off_t) _region_current_size);
+}
+
+size_t HugePageBackedRegion::GetCommittedSize(PageSize page_size) {
+    assert(_initialized);
+    if (page_size == PageSize::BASE_4KB) {
+        return GetCommittedSize() - GetCommittedSize(PageSize::HUGE_2MB) -
+            GetCommittedSize(PageSize::HUGE_1GB);
+    }
+    size_t size = 0;
+    for (size_t i = 0; i < _region_intervals.GetLength(); i++) {
+        MemoryInterval& interval = _region_intervals.At(i);
+        off_t end_offset = std::min(interval._end_offset,
+                                    (off_t) _region_current_size);
+        if (interval._page_size != page_size ||
+            interval._start_offset >= end_offset) {
+            continue;
+        }
+        size += (end_offset - interval._start_offset) -
+            _uncommitted_ranges.GetIntersectionSize(interval._start_offset,
+                                                    end_offset);
+    }
+    return size;
+}
+
+size_t HugePageBackedRegion::GetResidentSize() {
+    assert(_initialized);
+    const size_t base_page_size = static_cast<size_t>(PageSize::BASE_4KB);
+    const size_t chunk_pages = 4096;
+    unsigned char residency[chunk_pages];
+    size_t resident = 0;
+    for (size_t offset = 0; offset < _region_current_size;
+         offset += chunk_pages * base_page_size) {
+        size_t len = std::min(_region_current_size - offset,
+                              chunk_pages * base_page_size);
+        if (mincore((void *) ((size_t) _region_start + offset), len,
+                    residency) != 0) {
+            continue;
+        }
+        for (size_t i = 0; i < ROUND_UP(len, base_page_size) / base_page_size; i++) {
+            if (residency[i] & 1) {
+                resident += base_page_size;
+            }
+        }
+    }
+    return resident;
+}
+
+int HugePageBackedRegion::EnableTouchTracking() {
+    assert(_initialized);
+    _touched_chunks_count = ROUND_UP(_region_max_size, TOUCHED_CHUNK_SIZE) /
+                            TOUCHED_CHUNK_SIZE;
+    size_t words = ROUND_UP(_touched_chunks_count, 64) / 64;
+    void *ptr = RegionIntervalListMemAlloc(
+            std::max(words, (size_t) 1) * sizeof(uint64_t));
+    if (ptr == MAP_FAILED) {
+        _touched_chunks_count = 0;
+        return -1;
+    }
+    _touched_chunks = static_cast<uint64_t *>(ptr);
+    return 0;
+}
+
+/*
+ * Marks the 2MB chunks of [start_offset, end_offset) that have resident
+ * pages as touched; the rest of a chunk is skipped once it is marked.
+ */
+void HugePageBackedRegion::RecordTouchedChunks(off_t start_offset,
+                                               off_t end_offset) {
+    if (_touched_chunks == nullptr) {
+        return;
+    }
+    const size_t base_page_size = static_cast<size_t>(PageSize::BASE_4KB);
+    unsigned char residency[MINCORE_BATCH_PAGES];
+    size_t offset = ROUND_DOWN((size_t) start_offset, base_page_size);
+    size_t end = std::min((size_t) end_offset, _region_current_size);
+    while (offset < end) {
+        size_t chunk = offset / TOUCHED_CHUNK_SIZE;
+        if (IsChunkTouched(chunk)) {
+            offset = (chunk + 1) * TOUCHED_CHUNK_SIZE;
+            continue;
+        }
+        size_t len = std::min(end - offset,
+                              MINCORE_BATCH_PAGES * base_page_size);
+        len = std::min(len, (chunk + 1) * TOUCHED_CHUNK_SIZE - offset);
+        if (mincore((void *) ((size_t) _region_start + offset), len,
+                    residency) == 0) {
+            for (size_t i = 0; i < ROUND_UP(len, base_page_size) / base_page_size; i++) {
+                if (residency[i] & 1) {
+                    _touched_chunks[chunk / 64] |= 1ull << (chunk % 64);
+                    break;
+                }
+            }
+        }
+        offset += len;
+    }
+}
+
+void HugePageBackedRegion::GetIntervalUtilization(
+        int index, struct IntervalUtilization *utilization) {
+    assert(_initialized);
+    MemoryInterval &interval = _region_intervals.At(index);
+    size_t start = (size_t) interval._start_offset;
+    size_t end = (size_t) interval._end_offset;
+    size_t top = std::min(end, _region_current_size);
+    utilization->mapped_size = (top > start) ? top - start : 0;
+    utilization->resident_size = 0;
+    utilization->touched_size = 0;
+    utilization->high_water_mark = 0;
+    RecordTouchedChunks((off_t) start, (off_t) top);
+
+    // a page of the interval is resident if any of its 4KB pages is
+    const size_t base_page_size = static_cast<size_t>(PageSize::BASE_4KB);
+    size_t page_size = static_cast<size_t>(interval._page_size);
+    unsigned char residency[MINCORE_BATCH_PAGES];
+    size_t last_resident_page = (size_t) -1;
+    for (size_t offset = start; offset < top;
+         offset += MINCORE_BATCH_PAGES * base_page_size) {
+        size_t len = std::min(top - offset,
+                              MINCORE_BATCH_PAGES * base_page_size);
+        if (mincore((void *) ((size_t) _region_start + offset), len,
+                    residency) != 0) {
+            continue;
+        }
+        for (size_t i = 0; i < ROUND_UP(len, base_page_size) / base_page_size; i++) {
+            size_t page = (offset + i * base_page_size - start) / page_size;
+            if ((residency[i] & 1) && page != last_resident_page) {
+                utilization->resident_size += page_size;
+                last_resident_page = page;
+            }
+        }
+    }
+
+    if (_touched_chunks == nullptr) {
+        return;
+    }
+    // the huge pages are touched as a whole, and the 4KB pages are counted
+    // by the parts of the touched chunks that overlap the interval
+    size_t unit_size = std::max(page_size, TOUCHED_CHUNK_SIZE);
+    for (size_t unit_start = ROUND_DOWN(start, unit_size); unit_start < end;
+         unit_start += unit_size) {
+        size_t unit_end = unit_start + unit_size;
+        bool is_touched = false;
+        for (size_t chunk = unit_start / TOUCHED_CHUNK_SIZE;
+             chunk < unit_end / TOUCHED_CHUNK_SIZE &&
+             chunk < _touched_chunks_count && !is_touched; chunk++) {
+            is_touched = IsChunkTouched(chunk);
+        }
+        if (!is_touched) {
+            continue;
+        }
+        size_t touched_start = std::max(unit_start, start);
+        size_t touched_end = std::min(unit_end, end);
+        utilization->touched_size += touched_end - touched_start;
+        utilization->high_water_mark = touched_end - start;
+    }
+}
+
+/*
+ * The untouched huge pages of an interval are the pages that are reserved
+ * for it without being used, so the interval could be shrunk by them.
+ */
+void HugePageBackedRegion::WriteUtilizationHeader(FILE *file) {
+    fprintf(file, "region,start-offset,end-offset,page-size,mapped-size,"
+            "resident-size,touched-size,high-water-mark,"
+            "untouched-huge-pages\n");
+}
+
+void HugePageBackedRegion::WriteUtilization(const char *name, FILE *file) {
+    size_t intervals_length = _region_intervals.GetLength();
+    for (unsigned int i = 0; i < intervals_length; i++) {
+        MemoryInterval &interval = _region_intervals.At(i);
+        struct IntervalUtilization utilization;
+        GetIntervalUtilization(i, &utilization);
+        size_t size = interval._end_offset - interval._start_offset;
+        size_t page_size = static_cast<size_t>(interval._page_size);
+        size_t untouched_pages = (interval._page_size == PageSize::BASE_4KB)
+            ? 0 : (size - utilization.touched_size) / page_size;
+        fprintf(file, "%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n", name,
+                (unsigned long) interval._start_offset,
+                (unsigned long) interval._end_offset,
+                (unsigned long) page_size,
+                (unsigned long) utilization.mapped_size,
+                (unsigned long) utilization.resident_size,
+                (unsigned long) utilization.touched_size,
+                (unsigned long) utilization.high_water_mark,
+                (unsigned long) untouched_pages);
+    }
+}
+
+/*
+ * Clears the verified bits of the 2MB chunks that intersect
+ * [start_offset, end_offset), whose pages were mapped again.
+ */
+void HugePageBackedRegion::InvalidateVerifiedChunks(off_t start_offset,
+                                                    off_t end_offset) {
+    if (_verified_chunks == nullptr || start_offset < 0 ||
+        start_offset >= end_offset) {
+        return;
+    }
+    size_t first = (size_t) start_offset / VERIFIED_CHUNK_SIZE;
+    size_t last = std::min(ROUND_UP((size_t) end_offset, VERIFIED_CHUNK_SIZE) /
+                           VERIFIED_CHUNK_SIZE, _verified_chunks_count);
+    for (size_t chunk = first; chunk < last; chunk++) {
+        _verified_chunks[chunk / 64] &= ~(1ull << (chunk % 64));
+    }
+}
+
+int HugePageBackedRegion::VerifyBacking(
+        PageBackingVerifier &verifier,
+        struct mosalloc_backing_report *report) {
+    assert(_initialized);
+    if (_verified_chunks == nullptr) {
+        size_t count = ROUND_UP(_region_max_size, VERIFIED_CHUNK_SIZE) /
+                       VERIFIED_CHUNK_SIZE;
+        size_t words = ROUND_UP(count, 64) / 64;
+        void *ptr = RegionIntervalListMemAlloc(
+                std::max(words, (size_t) 1) * sizeof(uint64_t));
+        if (ptr == MAP_FAILED) {
+            return -1;
+        }
+        _verified_chunks = static_cast<uint64_t *>(ptr);
+        _verified_chunks_count = count;
+    }
+    size_t region_start = (size_t) _region_start;
+    size_t intervals_length = _region_intervals.GetLength();
+    size_t interval_index = 0;
+    for (size_t chunk = 0; chunk * VERIFIED_CHUNK_SIZE < _region_current_size;
+         chunk++) {
+        if (IsChunkVerified(chunk)) {
+            continue;
+        }
+        off_t chunk_start = (off_t) (chunk * VERIFIED_CHUNK_SIZE);
+        off_t chunk_end = std::min((off_t) (chunk_start + VERIFIED_CHUNK_SIZE),
+                                   (off_t) _region_current_size);
+        while (interval_index < intervals_length &&
+               _region_intervals.At(interval_index)._end_offset <= chunk_start) {
+            interval_index++;
+        }
+        // the chunk may be split between several 4KB and huge intervals
+        bool is_verified = true;
+        for (size_t i = interval_index; i < intervals_length &&
+             _region_intervals.At(i)._start_offset < chunk_end; i++) {
+            MemoryInterval& interval = _region_intervals.At(i);
+            off_t start = std::max(interval._start_offset, chunk_start);
+            off_t end = std::min(interval._end_offset, chunk_end);
+            PageSize page_size = interval._page_size;
+            ForEachCommittedRange(start, end, [&](off_t from, off_t to) {
+                is_verified &= verifier.VerifyRange(
+                        (void *) (region_start + from), to - from,
+                        page_size, report);
+            });
+        }
+        if (is_verified) {
+            _verified_chunks[chunk / 64] |= 1ull << (chunk % 64);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,154 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <mutex>
+
+#include "HugePagesAvailability.h"
+
+// the hugetlb files of a cgroup, which are named by the page sizes
+static char cgroup_limit_format[PATH_MAX];
+static char cgroup_usage_format[PATH_MAX];
+static std::once_flag cgroup_found;
+
+/*
+ * Reads the file at @path into @buffer as a null-terminated string.
+ * Returns false if the file cannot be read.
+ */
+static bool ReadFile(const char *path, char *buffer, size_t size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t res = read(fd, buffer, size - 1);
+    close(fd);
+    if (res < 0) {
+        return false;
+    }
+    buffer[res] = '\0';
+    return true;
+}
+
+/*
+ * Reads a number from the file at @path ("max" reads as ULONG_MAX).
+ * Returns false if the file cannot be read.
+ */
+static bool ReadNumber(const char *path, unsigned long *value) {
+    char buffer[64];
+    if (!ReadFile(path, buffer, sizeof(buffer))) {
+        return false;
+    }
+    if (strncmp(buffer, "max", 3) == 0) {
+        *value = ULONG_MAX;
+    } else {
+        *value = strtoul(buffer, NULL, 10);
+    }
+    return true;
+}
+
+static const char *GetCgroupPageSizeName(PageSize page_size) {
+    return (page_size == PageSize::HUGE_1GB) ? "1GB" : "2MB";
+}
+
+/*
+ * Finds the hugetlb controller of the process in /proc/self/cgroup: a
+ * "<id>:hugetlb:<path>" line for cgroup v1, or else the "0::<path>" line of
+ * cgroup v2. The limits are not checked if neither is found.
+ */
+void HugePagesAvailability::FindCgroup() {
+    char buffer[4096];
+    cgroup_limit_format[0] = '\0';
+    cgroup_usage_format[0] = '\0';
+    if (!ReadFile("/proc/self/cgroup", buffer, sizeof(buffer))) {
+        return;
+    }
+    const char *v2_path = nullptr;
+    for (char *line = buffer; line != nullptr && *line != '\0';) {
+        char *next = strchr(line, '\n');
+        if (next != nullptr) {
+            *next++ = '\0';
+        }
+        char *controllers = strchr(line, ':');
+        char *path = (controllers != nullptr) ?
+            strchr(controllers + 1, ':') : nullptr;
+        if (path != nullptr) {
+            *path++ = '\0';
+            controllers++;
+            if (strstr(controllers, "hugetlb") != nullptr) {
+                snprintf(cgroup_limit_format, sizeof(cgroup_limit_format),
+                         "%s/hugetlb%s/hugetlb.%%s.limit_in_bytes",
+                         HUGE_PAGES_CGROUP_DIR, path);
+                snprintf(cgroup_usage_format, sizeof(cgroup_usage_format),
+                         "%s/hugetlb%s/hugetlb.%%s.usage_in_bytes",
+                         HUGE_PAGES_CGROUP_DIR, path);
+                return;
+            }
+            if (*controllers == '\0') {
+                v2_path = path;
+            }
+        }
+        line = next;
+    }
+    if (v2_path != nullptr) {
+        snprintf(cgroup_limit_format, sizeof(cgroup_limit_format),
+                 "%s%s/hugetlb.%%s.max", HUGE_PAGES_CGROUP_DIR, v2_path);
+        snprintf(cgroup_usage_format, sizeof(cgroup_usage_format),
+                 "%s%s/hugetlb.%%s.current", HUGE_PAGES_CGROUP_DIR, v2_path);
+    }
+}
+
+size_t HugePagesAvailability::GetPoolAvailableSize(PageSize page_size) {
+    const char *names[] = {"free_hugepages", "resv_hugepages",
+                           "nr_overcommit_hugepages", "surplus_hugepages"};
+    unsigned long values[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 4; i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/hugepages-%lukB/%s",
+                 HUGE_PAGES_SYSFS_DIR,
+                 (unsigned long)page_size / 1024, names[i]);
+        if (!ReadNumber(path, &values[i]) && i < 2) {
+            return 0;
+        }
+    }
+    // the free pages include the pages that are reserved by mappings
+    unsigned long pages = (values[0] > values[1]) ? values[0] - values[1] : 0;
+    if (values[2] > values[3]) {
+        pages += values[2] - values[3];
+    }
+    return pages * (size_t)page_size;
+}
+
+/*
+ * Returns the room that is left under the hugetlb limit of the cgroup. The
+ * usage counts the pages that were faulted in (and not the reservations of
+ * the pages that were not touched yet), so this is an upper bound.
+ */
+size_t HugePagesAvailability::GetCgroupAvailableSize(PageSize page_size) {
+    std::call_once(cgroup_found, FindCgroup);
+    if (cgroup_limit_format[0] == '\0') {
+        return SIZE_MAX;
+    }
+    char limit_path[PATH_MAX];
+    char usage_path[PATH_MAX];
+    const char *name = GetCgroupPageSizeName(page_size);
+    snprintf(limit_path, sizeof(limit_path), cgroup_limit_format, name);
+    snprintf(usage_path, sizeof(usage_path), cgroup_usage_format, name);
+    unsigned long limit;
+    unsigned long usage;
+    if (!ReadNumber(limit_path, &limit) || !ReadNumber(usage_path, &usage)) {
+        return SIZE_MAX;
+    }
+    return (limit > usage) ? limit - usage : 0;
+}
+
+size_t HugePagesAvailability::GetAvailableSize(PageSize page_size) {
+    if (page_size != PageSize::HUGE_2MB && page_size != PageSize::HUGE_1GB) {
+        return 0;
+    }
+    size_t pool_size = GetPoolAvailableSize(page_size);
+    size_t cgroup_size = GetCgroupAvailableSize(page_size);
+    return (pool_size < cgroup_size) ? pool_size : cgroup_size;
+}
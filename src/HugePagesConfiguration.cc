@@ -7,6 +7,7 @@ HugePagesConfiguration::HugePagesConfiguration() {
     ReadBrkPoolEnvParams(_brk_pool_params);
     ReadMmapPoolEnvParams(_mmap_pool_params);
     ReadFileBackedPoolEnvParams(_file_backed_pool_params);
+    ReadStackPoolEnvParams(_stack_pool_params);
     ReadGeneralEnvParams(_general_params);
 }
 
@@ -20,6 +21,8 @@ HugePagesConfiguration::ReadFromEnvironmentVariables(
             return _mmap_pool_params;
         case ConfigType::FILE_BACKED_POOL:
             return _file_backed_pool_params;
+        case ConfigType::STACK_POOL:
+            return _stack_pool_params;
         default:
             THROW_EXCEPTION("invalid type!");
     }
@@ -55,6 +58,52 @@ void HugePagesConfiguration::ReadGeneralEnvParams(
     
     char *verbose_val = getenv(VERBOSE_LEVEL_ENV_VAR);
     params._verbose_level = (verbose_val == NULL) ? 0 : stoul(verbose_val);
+
+    params._routing_file = getenv(ROUTING_FILE_ENV_VAR);
+    char *depth_val = getenv(CALL_SITE_DEPTH_ENV_VAR);
+    params._call_site_depth = (depth_val == NULL) ? DEFAULT_CALL_SITE_DEPTH
+        : stoi(depth_val);
+
+    params._layout_control_file = getenv(LAYOUT_CONTROL_FILE_ENV_VAR);
+
+    char *statistics_val = getenv(STATISTICS_ENV_VAR);
+    params._statistics = (statistics_val == NULL) ? false
+        : (stoul(statistics_val) != 0);
+
+    // the footprints are sampled by time unless only an operations count
+    // is given
+    params._sampling_file = getenv(SAMPLING_FILE_ENV_VAR);
+    char *interval_val = getenv(SAMPLING_INTERVAL_ENV_VAR);
+    char *operations_val = getenv(SAMPLING_OPERATIONS_ENV_VAR);
+    params._sampling_operations = (operations_val == NULL) ? 0
+        : stoul(operations_val);
+    params._sampling_interval_ms = (interval_val != NULL) ? stoul(interval_val)
+        : (operations_val == NULL) ? DEFAULT_SAMPLING_INTERVAL_MS : 0;
+
+    params._access_sampling_file = getenv(ACCESS_SAMPLING_FILE_ENV_VAR);
+    char *access_interval_val = getenv(ACCESS_SAMPLING_INTERVAL_ENV_VAR);
+    params._access_sampling_interval_ms = (access_interval_val == NULL)
+        ? DEFAULT_ACCESS_SAMPLING_INTERVAL_MS : stoul(access_interval_val);
+
+    params._latency_file = getenv(LATENCY_FILE_ENV_VAR);
+    params._trace_file = getenv(TRACE_FILE_ENV_VAR);
+
+    char *fallback_val = getenv(HUGE_PAGES_FALLBACK_ENV_VAR);
+    if (fallback_val == NULL || strcmp(fallback_val, "abort") == 0) {
+        params._huge_pages_fallback = HugePagesFallback::ABORT;
+    } else if (strcmp(fallback_val, "degrade") == 0) {
+        params._huge_pages_fallback = HugePagesFallback::DEGRADE;
+    } else if (strcmp(fallback_val, "fail") == 0) {
+        params._huge_pages_fallback = HugePagesFallback::FAIL;
+    } else {
+        THROW_EXCEPTION("unknown huge pages fallback policy");
+    }
+
+    // the stack lengths are learned from the guards only on request, since
+    // any later mapping of a learned length is routed to the stack pool
+    char *learn_val = getenv(LEARN_STACK_LENGTHS_ENV_VAR);
+    params._learn_stack_lengths = (learn_val == NULL) ? false
+        : (stoul(learn_val) != 0);
 }
 
 void HugePagesConfiguration::ReadMmapPoolEnvParams(
@@ -77,3 +126,11 @@ void HugePagesConfiguration::ReadFileBackedPoolEnvParams(
             FILE_BACKED_FFA_SIZE_ENV_VAR);
 }
 
+//Note: the stack pool is optional, so its list size has a default value.
+void HugePagesConfiguration::ReadStackPoolEnvParams(
+        HugePagesConfiguration::HugePagesConfigurationParams &params) {
+    params.configuration_file = nullptr;
+    char *ffa_size_val = getenv(STACK_FFA_SIZE_ENV_VAR);
+    params._ffa_list_size = (ffa_size_val == NULL) ? DEFAULT_STACK_FFA_SIZE
+        : stoul(ffa_size_val);
+}
@@ -0,0 +1,89 @@
+#include <sys/mman.h>
+#include "IntervalIndex.h"
+
+IntervalIndex::IntervalIndex() :
+    _slots(nullptr),
+    _slots_count(0),
+    _intervals(nullptr),
+    _end_offset(0),
+    _mmap(nullptr),
+    _munmap(nullptr) {
+    }
+
+void IntervalIndex::Initialize(MmapFuncPtr allocator,
+        MunmapFuncPtr deallocator,
+        MemoryIntervalList &intervals,
+        size_t region_size) {
+    _mmap = allocator;
+    _munmap = deallocator;
+    _intervals = &intervals;
+    _end_offset = 0;
+    size_t intervals_length = intervals.GetLength();
+    if (intervals_length > 0) {
+        _end_offset = intervals.At(intervals_length - 1)._end_offset;
+    }
+    if ((size_t) _end_offset > region_size) {
+        _end_offset = (off_t) region_size;
+    }
+    _slots_count = ROUND_UP(_end_offset, PageSize::HUGE_2MB)
+                   >> INTERVAL_INDEX_SLOT_SHIFT;
+    if (_slots_count == 0) {
+        return;
+    }
+    size_t length = ROUND_UP(_slots_count * sizeof(uint32_t),
+                             PageSize::BASE_4KB);
+    void *ptr = _mmap(NULL, length, MMAP_PROTECTION, MMAP_FLAGS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        THROW_EXCEPTION("Failed to allocate Interval Index");
+    }
+    _slots = static_cast<uint32_t*>(ptr);
+    Update();
+}
+
+void IntervalIndex::Update() {
+    // the intervals may change before the index is initialized
+    if (_intervals == nullptr) {
+        return;
+    }
+    // walk the intervals backwards, so each slot ends up with the first
+    // interval that intersects it
+    for (size_t i = _intervals->GetLength(); i > 0; i--) {
+        MemoryInterval& interval = _intervals->At(i - 1);
+        if (interval._start_offset >= _end_offset) {
+            continue;
+        }
+        size_t first_slot = (size_t) interval._start_offset
+                            >> INTERVAL_INDEX_SLOT_SHIFT;
+        size_t last_slot = (size_t) (interval._end_offset - 1)
+                           >> INTERVAL_INDEX_SLOT_SHIFT;
+        for (size_t s = first_slot; s <= last_slot && s < _slots_count; s++) {
+            _slots[s] = (uint32_t) (i - 1);
+        }
+    }
+}
+
+IntervalIndex::~IntervalIndex() {
+    if (_slots == nullptr) {
+        return;
+    }
+    size_t length = ROUND_UP(_slots_count * sizeof(uint32_t),
+                             PageSize::BASE_4KB);
+    if (_munmap(_slots, length) != 0) {
+        THROW_EXCEPTION("Failed to deallocate Interval Index");
+    }
+}
+
+int IntervalIndex::Find(off_t offset) const {
+    if (offset < 0 || offset >= _end_offset) {
+        return -1;
+    }
+    size_t intervals_length = _intervals->GetLength();
+    size_t i = _slots[(size_t) offset >> INTERVAL_INDEX_SLOT_SHIFT];
+    while (i < intervals_length && _intervals->At(i)._end_offset <= offset) {
+        i++;
+    }
+    if (i == intervals_length || _intervals->At(i)._start_offset > offset) {
+        return -1;
+    }
+    return (int) i;
+}
@@ -0,0 +1,287 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <atomic>
+#include <new>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "globals.h"
+#include "GlibcAllocationFunctions.h"
+#include "LatencyHistograms.h"
+
+// the deepest nesting of measured operations (e.g., sbrk calls brk, which
+// resizes the brk region)
+#define LATENCY_MAX_DEPTH (4)
+
+static const char *OPERATION_NAMES[LATENCY_OPERATIONS] = {
+    "mmap", "munmap", "mremap", "mprotect", "madvise", "brk", "sbrk", "resize"
+};
+
+static const char *COMPONENT_NAMES[LATENCY_COMPONENTS] = {
+    "total", "lock-wait", "ffa", "syscall"
+};
+
+struct LatencyFrame {
+    uint64_t start_cycles;
+    uint64_t components[LATENCY_COMPONENTS];
+};
+
+struct ThreadLatencies {
+    ThreadLatencies *next;
+    int depth;
+    LatencyFrame frames[LATENCY_MAX_DEPTH];
+    LatencyHistogram histograms[LATENCY_OPERATIONS][LATENCY_COMPONENTS];
+};
+
+// the histograms of all the threads; they are never freed, so the
+// histograms of the threads that exited are merged as well
+static std::atomic<ThreadLatencies*> all_thread_latencies(nullptr);
+
+bool LatencyHistograms::_is_enabled = false;
+uint64_t LatencyHistograms::_start_cycles = 0;
+uint64_t LatencyHistograms::_start_ns = 0;
+__thread ThreadLatencies *LatencyHistograms::_thread_latencies = nullptr;
+
+static void Increase(uint64_t *counter, uint64_t value) {
+    __atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+static uint64_t Load(const uint64_t *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static uint64_t GetTimeNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+LatencyHistogram::LatencyHistogram() :
+    _count(0),
+    _sum(0),
+    _max(0) {
+        memset(_buckets, 0, sizeof(_buckets));
+    }
+
+int LatencyHistogram::GetBucket(uint64_t cycles) {
+    if (cycles < LATENCY_SUB_BUCKETS) {
+        return (int)cycles;
+    }
+    int exponent = 63 - __builtin_clzll(cycles);
+    if (exponent >= LATENCY_MAX_BITS) {
+        return LATENCY_BUCKETS - 1;
+    }
+    int shift = exponent - LATENCY_SUB_BUCKET_BITS;
+    int sub_bucket = (int)(cycles >> shift) & (LATENCY_SUB_BUCKETS - 1);
+    return (shift + 1) * LATENCY_SUB_BUCKETS + sub_bucket;
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(int bucket) {
+    if (bucket < LATENCY_SUB_BUCKETS) {
+        return (uint64_t)bucket;
+    }
+    int shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    uint64_t sub_bucket = bucket % LATENCY_SUB_BUCKETS;
+    return ((LATENCY_SUB_BUCKETS + sub_bucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t cycles) {
+    Increase(&_buckets[GetBucket(cycles)], 1);
+    Increase(&_count, 1);
+    Increase(&_sum, cycles);
+    if (cycles > _max) {
+        __atomic_store_n(&_max, cycles, __ATOMIC_RELAXED);
+    }
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram &other) {
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        _buckets[i] += Load(&other._buckets[i]);
+    }
+    _count += Load(&other._count);
+    _sum += Load(&other._sum);
+    uint64_t max = Load(&other._max);
+    if (max > _max) {
+        _max = max;
+    }
+}
+
+uint64_t LatencyHistogram::GetPercentile(double fraction) const {
+    uint64_t rank = (uint64_t)(fraction * _count + 0.999999);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t count = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        count += _buckets[i];
+        if (count >= rank) {
+            uint64_t upper_bound = GetBucketUpperBound(i);
+            return (upper_bound < _max) ? upper_bound : _max;
+        }
+    }
+    return _max;
+}
+
+uint64_t LatencyHistograms::ReadClock() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return GetTimeNs();
+#endif
+}
+
+void LatencyHistograms::Enable() {
+    _start_ns = GetTimeNs();
+    _start_cycles = ReadClock();
+    _is_enabled = true;
+}
+
+/*
+ * The rate of the clock is measured over the whole run, so it needs no
+ * calibration period.
+ */
+double LatencyHistograms::GetCyclesPerNs() {
+    uint64_t elapsed_ns = GetTimeNs() - _start_ns;
+    uint64_t elapsed_cycles = ReadClock() - _start_cycles;
+    if (elapsed_ns == 0 || elapsed_cycles == 0) {
+        return 1.0;
+    }
+    return (double)elapsed_cycles / elapsed_ns;
+}
+
+ThreadLatencies *LatencyHistograms::GetThreadLatencies() {
+    if (_thread_latencies != nullptr) {
+        return _thread_latencies;
+    }
+    // the histograms are allocated through glibc so they are not taken from
+    // the pools that they measure
+    void *ptr = GlibcMmap(NULL, sizeof(ThreadLatencies), MMAP_PROTECTION,
+                          MMAP_FLAGS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return nullptr;
+    }
+    ThreadLatencies *latencies = new (ptr) ThreadLatencies();
+    latencies->next = all_thread_latencies.load(std::memory_order_relaxed);
+    while (!all_thread_latencies.compare_exchange_weak(
+                latencies->next, latencies, std::memory_order_release,
+                std::memory_order_relaxed)) {
+    }
+    _thread_latencies = latencies;
+    return latencies;
+}
+
+bool LatencyHistograms::IsMeasuring() {
+    return _is_enabled && _thread_latencies != nullptr &&
+           _thread_latencies->depth > 0;
+}
+
+void LatencyHistograms::Begin() {
+    ThreadLatencies *latencies = GetThreadLatencies();
+    if (latencies == nullptr) {
+        return;
+    }
+    if (latencies->depth < LATENCY_MAX_DEPTH) {
+        LatencyFrame &frame = latencies->frames[latencies->depth];
+        memset(frame.components, 0, sizeof(frame.components));
+        frame.start_cycles = ReadClock();
+    }
+    latencies->depth++;
+}
+
+void LatencyHistograms::End(LatencyOperation operation) {
+    ThreadLatencies *latencies = _thread_latencies;
+    // the thread may have failed to allocate its histograms in Begin
+    if (latencies == nullptr || latencies->depth == 0) {
+        return;
+    }
+    latencies->depth--;
+    if (latencies->depth >= LATENCY_MAX_DEPTH) {
+        return;
+    }
+    LatencyFrame &frame = latencies->frames[latencies->depth];
+    frame.components[(int)LatencyComponent::TOTAL] =
+        ReadClock() - frame.start_cycles;
+    for (int c = 0; c < LATENCY_COMPONENTS; c++) {
+        latencies->histograms[(int)operation][c].Record(frame.components[c]);
+    }
+}
+
+void LatencyHistograms::AddComponent(LatencyComponent component,
+                                     uint64_t cycles) {
+    ThreadLatencies *latencies = _thread_latencies;
+    int depth = (latencies->depth < LATENCY_MAX_DEPTH) ?
+        latencies->depth : LATENCY_MAX_DEPTH;
+    for (int i = 0; i < depth; i++) {
+        latencies->frames[i].components[(int)component] += cycles;
+    }
+}
+
+void LatencyHistograms::Merge(
+        LatencyHistogram histograms[LATENCY_OPERATIONS][LATENCY_COMPONENTS]) {
+    ThreadLatencies *latencies =
+        all_thread_latencies.load(std::memory_order_acquire);
+    for (; latencies != nullptr; latencies = latencies->next) {
+        for (int o = 0; o < LATENCY_OPERATIONS; o++) {
+            for (int c = 0; c < LATENCY_COMPONENTS; c++) {
+                histograms[o][c].Merge(latencies->histograms[o][c]);
+            }
+        }
+    }
+}
+
+int LatencyHistograms::Write(const char *path) {
+    if (!_is_enabled) {
+        errno = ENODATA;
+        return -1;
+    }
+    // the merged histograms are too large for the stack of the caller
+    size_t length = sizeof(LatencyHistogram) *
+                    LATENCY_OPERATIONS * LATENCY_COMPONENTS;
+    void *ptr = GlibcMmap(NULL, length, MMAP_PROTECTION, MMAP_FLAGS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return -1;
+    }
+    auto histograms = static_cast<LatencyHistogram (*)[LATENCY_COMPONENTS]>(
+            ptr);
+    for (int o = 0; o < LATENCY_OPERATIONS; o++) {
+        for (int c = 0; c < LATENCY_COMPONENTS; c++) {
+            new (&histograms[o][c]) LatencyHistogram();
+        }
+    }
+    Merge(histograms);
+
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        int error = errno;
+        GlibcMunmap(ptr, length);
+        errno = error;
+        return -1;
+    }
+    double cycles_per_ns = GetCyclesPerNs();
+    fprintf(file, "operation,component,count,mean-ns,p50-ns,p90-ns,p99-ns,"
+                  "p99.9-ns,max-ns\n");
+    for (int o = 0; o < LATENCY_OPERATIONS; o++) {
+        for (int c = 0; c < LATENCY_COMPONENTS; c++) {
+            LatencyHistogram &histogram = histograms[o][c];
+            uint64_t count = histogram.GetCount();
+            fprintf(file, "%s,%s,%lu,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f\n",
+                    OPERATION_NAMES[o], COMPONENT_NAMES[c],
+                    (unsigned long)count,
+                    count ? histogram.GetSum() / cycles_per_ns / count : 0.0,
+                    histogram.GetPercentile(0.5) / cycles_per_ns,
+                    histogram.GetPercentile(0.9) / cycles_per_ns,
+                    histogram.GetPercentile(0.99) / cycles_per_ns,
+                    histogram.GetPercentile(0.999) / cycles_per_ns,
+                    histogram.GetMax() / cycles_per_ns);
+        }
+    }
+    int res = (fclose(file) == 0) ? 0 : -1;
+    int error = errno;
+    GlibcMunmap(ptr, length);
+    errno = error;
+    return res;
+}
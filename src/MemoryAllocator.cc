@@ -2,6 +2,9 @@
 #include <iostream>
 #include <fstream>
 #include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <errno.h>
 #include <assert.h>
 #include "MemoryAllocator.h"
 
@@ -15,17 +18,21 @@
 
 #define RESIZE_THRESHOLD (2097152)
 
+// the waiting times for the locks of the brk and file pools are published
+// with their statistics
+#define BRK_GUARD() TIMED_MUTEX_GUARD(_brk_mutex, \
+        (_brk_stats != nullptr) ? &_brk_stats->lock : nullptr)
+#define FILE_GUARD() TIMED_MUTEX_GUARD(_file_mmap_mutex, \
+        (_file_stats != nullptr) ? &_file_stats->lock : nullptr)
+
 void *_brk_region_base = 0;
 
-void* GlibcMmap(void *addr, size_t length, int prot, int flags,
-                int fd, off_t offset) {
-    static GlibcAllocationFunctions glibc_funcs;
-    return glibc_funcs.CallGlibcMmap(addr, length, prot, flags, fd, offset);
-}
+MemoryAllocator *MemoryAllocator::_forked_allocator = nullptr;
 
-int GlibcMunmap(void *addr, size_t length) {
-    static GlibcAllocationFunctions glibc_funcs;
-    return glibc_funcs.CallGlibcMunmap(addr, length);
+static uint64_t GetMonotonicTimeNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
 }
 
 void MemoryAllocator::SetIntervalConfigList(PoolConfigurationData &configurationData, const char *config_file,
@@ -42,18 +49,90 @@ void MemoryAllocator::SetIntervalConfigList(PoolConfigurationData &configuration
     }
 }
 
+/*
+ * Adds the pool of @pool_type to the anonymous mmap pools registry.
+ * Pools of size 0 are not added, unless they are mandatory.
+ */
+void MemoryAllocator::AddAnonymousMmapPool(const char *config_file,
+                                           const char *pool_type,
+                                           size_t ffa_list_size,
+                                           bool is_mandatory) {
+    PoolConfigurationData configuration_data;
+    SetIntervalConfigList(configuration_data, config_file, pool_type);
+    bool is_stack_pool = (strcmp(pool_type, STACK_POOL_TYPE) == 0);
+    // the stack pool is backed only with 4KB pages, so the huge-page windows
+    // of the other pools hold data only
+    if (is_stack_pool && configuration_data.intervalList.GetLength() != 0) {
+        THROW_EXCEPTION("stack pool supports only 4KB pages");
+    }
+    if (configuration_data.size == 0 && !is_mandatory) {
+        return;
+    }
+    if (_mmap_pools_count == MAX_ANONYMOUS_MMAP_POOLS) {
+        THROW_EXCEPTION("too many anonymous mmap pools");
+    }
+
+    int index = _mmap_pools_count++;
+    strcpy(_mmap_pool_names[index], pool_type);
+    _mmap_pools[index].SetHugePagesFallback(_huge_pages_fallback);
+    _mmap_pools[index].Initialize(configuration_data, ffa_list_size);
+    if (is_stack_pool) {
+        _stack_pool_index = index;
+    }
+}
+
 void MemoryAllocator::InitRegions(void *brk_region_base) {
     HugePagesConfiguration hppc;
+    auto general_params = hppc.GetGeneralParams();
+    _huge_pages_fallback = general_params._huge_pages_fallback;
+    _learn_stack_lengths = general_params._learn_stack_lengths;
     auto mmap_params = hppc.ReadFromEnvironmentVariables(HugePagesConfiguration::ConfigType::MMAP_POOL);
-    PoolConfigurationData mmap_configuration_data;
-    std::string mmap_type = "mmap";
-    SetIntervalConfigList(mmap_configuration_data, mmap_params.configuration_file, mmap_type.c_str());
-    _mmap_anon_hpbr.Initialize(mmap_configuration_data.size, mmap_configuration_data.intervalList, GlibcMmap,
-                               GlibcMunmap);
+    // the "mmap" pool is the default anonymous mmap pool, so it comes first
+    AddAnonymousMmapPool(mmap_params.configuration_file, DEFAULT_POOL_TYPE,
+                         mmap_params._ffa_list_size, true);
+    void* start = _mmap_pools[0].GetRegionBase();
 
-    void* start = _mmap_anon_hpbr.GetRegionBase();
-    void* end = (void*)((size_t)start + mmap_configuration_data.size);
-    _mmap_anon_ffa.Initialize(mmap_params._ffa_list_size, start, end, GlibcMmap, GlibcMunmap);
+    // any other pool type of the configuration file (other than brk and
+    // file) is an additional anonymous mmap pool, which is selected by the
+    // routing rules
+    auto stack_params = hppc.ReadFromEnvironmentVariables
+            (HugePagesConfiguration::ConfigType::STACK_POOL);
+    char pool_types[MAX_ANONYMOUS_MMAP_POOLS + 2][MAX_POOL_NAME_LENGTH];
+    int pool_types_count = parseCsv::GetPoolTypes(mmap_params.configuration_file,
+                                                  pool_types,
+                                                  MAX_ANONYMOUS_MMAP_POOLS + 2);
+    for (int i = 0; i < pool_types_count; i++) {
+        if (strcmp(pool_types[i], DEFAULT_POOL_TYPE) == 0 ||
+            strcmp(pool_types[i], "brk") == 0 ||
+            strcmp(pool_types[i], "file") == 0) {
+            continue;
+        }
+        size_t ffa_list_size = (strcmp(pool_types[i], STACK_POOL_TYPE) == 0) ?
+            stack_params._ffa_list_size : mmap_params._ffa_list_size;
+        AddAnonymousMmapPool(mmap_params.configuration_file, pool_types[i],
+                             ffa_list_size, false);
+    }
+
+    _call_site_depth = general_params._call_site_depth;
+    if (_call_site_depth < 1 || _call_site_depth > MAX_CALL_SITE_DEPTH) {
+        THROW_EXCEPTION("call-site depth is out of range");
+    }
+    // the layouts of the control file are applied only when it is modified
+    _layout_control_file = general_params._layout_control_file;
+    struct stat control_file_stat;
+    if (_layout_control_file != nullptr &&
+        stat(_layout_control_file, &control_file_stat) == 0) {
+        _layout_control_mtime = control_file_stat.st_mtim;
+    }
+    if (_layout_control_file != nullptr) {
+        _background_periods_ns[LAYOUT_POLLING_TASK] =
+            LAYOUT_CONTROL_POLL_INTERVAL_NS;
+    }
+    if (general_params._routing_file != nullptr) {
+        parseCsv::ParseRoutingRules(_routing_rules,
+                                    general_params._routing_file);
+        _routing_rules.BindPools(_mmap_pool_names, _mmap_pools_count);
+    }
 
     auto mmap_file_params = hppc.ReadFromEnvironmentVariables
             (HugePagesConfiguration::ConfigType::FILE_BACKED_POOL);
@@ -65,10 +144,15 @@ void MemoryAllocator::InitRegions(void *brk_region_base) {
     SetIntervalConfigList(mmap_file_configuration_list, mmap_params.configuration_file, file_type.c_str());
 
     mmap_file_configuration_list.intervalList.Initialize(GlibcMmap, GlibcMunmap, 0);
+    _mmap_file_hpbr.SetHugePagesFallback(_huge_pages_fallback);
     _mmap_file_hpbr.Initialize(mmap_file_configuration_list.size,
                                mmap_file_configuration_list.intervalList,
                                GlibcMmap,
-                               GlibcMunmap);
+                               GlibcMunmap,
+                               nullptr,
+                               GlibcMprotect,
+                               GlibcMadvise,
+                               GlibcMremap);
 
     void* mmap_file_start = _mmap_file_hpbr.GetRegionBase();
     void* mmap_file_end = (void*)((size_t)start + mmap_file_configuration_list.size);
@@ -80,26 +164,67 @@ void MemoryAllocator::InitRegions(void *brk_region_base) {
     PoolConfigurationData brk_configuration_list;
     std::string brk_type = "brk";
     SetIntervalConfigList(brk_configuration_list, brk_params.configuration_file, brk_type.c_str());
+    _brk_hpbr.SetHugePagesFallback(_huge_pages_fallback);
     _brk_hpbr.Initialize(brk_configuration_list.size,
                          brk_configuration_list.intervalList,
                          GlibcMmap,
                          GlibcMunmap,
-                         brk_region_base);
+                         brk_region_base,
+                         GlibcMprotect,
+                         GlibcMadvise,
+                         GlibcMremap);
 
-    _mmap_anon_hpbr.Resize(0);
+    // the regions do not move from now on, so they are indexed once
+    void *region_bases[MAX_ANONYMOUS_MMAP_POOLS + 2];
+    size_t region_sizes[MAX_ANONYMOUS_MMAP_POOLS + 2];
+    int regions_count = GetRegionsCount();
+    for (int i = 0; i < regions_count; i++) {
+        const char *name;
+        HugePageBackedRegion *region = GetRegion(i, &name);
+        region_bases[i] = region->GetRegionBase();
+        region_sizes[i] = region->GetRegionMaxSize();
+    }
+    _region_index.Initialize(GlibcMmap, GlibcMunmap, region_bases,
+                             region_sizes, regions_count);
+
+    for (int i = 0; i < _mmap_pools_count; i++) {
+        _mmap_pools[i].ResetRegion();
+    }
     _mmap_file_hpbr.Resize(0);
     _brk_hpbr.Resize(0);
 
-    _anon_mmap_max_size = 0;
     _file_mmap_max_size = 0;
     _brk_max_size = 0;
+    _brk_discarded_size = 0;
 
-    auto general_params = hppc.GetGeneralParams();
     _analyze_hpbrs = general_params._analyze_hpbrs;
+    if (_analyze_hpbrs) {
+        InitProfiles();
+    }
+    if (general_params._statistics) {
+        InitStatistics();
+    }
+    _latency_file = general_params._latency_file;
+    if (_latency_file != nullptr) {
+        LatencyHistograms::Enable();
+    }
+    if (general_params._sampling_file != nullptr) {
+        InitSampling(general_params._sampling_file,
+                     general_params._sampling_interval_ms * 1000000ull,
+                     general_params._sampling_operations);
+    }
+    if (general_params._access_sampling_file != nullptr) {
+        InitAccessSampling(general_params._access_sampling_file,
+                           general_params._access_sampling_interval_ms *
+                           1000000ull);
+    }
+    if (general_params._trace_file != nullptr) {
+        InitTracing(general_params._trace_file);
+    }
 
     if (_analyze_hpbrs) {
-        void* anon_start = _mmap_anon_hpbr.GetRegionBase();
-        void* anon_end = PTR_ADD(anon_start, _mmap_anon_hpbr.GetRegionMaxSize());
+        void* anon_start = _mmap_pools[0].GetRegionBase();
+        void* anon_end = PTR_ADD(anon_start, _mmap_pools[0].GetRegionMaxSize());
         void* brk_start = _brk_hpbr.GetRegionBase();
         void* brk_end = PTR_ADD(brk_start, _brk_hpbr.GetRegionMaxSize());
         void* file_start = _mmap_file_hpbr.GetRegionBase();
@@ -113,28 +238,533 @@ void MemoryAllocator::InitRegions(void *brk_region_base) {
             auto len = (unsigned long)ftell(log_file);
             if (len == 0) {
                 fprintf(log_file, 
-                        "pid,tid,anon-mmap-start,anon-mmap-end,brk-start,brk-end,file-mmap-start,file-mmap-end\n");
+                        "pid,tid,anon-mmap-start,anon-mmap-end,brk-start,brk-end,file-mmap-start,file-mmap-end,stack-mmap-start,stack-mmap-end\n");
             }
         }
-        fprintf(log_file, "%d,%d,%p,%p,%p,%p,%p,%p\n",
+        void* stack_start = nullptr;
+        void* stack_end = nullptr;
+        if (_stack_pool_index >= 0) {
+            MemoryPool &stack_pool = _mmap_pools[_stack_pool_index];
+            stack_start = stack_pool.GetRegionBase();
+            stack_end = PTR_ADD(stack_start, stack_pool.GetRegionMaxSize());
+        }
+        fprintf(log_file, "%d,%d,%p,%p,%p,%p,%p,%p,%p,%p\n",
                 pid, tid,
                 anon_start, anon_end,
                 brk_start, brk_end,
-                file_start, file_end);
+                file_start, file_end,
+                stack_start, stack_end);
         fclose(log_file);
     }
         
 }
 
 MemoryAllocator::MemoryAllocator() : 
-    _isInitialized(true), _analyze_hpbrs(false),
-    _anon_mmap_max_size(0), _file_mmap_max_size(0), _brk_max_size(0)
+    _isInitialized(true), _mmap_pools_count(0), _stack_pool_index(-1),
+    _call_site_depth(1),
+    _huge_pages_fallback(HugePagesFallback::ABORT),
+    _learn_stack_lengths(false),
+    _layout_control_file(nullptr), _layout_control_mtime({0, 0}),
+    _brk_stats(nullptr), _file_stats(nullptr), _latency_file(nullptr),
+    _is_background_thread_running(false), _background_wakeup_fd(-1),
+    _is_background_thread_stopping(false), _is_footprint_sample_due(false),
+    _analyze_hpbrs(false),
+    _file_mmap_max_size(0), _brk_max_size(0), _brk_discarded_size(0)
 {
+    for (int i = 0; i < MAX_STACK_LENGTHS; i++) {
+        _stack_lengths[i].store(0, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < BACKGROUND_TASKS_COUNT; i++) {
+        _background_periods_ns[i] = 0;
+    }
     InitRegions(_brk_region_base);
+    StartBackgroundThread();
 }
 
 MemoryAllocator::~MemoryAllocator() {
+    StopBackgroundThread();
+    // the last sample shows the footprints at exit
+    if (_isInitialized) {
+        SampleFootprint();
+        SampleAccesses(true);
+    }
+    _sampler.Close();
+    _access_sampler.Close();
+    TraceRecorder::Close();
+    if (_latency_file != nullptr) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s.%d", _latency_file, (int)getpid());
+        LatencyHistograms::Write(path);
+    }
     _isInitialized = false;
+    _statistics.Unlink();
+}
+
+/*
+ * Starts profiling the mappings of the pools for the analysis.
+ */
+void MemoryAllocator::InitProfiles() {
+    for (int i = 0; i < _mmap_pools_count; i++) {
+        if (_mmap_pools[i].EnableProfile() != 0) {
+            THROW_EXCEPTION("failed to allocate the profile of a pool");
+        }
+    }
+    if (_brk_profile.Initialize(_brk_hpbr.GetRegionBase(),
+                                _brk_hpbr.GetRegionMaxSize()) != 0 ||
+        _file_profile.Initialize(_mmap_file_hpbr.GetRegionBase(),
+                                 _mmap_file_hpbr.GetRegionMaxSize()) != 0) {
+        THROW_EXCEPTION("failed to allocate the profile of a pool");
+    }
+    int regions_count = GetRegionsCount();
+    for (int i = 0; i < regions_count; i++) {
+        const char *name = nullptr;
+        if (GetRegion(i, &name)->EnableTouchTracking() != 0) {
+            THROW_EXCEPTION("failed to allocate the touched chunks of a pool");
+        }
+    }
+}
+
+// the brk pool is occupied up to the program break
+void MemoryAllocator::SampleBrkOccupancy(bool is_forced) {
+    if (_brk_profile.BeginOccupancySample(is_forced)) {
+        void *base = _brk_hpbr.GetRegionBase();
+        RegionProfile::AddOccupiedRange(
+                base, PTR_ADD(base, _brk_hpbr.GetRegionSize()), &_brk_profile);
+    }
+}
+
+/*
+ * Writes the histograms of the sizes and the lifetimes of the mappings and
+ * the occupancy heatmaps of the pools next to the sizes of the pools, with
+ * the same region names.
+ */
+void MemoryAllocator::WriteProfiles(const std::string& pid_str) {
+    std::string sizes_name = "mosalloc_hpbrs_size_histograms." + pid_str +
+                             ".csv";
+    std::string lifetimes_name = "mosalloc_hpbrs_lifetimes." + pid_str +
+                                 ".csv";
+    std::string heatmap_name = "mosalloc_hpbrs_heatmap." + pid_str + ".csv";
+    FILE *sizes_file = fopen(sizes_name.c_str(), "w+");
+    FILE *lifetimes_file = fopen(lifetimes_name.c_str(), "w+");
+    FILE *heatmap_file = fopen(heatmap_name.c_str(), "w+");
+    if (sizes_file != NULL && lifetimes_file != NULL &&
+        heatmap_file != NULL) {
+        RegionProfile::WriteHeaders(sizes_file, lifetimes_file, heatmap_file);
+        {
+            BRK_GUARD();
+            SampleBrkOccupancy(true);
+            _brk_profile.Write("brk", sizes_file, lifetimes_file,
+                               heatmap_file);
+        }
+        _mmap_pools[0].WriteProfile("anon-mmap", sizes_file, lifetimes_file,
+                                    heatmap_file);
+        {
+            FILE_GUARD();
+            if (_file_profile.BeginOccupancySample(true)) {
+                _mmap_file_ffa.ForEachOccupied(RegionProfile::AddOccupiedRange,
+                                               &_file_profile);
+            }
+            _file_profile.Write("file-mmap", sizes_file, lifetimes_file,
+                                heatmap_file);
+        }
+        for (int i = 1; i < _mmap_pools_count; i++) {
+            std::string name = std::string(_mmap_pool_names[i]) + "-mmap";
+            _mmap_pools[i].WriteProfile(name.c_str(), sizes_file,
+                                        lifetimes_file, heatmap_file);
+        }
+    }
+    if (sizes_file != NULL) {
+        fclose(sizes_file);
+    }
+    if (lifetimes_file != NULL) {
+        fclose(lifetimes_file);
+    }
+    if (heatmap_file != NULL) {
+        fclose(heatmap_file);
+    }
+}
+
+/*
+ * Starts sampling the footprints of the pools (in the order of GetRegion).
+ */
+void MemoryAllocator::InitSampling(const char *sampling_file,
+                                   uint64_t interval_ns,
+                                   uint64_t operations) {
+    if (_sampler.Open(sampling_file, interval_ns, operations) != 0) {
+        THROW_EXCEPTION("failed to open the sampling file");
+    }
+    _background_periods_ns[FOOTPRINT_SAMPLING_TASK] = interval_ns;
+    int regions_count = GetRegionsCount();
+    for (int i = 0; i < regions_count; i++) {
+        const char *name = nullptr;
+        HugePageBackedRegion *region = GetRegion(i, &name);
+        _sampler.AddPool(name, region->GetRegionBase());
+    }
+}
+
+/*
+ * Starts recording the hooked calls, with the pools (in the order of
+ * GetRegion) in the header of the trace.
+ */
+void MemoryAllocator::InitTracing(const char *trace_file) {
+    int regions_count = GetRegionsCount();
+    for (int i = 0; i < regions_count; i++) {
+        const char *name = nullptr;
+        HugePageBackedRegion *region = GetRegion(i, &name);
+        TraceRecorder::AddPool(name, region->GetRegionBase(),
+                               region->GetRegionMaxSize());
+    }
+    if (TraceRecorder::Open(trace_file) != 0) {
+        THROW_EXCEPTION("failed to open the trace file");
+    }
+}
+
+/*
+ * Counts a call that may change the footprints of the pools. The hooks only
+ * bump the counter: when a sample is due by the count, the background thread
+ * is woken up to take it.
+ */
+void MemoryAllocator::CountFootprintOperation() {
+    if (_sampler.IsOpen() && _sampler.CountOperation()) {
+        _is_footprint_sample_due.store(true);
+        WakeBackgroundThread();
+    }
+}
+
+/*
+ * Writes a sample of the footprints of the pools. The samples are taken by
+ * the background thread and on exit (after the thread is stopped), so they
+ * are serialized.
+ */
+void MemoryAllocator::SampleFootprint() {
+    if (!_sampler.IsOpen()) {
+        return;
+    }
+    struct mosalloc_footprint_pool footprints[MOSALLOC_FOOTPRINT_MAX_POOLS];
+    CollectFootprints(footprints);
+    _sampler.Write(footprints);
+}
+
+/*
+ * Fills @footprints with the footprints of the pools (in the order of
+ * GetRegion), each under the lock of its pool.
+ */
+void MemoryAllocator::CollectFootprints(
+        struct mosalloc_footprint_pool *footprints) {
+    for (int i = 0; i < _mmap_pools_count; i++) {
+        _mmap_pools[i].GetFootprint(&footprints[i]);
+    }
+    {
+        BRK_GUARD();
+        struct mosalloc_footprint_pool &brk = footprints[_mmap_pools_count];
+        brk.size = _brk_hpbr.GetRegionSize();
+        brk.committed[0] = _brk_hpbr.GetCommittedSize(PageSize::BASE_4KB);
+        brk.committed[1] = _brk_hpbr.GetCommittedSize(PageSize::HUGE_2MB);
+        brk.committed[2] = _brk_hpbr.GetCommittedSize(PageSize::HUGE_1GB);
+        brk.ffa_top = (uint64_t)PTR_ADD(_brk_hpbr.GetRegionBase(), brk.size);
+    }
+    {
+        // the file mappings are mapped directly with 4KB pages, so the file
+        // pool is as large as the top of its allocations
+        FILE_GUARD();
+        struct mosalloc_footprint_pool &file =
+            footprints[_mmap_pools_count + 1];
+        file.ffa_top = (uint64_t)_mmap_file_ffa.GetTopAddress();
+        file.size = file.ffa_top - (uint64_t)_mmap_file_hpbr.GetRegionBase();
+        file.committed[0] = file.size;
+        file.committed[1] = 0;
+        file.committed[2] = 0;
+    }
+}
+
+/*
+ * Starts sampling the accesses to the pools (in the order of GetRegion).
+ */
+void MemoryAllocator::InitAccessSampling(const char *sampling_file,
+                                         uint64_t interval_ns) {
+    if (_access_sampler.Open(sampling_file, interval_ns) != 0) {
+        THROW_EXCEPTION("failed to open the idle page tracking files");
+    }
+    _background_periods_ns[ACCESS_SAMPLING_TASK] = interval_ns;
+    int regions_count = GetRegionsCount();
+    for (int i = 0; i < regions_count; i++) {
+        const char *name = nullptr;
+        HugePageBackedRegion *region = GetRegion(i, &name);
+        if (_access_sampler.AddPool(name, region->GetRegionBase(),
+                                    region->GetRegionMaxSize()) != 0) {
+            THROW_EXCEPTION("failed to allocate the access counters");
+        }
+    }
+}
+
+/*
+ * Samples the accesses to the pools up to their tops when a sample is due
+ * (or when @is_forced). The samples are taken by the background thread, on
+ * exit and by mosalloc_sample_accesses, never by the hooks. The pages are
+ * scanned without the locks of the pools: the pagemap reports the pages
+ * that are unmapped meanwhile as not present. A sample that is due while
+ * another thread takes one is skipped.
+ * Returns 0 on success, or -1 and sets errno to ENODATA if the accesses are
+ * not sampled.
+ */
+int MemoryAllocator::SampleAccesses(bool is_forced) {
+    if (!_access_sampler.IsOpen()) {
+        errno = ENODATA;
+        return -1;
+    }
+    if (!_access_sampler.IsDue() && !is_forced) {
+        return 0;
+    }
+#ifdef THREAD_SAFETY
+    std::unique_lock<std::mutex> guard(_access_sampling_mutex,
+                                       std::try_to_lock);
+    if (!guard.owns_lock()) {
+        return 0;
+    }
+#endif // THREAD_SAFETY
+    struct mosalloc_footprint_pool footprints[MOSALLOC_FOOTPRINT_MAX_POOLS];
+    CollectFootprints(footprints);
+    _access_sampler.BeginSample();
+    int regions_count = GetRegionsCount();
+    for (int i = 0; i < regions_count; i++) {
+        _access_sampler.SamplePool(i, footprints[i].size);
+    }
+    return 0;
+}
+
+/*
+ * Starts the background thread if any of its tasks is enabled. The thread is
+ * started only in the thread-safe build, since the tasks take the locks of
+ * the pools; otherwise, the samples are taken only on exit and on request.
+ */
+void MemoryAllocator::StartBackgroundThread() {
+#ifdef THREAD_SAFETY
+    // the footprint samples may be due by the number of calls only
+    bool has_tasks = _sampler.IsOpen();
+    for (int i = 0; i < BACKGROUND_TASKS_COUNT; i++) {
+        has_tasks = has_tasks || (_background_periods_ns[i] != 0);
+    }
+    if (!has_tasks) {
+        return;
+    }
+    _background_wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (_background_wakeup_fd < 0) {
+        THROW_EXCEPTION("failed to create the background thread eventfd");
+    }
+    _is_background_thread_stopping.store(false);
+    if (pthread_create(&_background_thread, nullptr, RunBackgroundThread,
+                       this) != 0) {
+        THROW_EXCEPTION("failed to create the background thread");
+    }
+    _is_background_thread_running = true;
+    if (_forked_allocator == nullptr) {
+        pthread_atfork(nullptr, nullptr, RestartBackgroundThreadInChild);
+    }
+    _forked_allocator = this;
+#endif // THREAD_SAFETY
+}
+
+void MemoryAllocator::StopBackgroundThread() {
+    if (!_is_background_thread_running) {
+        return;
+    }
+    _is_background_thread_stopping.store(true);
+    WakeBackgroundThread();
+    pthread_join(_background_thread, nullptr);
+    close(_background_wakeup_fd);
+    _background_wakeup_fd = -1;
+    _is_background_thread_running = false;
+}
+
+void MemoryAllocator::WakeBackgroundThread() {
+    if (_background_wakeup_fd < 0) {
+        return;
+    }
+    uint64_t wakeup = 1;
+    if (write(_background_wakeup_fd, &wakeup, sizeof(wakeup)) < 0) {
+        // the eventfd is only full if the thread is already woken up
+    }
+}
+
+/*
+ * The threads of the parent do not exist in a child process, so the child
+ * starts a background thread of its own (with an eventfd of its own, so it
+ * does not wake the thread of the parent up).
+ */
+void MemoryAllocator::RestartBackgroundThreadInChild() {
+    MemoryAllocator *allocator = _forked_allocator;
+    if (allocator == nullptr || !allocator->_is_background_thread_running) {
+        return;
+    }
+    close(allocator->_background_wakeup_fd);
+    allocator->_is_background_thread_running = false;
+    allocator->StartBackgroundThread();
+}
+
+/*
+ * Waits until the monotonic clock reaches @wakeup_ns (or forever if it is
+ * UINT64_MAX), or until the thread is woken up.
+ */
+void MemoryAllocator::WaitForBackgroundTasks(uint64_t wakeup_ns) {
+    struct pollfd wakeup_poll = {_background_wakeup_fd, POLLIN, 0};
+    struct timespec timeout;
+    struct timespec *timeout_ptr = nullptr;
+    if (wakeup_ns != UINT64_MAX) {
+        uint64_t now_ns = GetMonotonicTimeNs();
+        uint64_t timeout_ns = (wakeup_ns > now_ns) ? wakeup_ns - now_ns : 0;
+        timeout.tv_sec = timeout_ns / 1000000000ull;
+        timeout.tv_nsec = timeout_ns % 1000000000ull;
+        timeout_ptr = &timeout;
+    }
+    if (ppoll(&wakeup_poll, 1, timeout_ptr, nullptr) > 0) {
+        uint64_t wakeups;
+        if (read(_background_wakeup_fd, &wakeups, sizeof(wakeups)) < 0) {
+            // another wakeup is read on the next wait
+        }
+    }
+}
+
+/*
+ * Runs the periodic tasks of the allocator (see BackgroundTask) at their
+ * periods, outside of the hooked calls, until the allocator is destroyed.
+ */
+void* MemoryAllocator::RunBackgroundThread(void *arg) {
+    MemoryAllocator *allocator = static_cast<MemoryAllocator*>(arg);
+    uint64_t next_ns[BACKGROUND_TASKS_COUNT];
+    uint64_t now_ns = GetMonotonicTimeNs();
+    for (int i = 0; i < BACKGROUND_TASKS_COUNT; i++) {
+        uint64_t period_ns = allocator->_background_periods_ns[i];
+        next_ns[i] = (period_ns == 0) ? UINT64_MAX : now_ns + period_ns;
+    }
+    while (true) {
+        uint64_t wakeup_ns = UINT64_MAX;
+        for (int i = 0; i < BACKGROUND_TASKS_COUNT; i++) {
+            wakeup_ns = (next_ns[i] < wakeup_ns) ? next_ns[i] : wakeup_ns;
+        }
+        allocator->WaitForBackgroundTasks(wakeup_ns);
+        if (allocator->_is_background_thread_stopping.load()) {
+            break;
+        }
+        now_ns = GetMonotonicTimeNs();
+        bool is_due[BACKGROUND_TASKS_COUNT];
+        for (int i = 0; i < BACKGROUND_TASKS_COUNT; i++) {
+            is_due[i] = (now_ns >= next_ns[i]);
+            if (is_due[i]) {
+                next_ns[i] = now_ns + allocator->_background_periods_ns[i];
+            }
+        }
+        if (is_due[FOOTPRINT_SAMPLING_TASK] ||
+            allocator->_is_footprint_sample_due.exchange(false)) {
+            allocator->SampleFootprint();
+        }
+        if (is_due[ACCESS_SAMPLING_TASK]) {
+            allocator->SampleAccesses(true);
+        }
+        if (is_due[LAYOUT_POLLING_TASK]) {
+            allocator->PollLayoutControlFile();
+        }
+    }
+    return nullptr;
+}
+
+/*
+ * Creates the statistics segment, with the counters of the pools in the
+ * order of GetRegion.
+ */
+void MemoryAllocator::InitStatistics() {
+    if (_statistics.Create() != 0) {
+        THROW_EXCEPTION("failed to create the statistics segment");
+    }
+    for (int i = 0; i < _mmap_pools_count; i++) {
+        _mmap_pools[i].SetStatistics(_statistics.AddPool(
+                _mmap_pool_names[i], _mmap_pools[i].GetRegionMaxSize()));
+    }
+    _brk_stats = _statistics.AddPool("brk", _brk_hpbr.GetRegionMaxSize());
+    _file_stats = _statistics.AddPool("file",
+                                      _mmap_file_hpbr.GetRegionMaxSize());
+    StatisticsSegment::Set(&_file_stats->ffa_capacity,
+                           _mmap_file_ffa.GetCapacity());
+    // the fallbacks of the brk and file pools at their initialization
+    StatisticsSegment::SetFallbackCounters(_brk_stats, _brk_hpbr);
+    StatisticsSegment::SetFallbackCounters(_file_stats, _mmap_file_hpbr);
+}
+
+/*
+ * Updates the counters that are expensive to collect (the list nodes of the
+ * pools) when a reader asks for them.
+ */
+void MemoryAllocator::RefreshStatistics() {
+    uint32_t request;
+    if (!_statistics.IsRefreshRequested(&request)) {
+        return;
+    }
+    for (int i = 0; i < _mmap_pools_count; i++) {
+        _mmap_pools[i].RefreshStatistics();
+    }
+    StatisticsSegment::Set(&_file_stats->ffa_used_nodes,
+                           _mmap_file_ffa.GetUsedNodes());
+    _statistics.EndRefresh(request);
+}
+
+struct mosalloc_lock_stats* MemoryAllocator::GetHooksLockStatistics(
+        enum mosalloc_stats_call call) {
+    struct mosalloc_stats *stats = _statistics.Get();
+    if (stats == nullptr) {
+        return nullptr;
+    }
+    if (call == MOSALLOC_STATS_BRK || call == MOSALLOC_STATS_SBRK) {
+        return &stats->brk_hooks_lock;
+    }
+    return &stats->mmap_hooks_lock;
+}
+
+/*
+ * Publishes the change of the program break from @old_size (the brk pool is
+ * never decommitted, so its committed size is its size).
+ */
+void MemoryAllocator::PublishBrkStatistics(size_t old_size) {
+    if (_brk_stats == nullptr) {
+        return;
+    }
+    size_t new_size = _brk_hpbr.GetRegionSize();
+    void *base = _brk_hpbr.GetRegionBase();
+    if (new_size > old_size) {
+        StatisticsSegment::Add(&_brk_stats->allocations, 1);
+        StatisticsSegment::Add(&_brk_stats->extends, 1);
+        StatisticsSegment::AddBackedSizes(_brk_stats->allocated_bytes,
+                                          _brk_hpbr, PTR_ADD(base, old_size),
+                                          new_size - old_size);
+    } else if (new_size < old_size) {
+        StatisticsSegment::Add(&_brk_stats->deallocations, 1);
+        StatisticsSegment::Add(&_brk_stats->shrinks, 1);
+        StatisticsSegment::AddBackedSizes(_brk_stats->freed_bytes,
+                                          _brk_hpbr, PTR_ADD(base, new_size),
+                                          old_size - new_size);
+    }
+    StatisticsSegment::Set(&_brk_stats->mapped_size, new_size);
+    StatisticsSegment::Max(&_brk_stats->peak_mapped_size, new_size);
+    StatisticsSegment::Set(&_brk_stats->committed_size, new_size);
+    StatisticsSegment::SetFallbackCounters(_brk_stats, _brk_hpbr);
+}
+
+/*
+ * Publishes the size of the file pool, which is the top of its allocations
+ * (the file mappings are mapped directly, so its region is not resized).
+ */
+void MemoryAllocator::PublishFileStatistics() {
+    if (_file_stats == nullptr) {
+        return;
+    }
+    size_t size = (size_t)PTR_SUB(_mmap_file_ffa.GetTopAddress(),
+                                  _mmap_file_hpbr.GetRegionBase());
+    if (size > _file_stats->mapped_size) {
+        StatisticsSegment::Add(&_file_stats->extends, 1);
+    } else if (size < _file_stats->mapped_size) {
+        StatisticsSegment::Add(&_file_stats->shrinks, 1);
+    }
+    StatisticsSegment::Set(&_file_stats->mapped_size, size);
+    StatisticsSegment::Max(&_file_stats->peak_mapped_size, size);
+    StatisticsSegment::Set(&_file_stats->committed_size, size);
 }
 
 void MemoryAllocator::AnalyzeRegions() {
@@ -148,10 +778,28 @@ void MemoryAllocator::AnalyzeRegions() {
 
         std::string fileName = "mosalloc_hpbrs_sizes." + pid_str + ".csv";
         FILE *log_file = fopen (fileName.c_str(), "w+");
-        fprintf(log_file, "region,max-size\n");
-        fprintf(log_file, "brk,%lu\n", _brk_max_size);
-        fprintf(log_file, "anon-mmap,%lu\n", _anon_mmap_max_size);
-        fprintf(log_file, "file-mmap,%lu\n", _file_mmap_max_size);
+        // the brk and file-mmap regions are never decommitted, so their
+        // committed size is their size
+        fprintf(log_file, "region,max-size,max-committed-size,resident-size,discarded-size\n");
+        fprintf(log_file, "brk,%lu,%lu,%lu,%lu\n", _brk_max_size,
+                _brk_max_size, _brk_hpbr.GetResidentSize(),
+                _brk_discarded_size);
+        fprintf(log_file, "anon-mmap,%lu,%lu,%lu,%lu\n",
+                _mmap_pools[0].GetMaxSize(),
+                _mmap_pools[0].GetMaxCommittedSize(),
+                _mmap_pools[0].GetResidentSize(),
+                _mmap_pools[0].GetDiscardedSize());
+        fprintf(log_file, "file-mmap,%lu,%lu,%lu,%lu\n", _file_mmap_max_size,
+                _file_mmap_max_size, _mmap_file_hpbr.GetResidentSize(), 0ul);
+        // the additional pools are named after their type (e.g., stack-mmap)
+        for (int i = 1; i < _mmap_pools_count; i++) {
+            fprintf(log_file, "%s-mmap,%lu,%lu,%lu,%lu\n",
+                    _mmap_pool_names[i],
+                    _mmap_pools[i].GetMaxSize(),
+                    _mmap_pools[i].GetMaxCommittedSize(),
+                    _mmap_pools[i].GetResidentSize(),
+                    _mmap_pools[i].GetDiscardedSize());
+        }
         fclose(log_file);
         /*
            std::string fileName = "mosalloc_hpbrs_sizes." + pid_str + ".csv";
@@ -161,40 +809,473 @@ void MemoryAllocator::AnalyzeRegions() {
            _file_mmap_max_size);
            fclose(log_file);
            */
+        WriteProfiles(pid_str);
+        WriteUtilization(("mosalloc_hpbrs_windows." + pid_str +
+                          ".csv").c_str());
+    }
+}
+
+/*
+ * Writes the utilization of the intervals of the pools to @path, with the
+ * region names of the sizes file (the touched sizes are tracked only in
+ * analyze mode).
+ * Returns 0 on success, or -1 and sets errno.
+ */
+int MemoryAllocator::WriteUtilization(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return -1;
+    }
+    HugePageBackedRegion::WriteUtilizationHeader(file);
+    {
+        BRK_GUARD();
+        _brk_hpbr.WriteUtilization("brk", file);
     }
+    _mmap_pools[0].WriteUtilization("anon-mmap", file);
+    {
+        FILE_GUARD();
+        _mmap_file_hpbr.WriteUtilization("file-mmap", file);
+    }
+    for (int i = 1; i < _mmap_pools_count; i++) {
+        std::string name = std::string(_mmap_pool_names[i]) + "-mmap";
+        _mmap_pools[i].WriteUtilization(name.c_str(), file);
+    }
+    fclose(file);
+    return 0;
+}
+
+/*
+ * Verifies the backing of the anonymous and the brk pools (see
+ * HugePageBackedRegion::VerifyBacking); the file pool is skipped, since the
+ * file mappings are not backed by its intervals.
+ * Returns 0 on success, or -1 and sets errno.
+ */
+int MemoryAllocator::VerifyBacking(struct mosalloc_backing_report *report) {
+#ifdef THREAD_SAFETY
+    MUTEX_GUARD(_backing_verification_mutex);
+#endif // THREAD_SAFETY
+    memset(report, 0, sizeof(*report));
+    if (!_backing_verifier.IsOpen() && _backing_verifier.Open() != 0) {
+        return -1;
+    }
+    for (int i = 0; i < _mmap_pools_count; i++) {
+        if (_mmap_pools[i].VerifyBacking(_backing_verifier, report) != 0) {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    {
+        BRK_GUARD();
+        if (_brk_hpbr.VerifyBacking(_backing_verifier, report) != 0) {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    return 0;
 }
 
 void* MemoryAllocator::GetBrkRegionBase() {
     return _brk_hpbr.GetRegionBase();
 }
 
-void* MemoryAllocator::AllocateFromAnonymousMmapRegion(size_t length) {
-    MUTEX_GUARD(_anon_mmap_mutex);
+bool MemoryAllocator::IsRangeOverlappingPools(void *addr, size_t length) {
+    HugePageBackedRegion *regions[] = {&_mmap_file_hpbr, &_brk_hpbr};
+    for (auto region : regions) {
+        void *start = region->GetRegionBase();
+        void *end = PTR_ADD(start, region->GetRegionMaxSize());
+        if (addr < end && PTR_ADD(addr, length) > start) {
+            return true;
+        }
+    }
+    for (int i = 0; i < _mmap_pools_count; i++) {
+        void *start = _mmap_pools[i].GetRegionBase();
+        void *end = PTR_ADD(start, _mmap_pools[i].GetRegionMaxSize());
+        if (addr < end && PTR_ADD(addr, length) > start) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    void *ptr = _mmap_anon_ffa.Allocate(length);
-    if (ptr == NULL) {
-        THROW_EXCEPTION("Anonymous mmap pool is out of memory\n");
+/*
+ * Returns the anonymous mmap pool that contains @addr, or nullptr if there
+ * is no such pool. The hooks call this before they take any pool lock, so
+ * the pool is found through the index of the regions, which is built before
+ * the pools are used and never changes afterwards (unlike the pools, whose
+ * state is guarded by their locks).
+ */
+MemoryPool* MemoryAllocator::FindAnonymousMmapPool(void *addr) {
+    int index = _region_index.Find(addr);
+    if (index < 0 || index >= _mmap_pools_count) {
+        return nullptr;
     }
-    size_t hpbr_top_addr = (size_t)_mmap_anon_hpbr.GetRegionBase() +
-            _mmap_anon_hpbr.GetRegionSize();
-    size_t alloc_mem_top_addr = (size_t)ptr + length;
+    return &_mmap_pools[index];
+}
 
-    if (alloc_mem_top_addr > hpbr_top_addr) {
-        size_t size = alloc_mem_top_addr - (size_t)_mmap_anon_hpbr.GetRegionBase();
-        _mmap_anon_hpbr.Resize(size);
+/*
+ * Selects the anonymous mmap pool of a new mapping (and the page size of the
+ * intervals to allocate it from): the pool of the first matching routing
+ * rule, otherwise the stack pool for stacks (MAP_STACK, MAP_GROWSDOWN or the
+ * length of a stack that was recognized by its guard) if it is configured,
+ * otherwise the default pool.
+ * The call site is walked from @hook_frame only when there are origin rules,
+ * and the origin rules it matches are cached by its hash.
+ */
+MemoryPool* MemoryAllocator::RouteAnonymousMmap(size_t length, int flags,
+                                                void *hook_frame,
+                                                PageSize *page_size) {
+    uint64_t origins_mask = 0;
+    if (_routing_rules.HasOriginRules() && hook_frame != nullptr) {
+        void *frames[MAX_CALL_SITE_DEPTH];
+        int depth = CaptureCallSite(hook_frame, frames, _call_site_depth);
+        uint64_t hash = HashCallSite(frames, depth);
+        if (!_call_site_cache.Lookup(hash, &origins_mask)) {
+            origins_mask = _routing_rules.MatchOrigins(frames, depth);
+            _call_site_cache.Insert(hash, origins_mask);
+        }
     }
 
-    if (_anon_mmap_max_size < _mmap_anon_hpbr.GetRegionSize()) {
-        _anon_mmap_max_size = _mmap_anon_hpbr.GetRegionSize();
+    *page_size = PageSize::UNKNOWN;
+    const PoolRoutingRule *rule = _routing_rules.Match(length, flags,
+                                                       origins_mask);
+    if (rule != nullptr) {
+        *page_size = rule->_page_size;
+        return &_mmap_pools[rule->_pool_index];
     }
+    if (_stack_pool_index >= 0 &&
+        ((flags & (MAP_STACK | MAP_GROWSDOWN)) || IsStackLength(length))) {
+        return &_mmap_pools[_stack_pool_index];
+    }
+    return &_mmap_pools[0];
+}
 
-    return ptr;
+/*
+ * Recognizes the stacks that are mapped without MAP_STACK or MAP_GROWSDOWN by
+ * their guards: a PROT_NONE mprotect at the low end of a stack-sized mapping
+ * in another pool than the stack pool (see
+ * MemoryPool::GetGuardedStackLength). The stack itself is already in use and
+ * stays where it is, but its length is learned, so the later mappings of the
+ * same length (e.g., the stacks of the next threads) are routed to the stack
+ * pool. Once all the entries are used, no more lengths are learned.
+ * Since the data mappings of a learned length are routed to the stack pool as
+ * well, the lengths are learned only when HPC_LEARN_STACK_LENGTHS is set.
+ */
+void MemoryAllocator::LearnStackGuard(MemoryPool *pool, void *addr,
+                                      size_t guard_length) {
+    if (!_learn_stack_lengths || _stack_pool_index < 0 ||
+        pool == &_mmap_pools[_stack_pool_index]) {
+        return;
+    }
+    size_t length = pool->GetGuardedStackLength(addr, guard_length);
+    if (length == 0 || IsStackLength(length)) {
+        return;
+    }
+    for (int i = 0; i < MAX_STACK_LENGTHS; i++) {
+        size_t unused = 0;
+        if (_stack_lengths[i].compare_exchange_strong(unused, length) ||
+            unused == length) {
+            return;
+        }
+    }
+}
+
+bool MemoryAllocator::IsStackLength(size_t length) {
+    for (int i = 0; i < MAX_STACK_LENGTHS; i++) {
+        size_t stack_length = _stack_lengths[i].load(std::memory_order_relaxed);
+        if (stack_length == 0) {
+            return false;
+        }
+        if (stack_length == length) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Serves anonymous mmap calls.
+ * Fixed requests (and hints) are served by the pool that contains them;
+ * fixed requests outside of the pools are forwarded to the kernel. The other
+ * requests are routed to a pool by RouteAnonymousMmap.
+ */
+void* MemoryAllocator::AllocateFromAnonymousMmapRegion(void *addr,
+                                                       size_t length,
+                                                       int prot,
+                                                       int flags,
+                                                       void *hook_frame) {
+    RefreshStatistics();
+    CountFootprintOperation();
+    bool is_fixed = (flags & (MAP_FIXED | MAP_FIXED_NOREPLACE)) != 0;
+    if (length == 0 || (is_fixed && !IS_ALIGNED(addr, PageSize::BASE_4KB))) {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+    // the kernel maps whole pages, so round the length up like mmap does to
+    // keep the allocations page aligned and their sizes consistent with
+    // later munmap/mremap calls
+    length = ROUND_UP(length, PageSize::BASE_4KB);
+
+    MemoryPool *pool = FindAnonymousMmapPool(addr);
+    if (pool != nullptr && !pool->ContainsRange(addr, length)) {
+        pool = nullptr;
+    }
+    if (is_fixed && pool == nullptr) {
+        if (!IsRangeOverlappingPools(addr, length)) {
+            return GlibcMmap(addr, length, prot, flags, -1, 0);
+        }
+        // mapping over the other pools (or over the pool boundaries) would
+        // corrupt them
+        errno = (flags & MAP_FIXED_NOREPLACE) ? EEXIST : ENOMEM;
+        return MAP_FAILED;
+    }
+    PageSize page_size = PageSize::UNKNOWN;
+    if (pool == nullptr) {
+        pool = RouteAnonymousMmap(length, flags, hook_frame, &page_size);
+    }
+    return pool->Allocate(addr, length, prot, flags, page_size);
+}
+
+/*
+ * Serves explicit page-size requests (see mosalloc_alloc): the first pool
+ * (in the registry order) with room in its intervals of @page_size (or
+ * anywhere, if @page_size is unknown) is used. Unless @is_strict, requests
+ * that do not fit in such intervals are served by the first fit of the
+ * default pool. Returns NULL and sets errno to ENOMEM if there is no room,
+ * without exiting like a full pool does on mmap.
+ */
+void* MemoryAllocator::AllocatePages(size_t length, PageSize page_size,
+                                     bool is_strict) {
+    if (length == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    length = ROUND_UP(length, PageSize::BASE_4KB);
+    for (int i = 0; i < _mmap_pools_count; i++) {
+        void *ptr = _mmap_pools[i].AllocatePages(length, page_size);
+        if (ptr != NULL) {
+            return ptr;
+        }
+    }
+    if (!is_strict && page_size != PageSize::UNKNOWN) {
+        void *ptr = _mmap_pools[0].AllocatePages(length, PageSize::UNKNOWN);
+        if (ptr != NULL) {
+            return ptr;
+        }
+    }
+    errno = ENOMEM;
+    return NULL;
+}
+
+/*
+ * Returns the anonymous mmap pool at @index of the registry (and its name),
+ * or nullptr if there is no such pool.
+ */
+MemoryPool* MemoryAllocator::GetAnonymousMmapPool(int index,
+                                                  const char **name) {
+    if (index < 0 || index >= _mmap_pools_count) {
+        return nullptr;
+    }
+    *name = _mmap_pool_names[index];
+    return &_mmap_pools[index];
+}
+
+/*
+ * Moves [addr, addr + length) of an anonymous or of the brk pool to pages of
+ * @page_size (see HugePageBackedRegion::Migrate). The file-backed pool is not
+ * supported, since its pages are shared with the files.
+ */
+int MemoryAllocator::MigrateRange(void *addr, size_t length,
+                                  PageSize page_size, size_t *copied_size) {
+    MemoryPool *pool = FindAnonymousMmapPool(addr);
+    if (pool != nullptr) {
+        if (!pool->ContainsRange(addr, length)) {
+            errno = EINVAL;
+            return -1;
+        }
+        return pool->Migrate(addr, length, page_size, copied_size);
+    }
+    void *brk_start = _brk_hpbr.GetRegionBase();
+    if (addr >= brk_start &&
+        addr < PTR_ADD(brk_start, _brk_hpbr.GetRegionMaxSize())) {
+        BRK_GUARD();
+        int res = _brk_hpbr.Migrate(addr, length, page_size, copied_size);
+        if (res != 0) {
+            errno = -res;
+            return -1;
+        }
+        return 0;
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+/*
+ * The caller holds the lock of the region (see GetRegionMutex).
+ */
+int MemoryAllocator::RelayoutRegion(int index, MemoryIntervalList& layout,
+                                    bool is_dry_run) {
+    int res;
+    if (index < _mmap_pools_count) {
+        return _mmap_pools[index].Relayout(layout, is_dry_run);
+    } else if (index == _mmap_pools_count) {
+        res = _brk_hpbr.Relayout(layout, is_dry_run);
+    } else {
+        res = _mmap_file_hpbr.Relayout(layout, is_dry_run);
+    }
+    if (res != 0) {
+        errno = -res;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Replaces the layouts of the pools above their tops (see
+ * HugePageBackedRegion::Relayout) with the layouts of @config_file, which has
+ * the format of the configuration file. Pools that do not appear in the file
+ * keep their layouts, and the sizes of the pools cannot be changed.
+ * The layouts are validated like the initial ones, and all of them are
+ * checked before any pool is changed. The locks of the changed pools are held
+ * from the checks until the layouts are applied, so the pools cannot grow
+ * into the new layouts in between.
+ * An invalid file fails the call (unlike the configuration file at
+ * initialization, which exits).
+ * Returns 0 on success, or -1 and sets errno.
+ */
+int MemoryAllocator::Relayout(const char *config_file) {
+    if (access(config_file, R_OK) != 0) {
+        return -1;
+    }
+    char pool_types[MAX_ANONYMOUS_MMAP_POOLS + 2][MAX_POOL_NAME_LENGTH];
+    int pool_types_count;
+    if (parseCsv::TryGetPoolTypes(config_file, pool_types,
+                                  MAX_ANONYMOUS_MMAP_POOLS + 2,
+                                  &pool_types_count)
+        != ParseCsvError::SUCCESS) {
+        return -1;
+    }
+    int max_windows;
+    if (parseCsv::TryGetConfigFileMaxWindows(config_file, &max_windows)
+        != ParseCsvError::SUCCESS) {
+        return -1;
+    }
+    int intervals_size = max_windows * 2 + 1;
+    PoolConfigurationData layouts[MAX_ANONYMOUS_MMAP_POOLS + 2];
+    int regions[MAX_ANONYMOUS_MMAP_POOLS + 2];
+    int layouts_count = 0;
+    for (int i = 0; i < GetRegionsCount(); i++) {
+        const char *name = nullptr;
+        GetRegion(i, &name);
+        bool is_in_file = false;
+        for (int j = 0; j < pool_types_count; j++) {
+            is_in_file |= (strcmp(pool_types[j], name) == 0);
+        }
+        if (!is_in_file) {
+            continue;
+        }
+        PoolConfigurationData& layout = layouts[layouts_count];
+        layout.intervalList.Initialize(GlibcMmap, GlibcMunmap, intervals_size);
+        if (parseCsv::TryParseCsv(layout, config_file, name)
+            != ParseCsvError::SUCCESS) {
+            return -1;
+        }
+        if (_intervals_configuration_validator.Validate(layout.intervalList)
+            != ValidatorErrorMessage::SUCCESS) {
+            errno = EINVAL;
+            return -1;
+        }
+        regions[layouts_count++] = i;
+    }
+#ifdef THREAD_SAFETY
+    // the regions are locked in the order of their indices, and no other path
+    // holds more than one of these locks
+    std::unique_lock<std::mutex> guards[MAX_ANONYMOUS_MMAP_POOLS + 2];
+    for (int i = 0; i < layouts_count; i++) {
+        guards[i] = std::unique_lock<std::mutex>(GetRegionMutex(regions[i]));
+    }
+#endif // THREAD_SAFETY
+    for (int i = 0; i < layouts_count; i++) {
+        if (RelayoutRegion(regions[i], layouts[i].intervalList, true) != 0) {
+            return -1;
+        }
+    }
+    for (int i = 0; i < layouts_count; i++) {
+        if (RelayoutRegion(regions[i], layouts[i].intervalList, false) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#ifdef THREAD_SAFETY
+std::mutex& MemoryAllocator::GetRegionMutex(int index) {
+    if (index < _mmap_pools_count) {
+        return _mmap_pools[index].GetMutex();
+    }
+    if (index == _mmap_pools_count) {
+        return _brk_mutex;
+    }
+    return _file_mmap_mutex;
+}
+#endif // THREAD_SAFETY
+
+/*
+ * Applies the layouts of the control file (see Relayout) whenever it is
+ * modified. The file is checked once a second by the background thread,
+ * never from the hooked calls, so it should be replaced atomically (e.g., by
+ * rename).
+ */
+void MemoryAllocator::PollLayoutControlFile() {
+    struct stat control_file_stat;
+    if (stat(_layout_control_file, &control_file_stat) != 0 ||
+        (control_file_stat.st_mtim.tv_sec == _layout_control_mtime.tv_sec &&
+         control_file_stat.st_mtim.tv_nsec == _layout_control_mtime.tv_nsec)) {
+        return;
+    }
+    _layout_control_mtime = control_file_stat.st_mtim;
+    Relayout(_layout_control_file);
+}
+
+/*
+ * The regions of all the pools, for introspection: the anonymous mmap pools
+ * (in the registry order), followed by the brk and the file-backed pools.
+ * These calls take no locks, so they can be called from signal handlers.
+ */
+int MemoryAllocator::GetRegionsCount() {
+    return _isInitialized ? _mmap_pools_count + 2 : 0;
+}
+
+HugePageBackedRegion* MemoryAllocator::GetRegion(int index,
+                                                 const char **name) {
+    if (index < 0 || index >= GetRegionsCount()) {
+        return nullptr;
+    }
+    if (index < _mmap_pools_count) {
+        *name = _mmap_pool_names[index];
+        return &_mmap_pools[index].GetRegion();
+    }
+    if (index == _mmap_pools_count) {
+        *name = "brk";
+        return &_brk_hpbr;
+    }
+    *name = "file";
+    return &_mmap_file_hpbr;
+}
+
+/*
+ * Returns the index of the region (see GetRegion) that contains @addr, or -1
+ * if there is no such region. The regions are found in constant time through
+ * their index (see RegionIndex), so this can be called from signal handlers.
+ */
+int MemoryAllocator::FindRegion(void *addr) {
+    return _region_index.Find(addr);
 }
 
 void* MemoryAllocator::AllocateFromFileMmapRegion(
         void *addr, size_t length, int prot, 
         int flags, int fd, off_t offset) {
-    MUTEX_GUARD(_file_mmap_mutex);
+    CountFootprintOperation();
+    FILE_GUARD();
 
     void* ptr = addr;
     if (ptr == NULL) {
@@ -209,30 +1290,37 @@ void* MemoryAllocator::AllocateFromFileMmapRegion(
         _file_mmap_max_size = ffa_max_size;
     }
 
-    return GlibcMmap(ptr, length, prot, MAP_FIXED | flags, fd, offset);
-}
-
-int MemoryAllocator::DeallocateFromAnonymousMmapRegion(void* addr, size_t length) {
-    MUTEX_GUARD(_anon_mmap_mutex);
-    int res = _mmap_anon_ffa.Free(addr, length);
-    auto ffa_top_size = (size_t)(PTR_SUB(_mmap_anon_ffa.GetTopAddress(),
-                                           _mmap_anon_hpbr.GetRegionBase()));
-    if (res == 0
-        && ffa_top_size < _mmap_anon_hpbr.GetRegionSize()) {
-        if ((_mmap_anon_hpbr.GetRegionSize() - ffa_top_size)
-            > RESIZE_THRESHOLD) {
-            return _mmap_anon_hpbr.Resize(ffa_top_size);
+    void *res = GlibcMmap(ptr, length, prot, MAP_FIXED | flags, fd, offset);
+    if (res != MAP_FAILED && _file_profile.IsInitialized()) {
+        if (_file_profile.BeginOccupancySample()) {
+            _mmap_file_ffa.ForEachOccupied(RegionProfile::AddOccupiedRange,
+                                           &_file_profile);
         }
+        _file_profile.CountAllocation(res, length);
+    }
+    if (res != MAP_FAILED && _file_stats != nullptr) {
+        StatisticsSegment::Add(&_file_stats->allocations, 1);
+        StatisticsSegment::AddBackedSizes(_file_stats->allocated_bytes,
+                                          _mmap_file_hpbr, res, length);
+        PublishFileStatistics();
     }
-
     return res;
 }
 
 int MemoryAllocator::DeallocateFromFileMmapRegion(void* addr, size_t length) {
-    MUTEX_GUARD(_file_mmap_mutex);
+    FILE_GUARD();
     int res = _mmap_file_ffa.Free(addr, length);
     if (res < 0) 
         return res;
+    if (_file_profile.IsInitialized()) {
+        _file_profile.CountDeallocation(addr, length);
+    }
+    if (_file_stats != nullptr) {
+        StatisticsSegment::Add(&_file_stats->deallocations, 1);
+        StatisticsSegment::AddBackedSizes(_file_stats->freed_bytes,
+                                          _mmap_file_hpbr, addr, length);
+        PublishFileStatistics();
+    }
     
     auto ffa_top_size = (size_t)(PTR_SUB(_mmap_file_ffa.GetTopAddress(),
                                            _mmap_file_hpbr.GetRegionBase()));
@@ -247,52 +1335,127 @@ int MemoryAllocator::DeallocateFromFileMmapRegion(void* addr, size_t length) {
 }
 
 int MemoryAllocator::ChangeProgramBreak(void *addr) {
-    MUTEX_GUARD(_brk_mutex);
+    RefreshStatistics();
+    CountFootprintOperation();
+    BRK_GUARD();
+    size_t old_size = _brk_hpbr.GetRegionSize();
 
     /* 
      * On success, brk() returns zero.  On error, -1 is returned, 
      * and errno is set to ENOMEM. 
     */
     size_t new_size = (size_t)addr - (size_t)_brk_hpbr.GetRegionBase();
-    if (addr < _brk_hpbr.GetRegionBase() ||
-        _brk_hpbr.Resize(new_size) != 0) {
+    if (addr < _brk_hpbr.GetRegionBase()) {
         errno = ENOMEM;
         
         return -1;
     }
+    if (_brk_hpbr.Resize(new_size) != 0) {
+        // the huge pages ran out (see HugePagesFallback::FAIL), so drop the
+        // part of the extension that was mapped
+        _brk_hpbr.Resize(old_size);
+        PublishBrkStatistics(old_size);
+        errno = ENOMEM;
+        return -1;
+    }
 
     if (_brk_max_size < _brk_hpbr.GetRegionSize()) {
         _brk_max_size = _brk_hpbr.GetRegionSize();
     }
+    SampleBrkOccupancy();
+    PublishBrkStatistics(old_size);
 
     return 0;
 }
 
 int MemoryAllocator::DeallocateFromMmapRegion(void *addr, size_t size) {
-    _anon_mmap_mutex.lock();
-    bool isAddrInAnonMmapPool = _mmap_anon_ffa.Contains(addr);
-    _anon_mmap_mutex.unlock();
+    CountFootprintOperation();
+    MemoryPool *pool = FindAnonymousMmapPool(addr);
 
     _file_mmap_mutex.lock();
     bool isAddrInFileMmapPool = _mmap_file_ffa.Contains(addr);
     _file_mmap_mutex.unlock();
 
-    if (isAddrInAnonMmapPool) {
-        return DeallocateFromAnonymousMmapRegion(addr, size);
+    if (pool != nullptr) {
+        return pool->Deallocate(addr, ROUND_UP(size, PageSize::BASE_4KB));
     }
     else if (isAddrInFileMmapPool) {
         return DeallocateFromFileMmapRegion(addr, size);
     }
-    else {
+    else if (!IsRangeOverlappingPools(addr, size)) {
+        // e.g., fixed mappings that were forwarded to the kernel
+        return GlibcMunmap(addr, size);
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+/*
+ * Serves mprotect calls on pool addresses.
+ * Protection changes are applied in the anonymous pools (see
+ * MemoryPool::Protect), and are ignored in the other pools. PROT_NONE changes
+ * may also reveal stack guards (see LearnStackGuard).
+ */
+int MemoryAllocator::ProtectMmapRegion(void *addr, size_t len, int prot) {
+    CountFootprintOperation();
+    if (!IS_ALIGNED(addr, PageSize::BASE_4KB)) {
+        errno = EINVAL;
         return -1;
     }
+    len = ROUND_UP(len, PageSize::BASE_4KB);
+
+    MemoryPool *pool = FindAnonymousMmapPool(addr);
+    if (pool == nullptr || len == 0) {
+        return 0;
+    }
+    if (pool->Protect(addr, len, prot) != 0) {
+        return -1;
+    }
+    if (prot == PROT_NONE) {
+        LearnStackGuard(pool, addr, len);
+    }
+    return 0;
+}
+
+/*
+ * Serves madvise calls on pool addresses.
+ * MADV_DONTNEED and MADV_FREE release the memory of the pages in the range
+ * according to the page sizes of the anonymous and brk pools (see
+ * HugePageBackedRegion::Discard); any other advice is passed to the kernel.
+ */
+int MemoryAllocator::AdviseMmapRegion(void *addr, size_t length, int advice) {
+    if (advice != MADV_DONTNEED && advice != MADV_FREE) {
+        return GlibcMadvise(addr, length, advice);
+    }
+    CountFootprintOperation();
+    if (!IS_ALIGNED(addr, PageSize::BASE_4KB)) {
+        errno = EINVAL;
+        return -1;
+    }
+    length = ROUND_UP(length, PageSize::BASE_4KB);
+
+    MemoryPool *pool = FindAnonymousMmapPool(addr);
+
+    bool isAddrInBrkPool = (addr >= _brk_hpbr.GetRegionBase() &&
+                            addr < PTR_ADD(_brk_hpbr.GetRegionBase(),
+                                           _brk_hpbr.GetRegionMaxSize()));
+
+    if (pool != nullptr) {
+        return pool->Advise(addr, length, advice);
+    }
+    else if (isAddrInBrkPool) {
+        BRK_GUARD();
+        _brk_discarded_size += _brk_hpbr.Discard(addr, length, advice);
+        return 0;
+    }
+    return GlibcMadvise(addr, length, advice);
 }
 
 bool MemoryAllocator::IsAddressInHugePageRegions(void *addr) {
     if (!_isInitialized)
         return false;
 
-    bool isAddrInAnonMmapPool = _mmap_anon_ffa.Contains(addr);
+    bool isAddrInAnonMmapPool = (FindAnonymousMmapPool(addr) != nullptr);
 
     bool isAddrInFileMmapPool = _mmap_file_ffa.Contains(addr);
     
@@ -302,3 +1465,65 @@ bool MemoryAllocator::IsAddressInHugePageRegions(void *addr) {
 
     return (isAddrInAnonMmapPool || isAddrInFileMmapPool || isAddrInBrkPool);
 }
+
+void* MemoryAllocator::RemapFileMmapRegion(void *old_address,
+                                           size_t old_size,
+                                           size_t new_size,
+                                           int flags) {
+    FILE_GUARD();
+
+    // file-backed mappings cannot be grown or moved without knowing their
+    // file, so only shrinking them in place is supported
+    (void)flags;
+    if (new_size > old_size ||
+        _mmap_file_ffa.ResizeInPlace(old_address, old_size, new_size) != 0) {
+        errno = ENOMEM;
+        return MAP_FAILED;
+    }
+    GlibcMunmap(PTR_ADD(old_address, new_size), old_size - new_size);
+    if (_file_profile.IsInitialized()) {
+        _file_profile.CountRemap(old_address, old_address, new_size);
+    }
+    return old_address;
+}
+
+/*
+ * Serves mremap calls on pool addresses.
+ * Allocations are resized in place when the adjacent range of the pool is
+ * free. Otherwise, if MREMAP_MAYMOVE is given, they are relocated inside the
+ * same pool.
+ */
+void* MemoryAllocator::RemapMmapRegion(void *old_address, size_t old_size,
+                                       size_t new_size, int flags,
+                                       void *new_address) {
+    CountFootprintOperation();
+    // remapping to a given address (MREMAP_FIXED) or keeping the old
+    // mapping (MREMAP_DONTUNMAP) is not supported inside the pools
+    (void)new_address;
+    if ((flags & ~MREMAP_MAYMOVE) != 0 ||
+        !IS_ALIGNED(old_address, PageSize::BASE_4KB) ||
+        new_size == 0) {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+    old_size = ROUND_UP(old_size, PageSize::BASE_4KB);
+    new_size = ROUND_UP(new_size, PageSize::BASE_4KB);
+    if (old_size == new_size) {
+        return old_address;
+    }
+
+    MemoryPool *pool = FindAnonymousMmapPool(old_address);
+
+    _file_mmap_mutex.lock();
+    bool isAddrInFileMmapPool = _mmap_file_ffa.Contains(old_address);
+    _file_mmap_mutex.unlock();
+
+    if (pool != nullptr) {
+        return pool->Remap(old_address, old_size, new_size, flags);
+    }
+    else if (isAddrInFileMmapPool) {
+        return RemapFileMmapRegion(old_address, old_size, new_size, flags);
+    }
+    errno = EFAULT;
+    return MAP_FAILED;
+}
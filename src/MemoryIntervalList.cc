@@ -135,5 +135,99 @@ off_t MemoryIntervalList::FindMaxEndOffset() {
     return max_end_offset;
 }
 
+int MemoryIntervalList::ReplaceRange(off_t start_offset, off_t end_offset,
+                                     PageSize page_size) {
+    if (start_offset >= end_offset || _list_length == 0 ||
+        start_offset < _interval_list[0]._start_offset ||
+        end_offset > _interval_list[_list_length - 1]._end_offset) {
+        return -1;
+    }
+    // the intervals that contain the first and the last byte of the range
+    size_t first = 0;
+    while (_interval_list[first]._end_offset <= start_offset) {
+        first++;
+    }
+    size_t last = first;
+    while (_interval_list[last]._end_offset < end_offset) {
+        last++;
+    }
 
+    // build the intervals that replace [first, last]
+    MemoryInterval replacement[3];
+    size_t replacement_length = 0;
+    if (_interval_list[first]._start_offset < start_offset) {
+        replacement[replacement_length]._start_offset =
+            _interval_list[first]._start_offset;
+        replacement[replacement_length]._end_offset = start_offset;
+        replacement[replacement_length]._page_size =
+            _interval_list[first]._page_size;
+        replacement_length++;
+    }
+    replacement[replacement_length]._start_offset = start_offset;
+    replacement[replacement_length]._end_offset = end_offset;
+    replacement[replacement_length]._page_size = page_size;
+    replacement_length++;
+    if (_interval_list[last]._end_offset > end_offset) {
+        replacement[replacement_length]._start_offset = end_offset;
+        replacement[replacement_length]._end_offset =
+            _interval_list[last]._end_offset;
+        replacement[replacement_length]._page_size =
+            _interval_list[last]._page_size;
+        replacement_length++;
+    }
+
+    // merge the replacement with the neighbours of the same page size
+    size_t merged_first = first;
+    size_t merged_last = last;
+    if (merged_first > 0 &&
+        _interval_list[merged_first - 1]._page_size ==
+        replacement[0]._page_size) {
+        merged_first--;
+        replacement[0]._start_offset =
+            _interval_list[merged_first]._start_offset;
+    }
+    if (merged_last + 1 < _list_length &&
+        _interval_list[merged_last + 1]._page_size ==
+        replacement[replacement_length - 1]._page_size) {
+        merged_last++;
+        replacement[replacement_length - 1]._end_offset =
+            _interval_list[merged_last]._end_offset;
+    }
+    size_t j = 0;
+    for (size_t i = 1; i < replacement_length; i++) {
+        if (replacement[i]._page_size == replacement[j]._page_size) {
+            replacement[j]._end_offset = replacement[i]._end_offset;
+        } else {
+            j++;
+            replacement[j]._start_offset = replacement[i]._start_offset;
+            replacement[j]._end_offset = replacement[i]._end_offset;
+            replacement[j]._page_size = replacement[i]._page_size;
+        }
+    }
+    replacement_length = j + 1;
 
+    size_t removed_length = merged_last - merged_first + 1;
+    size_t new_length = _list_length - removed_length + replacement_length;
+    if (new_length > _list_capcaity) {
+        return -1;
+    }
+    // move the tail field by field (in the direction that does not
+    // overwrite the intervals that were not moved yet)
+    size_t tail_length = _list_length - merged_last - 1;
+    size_t from = merged_last + 1;
+    size_t to = merged_first + replacement_length;
+    for (size_t k = 0; k < tail_length; k++) {
+        size_t i = (to < from) ? k : tail_length - 1 - k;
+        _interval_list[to + i]._start_offset = _interval_list[from + i]._start_offset;
+        _interval_list[to + i]._end_offset = _interval_list[from + i]._end_offset;
+        _interval_list[to + i]._page_size = _interval_list[from + i]._page_size;
+    }
+    for (size_t i = 0; i < replacement_length; i++) {
+        MemoryInterval& interval = _interval_list[merged_first + i];
+        interval._start_offset = replacement[i]._start_offset;
+        interval._end_offset = replacement[i]._end_offset;
+        interval._page_size = replacement[i]._page_size;
+    }
+    _list_length = new_length;
+    return 0;
+}
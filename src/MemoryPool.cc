@@ -0,0 +1,579 @@
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "GlibcAllocationFunctions.h"
+#include "MemoryPool.h"
+
+// the waiting times for the pool lock are published with its statistics
+#define POOL_GUARD() \
+    TIMED_MUTEX_GUARD(_mutex, (_stats != nullptr) ? &_stats->lock : nullptr)
+
+#define RESIZE_THRESHOLD (2097152)
+
+MemoryPool::MemoryPool() :
+    _is_initialized(false),
+    _mapper(GlibcMmap),
+    _advisor(GlibcMadvise),
+    _remapper(GlibcMremap),
+    _max_size(0),
+    _max_committed_size(0),
+    _discarded_size(0),
+    _stats(nullptr) {
+    }
+
+void MemoryPool::Initialize(PoolConfigurationData &configurationData,
+                            size_t ffa_list_size,
+                            MmapFuncPtr mapper,
+                            MunmapFuncPtr unmapper,
+                            MprotectFuncPtr protector,
+                            MadviseFuncPtr advisor,
+                            MremapFuncPtr remapper) {
+    _mapper = mapper;
+    _advisor = advisor;
+    _remapper = remapper;
+    _hpbr.Initialize(configurationData.size,
+                     configurationData.intervalList,
+                     mapper,
+                     unmapper,
+                     nullptr,
+                     protector,
+                     advisor,
+                     remapper);
+
+    void* start = _hpbr.GetRegionBase();
+    void* end = PTR_ADD(start, configurationData.size);
+    _ffa.Initialize(ffa_list_size, start, end, GlibcMmap, GlibcMunmap);
+    _is_initialized = true;
+}
+
+/*
+ * Unmaps the (fully mapped) region of the pool until it is used. This should
+ * be called only after all the pools were initialized, so the address ranges
+ * of the pools are not reused by the other pools.
+ */
+void MemoryPool::ResetRegion() {
+    _hpbr.Resize(0);
+    _max_size = 0;
+    _max_committed_size = 0;
+    _discarded_size = 0;
+}
+
+bool MemoryPool::Contains(void *addr) {
+    return (_is_initialized && _ffa.Contains(addr));
+}
+
+bool MemoryPool::ContainsRange(void *addr, size_t length) {
+    return (Contains(addr) && _ffa.Contains(PTR_ADD(addr, length - 1)));
+}
+
+void *MemoryPool::GetRegionBase() {
+    return _hpbr.GetRegionBase();
+}
+
+size_t MemoryPool::GetRegionMaxSize() {
+    return _hpbr.GetRegionMaxSize();
+}
+
+size_t MemoryPool::GetResidentSize() {
+    POOL_GUARD();
+    return _hpbr.GetResidentSize();
+}
+
+size_t MemoryPool::GetRegionSize() {
+    POOL_GUARD();
+    return _hpbr.GetRegionSize();
+}
+
+size_t MemoryPool::GetCommittedSize() {
+    POOL_GUARD();
+    return _hpbr.GetCommittedSize();
+}
+
+/*
+ * Returns the size of the intervals of the pool with @page_size.
+ */
+size_t MemoryPool::GetBackedSize(PageSize page_size) {
+    MemoryIntervalList& intervals = _hpbr.GetIntervals();
+    size_t size = 0;
+    for (size_t i = 0; i < intervals.GetLength(); i++) {
+        MemoryInterval& interval = intervals.At(i);
+        if (interval._page_size == page_size) {
+            size += interval._end_offset - interval._start_offset;
+        }
+    }
+    return size;
+}
+
+/*
+ * Returns 0, or -ENOMEM if the region could not be extended up to
+ * [ptr, ptr + length) because its huge pages ran out (see
+ * HugePagesFallback::FAIL).
+ */
+int MemoryPool::ExtendRegion(void *ptr, size_t length) {
+    size_t hpbr_top_addr = (size_t)_hpbr.GetRegionBase() +
+            _hpbr.GetRegionSize();
+    size_t alloc_mem_top_addr = (size_t)ptr + length;
+
+    int res = 0;
+    if (alloc_mem_top_addr > hpbr_top_addr) {
+        size_t size = alloc_mem_top_addr - (size_t)_hpbr.GetRegionBase();
+        res = _hpbr.Resize(size);
+        if (res == 0 && _stats != nullptr) {
+            StatisticsSegment::Add(&_stats->extends, 1);
+        }
+    }
+
+    if (_max_size < _hpbr.GetRegionSize()) {
+        _max_size = _hpbr.GetRegionSize();
+    }
+    UpdateCommittedSize();
+    PublishSizes();
+    return res;
+}
+
+void MemoryPool::UpdateCommittedSize() {
+    size_t committed_size = _hpbr.GetCommittedSize();
+    if (_max_committed_size < committed_size) {
+        _max_committed_size = committed_size;
+    }
+}
+
+int MemoryPool::ShrinkRegion() {
+    auto ffa_top_size = (size_t)(PTR_SUB(_ffa.GetTopAddress(),
+                                           _hpbr.GetRegionBase()));
+    if (ffa_top_size < _hpbr.GetRegionSize()) {
+        if ((_hpbr.GetRegionSize() - ffa_top_size)
+            > RESIZE_THRESHOLD) {
+            int res = _hpbr.Resize(ffa_top_size);
+            if (_stats != nullptr) {
+                StatisticsSegment::Add(&_stats->shrinks, 1);
+                PublishSizes();
+            }
+            return res;
+        }
+    }
+    return 0;
+}
+
+void MemoryPool::SetStatistics(struct mosalloc_pool_stats *stats) {
+    _stats = stats;
+    if (_stats != nullptr) {
+        StatisticsSegment::Set(&_stats->ffa_capacity, _ffa.GetCapacity());
+        PublishSizes();
+    }
+}
+
+void MemoryPool::RefreshStatistics() {
+    if (_stats != nullptr) {
+        StatisticsSegment::Set(&_stats->ffa_used_nodes, _ffa.GetUsedNodes());
+    }
+}
+
+void MemoryPool::GetFootprint(struct mosalloc_footprint_pool *footprint) {
+    POOL_GUARD();
+    footprint->size = _hpbr.GetRegionSize();
+    footprint->committed[0] = _hpbr.GetCommittedSize(PageSize::BASE_4KB);
+    footprint->committed[1] = _hpbr.GetCommittedSize(PageSize::HUGE_2MB);
+    footprint->committed[2] = _hpbr.GetCommittedSize(PageSize::HUGE_1GB);
+    footprint->ffa_top = (uint64_t)_ffa.GetTopAddress();
+}
+
+int MemoryPool::EnableProfile() {
+    return _profile.Initialize(_hpbr.GetRegionBase(), GetRegionMaxSize());
+}
+
+void MemoryPool::SampleOccupancy(bool is_forced) {
+    if (_profile.BeginOccupancySample(is_forced)) {
+        _ffa.ForEachOccupied(RegionProfile::AddOccupiedRange, &_profile);
+    }
+}
+
+void MemoryPool::WriteUtilization(const char *name, FILE *file) {
+    POOL_GUARD();
+    _hpbr.WriteUtilization(name, file);
+}
+
+int MemoryPool::VerifyBacking(PageBackingVerifier &verifier,
+                              struct mosalloc_backing_report *report) {
+    POOL_GUARD();
+    return _hpbr.VerifyBacking(verifier, report);
+}
+
+void MemoryPool::WriteProfile(const char *name, FILE *sizes_file,
+                              FILE *lifetimes_file, FILE *heatmap_file) {
+    POOL_GUARD();
+    // the last sample shows the occupancy at the end
+    SampleOccupancy(true);
+    _profile.Write(name, sizes_file, lifetimes_file, heatmap_file);
+}
+
+void MemoryPool::PublishSizes() {
+    if (_stats == nullptr) {
+        return;
+    }
+    size_t mapped_size = _hpbr.GetRegionSize();
+    StatisticsSegment::Set(&_stats->mapped_size, mapped_size);
+    StatisticsSegment::Max(&_stats->peak_mapped_size, mapped_size);
+    StatisticsSegment::Set(&_stats->committed_size, _hpbr.GetCommittedSize());
+    StatisticsSegment::SetFallbackCounters(_stats, _hpbr);
+}
+
+void MemoryPool::CountAllocation(void *addr, size_t length) {
+    if (_stats != nullptr) {
+        StatisticsSegment::Add(&_stats->allocations, 1);
+        StatisticsSegment::AddBackedSizes(_stats->allocated_bytes, _hpbr,
+                                          addr, length);
+    }
+}
+
+void MemoryPool::CountDeallocation(void *addr, size_t length) {
+    if (_stats != nullptr) {
+        StatisticsSegment::Add(&_stats->deallocations, 1);
+        StatisticsSegment::AddBackedSizes(_stats->freed_bytes, _hpbr,
+                                          addr, length);
+    }
+}
+
+/*
+ * Returns [addr, addr + length) to the pool, restoring the default
+ * protection of the pages that were protected by the released allocations.
+ */
+void MemoryPool::ReleaseRange(void *addr, size_t length) {
+    _ffa.FreeRange(addr, length);
+    _hpbr.Protect(addr, length, MMAP_PROTECTION);
+}
+
+/*
+ * Returns the first fit inside the intervals of @page_size, or NULL.
+ */
+void* MemoryPool::AllocateInIntervalsOf(size_t length, PageSize page_size) {
+    MemoryIntervalList& intervals = _hpbr.GetIntervals();
+    void *base = _hpbr.GetRegionBase();
+    for (size_t i = 0; i < intervals.GetLength(); i++) {
+        MemoryInterval& interval = intervals.At(i);
+        if (interval._page_size != page_size) {
+            continue;
+        }
+        void *ptr = _ffa.AllocateInRange(length,
+                                         PTR_ADD(base, interval._start_offset),
+                                         PTR_ADD(base, interval._end_offset));
+        if (ptr != NULL) {
+            return ptr;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * An address hint is used when the requested range is inside the pool and
+ * free; otherwise, the first fit (inside the intervals of @page_size, if it
+ * is known and they have room) is returned. MAP_FIXED replaces whatever is
+ * allocated in the requested range (like mmap does), while
+ * MAP_FIXED_NOREPLACE fails with EEXIST if any of it is in use.
+ */
+void* MemoryPool::Allocate(void *addr, size_t length, int prot, int flags,
+                           PageSize page_size) {
+    POOL_GUARD();
+    SampleOccupancy();
+
+    void *ptr = NULL;
+    if (flags & MAP_FIXED_NOREPLACE) {
+        ptr = _ffa.AllocateAt(addr, length);
+        if (ptr == NULL) {
+            errno = EEXIST;
+            return MAP_FAILED;
+        }
+    } else if (flags & MAP_FIXED) {
+        // the mappings in the range are kept if it cannot be replaced
+        ptr = _ffa.ReplaceAt(addr, length);
+        if (ptr == NULL) {
+            errno = ENOMEM;
+            return MAP_FAILED;
+        }
+        // the replaced mappings end their lifetimes
+        if (_profile.IsInitialized()) {
+            _profile.CountDeallocation(addr, length);
+        }
+        _hpbr.Protect(addr, length, MMAP_PROTECTION);
+    } else {
+        if (addr != NULL && IS_ALIGNED(addr, PageSize::BASE_4KB) &&
+            ContainsRange(addr, length)) {
+            ptr = _ffa.AllocateAt(addr, length);
+        }
+        if (ptr == NULL && page_size != PageSize::UNKNOWN) {
+            ptr = AllocateInIntervalsOf(length, page_size);
+        }
+        if (ptr == NULL) {
+            ptr = _ffa.Allocate(length);
+        }
+        if (ptr == NULL) {
+            THROW_EXCEPTION("mmap pool is out of memory\n");
+        }
+    }
+
+    // PROT_NONE mappings are reservations that are committed later (by
+    // mprotect or by MAP_FIXED mmap), so do not back them with memory
+    // unless the decommitted ranges cannot be tracked
+    bool is_reserved = (prot == PROT_NONE &&
+                        _hpbr.Decommit(ptr, length) == 0);
+    if (flags & MAP_FIXED) {
+        _hpbr.ClearRange(ptr, length);
+    }
+    if ((!is_reserved && _hpbr.Commit(ptr, length) != 0) ||
+        ExtendRegion(ptr, length) != 0) {
+        ReleaseRange(ptr, length);
+        ShrinkRegion();
+        errno = ENOMEM;
+        return MAP_FAILED;
+    }
+
+    if (!is_reserved && prot != MMAP_PROTECTION &&
+        _hpbr.Protect(ptr, length, prot) != 0) {
+        ReleaseRange(ptr, length);
+        ShrinkRegion();
+        errno = ENOMEM;
+        return MAP_FAILED;
+    }
+    CountAllocation(ptr, length);
+    if (_profile.IsInitialized()) {
+        _profile.CountAllocation(ptr, length);
+    }
+    return ptr;
+}
+
+/*
+ * Allocates @length bytes (readable and writable) only inside the intervals
+ * of @page_size, or at the first fit of the pool if @page_size is unknown.
+ * Returns NULL if there is no room (unlike Allocate, which exits when the
+ * pool is full).
+ */
+void* MemoryPool::AllocatePages(size_t length, PageSize page_size) {
+    POOL_GUARD();
+    SampleOccupancy();
+    void *ptr = (page_size == PageSize::UNKNOWN) ?
+        _ffa.Allocate(length) : AllocateInIntervalsOf(length, page_size);
+    if (ptr == NULL) {
+        return NULL;
+    }
+    if (_hpbr.Commit(ptr, length) != 0 || ExtendRegion(ptr, length) != 0) {
+        ReleaseRange(ptr, length);
+        ShrinkRegion();
+        return NULL;
+    }
+    CountAllocation(ptr, length);
+    if (_profile.IsInitialized()) {
+        _profile.CountAllocation(ptr, length);
+    }
+    return ptr;
+}
+
+int MemoryPool::Deallocate(void *addr, size_t length) {
+    POOL_GUARD();
+    SampleOccupancy();
+    CountDeallocation(addr, length);
+    if (_profile.IsInitialized()) {
+        _profile.CountDeallocation(addr, length);
+    }
+    ReleaseRange(addr, length);
+    return ShrinkRegion();
+}
+
+/*
+ * Moves the contents of [from, from + length) to [to, to + length) inside the
+ * pool. When both ranges are backed with 4KB pages, the page-table entries
+ * are moved by the kernel (mremap) instead of copying the data, and the
+ * source range is then backed again with fresh pages so the pool stays fully
+ * mapped below its top.
+ */
+void MemoryPool::MovePages(void *from, void *to, size_t length) {
+    if (_hpbr.IsUniformlyBacked(from, length, PageSize::BASE_4KB) &&
+        _hpbr.IsUniformlyBacked(to, length, PageSize::BASE_4KB)) {
+        void *res = _remapper(from, length, length,
+                              MREMAP_MAYMOVE | MREMAP_FIXED, to);
+        if (res == to) {
+            res = _mapper(from, length, MMAP_PROTECTION,
+                          MMAP_FLAGS | MAP_FIXED, -1, 0);
+            if (res == MAP_FAILED) {
+                THROW_EXCEPTION("failed to refill the mmap pool");
+            }
+            return;
+        }
+    }
+    memcpy(to, from, length);
+}
+
+/*
+ * Allocations are resized in place when the adjacent range of the pool is
+ * free, and are always shrunk in place (their tails are freed like munmap
+ * does). Otherwise, if MREMAP_MAYMOVE is given, they are relocated inside the
+ * pool.
+ */
+void* MemoryPool::Remap(void *old_address, size_t old_size, size_t new_size,
+                        int flags) {
+    POOL_GUARD();
+    SampleOccupancy();
+
+    // first, try to grow/shrink the allocation in place, where the tail of
+    // an allocation that is followed by other allocations is freed
+    if (_ffa.ResizeInPlace(old_address, old_size, new_size) == 0 ||
+        (new_size < old_size &&
+         _ffa.FreeRange(PTR_ADD(old_address, new_size),
+                        old_size - new_size) == 0)) {
+        if (new_size > old_size) {
+            if (_hpbr.Commit(PTR_ADD(old_address, old_size),
+                             new_size - old_size) != 0 ||
+                ExtendRegion(old_address, new_size) != 0) {
+                _ffa.ResizeInPlace(old_address, new_size, old_size);
+                ShrinkRegion();
+                errno = ENOMEM;
+                return MAP_FAILED;
+            }
+            if (_stats != nullptr) {
+                StatisticsSegment::AddBackedSizes(
+                        _stats->allocated_bytes, _hpbr,
+                        PTR_ADD(old_address, old_size), new_size - old_size);
+            }
+        } else {
+            if (_stats != nullptr) {
+                StatisticsSegment::AddBackedSizes(
+                        _stats->freed_bytes, _hpbr,
+                        PTR_ADD(old_address, new_size), old_size - new_size);
+            }
+            _hpbr.Protect(PTR_ADD(old_address, new_size),
+                          old_size - new_size, MMAP_PROTECTION);
+            ShrinkRegion();
+        }
+        if (_profile.IsInitialized()) {
+            _profile.CountRemap(old_address, old_address, new_size);
+        }
+        return old_address;
+    }
+
+    if (new_size < old_size || !(flags & MREMAP_MAYMOVE)) {
+        errno = ENOMEM;
+        return MAP_FAILED;
+    }
+
+    // otherwise, relocate the allocation inside the pool
+    void *new_address = _ffa.Allocate(new_size);
+    if (new_address == NULL) {
+        errno = ENOMEM;
+        return MAP_FAILED;
+    }
+    // the pages must be accessible to be moved, and the protection of the
+    // source range is not carried over to the new address
+    if (_hpbr.Commit(new_address, new_size) != 0 ||
+        ExtendRegion(new_address, new_size) != 0 ||
+        _hpbr.Commit(old_address, old_size) != 0) {
+        ReleaseRange(new_address, new_size);
+        ShrinkRegion();
+        errno = ENOMEM;
+        return MAP_FAILED;
+    }
+    _hpbr.Protect(old_address, old_size, MMAP_PROTECTION);
+    MovePages(old_address, new_address, old_size);
+    CountAllocation(new_address, new_size);
+    CountDeallocation(old_address, old_size);
+    // the moved mapping keeps its lifetime
+    if (_profile.IsInitialized()) {
+        _profile.CountRemap(old_address, new_address, new_size);
+    }
+
+    ReleaseRange(old_address, old_size);
+    ShrinkRegion();
+    return new_address;
+}
+
+/*
+ * Making decommitted pages accessible commits them, while other protection
+ * changes are applied to the committed pages (so PROT_NONE keeps their
+ * contents). Fails with ENOMEM (like mprotect) if there are no huge pages
+ * left to commit them.
+ */
+int MemoryPool::Protect(void *addr, size_t len, int prot) {
+    POOL_GUARD();
+    if (prot != PROT_NONE) {
+        int res = _hpbr.Commit(addr, len);
+        UpdateCommittedSize();
+        PublishSizes();
+        if (res != 0) {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    if (_hpbr.Protect(addr, len, prot) != 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Returns the length of the mapping that starts at @addr if it looks like a
+ * stack whose guard is [addr, addr + guard_length): a stack-sized mapping
+ * that is protected at its low end, since stacks grow down. Returns 0
+ * otherwise.
+ */
+size_t MemoryPool::GetGuardedStackLength(void *addr, size_t guard_length) {
+    if (guard_length > MAX_STACK_GUARD_LENGTH) {
+        return 0;
+    }
+    POOL_GUARD();
+    size_t length = _ffa.GetOccupiedSize(addr);
+    if (length <= guard_length || length < MIN_STACK_LENGTH ||
+        length > MAX_STACK_LENGTH) {
+        return 0;
+    }
+    return length;
+}
+
+/*
+ * Moves [addr, addr + length) to pages of @page_size (see
+ * HugePageBackedRegion::Migrate). Returns 0 on success, or -1 and sets errno.
+ */
+int MemoryPool::Migrate(void *addr, size_t length, PageSize page_size,
+                        size_t *copied_size) {
+    POOL_GUARD();
+    int res = _hpbr.Migrate(addr, length, page_size, copied_size);
+    if (res != 0) {
+        errno = -res;
+        return -1;
+    }
+    if (_max_size < _hpbr.GetRegionSize()) {
+        _max_size = _hpbr.GetRegionSize();
+    }
+    UpdateCommittedSize();
+    PublishSizes();
+    return 0;
+}
+
+/*
+ * Replaces the layout of the pool above its top (see
+ * HugePageBackedRegion::Relayout). Returns 0 on success, or -1 and sets
+ * errno.
+ * The caller holds the lock of the pool (see GetMutex), so that a dry run
+ * stays valid until the layout is applied.
+ */
+int MemoryPool::Relayout(MemoryIntervalList& layout, bool is_dry_run) {
+    int res = _hpbr.Relayout(layout, is_dry_run);
+    if (res != 0) {
+        errno = -res;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * MADV_DONTNEED and MADV_FREE release the memory of the pages in the range
+ * according to the page sizes of the pool (see
+ * HugePageBackedRegion::Discard); any other advice is passed to the kernel.
+ */
+int MemoryPool::Advise(void *addr, size_t length, int advice) {
+    if (advice != MADV_DONTNEED && advice != MADV_FREE) {
+        return _advisor(addr, length, advice);
+    }
+    POOL_GUARD();
+    _discarded_size += _hpbr.Discard(addr, length, advice);
+    return 0;
+}
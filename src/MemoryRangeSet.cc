@@ -0,0 +1,173 @@
+#include <string.h>
+#include <sys/mman.h>
+#include "MemoryRangeSet.h"
+
+MemoryRangeSet::MemoryRangeSet() :
+    _ranges(nullptr),
+    _capacity(0),
+    _length(0),
+    _mmap(nullptr),
+    _munmap(nullptr) {
+    }
+
+void MemoryRangeSet::Initialize(MmapFuncPtr allocator,
+        MunmapFuncPtr deallocator,
+        size_t capacity) {
+    _capacity = capacity;
+    _length = 0;
+    _mmap = allocator;
+    _munmap = deallocator;
+    if (capacity == 0) {
+        return;
+    }
+    size_t length = ROUND_UP(capacity * sizeof(OffsetRange), PageSize::BASE_4KB);
+    void *ptr = _mmap(NULL, length, MMAP_PROTECTION, MMAP_FLAGS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        THROW_EXCEPTION("Failed to allocate Memory Range Set");
+    }
+    _ranges = static_cast<OffsetRange*>(ptr);
+}
+
+MemoryRangeSet::~MemoryRangeSet() {
+    if (_ranges == nullptr) {
+        return;
+    }
+    size_t length = ROUND_UP(_capacity * sizeof(OffsetRange), PageSize::BASE_4KB);
+    if (_munmap(_ranges, length) != 0) {
+        THROW_EXCEPTION("Failed to deallocate Memory Range Set");
+    }
+}
+
+/*
+ * Binary search for the first range that ends after @offset, i.e., the first
+ * range that may contain @offset or that starts after it.
+ */
+size_t MemoryRangeSet::FindFirstEndingAfter(off_t offset) {
+    size_t low = 0, high = _length;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (_ranges[mid]._end_offset <= offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/*
+ * Move the ranges [from, _length) to start at index @to
+ */
+void MemoryRangeSet::MoveRanges(size_t from, size_t to) {
+    if (from == to) {
+        return;
+    }
+    memmove(&_ranges[to], &_ranges[from],
+            (_length - from) * sizeof(OffsetRange));
+    _length = _length + to - from;
+}
+
+int MemoryRangeSet::Add(off_t start_offset, off_t end_offset) {
+    if (start_offset >= end_offset) {
+        return 0;
+    }
+    // find the first range that overlaps or touches the new one
+    size_t first = FindFirstEndingAfter(start_offset - 1);
+    size_t last = first;
+    while (last < _length && _ranges[last]._start_offset <= end_offset) {
+        last++;
+    }
+    // ranges [first, last) are merged with the new range
+    if (first == last) {
+        if (_length == _capacity) {
+            return -1;
+        }
+        MoveRanges(first, first + 1);
+        _ranges[first]._start_offset = start_offset;
+        _ranges[first]._end_offset = end_offset;
+        return 0;
+    }
+    if (_ranges[first]._start_offset < start_offset) {
+        start_offset = _ranges[first]._start_offset;
+    }
+    if (_ranges[last - 1]._end_offset > end_offset) {
+        end_offset = _ranges[last - 1]._end_offset;
+    }
+    _ranges[first]._start_offset = start_offset;
+    _ranges[first]._end_offset = end_offset;
+    MoveRanges(last, first + 1);
+    return 0;
+}
+
+int MemoryRangeSet::Remove(off_t start_offset, off_t end_offset) {
+    if (start_offset >= end_offset) {
+        return 0;
+    }
+    size_t first = FindFirstEndingAfter(start_offset);
+    if (first == _length || _ranges[first]._start_offset >= end_offset) {
+        return 0;
+    }
+    // removing a sub-range from the middle of a range splits it
+    if (_ranges[first]._start_offset < start_offset &&
+        _ranges[first]._end_offset > end_offset) {
+        if (_length == _capacity) {
+            return -1;
+        }
+        MoveRanges(first + 1, first + 2);
+        _ranges[first + 1]._start_offset = end_offset;
+        _ranges[first + 1]._end_offset = _ranges[first]._end_offset;
+        _ranges[first]._end_offset = start_offset;
+        return 0;
+    }
+    size_t keep_from = first;
+    if (_ranges[first]._start_offset < start_offset) {
+        _ranges[first]._end_offset = start_offset;
+        keep_from = first + 1;
+    }
+    size_t last = keep_from;
+    while (last < _length && _ranges[last]._end_offset <= end_offset) {
+        last++;
+    }
+    if (last < _length && _ranges[last]._start_offset < end_offset) {
+        _ranges[last]._start_offset = end_offset;
+    }
+    MoveRanges(last, keep_from);
+    return 0;
+}
+
+void MemoryRangeSet::Clear() {
+    _length = 0;
+}
+
+bool MemoryRangeSet::Contains(off_t offset) {
+    size_t i = FindFirstEndingAfter(offset);
+    return (i < _length && _ranges[i]._start_offset <= offset);
+}
+
+bool MemoryRangeSet::Intersects(off_t start_offset, off_t end_offset) {
+    size_t i = FindFirstEndingAfter(start_offset);
+    return (i < _length && _ranges[i]._start_offset < end_offset);
+}
+
+size_t MemoryRangeSet::GetIntersectionSize(off_t start_offset,
+                                           off_t end_offset) {
+    size_t total = 0;
+    for (size_t i = FindFirstEndingAfter(start_offset);
+         i < _length && _ranges[i]._start_offset < end_offset;
+         i++) {
+        off_t start = (_ranges[i]._start_offset > start_offset) ?
+            _ranges[i]._start_offset : start_offset;
+        off_t end = (_ranges[i]._end_offset < end_offset) ?
+            _ranges[i]._end_offset : end_offset;
+        total += (size_t)(end - start);
+    }
+    return total;
+}
+
+size_t MemoryRangeSet::GetTotalSize() {
+    size_t total = 0;
+    for (size_t i = 0; i < _length; i++) {
+        total += (size_t)(_ranges[i]._end_offset - _ranges[i]._start_offset);
+    }
+    return total;
+}
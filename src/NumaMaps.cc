@@ -1,7 +1,11 @@
 #include <stdexcept>
-#include <regex>
-#include <fstream>
-#include <iostream>
+#include <system_error>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <dirent.h>
 
 #include "NumaMaps.h"
@@ -19,12 +23,26 @@ NumaMaps::MemoryRange::MemoryRange(void *start_address,
         _dirty_pages(dirty_pages),
         _page_size(page_size),
         _total_size(total_size),
-        _pages_in_node(pages_in_node) {}
+        _pages_in_node(std::move(pages_in_node)),
+        _rss(0),
+        _anon_huge_pages(0),
+        _private_hugetlb(0) {}
 
 NumaMaps::MemoryRange::~MemoryRange() {}
 
-PageSize CastPageSizeString(std::string page_size_in_kb_str) {
-    size_t page_size_in_kb = stoul(page_size_in_kb_str);
+#define READ_BUFFER_SIZE (65536)
+
+// compares the token [@begin, @end) with the string literal @literal
+#define TOKEN_EQUALS(begin, end, literal) \
+    ((size_t)((end) - (begin)) == sizeof(literal) - 1 && \
+     memcmp((begin), (literal), sizeof(literal) - 1) == 0)
+
+// checks whether the token [@begin, @end) starts with the literal @prefix
+#define TOKEN_STARTS_WITH(begin, end, prefix) \
+    ((size_t)((end) - (begin)) >= sizeof(prefix) - 1 && \
+     memcmp((begin), (prefix), sizeof(prefix) - 1) == 0)
+
+static PageSize CastPageSizeInKB(unsigned long page_size_in_kb) {
     if (page_size_in_kb == 4) {
         return PageSize::BASE_4KB;
     } else if (page_size_in_kb == 2048) {
@@ -36,9 +54,107 @@ PageSize CastPageSizeString(std::string page_size_in_kb_str) {
     }
 }
 
-NumaMaps::NumaMaps(pid_t pid) : _pid(pid) {
+/*
+ * Parses the number at [@begin, @end) in the given @base, and stops at the
+ * first character that is not a digit (the fields are not null-terminated,
+ * so strtoul cannot be used).
+ */
+static unsigned long ParseNumber(const char *begin, const char *end,
+                                 int base) {
+    unsigned long value = 0;
+    for (const char *p = begin; p < end; p++) {
+        int digit;
+        if (*p >= '0' && *p <= '9') {
+            digit = *p - '0';
+        } else if (base == 16 && *p >= 'a' && *p <= 'f') {
+            digit = *p - 'a' + 10;
+        } else if (base == 16 && *p >= 'A' && *p <= 'F') {
+            digit = *p - 'A' + 10;
+        } else {
+            break;
+        }
+        value = value * base + digit;
+    }
+    return value;
+}
+
+static const char *SkipSpaces(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    return p;
+}
+
+static const char *SkipToken(const char *p, const char *end) {
+    while (p < end && *p != ' ' && *p != '\t') {
+        p++;
+    }
+    return p;
+}
+
+/*
+ * Calls @parse_line(begin, end) for each line of the file at @path, without
+ * the newline. The file is read through a single buffer on the stack, and
+ * the partial line at the end of the buffer is moved to its start before
+ * the next read; a line that is longer than the buffer is cut.
+ * Nothing is parsed if the file cannot be opened (e.g., the process exited).
+ */
+template <typename ParseLine>
+static void ForEachLine(const char *path, ParseLine parse_line) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    char buffer[READ_BUFFER_SIZE];
+    size_t used = 0;
+    while (true) {
+        ssize_t res = read(fd, buffer + used, sizeof(buffer) - used);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res <= 0) {
+            break;
+        }
+        used += res;
+        const char *line = buffer;
+        const char *buffer_end = buffer + used;
+        const char *newline;
+        while ((newline = static_cast<const char *>(
+                memchr(line, '\n', buffer_end - line))) != nullptr) {
+            parse_line(line, newline);
+            line = newline + 1;
+        }
+        if (line == buffer && used == sizeof(buffer)) {
+            parse_line(line, buffer_end);
+            line = buffer_end;
+        }
+        used = buffer_end - line;
+        memmove(buffer, line, used);
+    }
+    if (used > 0) {
+        parse_line(buffer, buffer + used);
+    }
+    close(fd);
+}
+
+NumaMaps::NumaMaps(pid_t pid, bool is_smaps_parsed) {
+    snprintf(_numa_maps_path, sizeof(_numa_maps_path), "/proc/%d/numa_maps",
+             (int)pid);
+    _smaps_path[0] = '\0';
+    if (is_smaps_parsed) {
+        snprintf(_smaps_path, sizeof(_smaps_path), "/proc/%d/smaps",
+                 (int)pid);
+    }
     _numa_nodes = GetNumaNodesCount();
-    ParseNumaMapsFile();
+    Reload();
+}
+
+NumaMaps::NumaMaps(const char *numa_maps_path, const char *smaps_path) {
+    snprintf(_numa_maps_path, sizeof(_numa_maps_path), "%s", numa_maps_path);
+    snprintf(_smaps_path, sizeof(_smaps_path), "%s",
+             smaps_path != nullptr ? smaps_path : "");
+    _numa_nodes = GetNumaNodesCount();
+    Reload();
 }
 
 NumaMaps::~NumaMaps() {
@@ -51,66 +167,127 @@ NumaMaps::~NumaMaps() {
 void NumaMaps::ParseNumaMapsFile() {
     // Parse process memory mappings according to /proc/<pid>/numa_maps
     // for more details: man numa
-    std::string file_name = "/proc/" + std::to_string(_pid) + "/numa_maps";
-    std::ifstream numa_maps_f(file_name);
-    std::smatch m;
-    std::string line;
-
-    while (std::getline(numa_maps_f, line)) {
-        // Parse memory region start address
-        void *start_address = nullptr;
-        if (std::regex_search(line, m,
-                              std::regex("(0[xX])?[0-9a-fA-F]+"))) {
-            start_address = (void *) std::stoul(m[0], nullptr, 16);
-        }
+    ForEachLine(_numa_maps_path, [this](const char *line, const char *end) {
+        ParseNumaMapsLine(line, end);
+    });
+}
 
-        // Parse page size
-        PageSize page_size = PageSize::UNKNOWN;
-        if (std::regex_search(line, m,
-                              std::regex("kernelpagesize_kB=(\\d*)"))) {
-            page_size = CastPageSizeString(m[1]);
-        }
+/*
+ * Parse a single numa-maps line in one pass over its space-separated
+ * fields, e.g.:
+ * 7f0000000000 default anon=3 dirty=3 N0=2 N1=1 kernelpagesize_kB=4
+ */
+void NumaMaps::ParseNumaMapsLine(const char *line, const char *end) {
+    const char *p = SkipSpaces(line, end);
+    if (p == end) {
+        return;
+    }
+    const char *token_end = SkipToken(p, end);
+    void *start_address = (void *) ParseNumber(p, token_end, 16);
 
-        // Prase dirty pages
-        unsigned long dirty_pages = 0;
-        if (std::regex_search(line, m, std::regex("dirty=(\\d*)"))) {
-            dirty_pages = stoul(m[1]);
+    PageSize page_size = PageSize::UNKNOWN;
+    unsigned long dirty_pages = 0;
+    bool is_anonymous = false, is_stack = false;
+    bool is_heap = false, is_file_mapped = false;
+    std::vector<unsigned long> pages_in_node(_numa_nodes);
+    unsigned long total_pages = 0;
+    for (p = SkipSpaces(token_end, end); p < end;
+         p = SkipSpaces(token_end, end)) {
+        token_end = SkipToken(p, end);
+        const char *value = static_cast<const char *>(
+                memchr(p, '=', token_end - p));
+        if (value == nullptr) {
+            is_heap |= TOKEN_EQUALS(p, token_end, "heap");
+            is_stack |= TOKEN_EQUALS(p, token_end, "stack");
+            continue;
         }
+        value++;
+        if (TOKEN_STARTS_WITH(p, token_end, "kernelpagesize_kB=")) {
+            page_size = CastPageSizeInKB(ParseNumber(value, token_end, 10));
+        } else if (TOKEN_STARTS_WITH(p, token_end, "dirty=")) {
+            dirty_pages = ParseNumber(value, token_end, 10);
+        } else if (TOKEN_STARTS_WITH(p, token_end, "anon=")) {
+            is_anonymous = true;
+        } else if (TOKEN_STARTS_WITH(p, token_end, "mapped=")) {
+            is_file_mapped = true;
+        } else if (*p == 'N' && p + 1 < value - 1 &&
+                   p[1] >= '0' && p[1] <= '9') {
+            // the nodes of a saved file may not exist in current system
+            unsigned long node = ParseNumber(p + 1, value - 1, 10);
+            if (node >= pages_in_node.size()) {
+                pages_in_node.resize(node + 1);
+            }
+            pages_in_node[node] = ParseNumber(value, token_end, 10);
+            total_pages += pages_in_node[node];
+        }
+    }
 
-        NumaMaps::MemoryRange::Type type = MemoryRange::Type::OTHER;
-        // Prase type (anonymous / heap / stack / file-mapped)
-        if (std::regex_search(line, m, std::regex("anon=(\\d*)"))) {
-            // m[1] will hold the anon pages
-            type = NumaMaps::MemoryRange::Type::ANONYMOUS;
+    // Set type (anonymous / heap / stack / file-mapped) by precedence
+    NumaMaps::MemoryRange::Type type = MemoryRange::Type::OTHER;
+    if (is_file_mapped) {
+        type = NumaMaps::MemoryRange::Type::FILE_MAPPED;
+    } else if (is_heap) {
+        type = NumaMaps::MemoryRange::Type::HEAP;
+    } else if (is_stack) {
+        type = NumaMaps::MemoryRange::Type::STACK;
+    } else if (is_anonymous) {
+        type = NumaMaps::MemoryRange::Type::ANONYMOUS;
+    }
+    unsigned long total_size = total_pages * static_cast<size_t>(page_size);
+
+    _numa_maps.emplace_back(start_address, type, total_pages,
+                            dirty_pages, page_size, total_size,
+                            std::move(pages_in_node));
+}
+
+/*
+ * Parse the smaps fields of the memory ranges: each range starts with a
+ * header line of its addresses (e.g., "7f0000000000-7f0000200000 rw-p ...")
+ * followed by a "<field>: <size> kB" line per field. Both files list the
+ * ranges by increasing addresses, so they are merged in one pass; the
+ * ranges that are missing from numa-maps are skipped.
+ */
+void NumaMaps::ParseSmapsFile() {
+    size_t next_range = 0;
+    MemoryRange *range = nullptr;
+    ForEachLine(_smaps_path, [&](const char *line, const char *end) {
+        const char *p = line;
+        while (p < end && ((*p >= '0' && *p <= '9') ||
+                           (*p >= 'a' && *p <= 'f'))) {
+            p++;
         }
-        if (std::regex_search(line, m, std::regex("stack"))) {
-            type = NumaMaps::MemoryRange::Type::STACK;
+        if (p != line && p < end && *p == '-') {
+            void *start_address = (void *) ParseNumber(line, p, 16);
+            while (next_range < _numa_maps.size() &&
+                   (uintptr_t)_numa_maps[next_range]._start_address <
+                   (uintptr_t)start_address) {
+                next_range++;
+            }
+            range = nullptr;
+            if (next_range < _numa_maps.size() &&
+                _numa_maps[next_range]._start_address == start_address) {
+                range = &_numa_maps[next_range++];
+            }
+            return;
         }
-        if (std::regex_search(line, m, std::regex("heap"))) {
-            type = NumaMaps::MemoryRange::Type::HEAP;
+        if (range == nullptr) {
+            return;
         }
-        if (std::regex_search(line, m, std::regex("mapped="))) {
-            type = NumaMaps::MemoryRange::Type::FILE_MAPPED;
+        const char *colon = static_cast<const char *>(
+                memchr(line, ':', end - line));
+        if (colon == nullptr) {
+            return;
         }
-
-        std::vector<unsigned long> pages_in_node(_numa_nodes);
-        unsigned long total_pages = 0;
-        // Parse Numa Nodes allocation
-        for (unsigned long node = 0; node < _numa_nodes; node++) {
-            std::string r = "N" + std::to_string(node) + "=(\\d*)";
-            if (std::regex_search(line, m, std::regex(r))) {
-                pages_in_node[node] = stoul(m[1]);
-                total_pages += pages_in_node[node];
-            }
+        const char *value = SkipSpaces(colon + 1, end);
+        size_t size = ParseNumber(value, end, 10) * 1024;
+        if (TOKEN_EQUALS(line, colon, "Rss")) {
+            range->_rss = size;
+        } else if (TOKEN_EQUALS(line, colon, "AnonHugePages")) {
+            range->_anon_huge_pages = size;
+        } else if (TOKEN_EQUALS(line, colon, "Private_Hugetlb")) {
+            range->_private_hugetlb = size;
         }
-        unsigned long total_size = total_pages * static_cast<size_t>(page_size);
-
-        MemoryRange memory_range(start_address, type, total_pages,
-                                 dirty_pages, page_size, total_size,
-                                 pages_in_node);
-
-        _numa_maps.push_back(memory_range);
-    }
+    });
 }
 
 /*
@@ -119,6 +296,9 @@ void NumaMaps::ParseNumaMapsFile() {
 void NumaMaps::Reload() {
     _numa_maps.clear();
     ParseNumaMapsFile();
+    if (_smaps_path[0] != '\0') {
+        ParseSmapsFile();
+    }
 }
 
 /*
@@ -127,7 +307,7 @@ void NumaMaps::Reload() {
  */
 unsigned long NumaMaps::GetTotalAnonymousPages(PageSize page_size) {
     unsigned long total_pages = 0;
-    for (auto mem_range : _numa_maps) {
+    for (const auto &mem_range : _numa_maps) {
         if ((mem_range._type == NumaMaps::MemoryRange::Type::ANONYMOUS) &&
             (mem_range._page_size == page_size)) {
             for (auto pages_in_node : mem_range._pages_in_node) {
@@ -165,13 +345,13 @@ unsigned long NumaMaps::GetNumaNodesCount() {
                                 "could not open /sys/devices/system/node dir!");
     }
     // Find all nodeX folders to find out numa nodes count in the system
-    std::smatch m;
     while ((ent = readdir(dir)) != NULL) {
-        std::string s(ent->d_name);
-        if (std::regex_search(s, m,
-                              std::regex("node(\\d*)"))) {
+        if (strncmp(ent->d_name, "node", 4) == 0 &&
+            ent->d_name[4] >= '0' && ent->d_name[4] <= '9') {
             // +1 because nodes indices are zero indexed
-            unsigned long node_num = stoul(m[1]) + 1;
+            const char *index = ent->d_name + 4;
+            unsigned long node_num =
+                    ParseNumber(index, index + strlen(index), 10) + 1;
             if (node_num > count) {
                 count = node_num;
             }
@@ -0,0 +1,167 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "PageBackingVerifier.h"
+
+#define PAGE_SIZE_4KB ((size_t)PageSize::BASE_4KB)
+// the bits of a pagemap entry (see Documentation/admin-guide/mm/pagemap.rst)
+#define PAGEMAP_PRESENT (1ull << 63)
+#define PAGEMAP_PFN_MASK ((1ull << 55) - 1)
+// the flags of a frame in kpageflags (see include/uapi/linux/kernel-page-flags.h)
+#define KPF_HUGE (1ull << 17)
+#define KPF_THP (1ull << 22)
+#define NO_FLAGS_BATCH ((uint64_t)-1)
+
+PageBackingVerifier::PageBackingVerifier() :
+    _pid(0),
+    _pagemap_path(nullptr),
+    _pagemap_fd(-1),
+    _kpageflags_fd(-1),
+    _flags_first_pfn(NO_FLAGS_BATCH) {}
+
+int PageBackingVerifier::Open(const char *pagemap_path,
+                              const char *kpageflags_path) {
+    _pagemap_fd = open(pagemap_path, O_RDONLY | O_CLOEXEC);
+    if (_pagemap_fd < 0) {
+        return -1;
+    }
+    // without kpageflags, only the frame numbers are checked
+    _kpageflags_fd = open(kpageflags_path, O_RDONLY | O_CLOEXEC);
+    _pid = getpid();
+    _pagemap_path = pagemap_path;
+    _flags_first_pfn = NO_FLAGS_BATCH;
+    return 0;
+}
+
+void PageBackingVerifier::Close() {
+    if (_pagemap_fd >= 0) {
+        close(_pagemap_fd);
+        _pagemap_fd = -1;
+    }
+    if (_kpageflags_fd >= 0) {
+        close(_kpageflags_fd);
+        _kpageflags_fd = -1;
+    }
+}
+
+void PageBackingVerifier::FollowFork() {
+    if (getpid() == _pid) {
+        return;
+    }
+    _pid = getpid();
+    close(_pagemap_fd);
+    _pagemap_fd = open(_pagemap_path, O_RDONLY | O_CLOEXEC);
+    if (_pagemap_fd < 0) {
+        THROW_EXCEPTION("failed to open the pagemap");
+    }
+}
+
+/*
+ * Returns the kpageflags of the frame @pfn, which are read in batches of
+ * neighboring frames (the frames of a range are mostly contiguous).
+ */
+uint64_t PageBackingVerifier::GetPageFlags(uint64_t pfn) {
+    if (_flags_first_pfn == NO_FLAGS_BATCH ||
+        pfn < _flags_first_pfn ||
+        pfn >= _flags_first_pfn + PAGE_BACKING_FLAGS_BATCH) {
+        _flags_first_pfn = ROUND_DOWN(pfn, PAGE_BACKING_FLAGS_BATCH);
+        memset(_flags, 0, sizeof(_flags));
+        if (pread(_kpageflags_fd, _flags, sizeof(_flags),
+                  (off_t)(_flags_first_pfn * sizeof(uint64_t))) < 0) {
+            _flags_first_pfn = NO_FLAGS_BATCH;
+            return 0;
+        }
+    }
+    return _flags[pfn - _flags_first_pfn];
+}
+
+bool PageBackingVerifier::IsFrameMismatched(uint64_t pfn,
+                                            PageSize page_size) {
+    uint64_t flags = GetPageFlags(pfn);
+    if (page_size == PageSize::BASE_4KB) {
+        return (flags & (KPF_HUGE | KPF_THP)) != 0;
+    }
+    return (flags & KPF_HUGE) == 0;
+}
+
+bool PageBackingVerifier::VerifyRange(void *addr, size_t len,
+                                      PageSize page_size,
+                                      struct mosalloc_backing_report *report) {
+    FollowFork();
+    uint64_t first_page = (uint64_t)addr / PAGE_SIZE_4KB;
+    uint64_t pages_count = ROUND_UP(len, PAGE_SIZE_4KB) / PAGE_SIZE_4KB;
+    uint64_t pages_per_page = (uint64_t)page_size / PAGE_SIZE_4KB;
+    bool is_verified = true;
+    report->checked_size += pages_count * PAGE_SIZE_4KB;
+    for (uint64_t first = 0; first < pages_count;
+         first += PAGE_BACKING_BATCH_PAGES) {
+        uint64_t count = pages_count - first;
+        if (count > PAGE_BACKING_BATCH_PAGES) {
+            count = PAGE_BACKING_BATCH_PAGES;
+        }
+        void *batch = (void *)((first_page + first) * PAGE_SIZE_4KB);
+        // the pages that are not resident are not present either
+        if (mincore(batch, count * PAGE_SIZE_4KB, _residency) == 0) {
+            bool is_resident = false;
+            for (uint64_t i = 0; i < count && !is_resident; i++) {
+                is_resident = (_residency[i] & 1) != 0;
+            }
+            if (!is_resident) {
+                is_verified = false;
+                continue;
+            }
+        }
+        ssize_t res = pread(_pagemap_fd, _entries, count * sizeof(uint64_t),
+                            (off_t)((first_page + first) * sizeof(uint64_t)));
+        if (res < 0) {
+            return false;
+        }
+        if ((uint64_t)res < count * sizeof(uint64_t)) {
+            is_verified = false;
+            count = (uint64_t)res / sizeof(uint64_t);
+        }
+        // the frame flags are checked once per page of @page_size
+        uint64_t flagged_page = (uint64_t)-1;
+        bool is_flagged_page_mismatched = false;
+        for (uint64_t i = 0; i < count; i++) {
+            uint64_t page = first_page + first + i;
+            uint64_t pfn = _entries[i] & PAGEMAP_PFN_MASK;
+            if ((_entries[i] & PAGEMAP_PRESENT) == 0) {
+                is_verified = false;
+                continue;
+            }
+            report->present_size += PAGE_SIZE_4KB;
+            if (pfn == 0) {
+                report->unverified_size += PAGE_SIZE_4KB;
+                continue;
+            }
+            bool is_mismatched =
+                (pfn % pages_per_page) != (page % pages_per_page);
+            if (!is_mismatched && HasPageFlags()) {
+                if (page / pages_per_page != flagged_page) {
+                    flagged_page = page / pages_per_page;
+                    is_flagged_page_mismatched =
+                        IsFrameMismatched(pfn, page_size);
+                }
+                is_mismatched = is_flagged_page_mismatched;
+            } else if (!HasPageFlags() && page_size == PageSize::BASE_4KB) {
+                // any frame fits a 4KB page, so a larger one is not seen
+                report->unverified_size += PAGE_SIZE_4KB;
+                continue;
+            }
+            if (is_mismatched) {
+                void *mismatch = (void *)(page * PAGE_SIZE_4KB);
+                if (report->first_mismatch == nullptr ||
+                    mismatch < report->first_mismatch) {
+                    report->first_mismatch = mismatch;
+                }
+                report->mismatched_size += PAGE_SIZE_4KB;
+                is_verified = false;
+            }
+        }
+    }
+    return is_verified;
+}
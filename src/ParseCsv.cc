@@ -1,4 +1,6 @@
 #include <sys/mman.h>
+#include <errno.h>
+#include <stdint.h>
 #include "ParseCsv.h"
 #include "globals.h"
 #include <cstdio>
@@ -25,39 +27,98 @@
         token[j++] = file_mmap[i]; \
     }
 
-int parseCsv::GetConfigFileMaxWindows(const char* path){
-    int count = 0;
-    int fd;
-    struct stat s;
-    char *file_mmap;
-
-    // Open the file for reading.
-    fd = open (path, O_RDONLY);
+/*
+ * Maps the file at @path for reading. On failure, errno is left as the call
+ * that failed set it.
+ */
+static ParseCsvError MapCsvFile(const char* path, char** file_mmap, size_t* size){
+    int fd = open (path, O_RDONLY);
     if (fd < 0) {
-        THROW_EXCEPTION("can not open csv file");
+        return ParseCsvError::OPEN_FAILED;
     }
-    
-    // Get the size of the file.
+    struct stat s;
     if (fstat (fd, &s) < 0) {
-        THROW_EXCEPTION("can not stat the csv file");
+        close(fd);
+        return ParseCsvError::STAT_FAILED;
     }
-    size_t size = s.st_size;
+    *size = s.st_size;
+    if (*size == 0) {
+        close(fd);
+        errno = EINVAL;
+        return ParseCsvError::EMPTY_FILE;
+    }
+    GlibcAllocationFunctions glibc_funcs;
+    *file_mmap = (char*)glibc_funcs.CallGlibcMmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (*file_mmap == MAP_FAILED) {
+        return ParseCsvError::MMAP_FAILED;
+    }
+    return ParseCsvError::SUCCESS;
+}
 
+static void UnmapCsvFile(char* file_mmap, size_t size){
     GlibcAllocationFunctions glibc_funcs;
-    // Memory-map the file.
-    file_mmap = (char*)glibc_funcs.CallGlibcMmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
-    if (file_mmap == MAP_FAILED)
+    glibc_funcs.CallGlibcMunmap(file_mmap, size);
+}
+
+void parseCsv::ThrowError(ParseCsvError error){
+    switch (error) {
+    case ParseCsvError::OPEN_FAILED:
+        THROW_EXCEPTION("can not open csv file");
+    case ParseCsvError::STAT_FAILED:
+        THROW_EXCEPTION("can not stat the csv file");
+    case ParseCsvError::EMPTY_FILE:
+        THROW_EXCEPTION("csv file is empty");
+    case ParseCsvError::MMAP_FAILED:
         THROW_EXCEPTION("can not mmap csv file");
+    case ParseCsvError::UNKNOWN_PAGE_SIZE:
+        THROW_EXCEPTION("unknown page size");
+    case ParseCsvError::POOL_SIZE_EXISTS:
+        THROW_EXCEPTION("pool size already exist");
+    case ParseCsvError::NEGATIVE_START_OFFSET:
+        THROW_EXCEPTION("start offset negative");
+    case ParseCsvError::NEGATIVE_END_OFFSET:
+        THROW_EXCEPTION("end offset negative");
+    case ParseCsvError::CORRUPTED_FILE:
+        THROW_EXCEPTION("csv configuration file is corrupted!");
+    case ParseCsvError::TOO_MANY_INTERVALS:
+        THROW_EXCEPTION("Memory Region Interval List is already full");
+    case ParseCsvError::TOO_MANY_POOL_TYPES:
+        THROW_EXCEPTION("too many pool types");
+    case ParseCsvError::POOL_TYPE_TOO_LONG:
+        THROW_EXCEPTION("pool type is too long");
+    case ParseCsvError::SUCCESS:
+        break;
+    }
+}
+
+int parseCsv::GetConfigFileMaxWindows(const char* path){
+    int count = 0;
+    ParseCsvError error = TryGetConfigFileMaxWindows(path, &count);
+    if (error != ParseCsvError::SUCCESS) {
+        ThrowError(error);
+    }
+    return count;
+}
+
+ParseCsvError parseCsv::TryGetConfigFileMaxWindows(const char* path, int* count){
+    char *file_mmap;
+    size_t size;
+    ParseCsvError error = MapCsvFile(path, &file_mmap, &size);
+    if (error != ParseCsvError::SUCCESS) {
+        return error;
+    }
 
     /* count the end-of-line characters */
+    *count = 0;
     for (size_t i = 0; i < size; i++) {
         if (file_mmap[i] == '\n') {
-            count++;
+            (*count)++;
         }
     }
 
-    close(fd);
-    return count;
+    UnmapCsvFile(file_mmap, size);
+    return ParseCsvError::SUCCESS;
 }
 
 /**
@@ -69,37 +130,30 @@ int parseCsv::GetConfigFileMaxWindows(const char* path){
  *
  */
 void parseCsv::ParseCsv(PoolConfigurationData& configurationData, const char* path, const char* poolType){
-    int fd;
-    struct stat s;
+    ParseCsvError error = TryParseCsv(configurationData, path, poolType);
+    if (error != ParseCsvError::SUCCESS) {
+        ThrowError(error);
+    }
+}
+
+ParseCsvError parseCsv::TryParseCsv(PoolConfigurationData& configurationData, const char* path, const char* poolType){
     char *file_mmap;
+    size_t size;
     size_t token_size = 1024;
     char token[1024] = {0};
     int one_time_size = 0;
     long long int _start_offset, _end_offset, _page_size;
 
-    // Open the file for reading.
-    fd = open (path, O_RDONLY);
-    if (fd < 0) {
-        THROW_EXCEPTION("can not open csv file");
-    }
-    
-    // Get the size of the file.
-    if (fstat (fd, &s) < 0) {
-        THROW_EXCEPTION("can not stat the csv file");
+    ParseCsvError error = MapCsvFile(path, &file_mmap, &size);
+    if (error != ParseCsvError::SUCCESS) {
+        return error;
     }
-    size_t size = s.st_size;
-
-    GlibcAllocationFunctions glibc_funcs;
-    // Memory-map the file.
-    file_mmap = (char*)glibc_funcs.CallGlibcMmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
-    if (file_mmap == MAP_FAILED)
-        THROW_EXCEPTION("can not mmap csv file");
 
     size_t i=0, j=0;
     // read the header line
     MOVE_TO_NEXT_LINE()
     // Parse the file
-    for (; i < size; i++) {
+    for (; i < size && error == ParseCsvError::SUCCESS; i++) {
         NEXT_TOKEN()
         if (token[0] == 0)
             continue;
@@ -110,32 +164,223 @@ void parseCsv::ParseCsv(PoolConfigurationData& configurationData, const char* pa
         NEXT_TOKEN()
         _page_size = atoll(token);
         if( _page_size!=-1 && _page_size!= static_cast<size_t>(PageSize::HUGE_1GB) && _page_size!= static_cast<size_t>(PageSize::HUGE_2MB)){
-            THROW_EXCEPTION("unknown page size");
+            error = ParseCsvError::UNKNOWN_PAGE_SIZE;
+            break;
         }
 
         if(_page_size == -1 ){
             if(!one_time_size){
                 one_time_size = 1;
             }
-            else THROW_EXCEPTION("pool size already exist");
+            else {
+                error = ParseCsvError::POOL_SIZE_EXISTS;
+                break;
+            }
         }
 
         NEXT_TOKEN()
         _start_offset = atoll(token);
-        if(_start_offset < 0 )
-            THROW_EXCEPTION("start offset negative");
-        
+        if(_start_offset < 0 ) {
+            error = ParseCsvError::NEGATIVE_START_OFFSET;
+            break;
+        }
+
         NEXT_TOKEN()
         _end_offset = atoll(token);
-        if(_end_offset < 0)
-            THROW_EXCEPTION("end offset negative");
-      
-        if(file_mmap[i] != '\n')
-            THROW_EXCEPTION("csv configuration file is corrupted!");
-        
-        if(_page_size !=-1) configurationData.intervalList.AddInterval(_start_offset, _end_offset, (PageSize)_page_size);
+        if(_end_offset < 0) {
+            error = ParseCsvError::NEGATIVE_END_OFFSET;
+            break;
+        }
+
+        // the last line must end with a newline as well
+        if(i >= size || file_mmap[i] != '\n') {
+            error = ParseCsvError::CORRUPTED_FILE;
+            break;
+        }
+
+        if(_page_size !=-1) {
+            // the file may have grown since its lines were counted
+            if (configurationData.intervalList.GetLength() ==
+                configurationData.intervalList.GetCapacity()) {
+                error = ParseCsvError::TOO_MANY_INTERVALS;
+                break;
+            }
+            configurationData.intervalList.AddInterval(_start_offset, _end_offset, (PageSize)_page_size);
+        }
         else configurationData.size= _end_offset - _start_offset;
     }
     configurationData.intervalList.Sort();
+    UnmapCsvFile(file_mmap, size);
+    if (error != ParseCsvError::SUCCESS) {
+        errno = EINVAL;
+    }
+    return error;
+}
+
+int parseCsv::GetPoolTypes(const char* path, char (*types)[MAX_POOL_NAME_LENGTH], int max_types){
+    int count = 0;
+    ParseCsvError error = TryGetPoolTypes(path, types, max_types, &count);
+    if (error != ParseCsvError::SUCCESS) {
+        ThrowError(error);
+    }
+    return count;
+}
+
+ParseCsvError parseCsv::TryGetPoolTypes(const char* path, char (*types)[MAX_POOL_NAME_LENGTH], int max_types, int* count){
+    char *file_mmap;
+    size_t size;
+    size_t token_size = 1024;
+    char token[1024] = {0};
+
+    ParseCsvError error = MapCsvFile(path, &file_mmap, &size);
+    if (error != ParseCsvError::SUCCESS) {
+        return error;
+    }
+
+    *count = 0;
+    size_t i=0, j=0;
+    // read the header line
+    MOVE_TO_NEXT_LINE()
+    while (i < size) {
+        // the type is the first token of each line
+        NEXT_TOKEN()
+        MOVE_TO_NEXT_LINE()
+        if (token[0] == 0)
+            continue;
+        int k = 0;
+        for (; k < *count && strcmp(types[k], token); k++);
+        if (k < *count)
+            continue;
+        if (*count == max_types) {
+            error = ParseCsvError::TOO_MANY_POOL_TYPES;
+            break;
+        }
+        if (strlen(token) >= MAX_POOL_NAME_LENGTH) {
+            error = ParseCsvError::POOL_TYPE_TOO_LONG;
+            break;
+        }
+        strcpy(types[(*count)++], token);
+    }
+    UnmapCsvFile(file_mmap, size);
+    if (error != ParseCsvError::SUCCESS) {
+        errno = EINVAL;
+    }
+    return error;
+}
+
+static int ParseMmapFlags(const char* token){
+    static const struct {
+        const char* name;
+        int flag;
+    } flag_names[] = {
+        {"MAP_SHARED", MAP_SHARED},
+        {"MAP_PRIVATE", MAP_PRIVATE},
+        {"MAP_FIXED", MAP_FIXED},
+        {"MAP_FIXED_NOREPLACE", MAP_FIXED_NOREPLACE},
+        {"MAP_GROWSDOWN", MAP_GROWSDOWN},
+        {"MAP_LOCKED", MAP_LOCKED},
+        {"MAP_NORESERVE", MAP_NORESERVE},
+        {"MAP_POPULATE", MAP_POPULATE},
+        {"MAP_STACK", MAP_STACK},
+        {"MAP_HUGETLB", MAP_HUGETLB},
+    };
+    if (token[0] == 0 || strcmp(token, "*") == 0)
+        return 0;
+    if (token[0] >= '0' && token[0] <= '9')
+        return (int)strtol(token, NULL, 0);
+
+    int flags = 0;
+    const char* name = token;
+    while (*name) {
+        size_t length = strcspn(name, "|");
+        size_t k = 0;
+        for (; k < sizeof(flag_names) / sizeof(flag_names[0]); k++) {
+            if (strlen(flag_names[k].name) == length &&
+                strncmp(flag_names[k].name, name, length) == 0)
+                break;
+        }
+        if (k == sizeof(flag_names) / sizeof(flag_names[0]))
+            THROW_EXCEPTION("unknown mmap flag");
+        flags |= flag_names[k].flag;
+        name += length;
+        if (*name == '|')
+            name++;
+    }
+    return flags;
+}
+
+void parseCsv::ParseRoutingRules(PoolRoutingRules& rules, const char* path){
+    int fd;
+    struct stat s;
+    char *file_mmap;
+    size_t token_size = 1024;
+    char token[1024] = {0};
+    char pool_name[1024] = {0};
+    char origin[1024] = {0};
+    long long int _min_size, _max_size, _page_size;
+    int _flags;
+
+    fd = open (path, O_RDONLY);
+    if (fd < 0) {
+        THROW_EXCEPTION("can not open routing rules file");
+    }
+    if (fstat (fd, &s) < 0) {
+        THROW_EXCEPTION("can not stat the routing rules file");
+    }
+    size_t size = s.st_size;
+
+    GlibcAllocationFunctions glibc_funcs;
+    file_mmap = (char*)glibc_funcs.CallGlibcMmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (file_mmap == MAP_FAILED)
+        THROW_EXCEPTION("can not mmap routing rules file");
+
+    size_t i=0, j=0;
+    // read the header line
+    MOVE_TO_NEXT_LINE()
+    for (; i < size; i++) {
+        NEXT_TOKEN()
+        if (token[0] == 0)
+            continue;
+        strcpy(pool_name, token);
+
+        NEXT_TOKEN()
+        _min_size = atoll(token);
+        if (_min_size < 0)
+            THROW_EXCEPTION("min size negative");
+
+        NEXT_TOKEN()
+        _max_size = atoll(token);
+        if (_max_size < -1 || (_max_size != -1 && _max_size < _min_size))
+            THROW_EXCEPTION("invalid max size");
+
+        NEXT_TOKEN()
+        _flags = ParseMmapFlags(token);
+
+        NEXT_TOKEN()
+        if (strcmp(token, "*") == 0)
+            token[0] = 0;
+        strcpy(origin, token);
+
+        // the page size column is optional
+        _page_size = 0;
+        if (i < size && file_mmap[i] != '\n') {
+            NEXT_TOKEN()
+            _page_size = (strcmp(token, "*") == 0) ? 0 : atoll(token);
+            if (_page_size != 0 && _page_size != static_cast<long long int>(PageSize::BASE_4KB) && _page_size != static_cast<long long int>(PageSize::HUGE_2MB) && _page_size != static_cast<long long int>(PageSize::HUGE_1GB))
+                THROW_EXCEPTION("unknown page size");
+        }
+
+        if (i < size && file_mmap[i] != '\n')
+            THROW_EXCEPTION("routing rules file is corrupted!");
+
+        int res = rules.AddRule(pool_name, (size_t)_min_size,
+                                (_max_size == -1) ? SIZE_MAX : (size_t)_max_size,
+                                _flags, origin, (PageSize)_page_size);
+        if (res == -EINVAL)
+            THROW_EXCEPTION("malformed routing rule origin");
+        if (res != 0)
+            THROW_EXCEPTION("too many (or too long) routing rules");
+    }
+    glibc_funcs.CallGlibcMunmap(file_mmap, size);
     close(fd);
 }
@@ -0,0 +1,166 @@
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "PoolRoutingRules.h"
+
+PoolRoutingRules::PoolRoutingRules() :
+    _length(0),
+    _has_origin_rules(false) {
+    }
+
+/*
+ * Returns true if @suffix is "0x" followed by hexadecimal digits only.
+ */
+static bool IsHexOffset(const char *suffix) {
+    if (suffix[0] != '0' || (suffix[1] != 'x' && suffix[1] != 'X') ||
+        suffix[2] == '\0') {
+        return false;
+    }
+    return strspn(suffix + 2, "0123456789abcdefABCDEF") == strlen(suffix + 2);
+}
+
+/*
+ * Appends a rule to the list; returns -1 if the list is full or if the names
+ * do not fit in the rule, or -EINVAL if the origin is malformed. An origin is
+ * a module and an offset only when it ends with "+0x<hex>", so module names
+ * may contain '+' (e.g., libstdc++.so.6).
+ */
+int PoolRoutingRules::AddRule(const char *pool_name, size_t min_size,
+                              size_t max_size, int flags,
+                              const char *origin, PageSize page_size) {
+    if (_length == MAX_ROUTING_RULES ||
+        strlen(pool_name) >= MAX_POOL_NAME_LENGTH ||
+        strlen(origin) >= MAX_ORIGIN_LENGTH) {
+        return -1;
+    }
+    PoolRoutingRule& rule = _rules[_length];
+    strcpy(rule._pool_name, pool_name);
+    rule._pool_index = -1;
+    rule._page_size = page_size;
+    rule._min_size = min_size;
+    rule._max_size = max_size;
+    rule._flags = flags;
+    rule._origin_offset = 0;
+
+    const char *offset = strrchr(origin, '+');
+    if (offset != nullptr && offset[1] == '0' &&
+        (offset[2] == 'x' || offset[2] == 'X') &&
+        (offset == origin || !IsHexOffset(offset + 1))) {
+        // e.g., "+0x1234" or "app+0x12zz"
+        return -EINVAL;
+    }
+    if (offset != nullptr && !IsHexOffset(offset + 1)) {
+        offset = nullptr;
+    }
+    if (origin[0] == '\0') {
+        rule._origin_kind = PoolRoutingRule::OriginKind::ANY;
+        rule._origin[0] = '\0';
+    } else if (origin[0] == '@') {
+        rule._origin_kind = PoolRoutingRule::OriginKind::SYMBOL;
+        strcpy(rule._origin, origin + 1);
+    } else if (offset != nullptr) {
+        rule._origin_kind = PoolRoutingRule::OriginKind::MODULE_OFFSET;
+        strncpy(rule._origin, origin, offset - origin);
+        rule._origin[offset - origin] = '\0';
+        char *end = nullptr;
+        rule._origin_offset = strtoull(offset + 1, &end, 16);
+        if (*end != '\0') {
+            return -EINVAL;
+        }
+    } else {
+        rule._origin_kind = PoolRoutingRule::OriginKind::MODULE;
+        strcpy(rule._origin, origin);
+    }
+    _has_origin_rules |= (rule._origin_kind !=
+                          PoolRoutingRule::OriginKind::ANY);
+    _length++;
+    return 0;
+}
+
+/*
+ * Resolves the pool names of the rules to indices in @pool_names.
+ */
+void PoolRoutingRules::BindPools(
+        const char (*pool_names)[MAX_POOL_NAME_LENGTH], int pools_count) {
+    for (int i = 0; i < _length; i++) {
+        PoolRoutingRule& rule = _rules[i];
+        rule._pool_index = -1;
+        for (int j = 0; j < pools_count; j++) {
+            if (strcmp(rule._pool_name, pool_names[j]) == 0) {
+                rule._pool_index = j;
+                break;
+            }
+        }
+        if (rule._pool_index == -1) {
+            THROW_EXCEPTION("routing rule refers to an unknown pool");
+        }
+    }
+}
+
+/*
+ * Returns the mask of the rules whose origins match one of the return
+ * addresses in @frames. Resolving the modules and symbols is expensive, so
+ * the result should be cached per call site.
+ */
+uint64_t PoolRoutingRules::MatchOrigins(void *const *frames,
+                                        int depth) const {
+    uint64_t mask = 0;
+    for (int f = 0; f < depth; f++) {
+        Dl_info info;
+        if (dladdr(frames[f], &info) == 0) {
+            continue;
+        }
+        for (int i = 0; i < _length; i++) {
+            const PoolRoutingRule& rule = _rules[i];
+            bool is_match = false;
+            switch (rule._origin_kind) {
+                case PoolRoutingRule::OriginKind::MODULE:
+                    is_match = (info.dli_fname != nullptr &&
+                                strstr(info.dli_fname, rule._origin) != nullptr);
+                    break;
+                case PoolRoutingRule::OriginKind::MODULE_OFFSET:
+                    is_match = (info.dli_fname != nullptr &&
+                                strstr(info.dli_fname, rule._origin) != nullptr &&
+                                (size_t)frames[f] - (size_t)info.dli_fbase ==
+                                rule._origin_offset);
+                    break;
+                case PoolRoutingRule::OriginKind::SYMBOL:
+                    is_match = (info.dli_sname != nullptr &&
+                                strcmp(info.dli_sname, rule._origin) == 0);
+                    break;
+                default:
+                    break;
+            }
+            if (is_match) {
+                mask |= (1ull << i);
+            }
+        }
+    }
+    return mask;
+}
+
+/*
+ * Returns the first rule that matches the request, or nullptr if no rule
+ * matches. @origins_mask holds the rules whose origins match the call site
+ * (see MatchOrigins), and it may be 0 when there are no origin rules.
+ */
+const PoolRoutingRule* PoolRoutingRules::Match(size_t length, int flags,
+                                               uint64_t origins_mask) const {
+    for (int i = 0; i < _length; i++) {
+        const PoolRoutingRule& rule = _rules[i];
+        if (length < rule._min_size || length > rule._max_size) {
+            continue;
+        }
+        if ((flags & rule._flags) != rule._flags) {
+            continue;
+        }
+        if (rule._origin_kind != PoolRoutingRule::OriginKind::ANY &&
+            (origins_mask & (1ull << i)) == 0) {
+            continue;
+        }
+        return &rule;
+    }
+    return nullptr;
+}
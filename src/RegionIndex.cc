@@ -0,0 +1,98 @@
+#include <sys/mman.h>
+#include "RegionIndex.h"
+
+RegionIndex::RegionIndex() :
+    _slots(nullptr),
+    _slots_count(0),
+    _start(0),
+    _end(0),
+    _count(0),
+    _mmap(nullptr),
+    _munmap(nullptr) {
+    }
+
+void RegionIndex::Initialize(MmapFuncPtr allocator,
+        MunmapFuncPtr deallocator,
+        void **bases,
+        size_t *sizes,
+        int count) {
+    _mmap = allocator;
+    _munmap = deallocator;
+    if (count > MAX_INDEXED_REGIONS) {
+        THROW_EXCEPTION("too many regions to index");
+    }
+    // insert the non-empty regions in the order of their addresses
+    _count = 0;
+    for (int i = 0; i < count; i++) {
+        if (sizes[i] == 0) {
+            continue;
+        }
+        size_t start = (size_t) bases[i];
+        int j = _count++;
+        for (; j > 0 && _starts[j - 1] > start; j--) {
+            _regions[j] = _regions[j - 1];
+            _starts[j] = _starts[j - 1];
+            _ends[j] = _ends[j - 1];
+        }
+        _regions[j] = i;
+        _starts[j] = start;
+        _ends[j] = start + sizes[i];
+    }
+    if (_count == 0) {
+        return;
+    }
+    _start = ROUND_DOWN(_starts[0], PageSize::HUGE_2MB);
+    _end = _ends[_count - 1];
+    _slots_count = ROUND_UP(_end - _start, PageSize::HUGE_2MB)
+                   >> REGION_INDEX_SLOT_SHIFT;
+    // the slots between the regions are never written, so they are not
+    // backed with memory (and read as no region)
+    size_t length = ROUND_UP(_slots_count * sizeof(uint8_t),
+                             PageSize::BASE_4KB);
+    void *ptr = _mmap(NULL, length, MMAP_PROTECTION,
+                      MMAP_FLAGS | MAP_NORESERVE, -1, 0);
+    if (ptr == MAP_FAILED) {
+        THROW_EXCEPTION("Failed to allocate Region Index");
+    }
+    _slots = static_cast<uint8_t*>(ptr);
+
+    // walk the regions backwards, so each slot ends up with the first region
+    // that intersects it (0 marks no region)
+    for (int i = _count; i > 0; i--) {
+        size_t first_slot = (_starts[i - 1] - _start)
+                            >> REGION_INDEX_SLOT_SHIFT;
+        size_t last_slot = (_ends[i - 1] - 1 - _start)
+                           >> REGION_INDEX_SLOT_SHIFT;
+        for (size_t s = first_slot; s <= last_slot; s++) {
+            _slots[s] = (uint8_t) i;
+        }
+    }
+}
+
+RegionIndex::~RegionIndex() {
+    if (_slots == nullptr) {
+        return;
+    }
+    size_t length = ROUND_UP(_slots_count * sizeof(uint8_t),
+                             PageSize::BASE_4KB);
+    if (_munmap(_slots, length) != 0) {
+        THROW_EXCEPTION("Failed to deallocate Region Index");
+    }
+}
+
+int RegionIndex::Find(const void *addr) const {
+    size_t address = (size_t) addr;
+    if (_slots == nullptr || address < _start || address >= _end) {
+        return -1;
+    }
+    int i = _slots[(address - _start) >> REGION_INDEX_SLOT_SHIFT];
+    if (i == 0) {
+        return -1;
+    }
+    for (i = i - 1; i < _count && _starts[i] <= address; i++) {
+        if (address < _ends[i]) {
+            return _regions[i];
+        }
+    }
+    return -1;
+}
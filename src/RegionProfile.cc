@@ -0,0 +1,286 @@
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "globals.h"
+#include "FirstFitAllocator.h"
+#include "GlibcAllocationFunctions.h"
+#include "RegionProfile.h"
+
+// the table of the live mappings is kept at most 3/4 full, so the probe
+// sequences stay short
+#define MAX_LIVE_COUNT (REGION_PROFILE_LIVE_CAPACITY / 4 * 3)
+
+RegionProfile::RegionProfile() :
+    _base(nullptr),
+    _start_ns(0),
+    _live(nullptr),
+    _live_count(0),
+    _heatmap(nullptr),
+    _chunks_count(0),
+    _used_chunks_count(0),
+    _window_ns(REGION_PROFILE_FIRST_WINDOW_NS),
+    _sampled_window(-1) {
+        memset(_sizes, 0, sizeof(_sizes));
+        memset(_lifetimes, 0, sizeof(_lifetimes));
+    }
+
+int RegionProfile::Initialize(void *base, size_t capacity) {
+    _chunks_count = (capacity + REGION_PROFILE_CHUNK_SIZE - 1) /
+                    REGION_PROFILE_CHUNK_SIZE;
+    size_t heatmap_length = _chunks_count * REGION_PROFILE_WINDOWS *
+                            sizeof(uint32_t);
+    // the pages of the buffers are committed only when they are used
+    void *heatmap = MAP_FAILED;
+    if (heatmap_length > 0) {
+        heatmap = GlibcMmap(NULL, heatmap_length, MMAP_PROTECTION,
+                            MMAP_FLAGS | MAP_NORESERVE, -1, 0);
+        if (heatmap == MAP_FAILED) {
+            return -1;
+        }
+    }
+    void *live = GlibcMmap(NULL,
+                           REGION_PROFILE_LIVE_CAPACITY * sizeof(LiveMapping),
+                           MMAP_PROTECTION, MMAP_FLAGS | MAP_NORESERVE, -1, 0);
+    if (live == MAP_FAILED) {
+        if (heatmap != MAP_FAILED) {
+            GlibcMunmap(heatmap, heatmap_length);
+        }
+        return -1;
+    }
+    _base = base;
+    _start_ns = GetTimeNs();
+    _heatmap = (heatmap == MAP_FAILED) ? nullptr
+        : static_cast<uint32_t*>(heatmap);
+    _live = static_cast<LiveMapping*>(live);
+    return 0;
+}
+
+int RegionProfile::GetBucket(uint64_t value) {
+    return (value == 0) ? 0 : 63 - __builtin_clzll(value);
+}
+
+uint64_t RegionProfile::GetTimeNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+size_t RegionProfile::Hash(void *addr) {
+    // the mappings are page aligned, so the low bits carry no information
+    uint64_t page = (uint64_t)addr >> 12;
+    return (size_t)((page * 0x9e3779b97f4a7c15ull) >> 32) &
+           (REGION_PROFILE_LIVE_CAPACITY - 1);
+}
+
+RegionProfile::LiveMapping *RegionProfile::FindLive(void *addr) {
+    for (size_t i = Hash(addr); _live[i].addr != nullptr;
+         i = (i + 1) & (REGION_PROFILE_LIVE_CAPACITY - 1)) {
+        if (_live[i].addr == addr) {
+            return &_live[i];
+        }
+    }
+    return nullptr;
+}
+
+void RegionProfile::InsertLive(void *addr, size_t length, uint64_t start_ns) {
+    if (_live_count == MAX_LIVE_COUNT) {
+        return;
+    }
+    size_t i = Hash(addr);
+    while (_live[i].addr != nullptr) {
+        i = (i + 1) & (REGION_PROFILE_LIVE_CAPACITY - 1);
+    }
+    _live[i].addr = addr;
+    _live[i].length = length;
+    _live[i].start_ns = start_ns;
+    _live_count++;
+}
+
+/*
+ * Removes the mapping and moves back the following mappings of its probe
+ * sequence (instead of leaving a tombstone), so the lookups stay short.
+ */
+void RegionProfile::RemoveLive(LiveMapping *mapping) {
+    size_t hole = mapping - _live;
+    _live[hole].addr = nullptr;
+    size_t i = hole;
+    while (true) {
+        i = (i + 1) & (REGION_PROFILE_LIVE_CAPACITY - 1);
+        if (_live[i].addr == nullptr) {
+            break;
+        }
+        size_t home = Hash(_live[i].addr);
+        // a mapping can move back only if its home is not after the hole
+        // (cyclically) in its probe sequence
+        bool is_between = (hole <= i) ? (hole < home && home <= i)
+                                      : (hole < home || home <= i);
+        if (is_between) {
+            continue;
+        }
+        _live[hole] = _live[i];
+        _live[i].addr = nullptr;
+        hole = i;
+    }
+    _live_count--;
+}
+
+void RegionProfile::CountAllocation(void *addr, size_t length) {
+    _sizes[GetBucket(length)]++;
+    // a mapping that replaced another one (e.g., by MAP_FIXED) starts a new
+    // lifetime
+    LiveMapping *replaced = FindLive(addr);
+    if (replaced != nullptr) {
+        RemoveLive(replaced);
+    }
+    InsertLive(addr, length, GetTimeNs());
+}
+
+void RegionProfile::CountDeallocation(void *addr, size_t length) {
+    void *end = PTR_ADD(addr, length);
+    void *current = addr;
+    while (current < end) {
+        LiveMapping *mapping = FindLive(current);
+        if (mapping == nullptr) {
+            break;
+        }
+        void *mapping_end = PTR_ADD(current, mapping->length);
+        uint64_t start_ns = mapping->start_ns;
+        RemoveLive(mapping);
+        if (mapping_end > end) {
+            InsertLive(end, (size_t)PTR_SUB(mapping_end, end), start_ns);
+            break;
+        }
+        _lifetimes[GetBucket(GetTimeNs() - start_ns)]++;
+        current = mapping_end;
+    }
+}
+
+void RegionProfile::CountRemap(void *old_addr, void *new_addr,
+                               size_t new_length) {
+    uint64_t start_ns = GetTimeNs();
+    LiveMapping *mapping = FindLive(old_addr);
+    if (mapping != nullptr) {
+        start_ns = mapping->start_ns;
+        RemoveLive(mapping);
+    }
+    InsertLive(new_addr, new_length, start_ns);
+}
+
+/*
+ * Merges every two adjacent windows (keeping the larger occupancy of each
+ * chunk), so the heatmap covers twice the time.
+ */
+void RegionProfile::MergeWindows() {
+    size_t length = _used_chunks_count * sizeof(uint32_t);
+    for (int w = 0; w < REGION_PROFILE_WINDOWS / 2; w++) {
+        uint32_t *merged = GetWindow(w);
+        uint32_t *first = GetWindow(2 * w);
+        uint32_t *second = GetWindow(2 * w + 1);
+        for (size_t c = 0; c < _used_chunks_count; c++) {
+            merged[c] = (first[c] > second[c]) ? first[c] : second[c];
+        }
+    }
+    for (int w = REGION_PROFILE_WINDOWS / 2; w < REGION_PROFILE_WINDOWS; w++) {
+        memset(GetWindow(w), 0, length);
+    }
+    _window_ns *= 2;
+    if (_sampled_window >= 0) {
+        _sampled_window /= 2;
+    }
+}
+
+bool RegionProfile::BeginOccupancySample(bool is_forced) {
+    if (_heatmap == nullptr) {
+        return false;
+    }
+    uint64_t elapsed_ns = GetTimeNs() - _start_ns;
+    while (elapsed_ns / _window_ns >= REGION_PROFILE_WINDOWS) {
+        MergeWindows();
+    }
+    int window = (int)(elapsed_ns / _window_ns);
+    if (window == _sampled_window && !is_forced) {
+        return false;
+    }
+    // the windows without calls keep the occupancy of the last sample
+    size_t length = _used_chunks_count * sizeof(uint32_t);
+    if (_sampled_window >= 0) {
+        for (int w = _sampled_window + 1; w < window; w++) {
+            memcpy(GetWindow(w), GetWindow(_sampled_window), length);
+        }
+    }
+    memset(GetWindow(window), 0, length);
+    _sampled_window = window;
+    return true;
+}
+
+void RegionProfile::AddOccupiedRange(void *start, void *end, void *profile) {
+    RegionProfile *self = static_cast<RegionProfile*>(profile);
+    uint32_t *window = self->GetWindow(self->_sampled_window);
+    size_t from = (size_t)PTR_SUB(start, self->_base);
+    size_t to = (size_t)PTR_SUB(end, self->_base);
+    while (from < to) {
+        size_t chunk = from / REGION_PROFILE_CHUNK_SIZE;
+        if (chunk >= self->_chunks_count) {
+            break;
+        }
+        size_t chunk_end = (chunk + 1) * REGION_PROFILE_CHUNK_SIZE;
+        size_t overlap_end = (to < chunk_end) ? to : chunk_end;
+        window[chunk] += (uint32_t)(overlap_end - from);
+        if (self->_used_chunks_count <= chunk) {
+            self->_used_chunks_count = chunk + 1;
+        }
+        from = overlap_end;
+    }
+}
+
+void RegionProfile::WriteHeaders(FILE *sizes_file, FILE *lifetimes_file,
+                                 FILE *heatmap_file) {
+    fprintf(sizes_file, "region,min-size,max-size,mappings\n");
+    fprintf(lifetimes_file,
+            "region,min-lifetime-ns,max-lifetime-ns,freed-mappings,"
+            "live-mappings\n");
+    fprintf(heatmap_file,
+            "region,window-start-sec,window-end-sec,offset,occupied-bytes\n");
+}
+
+void RegionProfile::Write(const char *name, FILE *sizes_file,
+                          FILE *lifetimes_file, FILE *heatmap_file) {
+    if (!IsInitialized()) {
+        return;
+    }
+    for (int b = 0; b < REGION_PROFILE_BUCKETS; b++) {
+        if (_sizes[b] != 0) {
+            fprintf(sizes_file, "%s,%lu,%lu,%lu\n", name, 1ul << b,
+                    (2ul << b) - 1, (unsigned long)_sizes[b]);
+        }
+    }
+
+    // the mappings that are still alive are counted with their ages
+    uint64_t live[REGION_PROFILE_BUCKETS];
+    memset(live, 0, sizeof(live));
+    uint64_t now_ns = GetTimeNs();
+    for (size_t i = 0; i < REGION_PROFILE_LIVE_CAPACITY; i++) {
+        if (_live[i].addr != nullptr) {
+            live[GetBucket(now_ns - _live[i].start_ns)]++;
+        }
+    }
+    for (int b = 0; b < REGION_PROFILE_BUCKETS; b++) {
+        if (_lifetimes[b] != 0 || live[b] != 0) {
+            fprintf(lifetimes_file, "%s,%lu,%lu,%lu,%lu\n", name,
+                    (b == 0) ? 0ul : 1ul << b, (2ul << b) - 1,
+                    (unsigned long)_lifetimes[b], (unsigned long)live[b]);
+        }
+    }
+
+    for (int w = 0; w <= _sampled_window; w++) {
+        uint32_t *window = GetWindow(w);
+        for (size_t c = 0; c < _used_chunks_count; c++) {
+            if (window[c] != 0) {
+                fprintf(heatmap_file, "%s,%.3f,%.3f,%lu,%u\n", name,
+                        w * _window_ns / 1e9, (w + 1) * _window_ns / 1e9,
+                        c * REGION_PROFILE_CHUNK_SIZE, window[c]);
+            }
+        }
+    }
+}
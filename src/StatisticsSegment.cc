@@ -0,0 +1,193 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/mman.h>
+
+#include "FirstFitAllocator.h"
+#include "GlibcAllocationFunctions.h"
+#include "StatisticsSegment.h"
+
+StatisticsSegment *StatisticsSegment::_forked_segment = nullptr;
+
+StatisticsSegment::StatisticsSegment() :
+    _stats(nullptr),
+    _length(0) {
+        _name[0] = '\0';
+    }
+
+void StatisticsSegment::SetName(pid_t pid) {
+    snprintf(_name, sizeof(_name), "%s%d", MOSALLOC_STATS_NAME_PREFIX,
+             (int)pid);
+}
+
+int StatisticsSegment::Create() {
+    _length = ROUND_UP(sizeof(struct mosalloc_stats), PageSize::BASE_4KB);
+    SetName(getpid());
+    int fd = shm_open(_name, O_CREAT | O_RDWR | O_TRUNC, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+    void *ptr = MAP_FAILED;
+    if (ftruncate(fd, _length) == 0) {
+        ptr = GlibcMmap(NULL, _length, MMAP_PROTECTION, MAP_SHARED, fd, 0);
+    }
+    int error = errno;
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        shm_unlink(_name);
+        _name[0] = '\0';
+        errno = error;
+        return -1;
+    }
+
+    _stats = static_cast<struct mosalloc_stats*>(ptr);
+    _stats->version = MOSALLOC_STATS_VERSION;
+    _stats->pid = getpid();
+    strncpy(_stats->command, program_invocation_short_name,
+            sizeof(_stats->command) - 1);
+    _stats->start_time = time(NULL);
+    // readers ignore the segment until the magic is published
+    __atomic_store_n(&_stats->magic, MOSALLOC_STATS_MAGIC, __ATOMIC_RELEASE);
+
+    if (_forked_segment == nullptr) {
+        pthread_atfork(nullptr, nullptr, ReopenInChild);
+    }
+    _forked_segment = this;
+    return 0;
+}
+
+void StatisticsSegment::Unlink() {
+    if (_name[0] != '\0') {
+        shm_unlink(_name);
+        _name[0] = '\0';
+    }
+}
+
+struct mosalloc_pool_stats *StatisticsSegment::AddPool(const char *name,
+                                                       size_t capacity) {
+    if (_stats == nullptr ||
+        _stats->pools_count == MOSALLOC_STATS_MAX_POOLS) {
+        return nullptr;
+    }
+    struct mosalloc_pool_stats *pool = &_stats->pools[_stats->pools_count];
+    strncpy(pool->name, name, MOSALLOC_STATS_MAX_NAME_LENGTH - 1);
+    pool->capacity = capacity;
+    __atomic_store_n(&_stats->pools_count, _stats->pools_count + 1,
+                     __ATOMIC_RELEASE);
+    return pool;
+}
+
+bool StatisticsSegment::IsRefreshRequested(uint32_t *request) {
+    if (_stats == nullptr) {
+        return false;
+    }
+    *request = __atomic_load_n(&_stats->refresh_requests, __ATOMIC_RELAXED);
+    return *request != __atomic_load_n(&_stats->refreshes, __ATOMIC_RELAXED);
+}
+
+void StatisticsSegment::EndRefresh(uint32_t request) {
+    __atomic_store_n(&_stats->refreshes, request, __ATOMIC_RELEASE);
+}
+
+void StatisticsSegment::Max(uint64_t *counter, uint64_t value) {
+    uint64_t current = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    while (current < value &&
+           !__atomic_compare_exchange_n(counter, &current, value, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+uint64_t StatisticsSegment::GetTimeNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+static int GetPageSizeIndex(PageSize page_size) {
+    switch (page_size) {
+        case PageSize::HUGE_2MB:
+            return MOSALLOC_STATS_2MB;
+        case PageSize::HUGE_1GB:
+            return MOSALLOC_STATS_1GB;
+        default:
+            return MOSALLOC_STATS_4KB;
+    }
+}
+
+void StatisticsSegment::AddBackedSizes(uint64_t *counters,
+                                       HugePageBackedRegion &region,
+                                       void *addr, size_t len) {
+    MemoryIntervalList& intervals = region.GetIntervals();
+    off_t start = (off_t)PTR_SUB(addr, region.GetRegionBase());
+    off_t end = start + (off_t)len;
+    // the offsets that are outside of the intervals are mapped with 4KB pages
+    size_t backed_size = 0;
+    int first = region.FindInterval(addr);
+    for (size_t i = (first < 0) ? 0 : first; i < intervals.GetLength(); i++) {
+        MemoryInterval& interval = intervals.At(i);
+        if (interval._start_offset >= end) {
+            break;
+        }
+        off_t from = (interval._start_offset > start) ?
+            interval._start_offset : start;
+        off_t to = (interval._end_offset < end) ? interval._end_offset : end;
+        if (from < to) {
+            Add(&counters[GetPageSizeIndex(interval._page_size)], to - from);
+            backed_size += to - from;
+        }
+    }
+    if (backed_size < len) {
+        Add(&counters[MOSALLOC_STATS_4KB], len - backed_size);
+    }
+}
+
+void StatisticsSegment::ReopenInChild() {
+    if (_forked_segment != nullptr) {
+        _forked_segment->Reopen();
+    }
+}
+
+/*
+ * After fork, the child shares the segment of its parent, so it is replaced
+ * (at the same address) with a new segment of the child that starts with a
+ * copy of the counters. If the new segment cannot be created, the child
+ * keeps counting in private memory instead.
+ */
+void StatisticsSegment::Reopen() {
+    SetName(getpid());
+    int fd = shm_open(_name, O_CREAT | O_RDWR | O_TRUNC, 0600);
+    void *ptr = MAP_FAILED;
+    if (fd >= 0 && write(fd, _stats, _length) == (ssize_t)_length) {
+        ptr = GlibcMmap(_stats, _length, MMAP_PROTECTION,
+                        MAP_SHARED | MAP_FIXED, fd, 0);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (ptr == MAP_FAILED) {
+        if (fd >= 0) {
+            shm_unlink(_name);
+        }
+        _name[0] = '\0';
+        if (GlibcMmap(_stats, _length, MMAP_PROTECTION,
+                      MMAP_FLAGS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+            THROW_EXCEPTION("failed to detach the statistics segment");
+        }
+        return;
+    }
+    _stats->pid = getpid();
+    _stats->start_time = time(NULL);
+}
+
+void StatisticsSegment::SetFallbackCounters(struct mosalloc_pool_stats *stats,
+                                            HugePageBackedRegion &region) {
+    const struct HugePagesFallbackCounters &counters =
+        region.GetFallbackCounters();
+    Set(&stats->downgrades, counters.downgrades);
+    Set(&stats->downgraded_bytes[MOSALLOC_STATS_2MB],
+        counters.downgraded_2mb_size);
+    Set(&stats->downgraded_bytes[MOSALLOC_STATS_1GB],
+        counters.downgraded_1gb_size);
+    Set(&stats->fallback_failures, counters.failures);
+}
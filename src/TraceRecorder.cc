@@ -0,0 +1,255 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "globals.h"
+#include "GlibcAllocationFunctions.h"
+#include "TraceRecorder.h"
+
+struct ThreadTrace {
+    ThreadTrace *next;
+    int32_t tid;
+    int depth;
+    // set while a record is appended, so a call that interrupts it (in a
+    // signal handler) does not corrupt the buffer
+    volatile int is_appending;
+    size_t used;
+    struct mosalloc_trace_record records[TRACE_BUFFER_RECORDS];
+};
+
+// the buffers of all the threads; they are never freed, so the records of
+// the threads that exited are written on Close
+static std::atomic<ThreadTrace*> all_thread_traces(nullptr);
+
+bool TraceRecorder::_is_enabled = false;
+int TraceRecorder::_fd = -1;
+const char *TraceRecorder::_path_prefix = nullptr;
+uint64_t TraceRecorder::_start_ns = 0;
+struct mosalloc_trace_header TraceRecorder::_header;
+std::atomic<uint64_t> TraceRecorder::_sequence(0);
+std::atomic<uint64_t> TraceRecorder::_dropped(0);
+__thread ThreadTrace *TraceRecorder::_thread_trace = nullptr;
+
+static uint64_t GetTimeNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+uint64_t TraceRecorder::GetElapsedNs() {
+    return GetTimeNs() - _start_ns;
+}
+
+void TraceRecorder::AddPool(const char *name, void *base, size_t capacity) {
+    if (_header.pools_count == MOSALLOC_TRACE_MAX_POOLS) {
+        THROW_EXCEPTION("too many pools to trace");
+    }
+    strncpy(_header.names[_header.pools_count], name,
+            MOSALLOC_TRACE_MAX_NAME_LENGTH - 1);
+    _header.bases[_header.pools_count] = (uint64_t)base;
+    _header.capacities[_header.pools_count] = capacity;
+    _header.pools_count++;
+}
+
+int TraceRecorder::OpenFile() {
+    char path[PATH_MAX];
+    _header.pid = getpid();
+    snprintf(path, sizeof(path), "%s.%d", _path_prefix, (int)_header.pid);
+    _fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+               0644);
+    if (_fd < 0) {
+        return -1;
+    }
+    _start_ns = GetTimeNs();
+    Write(&_header, sizeof(_header));
+    return 0;
+}
+
+int TraceRecorder::Open(const char *path_prefix) {
+    _path_prefix = path_prefix;
+    _header.magic = MOSALLOC_TRACE_MAGIC;
+    _header.version = MOSALLOC_TRACE_VERSION;
+    _header.record_size = sizeof(struct mosalloc_trace_record);
+    _sequence.store(0, std::memory_order_relaxed);
+    _dropped.store(0, std::memory_order_relaxed);
+    if (OpenFile() != 0) {
+        return -1;
+    }
+    static bool is_fork_handler_registered = false;
+    if (!is_fork_handler_registered) {
+        int res = pthread_atfork(nullptr, nullptr, FollowFork);
+        if (res != 0) {
+            close(_fd);
+            _fd = -1;
+            errno = res;
+            return -1;
+        }
+        is_fork_handler_registered = true;
+    }
+    _is_enabled = true;
+    return 0;
+}
+
+/*
+ * Runs in the child after fork: the buffers hold the records of the parent
+ * (which the parent writes), so the child drops them and starts a file of
+ * its own. Only the forking thread exists in the child.
+ */
+void TraceRecorder::FollowFork() {
+    if (!_is_enabled) {
+        return;
+    }
+    close(_fd);
+    ThreadTrace *trace = all_thread_traces.load(std::memory_order_acquire);
+    for (; trace != nullptr; trace = trace->next) {
+        trace->used = 0;
+        trace->depth = 0;
+        trace->is_appending = 0;
+    }
+    if (_thread_trace != nullptr) {
+        _thread_trace->tid = (int32_t)syscall(SYS_gettid);
+    }
+    _sequence.store(0, std::memory_order_relaxed);
+    _dropped.store(0, std::memory_order_relaxed);
+    if (OpenFile() != 0) {
+        THROW_EXCEPTION("failed to open the trace file");
+    }
+}
+
+ThreadTrace *TraceRecorder::GetThreadTrace() {
+    if (_thread_trace != nullptr) {
+        return _thread_trace;
+    }
+    // the buffers are allocated through glibc so they are not taken from
+    // the pools that they record
+    void *ptr = GlibcMmap(NULL, sizeof(ThreadTrace), MMAP_PROTECTION,
+                          MMAP_FLAGS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return nullptr;
+    }
+    ThreadTrace *trace = static_cast<ThreadTrace*>(ptr);
+    trace->tid = (int32_t)syscall(SYS_gettid);
+    trace->next = all_thread_traces.load(std::memory_order_relaxed);
+    while (!all_thread_traces.compare_exchange_weak(
+                trace->next, trace, std::memory_order_release,
+                std::memory_order_relaxed)) {
+    }
+    _thread_trace = trace;
+    return trace;
+}
+
+ThreadTrace *TraceRecorder::Begin() {
+    ThreadTrace *trace = GetThreadTrace();
+    if (trace == nullptr) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    trace->depth++;
+    return trace;
+}
+
+void TraceRecorder::End(ThreadTrace *trace) {
+    trace->depth--;
+}
+
+void TraceRecorder::Append(ThreadTrace *trace,
+                           struct mosalloc_trace_record *record) {
+    if (!_is_enabled) {
+        return;
+    }
+    if (trace->is_appending) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    trace->is_appending = 1;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    record->sequence = _sequence.fetch_add(1, std::memory_order_relaxed);
+    trace->records[trace->used++] = *record;
+    if (trace->used == TRACE_BUFFER_RECORDS) {
+        Flush(trace);
+    }
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    trace->is_appending = 0;
+}
+
+void TraceRecorder::Flush(ThreadTrace *trace) {
+    if (trace->used == 0) {
+        return;
+    }
+    Write(trace->records, trace->used * sizeof(trace->records[0]));
+    trace->used = 0;
+}
+
+/*
+ * Writes @data to the end of the file; the records that could not be
+ * written are counted as dropped. errno is kept, since it belongs to the
+ * recorded call.
+ */
+void TraceRecorder::Write(const void *data, size_t length) {
+    int error = errno;
+    size_t written = 0;
+    while (written < length) {
+        ssize_t res = write(_fd, (const char*)data + written,
+                            length - written);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res <= 0) {
+            _dropped.fetch_add((length - written) /
+                               sizeof(struct mosalloc_trace_record),
+                               std::memory_order_relaxed);
+            break;
+        }
+        written += res;
+    }
+    errno = error;
+}
+
+void TraceRecorder::Close() {
+    if (!_is_enabled) {
+        return;
+    }
+    _is_enabled = false;
+    ThreadTrace *trace = all_thread_traces.load(std::memory_order_acquire);
+    for (; trace != nullptr; trace = trace->next) {
+        Flush(trace);
+    }
+    struct mosalloc_trace_record end;
+    memset(&end, 0, sizeof(end));
+    end.sequence = _sequence.fetch_add(1, std::memory_order_relaxed);
+    end.time_ns = GetElapsedNs();
+    end.call = MOSALLOC_TRACE_END;
+    end.result = _dropped.load(std::memory_order_relaxed);
+    Write(&end, sizeof(end));
+    close(_fd);
+    _fd = -1;
+    memset(&_header, 0, sizeof(_header));
+}
+
+void TraceCall::Begin(enum mosalloc_trace_call call) {
+    _trace = TraceRecorder::Begin();
+    if (_trace == nullptr) {
+        return;
+    }
+    memset(&_record, 0, sizeof(_record));
+    _record.call = (uint16_t)call;
+    _record.depth = (uint16_t)(_trace->depth - 1);
+    _record.tid = _trace->tid;
+    _record.fd = -1;
+    _record.time_ns = TraceRecorder::GetElapsedNs();
+}
+
+void TraceCall::Finish(uint64_t result, bool is_failed) {
+    _record.error = is_failed ? errno : 0;
+    _record.result = result;
+    _record.duration_ns =
+        (uint32_t)(TraceRecorder::GetElapsedNs() - _record.time_ns);
+    TraceRecorder::Append(_trace, &_record);
+}
@@ -8,10 +8,12 @@
 #include <string.h>
 #include <fcntl.h>
 #include <assert.h>
+#include <stdarg.h>
 
 #include "hooks.h"
 #include "GlibcAllocationFunctions.h"
 #include "MemoryAllocator.h"
+#include "TraceRecorder.h"
 
 static void constructor() __attribute__((constructor));
 static void destructor() __attribute__((destructor));
@@ -27,6 +29,11 @@ std::mutex g_hook_mmap_mutex;
 //std::mutex g_hook_malloc_mutex;
 bool alloc_request_intercepted = false;
 
+// records the acquisitions of the lock of the hook of @call in the live
+// statistics (when they are enabled)
+#define HOOK_GUARD(lock, call) \
+    TIMED_MUTEX_GUARD(lock, hpbrs_allocator.GetHooksLockStatistics(call))
+
 //void *(*__morecore)(ptrdiff_t) = sbrk;
 //__morecore = sbrk;
 
@@ -132,52 +139,117 @@ static void destructor() {
 }
 
 int mprotect(void *addr, size_t len, int prot) __THROW_EXCEPTION {
+    hpbrs_allocator.CountCall(MOSALLOC_STATS_MPROTECT);
+    LATENCY_SCOPE(MPROTECT);
     if (hpbrs_allocator.IsInitialized() == true &&
         hpbrs_allocator.IsAddressInHugePageRegions(addr) == true) {
-        return 0;
+        HOOK_GUARD(g_hook_mmap_mutex, MOSALLOC_STATS_MPROTECT);
+        TRACE_CALL(MPROTECT);
+        trace_call.SetArguments(addr, len, prot);
+        return trace_call.Return(
+                hpbrs_allocator.ProtectMmapRegion(addr, len, prot));
     }
     GlibcAllocationFunctions local_glibc_funcs;
     return local_glibc_funcs.CallGlibcMprotect(addr, len, prot);
 }
 
+int madvise(void *addr, size_t length, int advice) __THROW_EXCEPTION {
+    hpbrs_allocator.CountCall(MOSALLOC_STATS_MADVISE);
+    LATENCY_SCOPE(MADVISE);
+    if (hpbrs_allocator.IsInitialized() == true &&
+        hpbrs_allocator.IsAddressInHugePageRegions(addr) == true) {
+        HOOK_GUARD(g_hook_mmap_mutex, MOSALLOC_STATS_MADVISE);
+        TRACE_CALL(MADVISE);
+        trace_call.SetArguments(addr, length, advice);
+        return trace_call.Return(
+                hpbrs_allocator.AdviseMmapRegion(addr, length, advice));
+    }
+    GlibcAllocationFunctions local_glibc_funcs;
+    return local_glibc_funcs.CallGlibcMadvise(addr, length, advice);
+}
+
 void *mmap(void *addr, size_t length, int prot, int flags, int fd, 
             off_t offset) __THROW_EXCEPTION {
+    hpbrs_allocator.CountCall(MOSALLOC_STATS_MMAP);
+    LATENCY_SCOPE(MMAP);
     if (hpbrs_allocator.IsInitialized() == false) {
         GlibcAllocationFunctions local_glibc_funcs;
         return local_glibc_funcs.CallGlibcMmap(addr, length, prot, flags, fd, offset);
     }
     
-    MUTEX_GUARD(g_hook_mmap_mutex);
+    HOOK_GUARD(g_hook_mmap_mutex, MOSALLOC_STATS_MMAP);
+    TRACE_CALL(MMAP);
+    trace_call.SetArguments(addr, length, prot, flags, fd, offset);
 
     if (fd >= 0) {
-        return hpbrs_allocator.AllocateFromFileMmapRegion(addr, length, prot, flags, fd, offset);
+        return trace_call.Return(hpbrs_allocator.AllocateFromFileMmapRegion(
+                    addr, length, prot, flags, fd, offset));
         //GlibcAllocationFunctions local_glibc_funcs;
         //return local_glibc_funcs.CallGlibcMmap(addr, length, prot, flags, fd, offset);
     }
-    return hpbrs_allocator.AllocateFromAnonymousMmapRegion(length);
+    // the frame address forces a frame pointer in this hook, so the call
+    // site can be walked from it
+    return trace_call.Return(hpbrs_allocator.AllocateFromAnonymousMmapRegion(
+                addr, length, prot, flags, __builtin_frame_address(0)));
 }
 
 int munmap(void *addr, size_t length) __THROW_EXCEPTION {
+    hpbrs_allocator.CountCall(MOSALLOC_STATS_MUNMAP);
+    LATENCY_SCOPE(MUNMAP);
     if (hpbrs_allocator.IsInitialized() == false) {
         GlibcAllocationFunctions local_glibc_funcs;
         return local_glibc_funcs.CallGlibcMunmap(addr, length);
     }
 
-    MUTEX_GUARD(g_hook_mmap_mutex);
+    HOOK_GUARD(g_hook_mmap_mutex, MOSALLOC_STATS_MUNMAP);
+    TRACE_CALL(MUNMAP);
+    trace_call.SetArguments(addr, length);
 
     int res = hpbrs_allocator.DeallocateFromMmapRegion(addr, length);
-    return res;
+    return trace_call.Return(res);
+}
+
+void *mremap(void *old_address, size_t old_size, size_t new_size,
+             int flags, ...) __THROW_EXCEPTION {
+    hpbrs_allocator.CountCall(MOSALLOC_STATS_MREMAP);
+    LATENCY_SCOPE(MREMAP);
+    void *new_address = nullptr;
+    if (flags & MREMAP_FIXED) {
+        va_list args;
+        va_start(args, flags);
+        new_address = va_arg(args, void *);
+        va_end(args);
+    }
+
+    if (hpbrs_allocator.IsInitialized() == false ||
+        hpbrs_allocator.IsAddressInHugePageRegions(old_address) == false) {
+        GlibcAllocationFunctions local_glibc_funcs;
+        return local_glibc_funcs.CallGlibcMremap(old_address, old_size,
+                                                 new_size, flags, new_address);
+    }
+
+    HOOK_GUARD(g_hook_mmap_mutex, MOSALLOC_STATS_MREMAP);
+    TRACE_CALL(MREMAP);
+    trace_call.SetArguments(old_address, old_size, 0, flags, -1, 0, new_size,
+                            new_address);
+
+    return trace_call.Return(hpbrs_allocator.RemapMmapRegion(
+                old_address, old_size, new_size, flags, new_address));
 }
 
 int brk(void *addr) __THROW_EXCEPTION {
+    hpbrs_allocator.CountCall(MOSALLOC_STATS_BRK);
+    LATENCY_SCOPE(BRK);
     if (hpbrs_allocator.IsInitialized() == false) {
         GlibcAllocationFunctions local_glibc_funcs;
         return local_glibc_funcs.CallGlibcBrk(addr);
     }
     
-    MUTEX_GUARD(g_hook_brk_mutex);
+    HOOK_GUARD(g_hook_brk_mutex, MOSALLOC_STATS_BRK);
+    TRACE_CALL(BRK);
+    trace_call.SetArguments(addr, 0);
 
-    return hpbrs_allocator.ChangeProgramBreak(addr);
+    return trace_call.Return(hpbrs_allocator.ChangeProgramBreak(addr));
 }
 
 void *mosalloc_morecore(intptr_t increment) __THROW_EXCEPTION {
@@ -187,12 +259,17 @@ void *mosalloc_morecore(intptr_t increment) __THROW_EXCEPTION {
 }
 
 void *sbrk(intptr_t increment) __THROW_EXCEPTION {
+    hpbrs_allocator.CountCall(MOSALLOC_STATS_SBRK);
+    LATENCY_SCOPE(SBRK);
     if (hpbrs_allocator.IsInitialized() == false) {
         GlibcAllocationFunctions local_glibc_funcs;
         return local_glibc_funcs.CallGlibcSbrk(increment);
     }
     
-    MUTEX_GUARD(g_hook_sbrk_mutex);
+    HOOK_GUARD(g_hook_sbrk_mutex, MOSALLOC_STATS_SBRK);
+    // the brk call of sbrk is recorded inside it (with a depth of 1)
+    TRACE_CALL(SBRK);
+    trace_call.SetArguments(nullptr, (uint64_t)increment);
 
     // if this the first call to sbrk after pools were initialized
     // then initialize brk_top to be the brk pool base address
@@ -211,11 +288,11 @@ void *sbrk(intptr_t increment) __THROW_EXCEPTION {
     void* new_brk = (void*) ((intptr_t)brk_top + increment);
 
     if (brk(new_brk) < 0) {
-        return ((void*)-1);
+        return trace_call.Return((void*)-1);
     }
 
     brk_top = new_brk;
-    return prev_brk;
+    return trace_call.Return(prev_brk);
 }
 
 
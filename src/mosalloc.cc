@@ -0,0 +1,269 @@
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "mosalloc.h"
+#include "MemoryAllocator.h"
+
+// defined by hooks.cc, which is not linked into the mosalloc-api target
+extern MemoryAllocator hpbrs_allocator __attribute__((weak));
+
+// the allocator of the API when the hooks are not linked
+static MemoryAllocator *api_allocator_ptr = nullptr;
+
+/*
+ * Returns the allocator of the hooks if they are linked, or an allocator
+ * that is initialized on the first call otherwise (unless @may_initialize is
+ * false, e.g., in signal handlers). Returns nullptr if the allocator is not
+ * initialized yet.
+ */
+static MemoryAllocator *GetAllocator(bool may_initialize = true) {
+    if (&hpbrs_allocator != nullptr) {
+        return hpbrs_allocator.IsInitialized() ? &hpbrs_allocator : nullptr;
+    }
+    if (!may_initialize) {
+        return api_allocator_ptr;
+    }
+    static MemoryAllocator api_allocator;
+    api_allocator_ptr = &api_allocator;
+    return api_allocator_ptr;
+}
+
+static bool ToPageSize(size_t page_size, PageSize *result) {
+    switch (page_size) {
+        case 0:
+            *result = PageSize::UNKNOWN;
+            return true;
+        case (size_t)PageSize::BASE_4KB:
+        case (size_t)PageSize::HUGE_2MB:
+        case (size_t)PageSize::HUGE_1GB:
+            *result = (PageSize)page_size;
+            return true;
+        default:
+            return false;
+    }
+}
+
+void *mosalloc_alloc(size_t size, size_t page_size, int flags) {
+    PageSize pages;
+    if (!ToPageSize(page_size, &pages) || (flags & ~MOSALLOC_STRICT)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    MemoryAllocator *allocator = GetAllocator();
+    if (allocator == nullptr) {
+        errno = EAGAIN;
+        return NULL;
+    }
+    return allocator->AllocatePages(size, pages, flags & MOSALLOC_STRICT);
+}
+
+int mosalloc_free(void *ptr, size_t size) {
+    MemoryAllocator *allocator = GetAllocator();
+    if (allocator == nullptr) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return allocator->DeallocateFromMmapRegion(ptr, size);
+}
+
+int mosalloc_pool_info(int pool_index, struct mosalloc_pool_info *info) {
+    MemoryAllocator *allocator = GetAllocator();
+    if (allocator == nullptr) {
+        errno = EAGAIN;
+        return -1;
+    }
+    const char *name = nullptr;
+    MemoryPool *pool = allocator->GetAnonymousMmapPool(pool_index, &name);
+    if (pool == nullptr) {
+        errno = ENOENT;
+        return -1;
+    }
+    strncpy(info->name, name, MOSALLOC_MAX_POOL_NAME_LENGTH - 1);
+    info->name[MOSALLOC_MAX_POOL_NAME_LENGTH - 1] = '\0';
+    info->base = pool->GetRegionBase();
+    info->capacity = pool->GetRegionMaxSize();
+    info->size = pool->GetRegionSize();
+    info->committed_size = pool->GetCommittedSize();
+    info->size_4kb = pool->GetBackedSize(PageSize::BASE_4KB);
+    info->size_2mb = pool->GetBackedSize(PageSize::HUGE_2MB);
+    info->size_1gb = pool->GetBackedSize(PageSize::HUGE_1GB);
+    return 0;
+}
+
+static uint64_t GetTimeNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+int mosalloc_migrate(void *addr, size_t size, size_t page_size,
+                     struct mosalloc_migration_stats *stats) {
+    PageSize pages;
+    if (!ToPageSize(page_size, &pages) || pages == PageSize::UNKNOWN) {
+        errno = EINVAL;
+        return -1;
+    }
+    MemoryAllocator *allocator = GetAllocator();
+    if (allocator == nullptr) {
+        errno = EAGAIN;
+        return -1;
+    }
+    size_t copied_size = 0;
+    uint64_t start_ns = GetTimeNs();
+    if (allocator->MigrateRange(addr, size, pages, &copied_size) != 0) {
+        return -1;
+    }
+    uint64_t elapsed_ns = GetTimeNs() - start_ns;
+    if (stats != NULL) {
+        stats->copied_size = copied_size;
+        stats->elapsed_ns = elapsed_ns;
+        stats->bandwidth = (elapsed_ns == 0) ? 0 :
+            (double)copied_size * 1e9 / (double)elapsed_ns;
+    }
+    return 0;
+}
+
+int mosalloc_relayout(const char *config_file) {
+    MemoryAllocator *allocator = GetAllocator();
+    if (allocator == nullptr) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return allocator->Relayout(config_file);
+}
+
+// the reads of the intervals, which take no locks, give up after this many
+// changes of the intervals (see HugePageBackedRegion::GetIntervalsGeneration),
+// since a signal handler may interrupt a change that it then waits for
+#define MAX_INTERVALS_READ_RETRIES (16)
+
+static size_t GetMappedSize(HugePageBackedRegion *region,
+                            MemoryInterval &interval) {
+    size_t top = region->GetRegionSize();
+    if (top <= (size_t)interval._start_offset) {
+        return 0;
+    }
+    if (top >= (size_t)interval._end_offset) {
+        return interval._end_offset - interval._start_offset;
+    }
+    return top - interval._start_offset;
+}
+
+int mosalloc_query(const void *addr, struct mosalloc_address_info *info) {
+    MemoryAllocator *allocator = GetAllocator(false);
+    if (allocator == nullptr) {
+        return -1;
+    }
+    int pool_index = allocator->FindRegion((void *)addr);
+    if (pool_index == -1) {
+        return -1;
+    }
+    const char *name = nullptr;
+    HugePageBackedRegion *region = allocator->GetRegion(pool_index, &name);
+    for (int retries = 0; retries < MAX_INTERVALS_READ_RETRIES; retries++) {
+        uint32_t generation = region->GetIntervalsGeneration();
+        int interval_index = region->FindInterval((void *)addr);
+        MemoryInterval interval;
+        if (interval_index != -1) {
+            interval = region->GetIntervals().At(interval_index);
+        }
+        if (region->HaveIntervalsChanged(generation)) {
+            continue;
+        }
+        if (interval_index == -1) {
+            return -1;
+        }
+        size_t offset = (size_t)addr - (size_t)region->GetRegionBase();
+        info->pool_index = pool_index;
+        info->pool_name = name;
+        info->interval_index = interval_index;
+        info->interval_start = PTR_ADD(region->GetRegionBase(),
+                                       interval._start_offset);
+        info->interval_size = interval._end_offset - interval._start_offset;
+        info->page_size = (size_t)interval._page_size;
+        info->offset = offset;
+        info->is_mapped = (offset < region->GetRegionSize());
+        return 0;
+    }
+    return -1;
+}
+
+int mosalloc_next_interval(struct mosalloc_interval_iterator *iterator,
+                           struct mosalloc_interval *interval) {
+    MemoryAllocator *allocator = GetAllocator(false);
+    if (allocator == nullptr) {
+        return 0;
+    }
+    const char *name = nullptr;
+    HugePageBackedRegion *region;
+    int retries = 0;
+    while ((region = allocator->GetRegion(iterator->pool_index, &name))
+           != nullptr) {
+        uint32_t generation = region->GetIntervalsGeneration();
+        MemoryIntervalList &intervals = region->GetIntervals();
+        bool is_found = (iterator->interval_index >= 0 &&
+                         (size_t)iterator->interval_index <
+                         intervals.GetLength());
+        MemoryInterval current;
+        if (is_found) {
+            current = intervals.At(iterator->interval_index);
+        }
+        if (region->HaveIntervalsChanged(generation)) {
+            if (++retries == MAX_INTERVALS_READ_RETRIES) {
+                return 0;
+            }
+            continue;
+        }
+        if (is_found) {
+            interval->pool_index = iterator->pool_index;
+            interval->pool_name = name;
+            interval->interval_index = iterator->interval_index;
+            interval->start = PTR_ADD(region->GetRegionBase(),
+                                      current._start_offset);
+            interval->size = current._end_offset - current._start_offset;
+            interval->page_size = (size_t)current._page_size;
+            interval->mapped_size = GetMappedSize(region, current);
+            iterator->interval_index++;
+            return 1;
+        }
+        iterator->pool_index++;
+        iterator->interval_index = 0;
+    }
+    return 0;
+}
+
+int mosalloc_write_latencies(const char *path) {
+    if (path == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    return LatencyHistograms::Write(path);
+}
+
+int mosalloc_sample_accesses(void) {
+    MemoryAllocator *allocator = GetAllocator();
+    if (allocator == nullptr) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return allocator->SampleAccesses(true);
+}
+
+int mosalloc_write_utilization(const char *path) {
+    MemoryAllocator *allocator = GetAllocator();
+    if (allocator == nullptr || path == NULL) {
+        errno = (allocator == nullptr) ? EAGAIN : EINVAL;
+        return -1;
+    }
+    return allocator->WriteUtilization(path);
+}
+
+int mosalloc_verify_backing(struct mosalloc_backing_report *report) {
+    MemoryAllocator *allocator = GetAllocator();
+    if (allocator == nullptr || report == NULL) {
+        errno = (allocator == nullptr) ? EAGAIN : EINVAL;
+        return -1;
+    }
+    return allocator->VerifyBacking(report);
+}
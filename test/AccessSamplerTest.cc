@@ -0,0 +1,132 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "AccessSampler.h"
+
+#define POOL_BASE (0x40000000ul)
+#define PAGE_SIZE_4KB (4096ul)
+#define PAGES_PER_2MB (512ul)
+#define PRESENT (1ull << 63)
+
+static void MakeTempPath(char *path) {
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+}
+
+// writes the pagemap entry of the page at @page of the pool
+static void WriteEntry(int fd, size_t page, uint64_t entry) {
+    off_t offset = (off_t)((POOL_BASE / PAGE_SIZE_4KB + page) *
+                           sizeof(uint64_t));
+    ASSERT_EQ(pwrite(fd, &entry, sizeof(entry), offset),
+              (ssize_t)sizeof(entry));
+}
+
+static uint64_t ReadWord(int fd, uint64_t pfn) {
+    uint64_t word = 0;
+    pread(fd, &word, sizeof(word), (off_t)(pfn / 64 * sizeof(word)));
+    return word;
+}
+
+// the kernel clears the idle bit of a frame when it is accessed
+static void Access(int fd, uint64_t pfn) {
+    uint64_t word = ReadWord(fd, pfn) & ~(1ull << (pfn % 64));
+    pwrite(fd, &word, sizeof(word), (off_t)(pfn / 64 * sizeof(word)));
+}
+
+/*
+ * The pagemap and the idle bitmap are emulated by files: the first 2MB of
+ * the pool and the first page of its second 2MB are present, and their
+ * frames are spread over several words of the bitmap.
+ */
+TEST(AccessSamplerTest, CountAccessedPages) {
+    char pagemap_path[] = "/tmp/mosalloc-pagemap-test-XXXXXX";
+    char bitmap_path[] = "/tmp/mosalloc-bitmap-test-XXXXXX";
+    char prefix[] = "/tmp/mosalloc-accesses-test-XXXXXX";
+    MakeTempPath(pagemap_path);
+    MakeTempPath(bitmap_path);
+    MakeTempPath(prefix);
+    unlink(prefix);
+    int pagemap_fd = open(pagemap_path, O_RDWR);
+    int bitmap_fd = open(bitmap_path, O_RDWR);
+    ASSERT_GE(pagemap_fd, 0);
+    ASSERT_GE(bitmap_fd, 0);
+    for (size_t page = 0; page < PAGES_PER_2MB; page++) {
+        WriteEntry(pagemap_fd, page, PRESENT | (1000 + page));
+    }
+    WriteEntry(pagemap_fd, PAGES_PER_2MB, PRESENT | 5000);
+    // a page that is not present, and a page whose frame is hidden
+    WriteEntry(pagemap_fd, PAGES_PER_2MB + 1, 6000);
+    WriteEntry(pagemap_fd, PAGES_PER_2MB + 2, PRESENT);
+
+    AccessSampler sampler;
+    EXPECT_FALSE(sampler.IsOpen());
+    ASSERT_EQ(sampler.Open(prefix, 0, pagemap_path, bitmap_path), 0);
+    EXPECT_TRUE(sampler.IsOpen());
+    ASSERT_EQ(sampler.AddPool("mmap", (void*)POOL_BASE, 3 * 2097152), 0);
+    // without an interval, samples are taken only when they are forced
+    EXPECT_FALSE(sampler.IsDue());
+
+    // no frame was marked idle yet, so all the present pages are accessed
+    sampler.BeginSample();
+    sampler.SamplePool(0, 2097152 + 3 * PAGE_SIZE_4KB);
+    EXPECT_EQ(sampler.GetAccessedPages(0, 0), PAGES_PER_2MB);
+    EXPECT_EQ(sampler.GetAccessedPages(0, 1), 1ul);
+    EXPECT_EQ(ReadWord(bitmap_fd, 1000) & (1ull << (1000 % 64)),
+              1ull << (1000 % 64));
+    EXPECT_EQ(ReadWord(bitmap_fd, 5000) & (1ull << (5000 % 64)),
+              1ull << (5000 % 64));
+    EXPECT_EQ(ReadWord(bitmap_fd, 6000), 0ul);
+
+    // the frames were marked idle, so only the accessed ones are counted
+    Access(bitmap_fd, 1000);
+    Access(bitmap_fd, 1100);
+    Access(bitmap_fd, 5000);
+    sampler.BeginSample();
+    sampler.SamplePool(0, 2097152 + 3 * PAGE_SIZE_4KB);
+    EXPECT_EQ(sampler.GetAccessedPages(0, 0), PAGES_PER_2MB + 2);
+    EXPECT_EQ(sampler.GetAccessedPages(0, 1), 2ul);
+
+    // the pages above the sampled size are not counted
+    Access(bitmap_fd, 1000);
+    Access(bitmap_fd, 5000);
+    sampler.BeginSample();
+    sampler.SamplePool(0, PAGE_SIZE_4KB);
+    EXPECT_EQ(sampler.GetAccessedPages(0, 0), PAGES_PER_2MB + 3);
+    EXPECT_EQ(sampler.GetAccessedPages(0, 1), 2ul);
+    EXPECT_EQ(sampler.GetSamplesCount(), 3ul);
+    sampler.Close();
+    EXPECT_FALSE(sampler.IsOpen());
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s.%d", prefix, (int)getpid());
+    FILE *file = fopen(path, "r");
+    ASSERT_NE(file, nullptr);
+    char line[256];
+    ASSERT_NE(fgets(line, sizeof(line), file), nullptr);
+    EXPECT_STREQ(line, "pool,offset,samples,accessed-samples,accessed-pages\n");
+    ASSERT_NE(fgets(line, sizeof(line), file), nullptr);
+    EXPECT_STREQ(line, "mmap,0,3,3,515\n");
+    ASSERT_NE(fgets(line, sizeof(line), file), nullptr);
+    EXPECT_STREQ(line, "mmap,2097152,3,2,2\n");
+    EXPECT_EQ(fgets(line, sizeof(line), file), nullptr);
+    fclose(file);
+    unlink(path);
+
+    close(pagemap_fd);
+    close(bitmap_fd);
+    unlink(pagemap_path);
+    unlink(bitmap_path);
+}
+
+TEST(AccessSamplerTest, OpenFailsWithoutBitmap) {
+    AccessSampler sampler;
+    EXPECT_EQ(sampler.Open("/tmp/mosalloc-accesses", 0, "/proc/self/pagemap",
+                           "/nonexistent/bitmap"), -1);
+    EXPECT_EQ(errno, ENOENT);
+    EXPECT_FALSE(sampler.IsOpen());
+}
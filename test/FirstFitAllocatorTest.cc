@@ -382,3 +382,163 @@ TEST(FirstFitAllocatorTest, AllocateFreeTopHalfAllocateAllMemory) {
 		EXPECT_EQ(ffa.GetFreeSpace(), (total_space - total_alloc));
 	}
 }
+
+TEST(FirstFitAllocatorTest, ResizeInPlace) {
+	FirstFitAllocator ffa(true, false);
+	const unsigned int len = 256;
+	void *const start = (void *) (1ul << 30); // 1GB
+	void *const end = (void *) (2ul << 30); // 2GB
+	size_t total_space = (size_t) (PTR_SUB(end, start));
+	size_t region_size = total_space / len;
+
+	ffa.Initialize(len, start, end);
+
+	void *first = ffa.Allocate(region_size);
+	void *second = ffa.Allocate(region_size);
+	void *third = ffa.Allocate(region_size);
+	ASSERT_EQ(first, start);
+	ASSERT_EQ(second, PTR_ADD(start, region_size));
+	ASSERT_EQ(third, PTR_ADD(start, 2 * region_size));
+
+	// cannot grow into an occupied region
+	EXPECT_NE(ffa.ResizeInPlace(first, region_size, 2 * region_size), 0);
+
+	// grow into the freed adjacent region
+	EXPECT_EQ(ffa.Free(second, region_size), 0);
+	EXPECT_EQ(ffa.ResizeInPlace(first, region_size, 2 * region_size), 0);
+	EXPECT_EQ(ffa.GetFreeSpace(), total_space - 3 * region_size);
+	EXPECT_NE(ffa.ResizeInPlace(first, 2 * region_size, 3 * region_size), 0);
+
+	// shrink back and reuse the freed tail
+	EXPECT_EQ(ffa.ResizeInPlace(first, 2 * region_size, region_size / 2), 0);
+	EXPECT_EQ(ffa.GetFreeSpace(), total_space - region_size - region_size / 2);
+	EXPECT_EQ(ffa.Allocate(region_size), PTR_ADD(start, region_size / 2));
+
+	// grow the top region partially into the free space above it
+	EXPECT_EQ(ffa.ResizeInPlace(third, region_size, 2 * region_size), 0);
+	EXPECT_EQ(ffa.GetTopAddress(), PTR_ADD(start, 4 * region_size));
+	EXPECT_EQ(ffa.Free(third, 2 * region_size), 0);
+
+	// resizing an unallocated address fails
+	EXPECT_LT(ffa.ResizeInPlace(third, region_size, 2 * region_size), 0);
+}
+
+TEST(FirstFitAllocatorTest, AllocateAtAndFreeRange) {
+	FirstFitAllocator ffa(true, false);
+	const unsigned int len = 256;
+	void *const start = (void *) (1ul << 30); // 1GB
+	void *const end = (void *) (2ul << 30); // 2GB
+	size_t total_space = (size_t) (PTR_SUB(end, start));
+	size_t region_size = total_space / len;
+
+	ffa.Initialize(len, start, end);
+
+	// allocate from the middle of the free region (splits it)
+	void *middle = PTR_ADD(start, 4 * region_size);
+	EXPECT_EQ(ffa.AllocateAt(middle, region_size), middle);
+	EXPECT_EQ(ffa.GetFreeSpace(), total_space - region_size);
+	// the range is already occupied
+	EXPECT_EQ(ffa.AllocateAt(middle, region_size), nullptr);
+	EXPECT_EQ(ffa.AllocateAt(PTR_SUB(middle, region_size), 2 * region_size), nullptr);
+	// outside of the managed range
+	EXPECT_EQ(ffa.AllocateAt(PTR_SUB(end, region_size), 2 * region_size), nullptr);
+
+	// allocate at the head and at the tail of a free region
+	EXPECT_EQ(ffa.AllocateAt(start, region_size), start);
+	void *before_middle = PTR_SUB(middle, region_size);
+	EXPECT_EQ(ffa.AllocateAt(before_middle, region_size), before_middle);
+	// first fit takes the gap that is left, and then the space above it
+	EXPECT_EQ(ffa.Allocate(2 * region_size), PTR_ADD(start, region_size));
+	EXPECT_EQ(ffa.Allocate(region_size), PTR_ADD(start, 5 * region_size));
+	EXPECT_EQ(ffa.GetFreeSpace(), total_space - 6 * region_size);
+
+	// free a range that spans several regions and covers only parts of the
+	// first and the last ones
+	EXPECT_EQ(ffa.FreeRange(PTR_ADD(start, region_size / 2), 3 * region_size), 0);
+	EXPECT_EQ(ffa.GetFreeSpace(), total_space - 3 * region_size);
+	EXPECT_EQ(ffa.AllocateAt(PTR_ADD(start, region_size / 2), 3 * region_size),
+		  PTR_ADD(start, region_size / 2));
+
+	// free from the middle of a region
+	EXPECT_EQ(ffa.FreeRange(PTR_ADD(start, region_size), region_size), 0);
+	EXPECT_EQ(ffa.GetFreeSpace(), total_space - 5 * region_size);
+	EXPECT_EQ(ffa.Allocate(region_size), PTR_ADD(start, region_size));
+
+	// freeing free memory is a no-op
+	EXPECT_EQ(ffa.FreeRange(PTR_ADD(start, 10 * region_size), region_size), 0);
+	EXPECT_EQ(ffa.FreeRange(start, total_space), 0);
+	EXPECT_EQ(ffa.GetFreeSpace(), total_space);
+	EXPECT_EQ(ffa.GetTopAddress(), start);
+}
+
+TEST(FirstFitAllocatorTest, AllocateInRange) {
+	FirstFitAllocator ffa(true, false);
+	const unsigned int len = 256;
+	void *const start = (void *) (1ul << 30); // 1GB
+	void *const end = (void *) (2ul << 30); // 2GB
+	size_t total_space = (size_t) (PTR_SUB(end, start));
+	size_t region_size = total_space / len;
+
+	ffa.Initialize(len, start, end);
+
+	// the first fit inside the range, even when the space below it is free
+	void *range_start = PTR_ADD(start, 8 * region_size);
+	void *range_end = PTR_ADD(start, 12 * region_size);
+	EXPECT_EQ(ffa.AllocateInRange(region_size, range_start, range_end), range_start);
+	EXPECT_EQ(ffa.AllocateInRange(2 * region_size, range_start, range_end),
+		  PTR_ADD(range_start, region_size));
+	// the range has no room left
+	EXPECT_EQ(ffa.AllocateInRange(2 * region_size, range_start, range_end), nullptr);
+	EXPECT_EQ(ffa.AllocateInRange(region_size, range_start, range_end),
+		  PTR_ADD(range_start, 3 * region_size));
+	EXPECT_EQ(ffa.GetFreeSpace(), total_space - 4 * region_size);
+
+	// first fit keeps using the space below the range
+	EXPECT_EQ(ffa.Allocate(region_size), start);
+	EXPECT_TRUE(ffa.IsValidDataStructure());
+}
+
+TEST(FirstFitAllocatorTest, ReplaceAt) {
+	FirstFitAllocator ffa(true, false);
+	const unsigned int len = 8;
+	void *const start = (void *) (1ul << 30); // 1GB
+	void *const end = (void *) (2ul << 30); // 2GB
+	size_t total_space = (size_t) (PTR_SUB(end, start));
+	size_t region_size = total_space / 64;
+
+	ffa.Initialize(len, start, end);
+	EXPECT_EQ(ffa.Allocate(4 * region_size), start);
+
+	// replace a range that overlaps the occupied region and the free one
+	void *replaced = PTR_ADD(start, 3 * region_size);
+	EXPECT_EQ(ffa.ReplaceAt(replaced, 2 * region_size), replaced);
+	EXPECT_EQ(ffa.GetFreeSpace(), total_space - 5 * region_size);
+	// outside of the managed range
+	EXPECT_EQ(ffa.ReplaceAt(PTR_SUB(end, region_size), 2 * region_size), nullptr);
+
+	// the list is left untouched when it may run out of nodes
+	EXPECT_EQ(ffa.AllocateAt(PTR_ADD(start, 8 * region_size), region_size),
+		  PTR_ADD(start, 8 * region_size));
+	unsigned int used_nodes = ffa.GetUsedNodes();
+	ASSERT_LT(len - used_nodes, 4u);
+	EXPECT_EQ(ffa.ReplaceAt(PTR_ADD(start, region_size), region_size), nullptr);
+	EXPECT_EQ(ffa.GetUsedNodes(), used_nodes);
+	EXPECT_EQ(ffa.GetFreeSpace(), total_space - 6 * region_size);
+}
+
+TEST(FirstFitAllocatorTest, GetOccupiedSize) {
+	FirstFitAllocator ffa(true, false);
+	const unsigned int len = 8;
+	void *const start = (void *) (1ul << 30); // 1GB
+	void *const end = (void *) (2ul << 30); // 2GB
+	size_t region_size = (size_t) (PTR_SUB(end, start)) / 64;
+
+	ffa.Initialize(len, start, end);
+	EXPECT_EQ(ffa.Allocate(4 * region_size), start);
+	EXPECT_EQ(ffa.Allocate(region_size), PTR_ADD(start, 4 * region_size));
+	EXPECT_EQ(ffa.GetOccupiedSize(start), 4 * region_size);
+	EXPECT_EQ(ffa.GetOccupiedSize(PTR_ADD(start, 4 * region_size)), region_size);
+	// only the starts of the occupied regions are matched
+	EXPECT_EQ(ffa.GetOccupiedSize(PTR_ADD(start, region_size)), 0ul);
+	EXPECT_EQ(ffa.GetOccupiedSize(PTR_ADD(start, 5 * region_size)), 0ul);
+}
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "FootprintSampler.h"
+
+static FILE *OpenSamplesFile(const char *prefix) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s.%d", prefix, (int)getpid());
+    FILE *file = fopen(path, "rb");
+    unlink(path);
+    return file;
+}
+
+TEST(FootprintSamplerTest, WriteAndReadBack) {
+    char prefix[] = "/tmp/mosalloc-footprint-test-XXXXXX";
+    int fd = mkstemp(prefix);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    unlink(prefix);
+
+    FootprintSampler sampler;
+    EXPECT_FALSE(sampler.IsOpen());
+    ASSERT_EQ(sampler.Open(prefix, 0, 3), 0);
+    EXPECT_TRUE(sampler.IsOpen());
+    sampler.AddPool("mmap", (void*)0x10000000);
+    sampler.AddPool("brk", (void*)0x20000000);
+
+    // without an interval, a sample is due every 3 operations
+    EXPECT_FALSE(sampler.CountOperation());
+    EXPECT_FALSE(sampler.CountOperation());
+    EXPECT_TRUE(sampler.CountOperation());
+
+    struct mosalloc_footprint_pool pools[2];
+    memset(pools, 0, sizeof(pools));
+    pools[0].size = 4096;
+    pools[0].committed[0] = 4096;
+    pools[0].ffa_top = 0x10001000;
+    pools[1].size = 2097152;
+    pools[1].committed[1] = 2097152;
+    pools[1].ffa_top = 0x20200000;
+    sampler.Write(pools);
+    EXPECT_FALSE(sampler.CountOperation());
+    sampler.Write(pools);
+    sampler.Close();
+    EXPECT_FALSE(sampler.IsOpen());
+
+    FILE *file = OpenSamplesFile(prefix);
+    ASSERT_NE(file, nullptr);
+    struct mosalloc_footprint_header header;
+    ASSERT_EQ(fread(&header, sizeof(header), 1, file), 1ul);
+    EXPECT_EQ(header.magic, MOSALLOC_FOOTPRINT_MAGIC);
+    EXPECT_EQ(header.version, (uint32_t)MOSALLOC_FOOTPRINT_VERSION);
+    EXPECT_EQ(header.pid, getpid());
+    EXPECT_EQ(header.pools_count, 2u);
+    EXPECT_EQ(header.operations, 3ul);
+    EXPECT_EQ(header.interval_ns, 0ul);
+    EXPECT_STREQ(header.names[0], "mmap");
+    EXPECT_STREQ(header.names[1], "brk");
+    EXPECT_EQ(header.bases[1], 0x20000000ul);
+
+    struct mosalloc_footprint_record record;
+    struct mosalloc_footprint_pool read_pools[2];
+    uint64_t expected_operations[] = {3, 4};
+    uint64_t last_time_ns = 0;
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQ(fread(&record, sizeof(record), 1, file), 1ul);
+        ASSERT_EQ(fread(read_pools, sizeof(read_pools), 1, file), 1ul);
+        EXPECT_EQ(record.operations, expected_operations[i]);
+        EXPECT_GE(record.time_ns, last_time_ns);
+        last_time_ns = record.time_ns;
+        EXPECT_EQ(memcmp(read_pools, pools, sizeof(pools)), 0);
+    }
+    EXPECT_EQ(fread(&record, sizeof(record), 1, file), 0ul);
+    fclose(file);
+}
+
+TEST(FootprintSamplerTest, TooManyPools) {
+    char prefix[] = "/tmp/mosalloc-footprint-test-XXXXXX";
+    int fd = mkstemp(prefix);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    unlink(prefix);
+
+    FootprintSampler sampler;
+    ASSERT_EQ(sampler.Open(prefix, 1000000, 0), 0);
+    for (int i = 0; i < MOSALLOC_FOOTPRINT_MAX_POOLS; i++) {
+        sampler.AddPool("mmap", nullptr);
+    }
+    EXPECT_DEATH(sampler.AddPool("brk", nullptr), "");
+    sampler.Close();
+    FILE *file = OpenSamplesFile(prefix);
+    ASSERT_NE(file, nullptr);
+    fclose(file);
+}
@@ -408,3 +408,381 @@ TEST_F(HugePageBackedRegionTest, TestAllocateRegionOfPages_1GB_AndResize) {
     }
     _hpbr.Resize(0);
 }
+
+static bool IsResident(void *addr, size_t size) {
+    std::vector<unsigned char> vec(size / static_cast<size_t>(PageSize::BASE_4KB));
+    EXPECT_EQ(mincore(addr, size, vec.data()), 0);
+    for (size_t i = 0; i < vec.size(); i++) {
+        if ((vec[i] & 1) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST(HugePageBackedRegionReserveTest, DecommitAndCommit_4KB) {
+    size_t size = 16*MB;
+    MemoryIntervalList configurationList;
+    configurationList.Initialize(mmap, munmap, 0);
+
+    HugePageBackedRegion hpbr;
+    hpbr.Initialize(size, configurationList, mmap, munmap);
+    char *region_base = (char*)hpbr.GetRegionBase();
+    hpbr.Resize(0);
+    hpbr.Resize(8*MB);
+    memset(region_base, WRITTEN_DATA, 8*MB);
+
+    // decommitted pages are released
+    EXPECT_EQ(hpbr.Decommit(region_base + MB, 2*MB), 0);
+    EXPECT_FALSE(IsResident(region_base + MB, 2*MB));
+    EXPECT_TRUE(IsResident(region_base, MB));
+    EXPECT_TRUE(IsResident(region_base + 3*MB, MB));
+
+    // committed pages are fresh, and the rest stay decommitted
+    EXPECT_EQ(hpbr.Commit(region_base + 2*MB + 100, 100), 0);
+    EXPECT_EQ(region_base[2*MB], 0);
+    region_base[2*MB] = WRITTEN_DATA;
+    EXPECT_TRUE(IsResident(region_base + 2*MB, 4096));
+    EXPECT_FALSE(IsResident(region_base + MB, MB));
+    EXPECT_FALSE(IsResident(region_base + 2*MB + 4096, MB - 4096));
+
+    // ranges above the top are backed with placeholders when extending
+    EXPECT_EQ(hpbr.Decommit(region_base + 8*MB, 4*MB), 0);
+    hpbr.Resize(16*MB);
+    memset(region_base + 12*MB, WRITTEN_DATA, 4*MB);
+    EXPECT_EQ(hpbr.Commit(region_base + 8*MB, 4*MB), 0);
+    memset(region_base + 8*MB, WRITTEN_DATA, 4*MB);
+    EXPECT_TRUE(IsResident(region_base + 8*MB, 8*MB));
+
+    // shrinking drops the decommitted ranges above the new top
+    EXPECT_EQ(hpbr.Decommit(region_base + 12*MB, 4*MB), 0);
+    hpbr.Resize(8*MB);
+    hpbr.Resize(16*MB);
+    memset(region_base + 12*MB, WRITTEN_DATA, 4*MB);
+    EXPECT_EQ(region_base[16*MB - 1], WRITTEN_DATA);
+    hpbr.Resize(0);
+}
+
+static int FailingMadvise(void *, size_t, int) {
+    errno = EINVAL;
+    return -1;
+}
+
+TEST(HugePageBackedRegionReserveTest, Discard_4KB) {
+    size_t size = 16*MB;
+    MemoryIntervalList configurationList;
+    configurationList.Initialize(mmap, munmap, 0);
+
+    HugePageBackedRegion hpbr;
+    hpbr.Initialize(size, configurationList, mmap, munmap);
+    char *region_base = (char*)hpbr.GetRegionBase();
+    hpbr.Resize(0);
+    hpbr.Resize(8*MB);
+    memset(region_base, WRITTEN_DATA, 8*MB);
+    EXPECT_EQ(hpbr.GetResidentSize(), 8*MB);
+    EXPECT_EQ(hpbr.GetCommittedSize(), 8*MB);
+
+    // whole pages are released and the partially covered ones are cleared
+    EXPECT_EQ(hpbr.Discard(region_base + MB + 100, 2*MB, MADV_DONTNEED), 2*MB - 4096);
+    EXPECT_EQ(region_base[MB + 99], WRITTEN_DATA);
+    EXPECT_EQ(region_base[MB + 100], 0);
+    EXPECT_EQ(region_base[3*MB + 99], 0);
+    EXPECT_EQ(region_base[3*MB + 100], WRITTEN_DATA);
+    EXPECT_EQ(hpbr.GetResidentSize(), 6*MB + 4096);
+    EXPECT_EQ(hpbr.GetCommittedSize(), 8*MB);
+
+    // decommitted pages are not counted as committed nor discarded again
+    EXPECT_EQ(hpbr.Decommit(region_base + 4*MB, 2*MB), 0);
+    EXPECT_EQ(hpbr.GetCommittedSize(), 6*MB);
+    EXPECT_EQ(hpbr.Discard(region_base + 4*MB, 4*MB, MADV_DONTNEED), 2*MB);
+    EXPECT_EQ(hpbr.GetResidentSize(), 2*MB + 4096);
+    hpbr.Resize(0);
+
+    // pages whose advice fails are not counted as discarded
+    HugePageBackedRegion rejecting_hpbr;
+    rejecting_hpbr.Initialize(size, configurationList, mmap, munmap, nullptr,
+                              mprotect, FailingMadvise);
+    char *rejecting_base = (char*)rejecting_hpbr.GetRegionBase();
+    rejecting_hpbr.Resize(0);
+    rejecting_hpbr.Resize(4*MB);
+    memset(rejecting_base, WRITTEN_DATA, 4*MB);
+    EXPECT_EQ(rejecting_hpbr.Discard(rejecting_base, 4*MB, MADV_FREE), 0ul);
+    EXPECT_EQ(rejecting_base[0], WRITTEN_DATA);
+    rejecting_hpbr.Resize(0);
+}
+
+TEST(HugePageBackedRegionReserveTest, Utilization_4KB) {
+    size_t size = 16*MB;
+    MemoryIntervalList configurationList;
+    configurationList.Initialize(mmap, munmap, 0);
+
+    HugePageBackedRegion hpbr;
+    hpbr.Initialize(size, configurationList, mmap, munmap);
+    char *region_base = (char*)hpbr.GetRegionBase();
+    hpbr.Resize(0);
+    ASSERT_EQ(hpbr.EnableTouchTracking(), 0);
+    hpbr.Resize(8*MB);
+    region_base[0] = WRITTEN_DATA;
+    region_base[5*MB] = WRITTEN_DATA;
+    ASSERT_EQ(hpbr.GetIntervals().GetLength(), 1);
+
+    // the touched 4KB pages are counted in 2MB chunks
+    struct IntervalUtilization utilization;
+    hpbr.GetIntervalUtilization(0, &utilization);
+    EXPECT_EQ(utilization.mapped_size, 8*MB);
+    EXPECT_EQ(utilization.resident_size, 2*4096ul);
+    EXPECT_EQ(utilization.touched_size, 4*MB);
+    EXPECT_EQ(utilization.high_water_mark, 6*MB);
+
+    // the touched pages are remembered when they are released
+    hpbr.Resize(4*MB);
+    hpbr.GetIntervalUtilization(0, &utilization);
+    EXPECT_EQ(utilization.mapped_size, 4*MB);
+    EXPECT_EQ(utilization.resident_size, 4096ul);
+    EXPECT_EQ(utilization.touched_size, 4*MB);
+    EXPECT_EQ(utilization.high_water_mark, 6*MB);
+    hpbr.Resize(0);
+}
+
+TEST(HugePageBackedRegionReserveTest, VerifyBacking_4KB) {
+    size_t size = 16*MB;
+    MemoryIntervalList configurationList;
+    configurationList.Initialize(mmap, munmap, 0);
+
+    HugePageBackedRegion hpbr;
+    hpbr.Initialize(size, configurationList, mmap, munmap);
+    char *region_base = (char*)hpbr.GetRegionBase();
+    hpbr.Resize(0);
+    hpbr.Resize(8*MB);
+    // THP would back the 4KB interval with 2MB pages
+    madvise(region_base, 8*MB, MADV_NOHUGEPAGE);
+    PageBackingVerifier verifier;
+    ASSERT_EQ(verifier.Open(), 0);
+
+    // the pages that were not touched yet are walked again by each check
+    struct mosalloc_backing_report report;
+    memset(&report, 0, sizeof(report));
+    ASSERT_EQ(hpbr.VerifyBacking(verifier, &report), 0);
+    EXPECT_EQ(report.checked_size, 8*MB);
+    EXPECT_EQ(report.present_size, 0ul);
+    memset(region_base, WRITTEN_DATA, 4*MB);
+    memset(&report, 0, sizeof(report));
+    ASSERT_EQ(hpbr.VerifyBacking(verifier, &report), 0);
+    EXPECT_EQ(report.checked_size, 8*MB);
+    EXPECT_EQ(report.present_size, 4*MB);
+    EXPECT_EQ(report.mismatched_size, 0ul);
+
+    // the verified chunks are skipped until their pages are mapped again
+    memset(&report, 0, sizeof(report));
+    ASSERT_EQ(hpbr.VerifyBacking(verifier, &report), 0);
+    EXPECT_EQ(report.checked_size, 4*MB);
+    hpbr.Discard(region_base, 2*MB, MADV_DONTNEED);
+    memset(&report, 0, sizeof(report));
+    ASSERT_EQ(hpbr.VerifyBacking(verifier, &report), 0);
+    EXPECT_EQ(report.checked_size, 6*MB);
+    EXPECT_EQ(report.present_size, 0ul);
+    hpbr.Resize(0);
+}
+
+TEST(HugePageBackedRegionReserveTest, Migrate_4KB) {
+    size_t size = 16*MB;
+    MemoryIntervalList configurationList;
+    configurationList.Initialize(mmap, munmap, 0);
+
+    HugePageBackedRegion hpbr;
+    hpbr.Initialize(size, configurationList, mmap, munmap);
+    char *region_base = (char*)hpbr.GetRegionBase();
+    hpbr.Resize(0);
+    hpbr.Resize(8*MB);
+    for (size_t i = 0; i < 8*MB; i += 4096) {
+        region_base[i] = (char)(i / 4096);
+    }
+    char *huge_page = (char*)ROUND_UP(region_base + 4096, 2*MB);
+    size_t copied_size = 0;
+
+    // the range must be aligned to the target page size
+    EXPECT_EQ(hpbr.Migrate(huge_page + 4096, 2*MB, PageSize::HUGE_2MB,
+                           &copied_size), -EINVAL);
+    EXPECT_EQ(hpbr.Migrate(region_base, 0, PageSize::BASE_4KB,
+                           &copied_size), -EINVAL);
+
+    // the contents move with the range
+    EXPECT_EQ(hpbr.Migrate(region_base + MB, MB, PageSize::BASE_4KB,
+                           &copied_size), 0);
+    EXPECT_EQ(copied_size, MB);
+    EXPECT_EQ(region_base[MB], (char)(MB / 4096));
+    EXPECT_EQ(hpbr.GetIntervals().GetLength(), 1);
+
+    // decommitted ranges are busy, and stay decommitted
+    EXPECT_EQ(hpbr.Decommit(region_base + 3*MB, MB), 0);
+    EXPECT_EQ(hpbr.Migrate(region_base + 2*MB, 2*MB, PageSize::BASE_4KB,
+                           &copied_size), -EBUSY);
+    EXPECT_EQ(hpbr.GetCommittedSize(PageSize::BASE_4KB), (size_t)7*MB);
+    EXPECT_EQ(hpbr.Commit(region_base + 3*MB, MB), 0);
+
+    // promotion succeeds only if there are free 2MB pages
+    int res = hpbr.Migrate(huge_page, 2*MB, PageSize::HUGE_2MB,
+                           &copied_size);
+    size_t offset = (size_t)(huge_page - region_base);
+    EXPECT_EQ(huge_page[4096], (char)((offset + 4096) / 4096));
+    if (res == 0) {
+        EXPECT_EQ(hpbr.GetPageSize(huge_page), PageSize::HUGE_2MB);
+        EXPECT_EQ(hpbr.GetIntervals().GetLength(), 3);
+        // and demotion restores the 4KB pages
+        EXPECT_EQ(hpbr.Migrate(huge_page, 2*MB, PageSize::BASE_4KB,
+                               &copied_size), 0);
+        EXPECT_EQ(huge_page[4096], (char)((offset + 4096) / 4096));
+    } else {
+        EXPECT_EQ(res, -ENOMEM);
+    }
+    EXPECT_EQ(hpbr.GetPageSize(huge_page), PageSize::BASE_4KB);
+    EXPECT_EQ(hpbr.GetIntervals().GetLength(), 1);
+
+    // ranges above the top only change the page size of the intervals
+    char *top_page = (char*)ROUND_UP(region_base + 10*MB, 2*MB);
+    EXPECT_EQ(hpbr.Migrate(top_page, 2*MB, PageSize::BASE_4KB,
+                           &copied_size), 0);
+    EXPECT_EQ(copied_size, 0);
+    hpbr.Resize(0);
+}
+
+TEST(HugePageBackedRegionReserveTest, Relayout_4KB) {
+    size_t size = 16*MB;
+    MemoryIntervalList configurationList;
+    configurationList.Initialize(mmap, munmap, 0);
+
+    HugePageBackedRegion hpbr;
+    hpbr.Initialize(size, configurationList, mmap, munmap);
+    char *region_base = (char*)hpbr.GetRegionBase();
+    hpbr.Resize(0);
+    hpbr.Resize(4*MB);
+    off_t huge_offset = (char*)ROUND_UP(region_base + 8*MB, 2*MB) - region_base;
+
+    // the huge pages must be aligned in the address space
+    MemoryIntervalList unaligned_layout;
+    unaligned_layout.Initialize(mmap, munmap, 1);
+    unaligned_layout.AddInterval(huge_offset + 4096, huge_offset + 4096 + 2*MB,
+                                 PageSize::HUGE_2MB);
+    EXPECT_EQ(hpbr.Relayout(unaligned_layout), -EINVAL);
+
+    // and inside the region
+    MemoryIntervalList large_layout;
+    large_layout.Initialize(mmap, munmap, 1);
+    large_layout.AddInterval(0, 32*MB, PageSize::HUGE_2MB);
+    EXPECT_EQ(hpbr.Relayout(large_layout), -EINVAL);
+
+    // the part of the layout below the top is ignored
+    MemoryIntervalList layout;
+    layout.Initialize(mmap, munmap, 2);
+    layout.AddInterval(0, 2*MB, PageSize::HUGE_2MB);
+    layout.AddInterval(huge_offset, huge_offset + 2*MB, PageSize::HUGE_2MB);
+    uint32_t generation = hpbr.GetIntervalsGeneration();
+    EXPECT_EQ(hpbr.Relayout(layout, true), 0);
+    EXPECT_EQ(hpbr.GetIntervals().GetLength(), 1);
+    EXPECT_FALSE(hpbr.HaveIntervalsChanged(generation));
+    EXPECT_EQ(hpbr.Relayout(layout), 0);
+    EXPECT_EQ(hpbr.GetIntervals().GetLength(), 3);
+    // the lock-free readers of the old intervals retry
+    EXPECT_TRUE(hpbr.HaveIntervalsChanged(generation));
+    EXPECT_FALSE(hpbr.HaveIntervalsChanged(hpbr.GetIntervalsGeneration()));
+    EXPECT_EQ(hpbr.GetPageSize(region_base), PageSize::BASE_4KB);
+    EXPECT_EQ(hpbr.GetPageSize(region_base + huge_offset), PageSize::HUGE_2MB);
+    EXPECT_EQ(hpbr.GetPageSize(region_base + huge_offset + 2*MB),
+              PageSize::BASE_4KB);
+
+    // a layout without huge pages restores the 4KB pages above the top
+    MemoryIntervalList empty_layout;
+    empty_layout.Initialize(mmap, munmap, 1);
+    EXPECT_EQ(hpbr.Relayout(empty_layout), 0);
+    EXPECT_EQ(hpbr.GetIntervals().GetLength(), 1);
+    hpbr.Resize(0);
+}
+
+// a backend without huge pages, as when the hugetlb pool is exhausted
+static void *MmapWithoutHugePages(void *addr, size_t length, int prot,
+                                  int flags, int fd, off_t offset) {
+    if (flags & MAP_HUGETLB) {
+        errno = ENOMEM;
+        return MAP_FAILED;
+    }
+    return mmap(addr, length, prot, flags, fd, offset);
+}
+
+TEST(HugePageBackedRegionReserveTest, HugePagesFallbackDegrade) {
+    size_t size = 8*MB;
+    MemoryIntervalList configurationList;
+    configurationList.Initialize(mmap, munmap, 1);
+    configurationList.AddInterval(2*MB, 6*MB, PageSize::HUGE_2MB);
+
+    HugePageBackedRegion hpbr;
+    hpbr.SetHugePagesFallback(HugePagesFallback::DEGRADE);
+    hpbr.Initialize(size, configurationList, MmapWithoutHugePages, munmap);
+    char *region_base = (char*)hpbr.GetRegionBase();
+    EXPECT_EQ(hpbr.GetRegionSize(), size);
+    EXPECT_EQ(hpbr.GetPageSize(region_base + 2*MB), PageSize::BASE_4KB);
+    EXPECT_EQ(hpbr.GetFallbackCounters().downgrades, 1ul);
+    EXPECT_EQ(hpbr.GetFallbackCounters().downgraded_2mb_size, 4*MB);
+    EXPECT_EQ(hpbr.GetFallbackCounters().failures, 0ul);
+
+    // the degraded interval is extended with 4KB pages from now on
+    EXPECT_EQ(hpbr.Resize(0), 0);
+    EXPECT_EQ(hpbr.Resize(size), 0);
+    memset(region_base, 1, size);
+    EXPECT_EQ(hpbr.GetFallbackCounters().downgrades, 1ul);
+    hpbr.Resize(0);
+}
+
+TEST(HugePageBackedRegionReserveTest, HugePagesFallbackFail) {
+    size_t size = 8*MB;
+    MemoryIntervalList configurationList;
+    configurationList.Initialize(mmap, munmap, 1);
+    configurationList.AddInterval(2*MB, 6*MB, PageSize::HUGE_2MB);
+
+    HugePageBackedRegion hpbr;
+    hpbr.SetHugePagesFallback(HugePagesFallback::FAIL);
+    hpbr.Initialize(size, configurationList, MmapWithoutHugePages, munmap);
+    char *region_base = (char*)hpbr.GetRegionBase();
+    // the region keeps its size, but is extended up to the 2MB interval
+    EXPECT_EQ(hpbr.GetRegionMaxSize(), size);
+    EXPECT_EQ(hpbr.GetRegionSize(), 2*MB);
+    EXPECT_EQ(hpbr.GetFallbackCounters().failures, 1ul);
+
+    EXPECT_EQ(hpbr.Resize(0), 0);
+    EXPECT_EQ(hpbr.Resize(MB), 0);
+    EXPECT_EQ(hpbr.Resize(4*MB), -ENOMEM);
+    EXPECT_EQ(hpbr.GetRegionSize(), 2*MB);
+    memset(region_base, 1, 2*MB);
+    EXPECT_EQ(hpbr.GetPageSize(region_base + 2*MB), PageSize::HUGE_2MB);
+    EXPECT_EQ(hpbr.GetFallbackCounters().downgrades, 0ul);
+    EXPECT_EQ(hpbr.GetFallbackCounters().failures, 2ul);
+    hpbr.Resize(0);
+}
+
+TEST(HugePageBackedRegionReserveTest, HugePagesFallbackFailKeepsReservation) {
+    size_t size = 8*MB;
+    MemoryIntervalList configurationList;
+    configurationList.Initialize(mmap, munmap, 1);
+    configurationList.AddInterval(2*MB, 6*MB, PageSize::HUGE_2MB);
+
+    HugePageBackedRegion hpbr;
+    hpbr.SetHugePagesFallback(HugePagesFallback::FAIL);
+    hpbr.Initialize(size, configurationList, MmapWithoutHugePages, munmap);
+    EXPECT_EQ(hpbr.GetRegionSize(), 2*MB);
+
+    // the part of the region that could not be mapped is still reserved, so
+    // the next region (which fits in it) is placed elsewhere
+    MemoryIntervalList nextConfigurationList;
+    nextConfigurationList.Initialize(mmap, munmap, 0);
+    HugePageBackedRegion next_hpbr;
+    next_hpbr.Initialize(4*MB, nextConfigurationList, mmap, munmap);
+    size_t start = (size_t)hpbr.GetRegionBase();
+    size_t end = start + hpbr.GetRegionMaxSize();
+    size_t next_start = (size_t)next_hpbr.GetRegionBase();
+    size_t next_end = next_start + next_hpbr.GetRegionMaxSize();
+    EXPECT_TRUE(next_end <= start || next_start >= end);
+
+    // and the reservation is replaced once the region is extended over it
+    EXPECT_EQ(hpbr.Resize(0), 0);
+    EXPECT_EQ(hpbr.Resize(MB), 0);
+    next_hpbr.Resize(0);
+}
@@ -0,0 +1,50 @@
+#include <sys/mman.h>
+
+#include "gtest/gtest.h"
+#include "IntervalIndex.h"
+
+#define KB (1024l)
+#define MB (1024*KB)
+#define GB (1024*MB)
+
+TEST(IntervalIndexTest, FindMixedIntervals) {
+    MemoryIntervalList l;
+    l.Initialize(mmap, munmap, 10);
+    // 4KB intervals that share 2MB slots with each other and with the huge
+    // intervals' neighbours
+    l.AddInterval(0, 8*KB, PageSize::BASE_4KB);
+    l.AddInterval(8*KB, 2*MB + 4*KB, PageSize::BASE_4KB);
+    l.AddInterval(2*MB + 4*KB, 4*MB, PageSize::BASE_4KB);
+    l.AddInterval(4*MB, 8*MB, PageSize::HUGE_2MB);
+    l.AddInterval(8*MB, 1*GB, PageSize::BASE_4KB);
+    l.AddInterval(1*GB, 2*GB, PageSize::HUGE_1GB);
+    l.AddInterval(2*GB, 2*GB + 12*KB, PageSize::BASE_4KB);
+
+    IntervalIndex index;
+    index.Initialize(mmap, munmap, l, 2*GB + 12*KB);
+    EXPECT_EQ(index.Find(0), 0);
+    EXPECT_EQ(index.Find(8*KB - 1), 0);
+    EXPECT_EQ(index.Find(8*KB), 1);
+    EXPECT_EQ(index.Find(2*MB), 1);
+    EXPECT_EQ(index.Find(2*MB + 4*KB), 2);
+    EXPECT_EQ(index.Find(4*MB), 3);
+    EXPECT_EQ(index.Find(8*MB - 1), 3);
+    EXPECT_EQ(index.Find(8*MB), 4);
+    EXPECT_EQ(index.Find(1*GB - 1), 4);
+    EXPECT_EQ(index.Find(1*GB + 3*MB), 5);
+    EXPECT_EQ(index.Find(2*GB + 8*KB), 6);
+    EXPECT_EQ(index.Find(2*GB + 12*KB), -1);
+    EXPECT_EQ(index.Find(-1), -1);
+
+    // the index does not go beyond the region
+    IntervalIndex truncated_index;
+    truncated_index.Initialize(mmap, munmap, l, 4*MB);
+    EXPECT_EQ(truncated_index.Find(4*MB - 1), 2);
+    EXPECT_EQ(truncated_index.Find(4*MB), -1);
+
+    MemoryIntervalList empty_list;
+    empty_list.Initialize(mmap, munmap, 1);
+    IntervalIndex empty_index;
+    empty_index.Initialize(mmap, munmap, empty_list, 0);
+    EXPECT_EQ(empty_index.Find(0), -1);
+}
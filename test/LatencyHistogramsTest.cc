@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "LatencyHistograms.h"
+
+TEST(LatencyHistogramsTest, Buckets) {
+    // the small values have buckets of their own
+    for (uint64_t value = 0; value < LATENCY_SUB_BUCKETS * 2; value++) {
+        int bucket = LatencyHistogram::GetBucket(value);
+        EXPECT_EQ(LatencyHistogram::GetBucketUpperBound(bucket), value);
+    }
+    // the larger values are rounded up by at most 1/16
+    int previous_bucket = 0;
+    for (uint64_t value = 1; value < (1ull << 39); value = value * 3 + 1) {
+        int bucket = LatencyHistogram::GetBucket(value);
+        uint64_t upper_bound = LatencyHistogram::GetBucketUpperBound(bucket);
+        EXPECT_GE(bucket, previous_bucket);
+        EXPECT_GE(upper_bound, value);
+        EXPECT_LE(upper_bound - value, value / LATENCY_SUB_BUCKETS);
+        EXPECT_LT(LatencyHistogram::GetBucket(upper_bound + 1), LATENCY_BUCKETS);
+        EXPECT_EQ(LatencyHistogram::GetBucket(upper_bound + 1), bucket + 1);
+        previous_bucket = bucket;
+    }
+    EXPECT_EQ(LatencyHistogram::GetBucket(~0ull), LATENCY_BUCKETS - 1);
+}
+
+TEST(LatencyHistogramsTest, Percentiles) {
+    LatencyHistogram histogram;
+    EXPECT_EQ(histogram.GetPercentile(0.5), 0ul);
+    for (uint64_t value = 1; value <= 1000; value++) {
+        histogram.Record(value);
+    }
+    EXPECT_EQ(histogram.GetCount(), 1000ul);
+    EXPECT_EQ(histogram.GetSum(), 500500ul);
+    EXPECT_EQ(histogram.GetMax(), 1000ul);
+    uint64_t median = histogram.GetPercentile(0.5);
+    EXPECT_GE(median, 500ul);
+    EXPECT_LE(median, 500ul + 500 / LATENCY_SUB_BUCKETS);
+    EXPECT_EQ(histogram.GetPercentile(1.0), 1000ul);
+
+    LatencyHistogram merged;
+    merged.Merge(histogram);
+    merged.Merge(histogram);
+    EXPECT_EQ(merged.GetCount(), 2000ul);
+    EXPECT_EQ(merged.GetPercentile(0.5), median);
+}
+
+static void MeasureOperations(int count) {
+    for (int i = 0; i < count; i++) {
+        LATENCY_SCOPE(MMAP);
+        {
+            LATENCY_COMPONENT_SCOPE(SYSCALL);
+            usleep(10);
+        }
+        {
+            LATENCY_SCOPE(RESIZE);
+            LATENCY_COMPONENT_SCOPE(FFA);
+        }
+    }
+    // outside of the operations the components are not measured
+    LATENCY_COMPONENT_SCOPE(LOCK_WAIT);
+}
+
+TEST(LatencyHistogramsTest, MergeThreads) {
+    LatencyHistograms::Enable();
+    static LatencyHistogram before[LATENCY_OPERATIONS][LATENCY_COMPONENTS];
+    static LatencyHistogram after[LATENCY_OPERATIONS][LATENCY_COMPONENTS];
+    LatencyHistograms::Merge(before);
+
+    std::thread thread(MeasureOperations, 30);
+    MeasureOperations(20);
+    thread.join();
+    LatencyHistograms::Merge(after);
+
+    int mmap = (int)LatencyOperation::MMAP;
+    int resize = (int)LatencyOperation::RESIZE;
+    int total = (int)LatencyComponent::TOTAL;
+    int syscall = (int)LatencyComponent::SYSCALL;
+    int lock_wait = (int)LatencyComponent::LOCK_WAIT;
+    for (int c = 0; c < LATENCY_COMPONENTS; c++) {
+        EXPECT_EQ(after[mmap][c].GetCount() - before[mmap][c].GetCount(), 50ul);
+        EXPECT_EQ(after[resize][c].GetCount() - before[resize][c].GetCount(),
+                  50ul);
+    }
+    // the nested operation is a part of the operation around it
+    EXPECT_GT(after[mmap][syscall].GetSum(), before[mmap][syscall].GetSum());
+    EXPECT_GE(after[mmap][total].GetSum() - before[mmap][total].GetSum(),
+              after[mmap][syscall].GetSum() - before[mmap][syscall].GetSum());
+    EXPECT_EQ(after[mmap][lock_wait].GetSum(),
+              before[mmap][lock_wait].GetSum());
+    EXPECT_EQ(after[resize][syscall].GetSum(),
+              before[resize][syscall].GetSum());
+
+    char path[] = "/tmp/mosalloc-latencies-test-XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    ASSERT_EQ(LatencyHistograms::Write(path), 0);
+    FILE *file = fopen(path, "r");
+    ASSERT_NE(file, nullptr);
+    char line[256];
+    int lines = 0;
+    ASSERT_NE(fgets(line, sizeof(line), file), nullptr);
+    EXPECT_EQ(strncmp(line, "operation,component,count,", 26), 0);
+    while (fgets(line, sizeof(line), file) != NULL) {
+        lines++;
+    }
+    fclose(file);
+    unlink(path);
+    EXPECT_EQ(lines, LATENCY_OPERATIONS * LATENCY_COMPONENTS);
+}
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <fstream>
+
+#include "gtest/gtest.h"
+#include "MemoryAllocator.h"
+#include "mosalloc_footprint.h"
+
+#define MB (1024*1024)
+
+static void WriteStackPoolConfiguration() {
+    std::ofstream config_file;
+    config_file.open("memory_allocator_test.csv", std::ios::out);
+    config_file << "type,pageSize,startOffset,endOffset\n"
+                   "mmap,-1,0,67108864\n"
+                   "stack,-1,0,16777216\n"
+                   "brk,-1,0,4194304\n"
+                   "file,-1,0,4194304\n";
+    config_file.close();
+    setenv("HPC_CONFIGURATION_FILE", "memory_allocator_test.csv", 1);
+    setenv("HPC_MMAP_FIRST_FIT_LIST_SIZE", "1024", 1);
+    setenv("HPC_FILE_BACKED_FIRST_FIT_LIST_SIZE", "1024", 1);
+}
+
+// guards a stack-sized mapping of the mmap pool, and returns whether the next
+// mapping of the same length is served by the stack pool
+static bool IsGuardedLengthRerouted(MemoryAllocator *allocator) {
+    const char *name = nullptr;
+    MemoryPool *stack_pool = allocator->GetAnonymousMmapPool(1, &name);
+    EXPECT_STREQ(name, STACK_POOL_TYPE);
+
+    void *stack = allocator->AllocateFromAnonymousMmapRegion(
+            nullptr, MB, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS);
+    EXPECT_NE(stack, MAP_FAILED);
+    EXPECT_FALSE(stack_pool->Contains(stack));
+    EXPECT_EQ(allocator->ProtectMmapRegion(stack, 4096, PROT_NONE), 0);
+
+    void *data = allocator->AllocateFromAnonymousMmapRegion(
+            nullptr, MB, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS);
+    EXPECT_NE(data, MAP_FAILED);
+    memset(data, 1, MB);
+    return stack_pool->Contains(data);
+}
+
+TEST(MemoryAllocatorTest, StackLengthsAreNotLearnedByDefault) {
+    WriteStackPoolConfiguration();
+    unsetenv("HPC_LEARN_STACK_LENGTHS");
+    MemoryAllocator *allocator = new MemoryAllocator();
+    remove("memory_allocator_test.csv");
+
+    // a data mapping of the length of a guarded mapping stays in the mmap
+    // pool
+    EXPECT_FALSE(IsGuardedLengthRerouted(allocator));
+
+    // stacks are still routed by their flags
+    const char *name = nullptr;
+    MemoryPool *stack_pool = allocator->GetAnonymousMmapPool(1, &name);
+    void *stack = allocator->AllocateFromAnonymousMmapRegion(
+            nullptr, MB, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK);
+    EXPECT_TRUE(stack_pool->Contains(stack));
+    delete allocator;
+}
+
+TEST(MemoryAllocatorTest, LearnStackLengths) {
+    WriteStackPoolConfiguration();
+    setenv("HPC_LEARN_STACK_LENGTHS", "1", 1);
+    MemoryAllocator *allocator = new MemoryAllocator();
+    remove("memory_allocator_test.csv");
+    unsetenv("HPC_LEARN_STACK_LENGTHS");
+
+    EXPECT_TRUE(IsGuardedLengthRerouted(allocator));
+    delete allocator;
+}
+
+TEST(MemoryAllocatorTest, FootprintsAreSampledInBackground) {
+    char prefix[] = "/tmp/mosalloc-allocator-test-XXXXXX";
+    int fd = mkstemp(prefix);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    unlink(prefix);
+    WriteStackPoolConfiguration();
+    setenv("HPC_SAMPLING_FILE", prefix, 1);
+    setenv("HPC_SAMPLING_INTERVAL_MS", "10", 1);
+    MemoryAllocator *allocator = new MemoryAllocator();
+    remove("memory_allocator_test.csv");
+    unsetenv("HPC_SAMPLING_FILE");
+    unsetenv("HPC_SAMPLING_INTERVAL_MS");
+
+    // the samples are taken while no hooked call is made
+    usleep(100000);
+    delete allocator;
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s.%d", prefix, (int)getpid());
+    FILE *file = fopen(path, "rb");
+    unlink(path);
+    ASSERT_NE(file, nullptr);
+    struct mosalloc_footprint_header header;
+    ASSERT_EQ(fread(&header, sizeof(header), 1, file), 1ul);
+    EXPECT_EQ(header.interval_ns, 10000000ul);
+    size_t sample_size = sizeof(struct mosalloc_footprint_record) +
+        header.pools_count * sizeof(struct mosalloc_footprint_pool);
+    fseek(file, 0, SEEK_END);
+    size_t samples_count = (ftell(file) - sizeof(header)) / sample_size;
+    fclose(file);
+    // the sample on exit, and at least one in the background
+    EXPECT_GE(samples_count, 2ul);
+}
@@ -63,3 +63,36 @@ TEST(MemoryIntervalListTest, MixedIntervals) {
     EXPECT_EQ(ls.At(8)._start_offset, (1ul<<36));
     EXPECT_EQ(ls.At(9)._start_offset, (1ul<<38));
 }
+
+TEST(MemoryIntervalListTest, ReplaceRange) {
+    MemoryIntervalList l;
+    l.Initialize(mmap, munmap, 5);
+    l.AddInterval(0, 1<<21, PageSize::BASE_4KB);
+    l.AddInterval(1<<21, 1<<23, PageSize::HUGE_2MB);
+    l.AddInterval(1<<23, 1<<24, PageSize::BASE_4KB);
+
+    // splitting an interval adds two intervals
+    EXPECT_EQ(l.ReplaceRange(1<<22, 3<<21, PageSize::BASE_4KB), 0);
+    EXPECT_EQ(l.GetLength(), 5);
+    EXPECT_EQ(l.At(1)._end_offset, (1<<22));
+    EXPECT_EQ(l.At(2)._start_offset, (1<<22));
+    EXPECT_EQ(l.At(2)._page_size, PageSize::BASE_4KB);
+    EXPECT_EQ(l.At(3)._start_offset, (3<<21));
+    EXPECT_EQ(l.At(3)._page_size, PageSize::HUGE_2MB);
+
+    // there is no room for another split
+    EXPECT_EQ(l.ReplaceRange(1<<12, 1<<13, PageSize::HUGE_2MB), -1);
+    EXPECT_EQ(l.GetLength(), 5);
+
+    // neighbours of the same page size are merged
+    EXPECT_EQ(l.ReplaceRange(1<<22, 3<<21, PageSize::HUGE_2MB), 0);
+    EXPECT_EQ(l.GetLength(), 3);
+    EXPECT_EQ(l.At(1)._start_offset, (1<<21));
+    EXPECT_EQ(l.At(1)._end_offset, (1<<23));
+    EXPECT_EQ(l.ReplaceRange(0, 1<<24, PageSize::BASE_4KB), 0);
+    EXPECT_EQ(l.GetLength(), 1);
+    EXPECT_EQ(l.At(0)._end_offset, (1<<24));
+
+    // the range must be covered by the intervals
+    EXPECT_EQ(l.ReplaceRange(1<<23, 1<<25, PageSize::HUGE_2MB), -1);
+}
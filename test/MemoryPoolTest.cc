@@ -0,0 +1,350 @@
+#include <errno.h>
+#include <sys/mman.h>
+#include <string.h>
+
+#include "gtest/gtest.h"
+#include "MemoryPool.h"
+
+#define MB (1024*1024)
+
+static int fixed_mmaps = 0;
+static int remaps = 0;
+static int advices = 0;
+
+static void *CountingMmap(void *addr, size_t length, int prot, int flags,
+                          int fd, off_t offset) {
+    fixed_mmaps += (flags & MAP_FIXED) ? 1 : 0;
+    return mmap(addr, length, prot, flags, fd, offset);
+}
+
+static void *CountingMremap(void *old_address, size_t old_size,
+                            size_t new_size, int flags, void *new_address) {
+    remaps++;
+    return mremap(old_address, old_size, new_size, flags, new_address);
+}
+
+static int CountingMadvise(void *addr, size_t length, int advice) {
+    advices++;
+    return madvise(addr, length, advice);
+}
+
+TEST(MemoryPoolTest, AllocateHintsAndFixed_4KB) {
+    PoolConfigurationData configurationData;
+    configurationData.intervalList.Initialize(mmap, munmap, 0);
+    configurationData.size = 16*MB;
+
+    MemoryPool pool;
+    EXPECT_FALSE(pool.IsInitialized());
+    EXPECT_FALSE(pool.Contains(&configurationData));
+    pool.Initialize(configurationData, 1024);
+    pool.ResetRegion();
+    char *base = (char*)pool.GetRegionBase();
+    EXPECT_TRUE(pool.ContainsRange(base, 16*MB));
+    EXPECT_FALSE(pool.ContainsRange(base + 8*MB, 16*MB));
+
+    // the first fit is returned unless a free range is hinted
+    char *p1 = (char*)pool.Allocate(nullptr, MB, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS);
+    EXPECT_EQ(p1, base);
+    char *p2 = (char*)pool.Allocate(base + 4*MB, MB, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS);
+    EXPECT_EQ(p2, base + 4*MB);
+    char *p3 = (char*)pool.Allocate(base + 4*MB, MB, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS);
+    EXPECT_EQ(p3, base + MB);
+    EXPECT_EQ(pool.GetMaxSize(), (size_t)5*MB);
+    memset(p2, 1, MB);
+
+    // MAP_FIXED_NOREPLACE does not replace allocated ranges
+    EXPECT_EQ(pool.Allocate(p2, MB, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE),
+              MAP_FAILED);
+    EXPECT_EQ(errno, EEXIST);
+    EXPECT_EQ(p2[0], 1);
+
+    // MAP_FIXED replaces them with fresh pages
+    EXPECT_EQ(pool.Allocate(p2, MB, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED),
+              p2);
+    EXPECT_EQ(p2[0], 0);
+
+    // the region shrinks with the top allocation
+    EXPECT_EQ(pool.Deallocate(p2, MB), 0);
+    EXPECT_EQ(pool.Deallocate(p1, MB), 0);
+    EXPECT_EQ(pool.Deallocate(p3, MB), 0);
+    EXPECT_EQ(pool.GetMaxSize(), (size_t)5*MB);
+}
+
+TEST(MemoryPoolTest, GetGuardedStackLength_4KB) {
+    PoolConfigurationData configurationData;
+    configurationData.intervalList.Initialize(mmap, munmap, 0);
+    configurationData.size = 16*MB;
+
+    MemoryPool pool;
+    pool.Initialize(configurationData, 1024);
+    pool.ResetRegion();
+    char *stack = (char*)pool.Allocate(nullptr, 8*MB, PROT_READ | PROT_WRITE,
+                                       MAP_PRIVATE | MAP_ANONYMOUS);
+    char *small = (char*)pool.Allocate(nullptr, 8192, PROT_READ | PROT_WRITE,
+                                       MAP_PRIVATE | MAP_ANONYMOUS);
+
+    // a guard at the low end of a stack-sized mapping
+    EXPECT_EQ(pool.Protect(stack, 4096, PROT_NONE), 0);
+    EXPECT_EQ(pool.GetGuardedStackLength(stack, 4096), (size_t)8*MB);
+    // guards that are not at the low end, too large or of too small mappings
+    EXPECT_EQ(pool.GetGuardedStackLength(stack + 4096, 4096), 0ul);
+    EXPECT_EQ(pool.GetGuardedStackLength(stack, MB), 0ul);
+    EXPECT_EQ(pool.GetGuardedStackLength(small, 4096), 0ul);
+    EXPECT_EQ(pool.Deallocate(small, 8192), 0);
+    EXPECT_EQ(pool.Deallocate(stack, 8*MB), 0);
+}
+
+TEST(MemoryPoolTest, ShrinkMiddleAllocation_4KB) {
+    PoolConfigurationData configurationData;
+    configurationData.intervalList.Initialize(mmap, munmap, 0);
+    configurationData.size = 16*MB;
+
+    MemoryPool pool;
+    pool.Initialize(configurationData, 1024);
+    pool.ResetRegion();
+    char *p1 = (char*)pool.Allocate(nullptr, 2*MB, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS);
+    char *p2 = (char*)pool.Allocate(nullptr, MB, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS);
+    EXPECT_EQ(p2, p1 + 2*MB);
+    memset(p1, 1, 2*MB);
+
+    // the tail of an allocation that is followed by another one is freed
+    // in place, even without MREMAP_MAYMOVE
+    EXPECT_EQ(pool.Remap(p1, 2*MB, MB, 0), p1);
+    EXPECT_EQ(p1[MB - 1], 1);
+    char *p3 = (char*)pool.Allocate(nullptr, MB, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS);
+    EXPECT_EQ(p3, p1 + MB);
+    EXPECT_EQ(pool.GetMaxSize(), (size_t)3*MB);
+}
+
+TEST(MemoryPoolTest, PublishStatistics_4KB) {
+    PoolConfigurationData configurationData;
+    configurationData.intervalList.Initialize(mmap, munmap, 0);
+    configurationData.size = 16*MB;
+
+    MemoryPool pool;
+    pool.Initialize(configurationData, 1024);
+    pool.ResetRegion();
+    struct mosalloc_pool_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    pool.SetStatistics(&stats);
+    EXPECT_EQ(stats.ffa_capacity, 1024ul);
+
+    char *p1 = (char*)pool.Allocate(nullptr, 4*MB, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS);
+    char *p2 = (char*)pool.Allocate(nullptr, MB, PROT_NONE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS);
+    EXPECT_EQ(stats.allocations, 2ul);
+    EXPECT_EQ(stats.allocated_bytes[MOSALLOC_STATS_4KB], (uint64_t)5*MB);
+    EXPECT_EQ(stats.allocated_bytes[MOSALLOC_STATS_2MB], 0ul);
+    EXPECT_EQ(stats.mapped_size, (uint64_t)5*MB);
+    EXPECT_EQ(stats.committed_size, (uint64_t)4*MB);
+    EXPECT_EQ(stats.extends, 2ul);
+    EXPECT_EQ(stats.lock.acquisitions, 2ul);
+    EXPECT_EQ(stats.lock.contentions, 0ul);
+
+    // the list nodes (of the two allocations and the free range after
+    // them) are counted only on refresh
+    EXPECT_EQ(stats.ffa_used_nodes, 0ul);
+    pool.RefreshStatistics();
+    EXPECT_EQ(stats.ffa_used_nodes, 3ul);
+
+    EXPECT_EQ(pool.Deallocate(p2, MB), 0);
+    EXPECT_EQ(pool.Deallocate(p1, 4*MB), 0);
+    EXPECT_EQ(stats.deallocations, 2ul);
+    EXPECT_EQ(stats.freed_bytes[MOSALLOC_STATS_4KB], (uint64_t)5*MB);
+    EXPECT_EQ(stats.shrinks, 1ul);
+    EXPECT_EQ(stats.mapped_size, 0ul);
+    EXPECT_EQ(stats.peak_mapped_size, (uint64_t)5*MB);
+}
+
+TEST(MemoryPoolTest, FailedFixedKeepsMappings_4KB) {
+    PoolConfigurationData configurationData;
+    configurationData.intervalList.Initialize(mmap, munmap, 0);
+    configurationData.size = 16*MB;
+
+    // a list of six nodes, which is nearly used up by three allocations
+    MemoryPool pool;
+    pool.Initialize(configurationData, 6);
+    pool.ResetRegion();
+    char *base = (char*)pool.GetRegionBase();
+    char *p1 = (char*)pool.Allocate(nullptr, 4*MB, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS);
+    EXPECT_EQ(p1, base);
+    EXPECT_EQ(pool.Allocate(base + 6*MB, MB, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS), base + 6*MB);
+    EXPECT_EQ(pool.Allocate(base + 8*MB, MB, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS), base + 8*MB);
+    memset(p1, 1, 4*MB);
+
+    // replacing the middle of the first mapping would split it, so the call
+    // fails and the mapping is kept
+    errno = 0;
+    EXPECT_EQ(pool.Allocate(base + MB, MB, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED),
+              MAP_FAILED);
+    EXPECT_EQ(errno, ENOMEM);
+    EXPECT_EQ(p1[MB], 1);
+    EXPECT_EQ(pool.Allocate(base + MB, MB, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE),
+              MAP_FAILED);
+    EXPECT_EQ(errno, EEXIST);
+}
+
+static void *MmapWithoutHugePages(void *addr, size_t length, int prot,
+                                  int flags, int fd, off_t offset) {
+    if (flags & MAP_HUGETLB) {
+        errno = ENOMEM;
+        return MAP_FAILED;
+    }
+    return mmap(addr, length, prot, flags, fd, offset);
+}
+
+TEST(MemoryPoolTest, HugePagesFallbackFail) {
+    PoolConfigurationData configurationData;
+    configurationData.intervalList.Initialize(mmap, munmap, 1);
+    configurationData.intervalList.AddInterval(2*MB, 6*MB, PageSize::HUGE_2MB);
+    configurationData.size = 8*MB;
+
+    MemoryPool pool;
+    pool.SetHugePagesFallback(HugePagesFallback::FAIL);
+    pool.Initialize(configurationData, 1024, MmapWithoutHugePages);
+    pool.ResetRegion();
+    struct mosalloc_pool_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    pool.SetStatistics(&stats);
+    // the extension of the initialization failed as well
+    EXPECT_EQ(stats.fallback_failures, 1ul);
+
+    char *base = (char*)pool.GetRegionBase();
+    char *p1 = (char*)pool.Allocate(nullptr, MB, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS);
+    EXPECT_EQ(p1, base);
+
+    // only the mapping that reaches the huge pages fails
+    errno = 0;
+    EXPECT_EQ(pool.Allocate(nullptr, 4*MB, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS), MAP_FAILED);
+    EXPECT_EQ(errno, ENOMEM);
+    EXPECT_EQ(stats.fallback_failures, 2ul);
+    EXPECT_EQ(stats.downgrades, 0ul);
+    EXPECT_EQ(pool.Remap(p1, MB, 4*MB, 0), MAP_FAILED);
+    EXPECT_EQ(errno, ENOMEM);
+    memset(p1, 1, MB);
+
+    char *p2 = (char*)pool.Allocate(nullptr, MB, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS);
+    EXPECT_EQ(p2, base + MB);
+    EXPECT_EQ(pool.Deallocate(p2, MB), 0);
+    EXPECT_EQ(pool.Deallocate(p1, MB), 0);
+}
+
+static bool are_huge_pages_exhausted = false;
+
+// a backend that backs the huge pages with 4KB pages until they run out
+static void *MmapWithExhaustibleHugePages(void *addr, size_t length, int prot,
+                                          int flags, int fd, off_t offset) {
+    if (flags & MAP_HUGETLB) {
+        if (are_huge_pages_exhausted) {
+            errno = ENOMEM;
+            return MAP_FAILED;
+        }
+        flags &= ~(MAP_HUGETLB | (0x3f << MAP_HUGE_SHIFT));
+    }
+    return mmap(addr, length, prot, flags, fd, offset);
+}
+
+TEST(MemoryPoolTest, CommitWithoutHugePages) {
+    PoolConfigurationData configurationData;
+    configurationData.intervalList.Initialize(mmap, munmap, 1);
+    configurationData.intervalList.AddInterval(2*MB, 6*MB, PageSize::HUGE_2MB);
+    configurationData.size = 8*MB;
+
+    MemoryPool pool;
+    pool.Initialize(configurationData, 1024, MmapWithExhaustibleHugePages);
+    pool.ResetRegion();
+    char *base = (char*)pool.GetRegionBase();
+    EXPECT_EQ(pool.Allocate(nullptr, 8*MB, PROT_NONE,
+                            MAP_PRIVATE | MAP_ANONYMOUS), base);
+
+    // committing the reservation fails like mprotect, rather than exiting
+    are_huge_pages_exhausted = true;
+    errno = 0;
+    EXPECT_EQ(pool.Protect(base, 8*MB, PROT_READ | PROT_WRITE), -1);
+    EXPECT_EQ(errno, ENOMEM);
+    EXPECT_EQ(pool.GetCommittedSize(), 0ul);
+    are_huge_pages_exhausted = false;
+    EXPECT_EQ(pool.Protect(base, 8*MB, PROT_READ | PROT_WRITE), 0);
+    EXPECT_EQ(pool.GetCommittedSize(), (size_t)8*MB);
+    memset(base, 1, 8*MB);
+
+    // MAP_FIXED clears the huge pages in place when no fresh ones are left
+    are_huge_pages_exhausted = true;
+    EXPECT_EQ(pool.Allocate(base + 2*MB, 2*MB, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED),
+              base + 2*MB);
+    EXPECT_EQ(base[2*MB], 0);
+    EXPECT_EQ(base[4*MB - 1], 0);
+    EXPECT_EQ(base[4*MB], 1);
+    are_huge_pages_exhausted = false;
+    EXPECT_EQ(pool.Deallocate(base, 8*MB), 0);
+}
+
+TEST(MemoryPoolTest, GetFootprint_4KB) {
+    PoolConfigurationData configurationData;
+    configurationData.intervalList.Initialize(mmap, munmap, 0);
+    configurationData.size = 16*MB;
+
+    MemoryPool pool;
+    pool.Initialize(configurationData, 1024);
+    pool.ResetRegion();
+    char *p1 = (char*)pool.Allocate(nullptr, 4*MB, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS);
+    pool.Allocate(nullptr, MB, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS);
+
+    // the PROT_NONE reservation is not committed
+    struct mosalloc_footprint_pool footprint;
+    pool.GetFootprint(&footprint);
+    EXPECT_EQ(footprint.size, (uint64_t)5*MB);
+    EXPECT_EQ(footprint.committed[0], (uint64_t)4*MB);
+    EXPECT_EQ(footprint.committed[1], 0ul);
+    EXPECT_EQ(footprint.committed[2], 0ul);
+    EXPECT_EQ(footprint.ffa_top, (uint64_t)(p1 + 5*MB));
+}
+
+TEST(MemoryPoolTest, BackendFunctions_4KB) {
+    PoolConfigurationData configurationData;
+    configurationData.intervalList.Initialize(mmap, munmap, 0);
+    configurationData.size = 16*MB;
+
+    MemoryPool pool;
+    pool.Initialize(configurationData, 1024, CountingMmap, munmap, mprotect,
+                    CountingMadvise, CountingMremap);
+    pool.ResetRegion();
+    char *p1 = (char*)pool.Allocate(nullptr, MB, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS);
+    pool.Allocate(nullptr, MB, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS);
+    EXPECT_GT(fixed_mmaps, 0);
+    memset(p1, 1, MB);
+
+    // the pages of a relocated allocation are moved and refilled through
+    // the backend
+    int mmaps_before_move = fixed_mmaps;
+    char *p3 = (char*)pool.Remap(p1, MB, 2*MB, MREMAP_MAYMOVE);
+    EXPECT_EQ(p3, p1 + 2*MB);
+    EXPECT_EQ(p3[0], 1);
+    EXPECT_EQ(remaps, 1);
+    EXPECT_GT(fixed_mmaps, mmaps_before_move);
+
+    // the advice that the pool does not handle is passed to the backend
+    EXPECT_EQ(pool.Advise(p3, MB, MADV_WILLNEED), 0);
+    EXPECT_EQ(advices, 1);
+}
@@ -0,0 +1,61 @@
+#include <sys/mman.h>
+
+#include "gtest/gtest.h"
+#include "MemoryRangeSet.h"
+
+TEST(MemoryRangeSetTest, AddMergesRanges) {
+    MemoryRangeSet s;
+    s.Initialize(mmap, munmap, 10);
+    EXPECT_EQ(s.Add(100, 200), 0);
+    EXPECT_EQ(s.Add(300, 400), 0);
+    EXPECT_EQ(s.Add(0, 50), 0);
+    EXPECT_EQ(s.GetLength(), 3);
+    EXPECT_EQ(s.At(0)._start_offset, 0);
+    EXPECT_EQ(s.At(1)._start_offset, 100);
+    EXPECT_EQ(s.At(2)._start_offset, 300);
+
+    // adjacent ranges are merged
+    EXPECT_EQ(s.Add(200, 250), 0);
+    EXPECT_EQ(s.GetLength(), 3);
+    EXPECT_EQ(s.At(1)._end_offset, 250);
+
+    // a range that overlaps several ranges swallows them
+    EXPECT_EQ(s.Add(40, 350), 0);
+    EXPECT_EQ(s.GetLength(), 1);
+    EXPECT_EQ(s.At(0)._start_offset, 0);
+    EXPECT_EQ(s.At(0)._end_offset, 400);
+    EXPECT_EQ(s.GetTotalSize(), 400);
+}
+
+TEST(MemoryRangeSetTest, RemoveSplitsRanges) {
+    MemoryRangeSet s;
+    s.Initialize(mmap, munmap, 2);
+    EXPECT_EQ(s.Add(0, 1000), 0);
+
+    // remove from the middle
+    EXPECT_EQ(s.Remove(400, 600), 0);
+    EXPECT_EQ(s.GetLength(), 2);
+    EXPECT_EQ(s.At(0)._end_offset, 400);
+    EXPECT_EQ(s.At(1)._start_offset, 600);
+    EXPECT_FALSE(s.Contains(500));
+    EXPECT_TRUE(s.Contains(399));
+    EXPECT_TRUE(s.Contains(600));
+
+    // the set is full, so another split fails and keeps the set as is
+    EXPECT_EQ(s.Remove(100, 200), -1);
+    EXPECT_EQ(s.GetTotalSize(), 800);
+
+    // remove across both ranges
+    EXPECT_EQ(s.Remove(300, 700), 0);
+    EXPECT_EQ(s.GetLength(), 2);
+    EXPECT_EQ(s.At(0)._end_offset, 300);
+    EXPECT_EQ(s.At(1)._start_offset, 700);
+    EXPECT_EQ(s.GetIntersectionSize(0, 1000), 600);
+    EXPECT_EQ(s.GetIntersectionSize(200, 800), 200);
+    EXPECT_TRUE(s.Intersects(250, 750));
+    EXPECT_FALSE(s.Intersects(300, 700));
+
+    // remove everything
+    EXPECT_EQ(s.Remove(0, 1000), 0);
+    EXPECT_EQ(s.GetLength(), 0);
+}
@@ -0,0 +1,128 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+
+#include "gtest/gtest.h"
+#include "mosalloc.h"
+
+#define MB (1024*1024)
+
+// the test binary is linked without the hooks, so the API initializes its
+// own pools from the environment on the first call
+TEST(MosallocApiTest, AllocateByPageSize) {
+    std::ofstream config_file;
+    config_file.open("mosalloc_api_test.csv", std::ios::out);
+    config_file << "type,pageSize,startOffset,endOffset\n"
+                   "mmap,-1,0,67108864\n"
+                   "brk,-1,0,4194304\n"
+                   "file,-1,0,4194304\n";
+    config_file.close();
+    setenv("HPC_CONFIGURATION_FILE", "mosalloc_api_test.csv", 1);
+    setenv("HPC_MMAP_FIRST_FIT_LIST_SIZE", "1024", 1);
+    setenv("HPC_FILE_BACKED_FIRST_FIT_LIST_SIZE", "1024", 1);
+
+    struct mosalloc_pool_info info;
+    ASSERT_EQ(mosalloc_pool_info(0, &info), 0);
+    remove("mosalloc_api_test.csv");
+    EXPECT_STREQ(info.name, "mmap");
+    EXPECT_EQ(info.capacity, (size_t)64*MB);
+    EXPECT_EQ(info.size, 0ul);
+    EXPECT_EQ(info.size_4kb, (size_t)64*MB);
+    EXPECT_EQ(info.size_2mb, 0ul);
+    EXPECT_EQ(mosalloc_pool_info(1, &info), -1);
+    EXPECT_EQ(errno, ENOENT);
+
+    // 4KB pages are allocated in the 4KB intervals
+    char *p1 = (char*)mosalloc_alloc(MB, 4096, MOSALLOC_STRICT);
+    ASSERT_NE(p1, nullptr);
+    EXPECT_EQ(p1, info.base);
+    memset(p1, 1, MB);
+
+    // there are no 2MB intervals, so only non-strict requests succeed
+    EXPECT_EQ(mosalloc_alloc(2*MB, 2*MB, MOSALLOC_STRICT), nullptr);
+    EXPECT_EQ(errno, ENOMEM);
+    char *p2 = (char*)mosalloc_alloc(2*MB, 2*MB, 0);
+    EXPECT_EQ(p2, p1 + MB);
+    EXPECT_EQ(mosalloc_alloc(MB, 12345, 0), nullptr);
+    EXPECT_EQ(errno, EINVAL);
+
+    ASSERT_EQ(mosalloc_pool_info(0, &info), 0);
+    EXPECT_EQ(info.size, (size_t)3*MB);
+    EXPECT_EQ(info.committed_size, (size_t)3*MB);
+
+    // requests that do not fit in the pool fail instead of exiting
+    errno = 0;
+    EXPECT_EQ(mosalloc_alloc(128*MB, 2*MB, 0), nullptr);
+    EXPECT_EQ(errno, ENOMEM);
+    errno = 0;
+    EXPECT_EQ(mosalloc_alloc(62*MB, 0, 0), nullptr);
+    EXPECT_EQ(errno, ENOMEM);
+
+    EXPECT_EQ(mosalloc_free(p2, 2*MB), 0);
+    EXPECT_EQ(mosalloc_free(p1, MB), 0);
+    EXPECT_EQ(mosalloc_alloc(MB, 0, 0), p1);
+
+    // the pool of the allocation and its 4KB interval back the address
+    struct mosalloc_address_info address_info;
+    ASSERT_EQ(mosalloc_query(p1 + 4096, &address_info), 0);
+    EXPECT_EQ(address_info.pool_index, 0);
+    EXPECT_STREQ(address_info.pool_name, "mmap");
+    EXPECT_EQ(address_info.interval_index, 0);
+    EXPECT_EQ(address_info.interval_start, info.base);
+    EXPECT_EQ(address_info.page_size, 4096ul);
+    EXPECT_EQ(address_info.offset, 4096ul);
+    EXPECT_TRUE(address_info.is_mapped);
+    ASSERT_EQ(mosalloc_query(p1 + 32*MB, &address_info), 0);
+    EXPECT_FALSE(address_info.is_mapped);
+    EXPECT_EQ(mosalloc_query(&info, &address_info), -1);
+
+    // the iteration covers the mmap pool, then the brk and file pools
+    struct mosalloc_interval_iterator iterator = MOSALLOC_INTERVAL_ITERATOR_INIT;
+    struct mosalloc_interval interval;
+    const char *expected_pools[] = {"mmap", "brk", "file"};
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ(mosalloc_next_interval(&iterator, &interval), 1);
+        EXPECT_EQ(interval.pool_index, i);
+        EXPECT_STREQ(interval.pool_name, expected_pools[i]);
+        EXPECT_EQ(interval.interval_index, 0);
+        EXPECT_EQ(interval.page_size, 4096ul);
+    }
+    EXPECT_EQ(mosalloc_next_interval(&iterator, &interval), 0);
+
+    // layouts are validated before any pool is changed
+    EXPECT_EQ(mosalloc_relayout("mosalloc_api_missing_layout.csv"), -1);
+    EXPECT_EQ(errno, ENOENT);
+    std::ofstream layout_file;
+    layout_file.open("mosalloc_api_layout.csv", std::ios::out);
+    layout_file << "type,pageSize,startOffset,endOffset\n"
+                   "mmap,-1,0,67108864\n"
+                   "mmap,2097152,33554432,34603008\n";
+    layout_file.close();
+    EXPECT_EQ(mosalloc_relayout("mosalloc_api_layout.csv"), -1);
+    EXPECT_EQ(errno, EINVAL);
+    // invalid files fail the call rather than the process
+    const char *invalid_layouts[] = {
+        "",
+        "type,pageSize,startOffset,endOffset\n"
+        "mmap,4096,0,4096\n",
+        "type,pageSize,startOffset,endOffset\n"
+        "mmap,2097152,-2097152,0\n",
+        "type,pageSize,startOffset,endOffset\n"
+        "mmap,-1,0,67108864",
+    };
+    for (const char *invalid_layout : invalid_layouts) {
+        layout_file.open("mosalloc_api_layout.csv", std::ios::out);
+        layout_file << invalid_layout;
+        layout_file.close();
+        EXPECT_EQ(mosalloc_relayout("mosalloc_api_layout.csv"), -1);
+        EXPECT_EQ(errno, EINVAL);
+    }
+    layout_file.open("mosalloc_api_layout.csv", std::ios::out);
+    layout_file << "type,pageSize,startOffset,endOffset\n"
+                   "mmap,-1,0,67108864\n"
+                   "file,-1,0,4194304\n";
+    layout_file.close();
+    EXPECT_EQ(mosalloc_relayout("mosalloc_api_layout.csv"), 0);
+    remove("mosalloc_api_layout.csv");
+}
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+#include "NumaMaps.h"
+
+static void WriteTempFile(char *path, const char *content) {
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    FILE *file = fdopen(fd, "w");
+    ASSERT_NE(file, nullptr);
+    fputs(content, file);
+    fclose(file);
+}
+
+static const char *NUMA_MAPS_CONTENT =
+    "00400000 default file=/bin/app mapped=10 N0=10 kernelpagesize_kB=4\n"
+    "01000000 default heap anon=5 dirty=5 N0=3 N1=2 kernelpagesize_kB=4\n"
+    "7f0000000000 default anon=2 dirty=1 N0=2 kernelpagesize_kB=2048\n"
+    "7f0040000000 default file=/anon_hugepage\\040(deleted) huge anon=1 "
+    "dirty=1 N3=1 kernelpagesize_kB=1048576\n"
+    "7ffd00000000 default stack anon=4 dirty=4 N0=4 kernelpagesize_kB=4\n"
+    "7ffe00000000 default\n";
+
+// the ranges are followed by fields that are not parsed, and the second
+// range is missing from numa-maps
+static const char *SMAPS_CONTENT =
+    "00400000-0040a000 r-xp 00000000 08:01 1234 /bin/app\n"
+    "Size:                 40 kB\n"
+    "Rss:                  40 kB\n"
+    "00500000-00501000 rw-p 00000000 00:00 0\n"
+    "Rss:                   4 kB\n"
+    "01000000-01005000 rw-p 00000000 00:00 0 [heap]\n"
+    "Rss:                  20 kB\n"
+    "AnonHugePages:         0 kB\n"
+    "7f0000000000-7f0000400000 rw-p 00000000 00:00 0\n"
+    "Rss:                4096 kB\n"
+    "AnonHugePages:      4096 kB\n"
+    "VmFlags: rd wr mr mw me ac\n"
+    "7f0040000000-7f0080000000 rw-p 00000000 00:0f 5678 /anon_hugepage\n"
+    "Rss:                   0 kB\n"
+    "Private_Hugetlb:  1048576 kB\n";
+
+TEST(NumaMapsTest, ParseFields) {
+    char path[] = "/tmp/mosalloc-numa-maps-test-XXXXXX";
+    WriteTempFile(path, NUMA_MAPS_CONTENT);
+    NumaMaps numa_maps(path);
+    unlink(path);
+
+    ASSERT_EQ(numa_maps.GetMemoryRanges().size(), 6ul);
+    auto &file_range = numa_maps.GetMemoryRange((void *)0x400000);
+    EXPECT_EQ(file_range._type, NumaMaps::MemoryRange::Type::FILE_MAPPED);
+    EXPECT_EQ(file_range._total_pages, 10ul);
+    EXPECT_EQ(file_range._total_size, 40960ul);
+
+    auto &heap_range = numa_maps.GetMemoryRange((void *)0x1000000);
+    EXPECT_EQ(heap_range._type, NumaMaps::MemoryRange::Type::HEAP);
+    EXPECT_EQ(heap_range._total_pages, 5ul);
+    EXPECT_EQ(heap_range._dirty_pages, 5ul);
+    ASSERT_GE(heap_range._pages_in_node.size(), 2ul);
+    EXPECT_EQ(heap_range._pages_in_node[0], 3ul);
+    EXPECT_EQ(heap_range._pages_in_node[1], 2ul);
+
+    auto &large_range = numa_maps.GetMemoryRange((void *)0x7f0000000000);
+    EXPECT_EQ(large_range._type, NumaMaps::MemoryRange::Type::ANONYMOUS);
+    EXPECT_EQ(large_range._page_size, PageSize::HUGE_2MB);
+    EXPECT_EQ(large_range._dirty_pages, 1ul);
+    EXPECT_EQ(large_range._total_size, 2 * 2097152ul);
+
+    // the node index is kept even if the node does not exist in the system
+    auto &huge_range = numa_maps.GetMemoryRange((void *)0x7f0040000000);
+    EXPECT_EQ(huge_range._page_size, PageSize::HUGE_1GB);
+    ASSERT_GE(huge_range._pages_in_node.size(), 4ul);
+    EXPECT_EQ(huge_range._pages_in_node[3], 1ul);
+
+    auto &stack_range = numa_maps.GetMemoryRange((void *)0x7ffd00000000);
+    EXPECT_EQ(stack_range._type, NumaMaps::MemoryRange::Type::STACK);
+
+    auto &other_range = numa_maps.GetMemoryRange((void *)0x7ffe00000000);
+    EXPECT_EQ(other_range._type, NumaMaps::MemoryRange::Type::OTHER);
+    EXPECT_EQ(other_range._page_size, PageSize::UNKNOWN);
+    EXPECT_EQ(other_range._total_pages, 0ul);
+
+    // the heap and the stack are not counted as anonymous ranges
+    EXPECT_EQ(numa_maps.GetTotalAnonymousPages(PageSize::BASE_4KB), 0ul);
+    EXPECT_EQ(numa_maps.GetTotalAnonymousPages(PageSize::HUGE_2MB), 2ul);
+    EXPECT_EQ(numa_maps.GetTotalAnonymousPages(PageSize::HUGE_1GB), 1ul);
+    EXPECT_THROW(numa_maps.GetMemoryRange((void *)0x500000),
+                 std::runtime_error);
+}
+
+TEST(NumaMapsTest, ParseSmaps) {
+    char numa_maps_path[] = "/tmp/mosalloc-numa-maps-test-XXXXXX";
+    char smaps_path[] = "/tmp/mosalloc-smaps-test-XXXXXX";
+    WriteTempFile(numa_maps_path, NUMA_MAPS_CONTENT);
+    WriteTempFile(smaps_path, SMAPS_CONTENT);
+    NumaMaps numa_maps(numa_maps_path, smaps_path);
+    unlink(numa_maps_path);
+    unlink(smaps_path);
+
+    EXPECT_EQ(numa_maps.GetMemoryRange((void *)0x400000)._rss, 40960ul);
+    EXPECT_EQ(numa_maps.GetMemoryRange((void *)0x1000000)._rss, 20480ul);
+    auto &large_range = numa_maps.GetMemoryRange((void *)0x7f0000000000);
+    EXPECT_EQ(large_range._rss, 4194304ul);
+    EXPECT_EQ(large_range._anon_huge_pages, 4194304ul);
+    EXPECT_EQ(large_range._private_hugetlb, 0ul);
+    auto &huge_range = numa_maps.GetMemoryRange((void *)0x7f0040000000);
+    EXPECT_EQ(huge_range._private_hugetlb, 1073741824ul);
+    // the ranges that smaps does not list keep zero sizes
+    EXPECT_EQ(numa_maps.GetMemoryRange((void *)0x7ffd00000000)._rss, 0ul);
+}
+
+TEST(NumaMapsTest, ParseCurrentProcess) {
+    void *ptr = malloc(1 << 20);
+    NumaMaps numa_maps(getpid(), true);
+    EXPECT_FALSE(numa_maps.GetMemoryRanges().empty());
+    size_t rss = 0;
+    for (auto &range : numa_maps.GetMemoryRanges()) {
+        rss += range._rss;
+    }
+    EXPECT_GT(rss, 0ul);
+    free(ptr);
+}
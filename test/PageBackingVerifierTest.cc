@@ -0,0 +1,161 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "gtest/gtest.h"
+#include "PageBackingVerifier.h"
+
+#define MB (1048576ul)
+#define PAGE_SIZE_4KB (4096ul)
+#define PAGES_PER_2MB (512ul)
+#define PRESENT (1ull << 63)
+#define KPF_HUGE (1ull << 17)
+#define KPF_THP (1ull << 22)
+
+static void MakeTempPath(char *path) {
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+}
+
+static void WriteWord(int fd, uint64_t index, uint64_t word) {
+    ASSERT_EQ(pwrite(fd, &word, sizeof(word),
+                     (off_t)(index * sizeof(uint64_t))),
+              (ssize_t)sizeof(word));
+}
+
+/*
+ * The pagemap and kpageflags are emulated by files, over a real mapping of
+ * 4MB whose pages are resident (so they pass the mincore check): the first
+ * 2MB are mapped to aligned hugetlb frames, and the second 2MB to frames of
+ * various kinds.
+ */
+class PageBackingVerifierTest : public ::testing::Test {
+    protected:
+        void SetUp() override {
+            strcpy(_pagemap_path, "/tmp/mosalloc-pagemap-test-XXXXXX");
+            strcpy(_kpageflags_path, "/tmp/mosalloc-kpageflags-test-XXXXXX");
+            MakeTempPath(_pagemap_path);
+            MakeTempPath(_kpageflags_path);
+            _pagemap_fd = open(_pagemap_path, O_RDWR);
+            _kpageflags_fd = open(_kpageflags_path, O_RDWR);
+            ASSERT_GE(_pagemap_fd, 0);
+            ASSERT_GE(_kpageflags_fd, 0);
+            _mapping = mmap(NULL, 6*MB, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            ASSERT_NE(_mapping, MAP_FAILED);
+            _base = (char *)ROUND_UP((size_t)_mapping, 2*MB);
+            memset(_base, 1, 4*MB);
+            _first_page = (uint64_t)_base / PAGE_SIZE_4KB;
+        }
+
+        void TearDown() override {
+            munmap(_mapping, 6*MB);
+            close(_pagemap_fd);
+            close(_kpageflags_fd);
+            unlink(_pagemap_path);
+            unlink(_kpageflags_path);
+        }
+
+        void MapPage(size_t page, uint64_t entry, uint64_t flags) {
+            WriteWord(_pagemap_fd, _first_page + page, entry);
+            WriteWord(_kpageflags_fd, entry & ((1ull << 55) - 1), flags);
+        }
+
+        char _pagemap_path[64];
+        char _kpageflags_path[64];
+        int _pagemap_fd;
+        int _kpageflags_fd;
+        void *_mapping;
+        char *_base;
+        uint64_t _first_page;
+};
+
+TEST_F(PageBackingVerifierTest, VerifyFrames) {
+    for (size_t page = 0; page < PAGES_PER_2MB; page++) {
+        MapPage(page, PRESENT | (PAGES_PER_2MB * 10 + page), KPF_HUGE);
+    }
+    // a 4KB frame, a THP frame, a hidden frame and a page that is not present
+    MapPage(PAGES_PER_2MB, PRESENT | 100000, 0);
+    MapPage(PAGES_PER_2MB + 1, PRESENT | 100001, KPF_THP);
+    MapPage(PAGES_PER_2MB + 2, PRESENT, 0);
+    MapPage(PAGES_PER_2MB + 3, 0, 0);
+
+    PageBackingVerifier verifier;
+    EXPECT_FALSE(verifier.IsOpen());
+    ASSERT_EQ(verifier.Open(_pagemap_path, _kpageflags_path), 0);
+    EXPECT_TRUE(verifier.IsOpen());
+    EXPECT_TRUE(verifier.HasPageFlags());
+
+    struct mosalloc_backing_report report;
+    memset(&report, 0, sizeof(report));
+    EXPECT_TRUE(verifier.VerifyRange(_base, 2*MB, PageSize::HUGE_2MB,
+                                     &report));
+    EXPECT_EQ(report.checked_size, 2*MB);
+    EXPECT_EQ(report.present_size, 2*MB);
+    EXPECT_EQ(report.mismatched_size, 0ul);
+    EXPECT_EQ(report.first_mismatch, nullptr);
+
+    // the hugetlb frames do not back 4KB pages, and the 2MB frames are not
+    // aligned to 1GB
+    memset(&report, 0, sizeof(report));
+    EXPECT_FALSE(verifier.VerifyRange(_base, 8192, PageSize::BASE_4KB,
+                                      &report));
+    EXPECT_EQ(report.mismatched_size, 8192ul);
+    EXPECT_EQ(report.first_mismatch, _base);
+    memset(&report, 0, sizeof(report));
+    EXPECT_FALSE(verifier.VerifyRange(_base, 2*MB, PageSize::HUGE_1GB,
+                                      &report));
+    EXPECT_EQ(report.mismatched_size, 2*MB);
+
+    memset(&report, 0, sizeof(report));
+    EXPECT_FALSE(verifier.VerifyRange(_base + 2*MB, 4 * PAGE_SIZE_4KB,
+                                      PageSize::BASE_4KB, &report));
+    EXPECT_EQ(report.checked_size, 4 * PAGE_SIZE_4KB);
+    EXPECT_EQ(report.present_size, 3 * PAGE_SIZE_4KB);
+    EXPECT_EQ(report.mismatched_size, PAGE_SIZE_4KB);
+    EXPECT_EQ(report.unverified_size, PAGE_SIZE_4KB);
+    EXPECT_EQ(report.first_mismatch, _base + 2*MB + PAGE_SIZE_4KB);
+
+    // the present 4KB frame alone is verified
+    memset(&report, 0, sizeof(report));
+    EXPECT_TRUE(verifier.VerifyRange(_base + 2*MB, PAGE_SIZE_4KB,
+                                     PageSize::BASE_4KB, &report));
+    verifier.Close();
+    EXPECT_FALSE(verifier.IsOpen());
+}
+
+TEST_F(PageBackingVerifierTest, VerifyWithoutPageFlags) {
+    for (size_t page = 0; page < PAGES_PER_2MB; page++) {
+        MapPage(page, PRESENT | (PAGES_PER_2MB * 10 + page), 0);
+    }
+    MapPage(PAGES_PER_2MB, PRESENT | 100000, 0);
+
+    PageBackingVerifier verifier;
+    ASSERT_EQ(verifier.Open(_pagemap_path, "/nonexistent/kpageflags"), 0);
+    EXPECT_FALSE(verifier.HasPageFlags());
+
+    // the huge pages are verified by the alignment of their frames alone
+    struct mosalloc_backing_report report;
+    memset(&report, 0, sizeof(report));
+    EXPECT_TRUE(verifier.VerifyRange(_base, 2*MB, PageSize::HUGE_2MB,
+                                     &report));
+    EXPECT_EQ(report.unverified_size, 0ul);
+
+    // but any frame fits a 4KB page
+    memset(&report, 0, sizeof(report));
+    EXPECT_TRUE(verifier.VerifyRange(_base + 2*MB, PAGE_SIZE_4KB,
+                                     PageSize::BASE_4KB, &report));
+    EXPECT_EQ(report.present_size, PAGE_SIZE_4KB);
+    EXPECT_EQ(report.unverified_size, PAGE_SIZE_4KB);
+}
+
+TEST(PageBackingVerifierOpenTest, OpenFailsWithoutPagemap) {
+    PageBackingVerifier verifier;
+    EXPECT_EQ(verifier.Open("/nonexistent/pagemap"), -1);
+    EXPECT_EQ(errno, ENOENT);
+    EXPECT_FALSE(verifier.IsOpen());
+}
@@ -2,6 +2,7 @@
 #include <iostream>
 #include <sys/mman.h>
 #include <fstream>
+#include <dlfcn.h>
 
 #include "gtest/gtest.h"
 #include "ParseCsv.h"
@@ -59,4 +60,122 @@ TEST(ParseCsvTest, CsvFiles) {
     EXPECT_EQ(l.intervalList.At(9)._end_offset, (1ul << 40));//38
     EXPECT_EQ(l.size, 50);//38
     remove("csv_file_for_test.csv");
-}
\ No newline at end of file
+}
+
+TEST(ParseCsvTest, PoolTypes) {
+    std::ofstream myfile;
+    myfile.open ("csv_file_for_test.csv", std::ios::out);
+    myfile << excel_data;
+    myfile.close();
+
+    char types[4][MAX_POOL_NAME_LENGTH];
+    int count = parseCsv::GetPoolTypes("csv_file_for_test.csv", types, 4);
+    EXPECT_EQ(count, 3);
+    EXPECT_STREQ(types[0], "mmap");
+    EXPECT_STREQ(types[1], "brk");
+    EXPECT_STREQ(types[2], "fff");
+    remove("csv_file_for_test.csv");
+}
+
+TEST(ParseCsvTest, InvalidFiles) {
+    struct {
+        const char *data;
+        ParseCsvError error;
+    } invalid_files[] = {
+        {"", ParseCsvError::EMPTY_FILE},
+        {"type, page size,start offset,end offset\n"
+         "mmap,4096,0,4096\n", ParseCsvError::UNKNOWN_PAGE_SIZE},
+        {"type, page size,start offset,end offset\n"
+         "mmap,-1,0,50\n"
+         "mmap,-1,0,50\n", ParseCsvError::POOL_SIZE_EXISTS},
+        {"type, page size,start offset,end offset\n"
+         "mmap,2097152,-2097152,0\n", ParseCsvError::NEGATIVE_START_OFFSET},
+        {"type, page size,start offset,end offset\n"
+         "mmap,2097152,0,-2097152\n", ParseCsvError::NEGATIVE_END_OFFSET},
+        {"type, page size,start offset,end offset\n"
+         "mmap,2097152,0,2097152", ParseCsvError::CORRUPTED_FILE},
+        {"type, page size,start offset,end offset\n"
+         "mmap,2097152,0,2097152,4194304\n", ParseCsvError::CORRUPTED_FILE},
+    };
+    for (auto& invalid_file : invalid_files) {
+        std::ofstream myfile;
+        myfile.open ("csv_file_for_test.csv", std::ios::out);
+        myfile << invalid_file.data;
+        myfile.close();
+
+        PoolConfigurationData l;
+        l.intervalList.Initialize(mmap, munmap, 1024);
+        errno = 0;
+        EXPECT_EQ(parseCsv::TryParseCsv(l, "csv_file_for_test.csv", "mmap"),
+                  invalid_file.error);
+        EXPECT_EQ(errno, EINVAL);
+    }
+
+    char types[1][MAX_POOL_NAME_LENGTH];
+    int count;
+    std::ofstream myfile;
+    myfile.open ("csv_file_for_test.csv", std::ios::out);
+    myfile << excel_data;
+    myfile.close();
+    EXPECT_EQ(parseCsv::TryGetPoolTypes("csv_file_for_test.csv", types, 1, &count),
+              ParseCsvError::TOO_MANY_POOL_TYPES);
+    EXPECT_EQ(parseCsv::TryGetConfigFileMaxWindows("csv_file_for_test.csv", &count),
+              ParseCsvError::SUCCESS);
+    EXPECT_EQ(count, 15);
+    remove("csv_file_for_test.csv");
+    EXPECT_EQ(parseCsv::TryGetConfigFileMaxWindows("csv_file_for_test.csv", &count),
+              ParseCsvError::OPEN_FAILED);
+    EXPECT_EQ(errno, ENOENT);
+}
+
+TEST(ParseCsvTest, RoutingRules) {
+    std::ofstream myfile;
+    myfile.open ("routing_file_for_test.csv", std::ios::out);
+    myfile << "pool,minSize,maxSize,flags,origin,pageSize\n"
+              "small,0,65536,*,*\n"
+              "stack,0,-1,MAP_STACK|MAP_GROWSDOWN,*\n"
+              "large,1073741824,-1,*,libc.so\n"
+              "mmap,0,-1,*,app+0x1234,2097152\n"
+              "mmap,0,-1,*,@build_graph,*\n"
+              "large,0,-1,*,libstdc++.so.6\n";
+    myfile.close();
+
+    PoolRoutingRules rules;
+    parseCsv::ParseRoutingRules(rules, "routing_file_for_test.csv");
+    EXPECT_EQ(rules.GetLength(), 6);
+    EXPECT_TRUE(rules.HasOriginRules());
+    EXPECT_EQ(rules.At(1)._flags, MAP_STACK | MAP_GROWSDOWN);
+    EXPECT_EQ(rules.At(2)._max_size, SIZE_MAX);
+    EXPECT_EQ(rules.At(3)._origin_kind, PoolRoutingRule::OriginKind::MODULE_OFFSET);
+    EXPECT_STREQ(rules.At(3)._origin, "app");
+    EXPECT_EQ(rules.At(3)._origin_offset, 0x1234ul);
+    EXPECT_EQ(rules.At(3)._page_size, PageSize::HUGE_2MB);
+    EXPECT_EQ(rules.At(4)._origin_kind, PoolRoutingRule::OriginKind::SYMBOL);
+    EXPECT_STREQ(rules.At(4)._origin, "build_graph");
+    EXPECT_EQ(rules.At(4)._page_size, PageSize::UNKNOWN);
+    // module names may contain '+'
+    EXPECT_EQ(rules.At(5)._origin_kind, PoolRoutingRule::OriginKind::MODULE);
+    EXPECT_STREQ(rules.At(5)._origin, "libstdc++.so.6");
+
+    // malformed offsets are rejected
+    PoolRoutingRules malformed_rules;
+    EXPECT_EQ(malformed_rules.AddRule("mmap", 0, SIZE_MAX, 0, "app+0x12zz"), -EINVAL);
+    EXPECT_EQ(malformed_rules.AddRule("mmap", 0, SIZE_MAX, 0, "app+0x"), -EINVAL);
+    EXPECT_EQ(malformed_rules.AddRule("mmap", 0, SIZE_MAX, 0, "+0x1234"), -EINVAL);
+    EXPECT_EQ(malformed_rules.GetLength(), 0);
+
+    const char pools[][MAX_POOL_NAME_LENGTH] = {"mmap", "large", "small", "stack"};
+    rules.BindPools(pools, 4);
+    EXPECT_EQ(rules.Match(4096, 0, 0)->_pool_index, 2);
+    EXPECT_EQ(rules.Match(1 << 20, MAP_STACK, 0), nullptr);
+    EXPECT_EQ(rules.Match(1 << 20, MAP_STACK | MAP_GROWSDOWN, 0)->_pool_index, 3);
+    EXPECT_EQ(rules.Match(1ul << 30, 0, 0), nullptr);
+
+    // origin rules match only the call sites in their mask
+    void *frames[] = {dlsym(RTLD_DEFAULT, "getpid")};
+    uint64_t mask = rules.MatchOrigins(frames, 1);
+    EXPECT_EQ(mask, 1ul << 2);
+    EXPECT_EQ(rules.Match(1ul << 30, 0, mask)->_pool_index, 1);
+    EXPECT_EQ(rules.Match(1 << 20, 0, 1ul << 4)->_pool_index, 0);
+    remove("routing_file_for_test.csv");
+}
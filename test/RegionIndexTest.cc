@@ -0,0 +1,34 @@
+#include <sys/mman.h>
+
+#include "gtest/gtest.h"
+#include "RegionIndex.h"
+
+#define KB (1024ul)
+#define MB (1024*KB)
+#define GB (1024*MB)
+
+TEST(RegionIndexTest, FindUnalignedRegions) {
+    // regions that share 2MB slots, an empty region and a distant region
+    void *bases[] = {(void*)(64*GB), (void*)(GB + 4*KB), (void*)(GB),
+                     (void*)(GB + 8*KB), (void*)(GB + 2*MB + 4*KB)};
+    size_t sizes[] = {4*MB, 4*KB, 4*KB, 0, 2*MB};
+
+    RegionIndex index;
+    index.Initialize(mmap, munmap, bases, sizes, 5);
+    EXPECT_EQ(index.Find((void*)(GB)), 2);
+    EXPECT_EQ(index.Find((void*)(GB + 4*KB - 1)), 2);
+    EXPECT_EQ(index.Find((void*)(GB + 4*KB)), 1);
+    EXPECT_EQ(index.Find((void*)(GB + 8*KB)), -1);
+    EXPECT_EQ(index.Find((void*)(GB + 2*MB)), -1);
+    EXPECT_EQ(index.Find((void*)(GB + 2*MB + 4*KB)), 4);
+    EXPECT_EQ(index.Find((void*)(GB + 4*MB + 4*KB - 1)), 4);
+    EXPECT_EQ(index.Find((void*)(GB + 4*MB + 4*KB)), -1);
+    EXPECT_EQ(index.Find((void*)(32*GB)), -1);
+    EXPECT_EQ(index.Find((void*)(64*GB + 3*MB)), 0);
+    EXPECT_EQ(index.Find((void*)(64*GB + 4*MB)), -1);
+    EXPECT_EQ(index.Find((void*)(GB - 1)), -1);
+
+    RegionIndex empty_index;
+    empty_index.Initialize(mmap, munmap, bases, sizes, 0);
+    EXPECT_EQ(empty_index.Find((void*)(GB)), -1);
+}
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "RegionProfile.h"
+
+#define KB (1024ul)
+#define MB (1024ul * KB)
+
+static std::string ReadAll(FILE *file) {
+    std::string content;
+    char line[256];
+    rewind(file);
+    while (fgets(line, sizeof(line), file) != NULL) {
+        content += line;
+    }
+    fclose(file);
+    return content;
+}
+
+// the profile only does arithmetic on the addresses, so the region does not
+// have to be mapped
+static char *const BASE = (char*)0x7f0000000000ul;
+
+struct ProfileOutput {
+    std::string sizes;
+    std::string lifetimes;
+    std::string heatmap;
+};
+
+static ProfileOutput WriteProfile(RegionProfile &profile) {
+    FILE *sizes_file = tmpfile();
+    FILE *lifetimes_file = tmpfile();
+    FILE *heatmap_file = tmpfile();
+    RegionProfile::WriteHeaders(sizes_file, lifetimes_file, heatmap_file);
+    profile.Write("anon-mmap", sizes_file, lifetimes_file, heatmap_file);
+    ProfileOutput output;
+    output.sizes = ReadAll(sizes_file);
+    output.lifetimes = ReadAll(lifetimes_file);
+    output.heatmap = ReadAll(heatmap_file);
+    return output;
+}
+
+TEST(RegionProfileTest, SizesAndLifetimes) {
+    RegionProfile profile;
+    ASSERT_EQ(profile.Initialize(BASE, 64*MB), 0);
+    ASSERT_TRUE(profile.IsInitialized());
+
+    // 1000 mappings of 4KB, half of which are freed
+    for (size_t i = 0; i < 1000; i++) {
+        profile.CountAllocation(BASE + i * 4*KB, 4*KB);
+    }
+    for (size_t i = 0; i < 1000; i += 2) {
+        profile.CountDeallocation(BASE + i * 4*KB, 4*KB);
+    }
+    // a mapping that is freed in two parts ends its lifetime once
+    profile.CountAllocation(BASE + 8*MB, 3*MB);
+    profile.CountDeallocation(BASE + 8*MB, 1*MB);
+    profile.CountDeallocation(BASE + 9*MB, 2*MB);
+    // a moved mapping is still alive
+    profile.CountAllocation(BASE + 16*MB, 64*KB);
+    profile.CountRemap(BASE + 16*MB, BASE + 32*MB, 128*KB);
+
+    ProfileOutput output = WriteProfile(profile);
+    EXPECT_EQ(output.sizes,
+              "region,min-size,max-size,mappings\n"
+              "anon-mmap,4096,8191,1000\n"
+              "anon-mmap,65536,131071,1\n"
+              "anon-mmap,2097152,4194303,1\n");
+
+    // the lifetimes are short, but their buckets depend on the clock
+    unsigned long min, max, freed, live;
+    unsigned long total_freed = 0, total_live = 0;
+    const char *line = output.lifetimes.c_str();
+    while ((line = strchr(line, '\n')) != NULL) {
+        line++;
+        if (sscanf(line, "anon-mmap,%lu,%lu,%lu,%lu", &min, &max, &freed,
+                   &live) == 4) {
+            total_freed += freed;
+            total_live += live;
+        }
+    }
+    EXPECT_EQ(total_freed, 501ul);
+    EXPECT_EQ(total_live, 501ul);
+}
+
+TEST(RegionProfileTest, OccupancyHeatmap) {
+    RegionProfile profile;
+    ASSERT_EQ(profile.Initialize(BASE, 8*MB), 0);
+
+    ASSERT_TRUE(profile.BeginOccupancySample());
+    RegionProfile::AddOccupiedRange(BASE + 1*MB, BASE + 5*MB, &profile);
+    RegionProfile::AddOccupiedRange(BASE + 6*MB, BASE + 6*MB + 4*KB,
+                                    &profile);
+    // ranges outside of the region are ignored
+    RegionProfile::AddOccupiedRange(BASE + 8*MB, BASE + 10*MB, &profile);
+    // the occupancy is sampled once per window, unless it is forced
+    EXPECT_FALSE(profile.BeginOccupancySample());
+
+    ProfileOutput output = WriteProfile(profile);
+    EXPECT_EQ(output.heatmap,
+              "region,window-start-sec,window-end-sec,offset,occupied-bytes\n"
+              "anon-mmap,0.000,0.100,0,1048576\n"
+              "anon-mmap,0.000,0.100,2097152,2097152\n"
+              "anon-mmap,0.000,0.100,4194304,1048576\n"
+              "anon-mmap,0.000,0.100,6291456,4096\n");
+
+    ASSERT_TRUE(profile.BeginOccupancySample(true));
+    RegionProfile::AddOccupiedRange(BASE, BASE + 4*KB, &profile);
+    output = WriteProfile(profile);
+    EXPECT_EQ(output.heatmap,
+              "region,window-start-sec,window-end-sec,offset,occupied-bytes\n"
+              "anon-mmap,0.000,0.100,0,4096\n");
+}
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <sys/stat.h>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "StatisticsSegment.h"
+
+static bool SegmentExists(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/dev/shm%s%d", MOSALLOC_STATS_NAME_PREFIX,
+             (int)pid);
+    struct stat path_stat;
+    return stat(path, &path_stat) == 0;
+}
+
+TEST(StatisticsSegmentTest, CreateCountAndUnlink) {
+    StatisticsSegment segment;
+    EXPECT_EQ(segment.Get(), nullptr);
+    EXPECT_EQ(segment.AddPool("mmap", 4096), nullptr);
+    segment.CountCall(MOSALLOC_STATS_MMAP);
+
+    ASSERT_EQ(segment.Create(), 0);
+    struct mosalloc_stats *stats = segment.Get();
+    ASSERT_NE(stats, nullptr);
+    EXPECT_TRUE(SegmentExists(getpid()));
+    EXPECT_EQ(stats->magic, MOSALLOC_STATS_MAGIC);
+    EXPECT_EQ(stats->version, (uint32_t)MOSALLOC_STATS_VERSION);
+    EXPECT_EQ(stats->pid, getpid());
+
+    segment.CountCall(MOSALLOC_STATS_MMAP);
+    segment.CountCall(MOSALLOC_STATS_MMAP);
+    segment.CountCall(MOSALLOC_STATS_BRK);
+    EXPECT_EQ(stats->calls[MOSALLOC_STATS_MMAP], 2ul);
+    EXPECT_EQ(stats->calls[MOSALLOC_STATS_BRK], 1ul);
+
+    for (int i = 0; i < MOSALLOC_STATS_MAX_POOLS; i++) {
+        EXPECT_EQ(segment.AddPool("mmap", 4096), &stats->pools[i]);
+    }
+    EXPECT_EQ(segment.AddPool("brk", 4096), nullptr);
+    EXPECT_STREQ(stats->pools[0].name, "mmap");
+    EXPECT_EQ(stats->pools_count, (uint32_t)MOSALLOC_STATS_MAX_POOLS);
+
+    // refreshes are reported once per request
+    uint32_t request;
+    EXPECT_FALSE(segment.IsRefreshRequested(&request));
+    stats->refresh_requests++;
+    ASSERT_TRUE(segment.IsRefreshRequested(&request));
+    segment.EndRefresh(request);
+    EXPECT_FALSE(segment.IsRefreshRequested(&request));
+
+    uint64_t counter = 5;
+    StatisticsSegment::Max(&counter, 3);
+    EXPECT_EQ(counter, 5ul);
+    StatisticsSegment::Max(&counter, 7);
+    EXPECT_EQ(counter, 7ul);
+
+    segment.Unlink();
+    EXPECT_FALSE(SegmentExists(getpid()));
+}
+
+TEST(StatisticsSegmentTest, TimedLockGuard) {
+    std::mutex lock;
+    struct mosalloc_lock_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    {
+        TimedLockGuard guard(lock, &stats);
+    }
+    EXPECT_EQ(stats.acquisitions, 1ul);
+    EXPECT_EQ(stats.contentions, 0ul);
+
+    // a contended acquisition records its waiting time
+    lock.lock();
+    std::thread waiter([&]() { TimedLockGuard guard(lock, &stats); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    lock.unlock();
+    waiter.join();
+    EXPECT_EQ(stats.acquisitions, 2ul);
+    EXPECT_EQ(stats.contentions, 1ul);
+    EXPECT_GE(stats.wait_ns, 10000000ul);
+}
@@ -0,0 +1,149 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "TraceRecorder.h"
+
+static void *TraceMmap(void *addr, size_t length) {
+    TRACE_CALL(MMAP);
+    trace_call.SetArguments(addr, length, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS);
+    return trace_call.Return(addr);
+}
+
+static int TraceBrk(void *addr) {
+    TRACE_CALL(BRK);
+    trace_call.SetArguments(addr, 0);
+    errno = ENOMEM;
+    return trace_call.Return(-1);
+}
+
+static void *TraceSbrk(intptr_t increment) {
+    TRACE_CALL(SBRK);
+    trace_call.SetArguments(nullptr, (uint64_t)increment);
+    TraceBrk(nullptr);
+    return trace_call.Return((void*)-1);
+}
+
+TEST(TraceRecorderTest, RecordAndReadBack) {
+    char prefix[] = "/tmp/mosalloc-trace-test-XXXXXX";
+    int fd = mkstemp(prefix);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    unlink(prefix);
+
+    EXPECT_FALSE(TraceRecorder::IsEnabled());
+    // nothing is recorded before the trace is opened
+    TraceMmap((void*)0x1000, 4096);
+    TraceRecorder::AddPool("mmap", (void*)0x10000000, 0x10000000);
+    TraceRecorder::AddPool("brk", (void*)0x20000000, 0x1000000);
+    ASSERT_EQ(TraceRecorder::Open(prefix), 0);
+    EXPECT_TRUE(TraceRecorder::IsEnabled());
+
+    // more calls than a buffer holds, so some of them are written before
+    // the trace is closed
+    const int calls = TRACE_BUFFER_RECORDS + 10;
+    std::thread thread([]() {
+        for (int i = 0; i < calls; i++) {
+            TraceMmap((void*)(0x10000000ul + i * 4096ul), 4096);
+        }
+    });
+    for (int i = 0; i < 10; i++) {
+        TraceMmap((void*)(0x18000000ul + i * 4096ul), 4096);
+    }
+    errno = 0;
+    EXPECT_EQ(TraceSbrk(-4096), (void*)-1);
+    EXPECT_EQ(errno, ENOMEM);
+    thread.join();
+    TraceRecorder::Close();
+    EXPECT_FALSE(TraceRecorder::IsEnabled());
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s.%d", prefix, (int)getpid());
+    FILE *file = fopen(path, "rb");
+    unlink(path);
+    ASSERT_NE(file, nullptr);
+    struct mosalloc_trace_header header;
+    ASSERT_EQ(fread(&header, sizeof(header), 1, file), 1ul);
+    EXPECT_EQ(header.magic, MOSALLOC_TRACE_MAGIC);
+    EXPECT_EQ(header.version, (uint32_t)MOSALLOC_TRACE_VERSION);
+    EXPECT_EQ(header.record_size, sizeof(struct mosalloc_trace_record));
+    EXPECT_EQ(header.pid, getpid());
+    EXPECT_EQ(header.pools_count, 2u);
+    EXPECT_STREQ(header.names[1], "brk");
+    EXPECT_EQ(header.bases[1], 0x20000000ul);
+    EXPECT_EQ(header.capacities[1], 0x1000000ul);
+
+    std::vector<struct mosalloc_trace_record> records(calls + 20);
+    size_t count = fread(records.data(), sizeof(records[0]), records.size(),
+                         file);
+    fclose(file);
+    ASSERT_EQ(count, (size_t)calls + 13);
+    records.resize(count);
+
+    // the sequence numbers are unique, and the end record is the last one
+    std::vector<bool> is_seen(count, false);
+    for (auto &record : records) {
+        ASSERT_LT(record.sequence, count);
+        EXPECT_FALSE(is_seen[record.sequence]);
+        is_seen[record.sequence] = true;
+    }
+    struct mosalloc_trace_record &end = records.back();
+    EXPECT_EQ(end.call, MOSALLOC_TRACE_END);
+    EXPECT_EQ(end.sequence, count - 1);
+    EXPECT_EQ(end.result, 0ul);
+
+    // the calls of each thread are in order (but the buffers of the threads
+    // are written separately)
+    uint64_t next_addr[2] = {0x10000000ul, 0x18000000ul};
+    uint64_t last_sequence[2] = {0, 0};
+    int mmaps = 0;
+    for (auto &record : records) {
+        if (record.call != MOSALLOC_TRACE_MMAP) {
+            continue;
+        }
+        int t = (record.addr >= 0x18000000ul) ? 1 : 0;
+        EXPECT_EQ(record.addr, next_addr[t]);
+        EXPECT_EQ(record.result, record.addr);
+        EXPECT_GE(record.sequence, last_sequence[t]);
+        EXPECT_EQ(record.length, 4096ul);
+        EXPECT_EQ(record.prot, PROT_READ | PROT_WRITE);
+        EXPECT_EQ(record.fd, -1);
+        EXPECT_EQ(record.error, 0);
+        EXPECT_EQ(record.depth, 0);
+        next_addr[t] += 4096;
+        last_sequence[t] = record.sequence;
+        mmaps++;
+    }
+    EXPECT_EQ(mmaps, calls + 10);
+
+    // the brk call of sbrk is nested in it and ends before it
+    struct mosalloc_trace_record brk, sbrk;
+    memset(&brk, 0, sizeof(brk));
+    memset(&sbrk, 0, sizeof(sbrk));
+    for (auto &record : records) {
+        if (record.call == MOSALLOC_TRACE_BRK) {
+            brk = record;
+        } else if (record.call == MOSALLOC_TRACE_SBRK) {
+            sbrk = record;
+        }
+    }
+    EXPECT_EQ(brk.call, MOSALLOC_TRACE_BRK);
+    EXPECT_EQ(brk.depth, 1);
+    EXPECT_EQ(brk.error, ENOMEM);
+    EXPECT_EQ((int64_t)brk.result, -1);
+    EXPECT_EQ(sbrk.call, MOSALLOC_TRACE_SBRK);
+    EXPECT_EQ(sbrk.depth, 0);
+    EXPECT_EQ((int64_t)sbrk.length, -4096);
+    EXPECT_EQ(sbrk.error, ENOMEM);
+    EXPECT_LT(brk.sequence, sbrk.sequence);
+    EXPECT_LE(sbrk.time_ns, brk.time_ns);
+    EXPECT_GE(sbrk.duration_ns, brk.duration_ns);
+}
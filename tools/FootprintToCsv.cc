@@ -0,0 +1,70 @@
+//
+// mosalloc-footprint-csv: converts the footprint samples files that are
+// written with HPC_SAMPLING_FILE (see mosalloc_footprint.h) to csv, with a
+// row per pool per sample:
+//
+// pid,time-sec,operations,pool,size,committed-4kb,committed-2mb,committed-1gb,ffa-top-offset
+//
+// usage: mosalloc-footprint-csv file... > footprints.csv
+//
+// A truncated last sample (e.g., of a process that was killed) is ignored.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mosalloc_footprint.h"
+
+static int Convert(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    struct mosalloc_footprint_header header;
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != MOSALLOC_FOOTPRINT_MAGIC ||
+        header.version != MOSALLOC_FOOTPRINT_VERSION ||
+        header.pools_count > MOSALLOC_FOOTPRINT_MAX_POOLS) {
+        fprintf(stderr, "%s: not a footprint samples file\n", path);
+        fclose(file);
+        return -1;
+    }
+    struct mosalloc_footprint_record record;
+    struct mosalloc_footprint_pool pools[MOSALLOC_FOOTPRINT_MAX_POOLS];
+    while (fread(&record, sizeof(record), 1, file) == 1 &&
+           fread(pools, sizeof(pools[0]), header.pools_count, file) ==
+               header.pools_count) {
+        for (uint32_t i = 0; i < header.pools_count; i++) {
+            const struct mosalloc_footprint_pool *pool = &pools[i];
+            // the names are padded with zeros, so they are terminated
+            header.names[i][MOSALLOC_FOOTPRINT_MAX_NAME_LENGTH - 1] = '\0';
+            printf("%d,%.6f,%lu,%s,%lu,%lu,%lu,%lu,%lu\n",
+                   (int)header.pid, record.time_ns / 1e9,
+                   (unsigned long)record.operations, header.names[i],
+                   (unsigned long)pool->size,
+                   (unsigned long)pool->committed[0],
+                   (unsigned long)pool->committed[1],
+                   (unsigned long)pool->committed[2],
+                   (unsigned long)(pool->ffa_top - header.bases[i]));
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s file...\n", argv[0]);
+        return 1;
+    }
+    printf("pid,time-sec,operations,pool,size,committed-4kb,committed-2mb,"
+           "committed-1gb,ffa-top-offset\n");
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        if (Convert(argv[i]) != 0) {
+            status = 1;
+        }
+    }
+    return status;
+}
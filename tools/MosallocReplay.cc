@@ -0,0 +1,252 @@
+//
+// mosalloc-replay: replays a trace that was recorded with HPC_TRACE_FILE
+// (see mosalloc_trace.h) against the pools of a MemoryAllocator, and prints
+// a row per call with the latencies of the replayed calls next to the
+// recorded ones:
+//
+// call,count,failed,mismatched,recorded-mean-ns,replayed-mean-ns
+//
+// usage: mosalloc-replay trace-file
+//
+// The pools are configured from the environment as in the library (e.g.,
+// HPC_CONFIGURATION_FILE), so a trace can be replayed with other layouts or
+// against a modified allocator. The calls are replayed in the order of their
+// sequence numbers on a single thread; the calls that were made inside other
+// calls (e.g., the brk calls of sbrk) are replayed by their outer calls.
+// The addresses of the trace are translated to the replayed mappings, so the
+// replay stays correct even if the allocator places the mappings elsewhere;
+// the addresses that are not in any replayed mapping (e.g., the program
+// break) are translated by their offsets in their pools. The file mappings
+// are replayed with /dev/zero, and the mappings are not routed by their call
+// sites (which are not recorded).
+// A call is mismatched if it failed in the trace but not in the replay, or
+// vice versa.
+//
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <vector>
+
+#include "MemoryAllocator.h"
+#include "TraceMappings.h"
+
+static const char *CALL_NAMES[MOSALLOC_TRACE_END] = {
+    "mmap", "munmap", "mremap", "mprotect", "madvise", "brk", "sbrk"
+};
+
+struct CallTotals {
+    uint64_t count;
+    uint64_t failed;
+    uint64_t mismatched;
+    uint64_t recorded_ns;
+    uint64_t replayed_ns;
+};
+
+static uint64_t GetTimeNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+/*
+ * Replays the calls of a trace against an allocator, and keeps the replayed
+ * mappings of the mappings of the trace.
+ */
+class Replayer {
+    public:
+        Replayer(const struct mosalloc_trace_header &header,
+                 MemoryAllocator &allocator);
+        ~Replayer();
+
+        int Open();
+        void Replay(const struct mosalloc_trace_record &record);
+        void Print();
+
+    private:
+        bool ReplayCall(const struct mosalloc_trace_record &record);
+
+        MemoryAllocator &_allocator;
+        TraceMappings _mappings;
+        uint64_t _sbrk_top;
+        int _zero_fd;
+        CallTotals _totals[MOSALLOC_TRACE_END];
+};
+
+Replayer::Replayer(const struct mosalloc_trace_header &header,
+                   MemoryAllocator &allocator) :
+    _allocator(allocator),
+    _mappings(header),
+    _sbrk_top((uint64_t)allocator.GetBrkRegionBase()),
+    _zero_fd(-1) {
+        memset(_totals, 0, sizeof(_totals));
+        for (uint32_t i = 0; i < header.pools_count; i++) {
+            bool is_configured = false;
+            for (int j = 0; j < allocator.GetRegionsCount(); j++) {
+                const char *name = nullptr;
+                HugePageBackedRegion *region = allocator.GetRegion(j, &name);
+                if (strncmp(name, header.names[i],
+                            MOSALLOC_TRACE_MAX_NAME_LENGTH) == 0) {
+                    _mappings.SetPoolBase(
+                            i, (uint64_t)region->GetRegionBase());
+                    is_configured = true;
+                }
+            }
+            if (!is_configured) {
+                fprintf(stderr, "warning: the pool %.*s is not configured\n",
+                        MOSALLOC_TRACE_MAX_NAME_LENGTH, header.names[i]);
+            }
+        }
+    }
+
+Replayer::~Replayer() {
+    if (_zero_fd >= 0) {
+        close(_zero_fd);
+    }
+}
+
+int Replayer::Open() {
+    _zero_fd = open("/dev/zero", O_RDWR | O_CLOEXEC);
+    if (_zero_fd < 0) {
+        perror("/dev/zero");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Replays @record, and returns true if the replayed call failed.
+ */
+bool Replayer::ReplayCall(const struct mosalloc_trace_record &record) {
+    bool is_failed = false;
+    std::vector<TraceMappings::Piece> pieces;
+    switch (record.call) {
+        case MOSALLOC_TRACE_MMAP: {
+            void *addr = (void*)_mappings.Translate(record.addr);
+            void *res = (record.fd >= 0) ?
+                _allocator.AllocateFromFileMmapRegion(
+                        addr, record.length, record.prot, record.flags,
+                        _zero_fd, record.offset) :
+                _allocator.AllocateFromAnonymousMmapRegion(
+                        addr, record.length, record.prot, record.flags);
+            is_failed = (res == MAP_FAILED);
+            if (!is_failed && record.error == 0) {
+                _mappings.Add(record.result, record.length, (uint64_t)res);
+            }
+            break;
+        }
+        case MOSALLOC_TRACE_MUNMAP:
+            _mappings.GetReplayedPieces(record.addr, record.length, pieces);
+            for (auto &piece : pieces) {
+                is_failed |= (_allocator.DeallocateFromMmapRegion(
+                            (void*)piece.addr, piece.length) != 0);
+            }
+            if (record.error == 0) {
+                _mappings.Remove(record.addr, record.length);
+            }
+            break;
+        case MOSALLOC_TRACE_MREMAP: {
+            void *new_address = (record.flags & MREMAP_FIXED) ?
+                (void*)_mappings.Translate(record.new_address) : nullptr;
+            void *res = _allocator.RemapMmapRegion(
+                    (void*)_mappings.Translate(record.addr), record.length,
+                    record.new_length, record.flags, new_address);
+            is_failed = (res == MAP_FAILED);
+            if (!is_failed && record.error == 0) {
+                _mappings.Remove(record.addr, record.length);
+                _mappings.Add(record.result, record.new_length, (uint64_t)res);
+            }
+            break;
+        }
+        case MOSALLOC_TRACE_MPROTECT:
+            _mappings.GetReplayedPieces(record.addr, record.length, pieces);
+            for (auto &piece : pieces) {
+                is_failed |= (_allocator.ProtectMmapRegion(
+                            (void*)piece.addr, piece.length,
+                            record.prot) != 0);
+            }
+            break;
+        case MOSALLOC_TRACE_MADVISE:
+            _mappings.GetReplayedPieces(record.addr, record.length, pieces);
+            for (auto &piece : pieces) {
+                is_failed |= (_allocator.AdviseMmapRegion(
+                            (void*)piece.addr, piece.length,
+                            record.prot) != 0);
+            }
+            break;
+        case MOSALLOC_TRACE_BRK:
+            is_failed = (_allocator.ChangeProgramBreak(
+                        (void*)_mappings.Translate(record.addr)) != 0);
+            break;
+        case MOSALLOC_TRACE_SBRK: {
+            // like the sbrk hook, which keeps a top of its own
+            uint64_t new_top = _sbrk_top + (int64_t)record.length;
+            is_failed = (_allocator.ChangeProgramBreak((void*)new_top) != 0);
+            if (!is_failed) {
+                _sbrk_top = new_top;
+            }
+            break;
+        }
+    }
+    return is_failed;
+}
+
+void Replayer::Replay(const struct mosalloc_trace_record &record) {
+    if (record.depth > 0) {
+        return;
+    }
+    uint64_t start_ns = GetTimeNs();
+    bool is_failed = ReplayCall(record);
+    uint64_t replayed_ns = GetTimeNs() - start_ns;
+
+    CallTotals &totals = _totals[record.call];
+    totals.count++;
+    totals.failed += is_failed;
+    totals.mismatched += (is_failed != (record.error != 0));
+    totals.recorded_ns += record.duration_ns;
+    totals.replayed_ns += replayed_ns;
+}
+
+void Replayer::Print() {
+    printf("call,count,failed,mismatched,recorded-mean-ns,"
+           "replayed-mean-ns\n");
+    for (int c = 0; c < MOSALLOC_TRACE_END; c++) {
+        CallTotals &totals = _totals[c];
+        if (totals.count == 0) {
+            continue;
+        }
+        printf("%s,%lu,%lu,%lu,%.0f,%.0f\n", CALL_NAMES[c],
+               (unsigned long)totals.count, (unsigned long)totals.failed,
+               (unsigned long)totals.mismatched,
+               (double)totals.recorded_ns / totals.count,
+               (double)totals.replayed_ns / totals.count);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s trace-file\n", argv[0]);
+        return 1;
+    }
+    struct mosalloc_trace_header header;
+    std::vector<struct mosalloc_trace_record> records;
+    if (ReadTrace(argv[1], &header, records) != 0) {
+        return 1;
+    }
+    // the replay itself is not traced
+    unsetenv("HPC_TRACE_FILE");
+    MemoryAllocator *allocator = new MemoryAllocator();
+    Replayer replayer(header, *allocator);
+    if (replayer.Open() != 0) {
+        return 1;
+    }
+    for (auto &record : records) {
+        replayer.Replay(record);
+    }
+    replayer.Print();
+    delete allocator;
+    return 0;
+}
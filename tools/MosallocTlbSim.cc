@@ -0,0 +1,537 @@
+//
+// mosalloc-tlbsim: simulates the data TLBs and the paging-structure caches
+// of a CPU on a memory-access trace for each of the given layouts, so
+// layouts can be screened before they are run (and without hardware
+// counters). A row is printed per layout:
+//
+// layout,instructions,accesses,accesses-4kb,accesses-2mb,accesses-1gb,
+// l1-misses,l2-misses,walk-references,walk-cycles,l2-mpki
+//
+// usage: mosalloc-tlbsim [-c tlb.csv] [-p pid] [-r reference-cycles]
+//                        pools_base_pointers.out trace-file layout.csv...
+//
+// The trace is the output of Valgrind lackey (valgrind --tool=lackey
+// --trace-mem=yes), or "-" to read it from stdin, of a run with Mosalloc and
+// HPC_ANALYZE_HPBRS=1, which writes the bases of the pools to
+// pools_base_pointers.out (the row of @pid, or the last row by default). The
+// addresses of the trace are mapped to page sizes by the intervals of the
+// mmap, brk and stack pools of each layout (which has the format of the
+// configuration file), and to 4KB pages elsewhere; the file pool is backed by
+// 4KB pages only.
+//
+// The TLBs are set-associative with LRU replacement, and are configured by
+// tlb.csv (see DEFAULT_TLB_CONFIGURATION):
+//
+// structure,entries,ways,page-sizes
+//
+// where the structure is l1 or l2 (a TLB for the given page sizes, separated
+// by ':'), or pml4, pdpte or pde (a paging-structure cache, which skips the
+// upper levels of the walks). An access looks up the L1 TLB of its page size
+// and then the L2 TLB; an L2 miss walks the page table, and each of the
+// levels that the paging-structure caches do not skip is a reference of
+// reference-cycles cycles (20 by default).
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+#include "GlibcAllocationFunctions.h"
+#include "ParseCsv.h"
+
+#define DEFAULT_REFERENCE_CYCLES (20)
+#define PAGE_SIZES (3)
+#define MAX_LINE_LENGTH (1024)
+
+// an Intel Skylake core
+static const char *DEFAULT_TLB_CONFIGURATION[] = {
+    "l1,64,4,4096",
+    "l1,32,4,2097152",
+    "l1,4,4,1073741824",
+    "l2,1536,12,4096:2097152",
+    "l2,16,4,1073741824",
+    "pml4,2,2,",
+    "pdpte,4,4,",
+    "pde,32,4,",
+};
+
+static const PageSize PAGE_SIZE_VALUES[PAGE_SIZES] = {
+    PageSize::BASE_4KB, PageSize::HUGE_2MB, PageSize::HUGE_1GB
+};
+static const int PAGE_SHIFTS[PAGE_SIZES] = {12, 21, 30};
+// the levels of the page table that a walk references
+static const int WALK_LEVELS[PAGE_SIZES] = {4, 3, 2};
+
+static int GetPageSizeIndex(PageSize page_size) {
+    for (int i = 0; i < PAGE_SIZES; i++) {
+        if (PAGE_SIZE_VALUES[i] == page_size) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * A set-associative cache of tags with LRU replacement.
+ */
+class TagCache {
+    public:
+        TagCache(size_t entries, size_t ways) :
+            _sets(entries / ways), _ways(ways),
+            _tags(entries, 0), _stamps(entries, 0), _clock(0) {}
+
+        // returns true if @tag is cached, otherwise caches it
+        bool Access(uint64_t tag) {
+            // the stored tags are offset by one, so 0 is an empty entry
+            tag++;
+            size_t first = (size_t)((tag * 0x9e3779b97f4a7c15ull) >> 32) %
+                _sets * _ways;
+            size_t victim = first;
+            _clock++;
+            for (size_t i = first; i < first + _ways; i++) {
+                if (_tags[i] == tag) {
+                    _stamps[i] = _clock;
+                    return true;
+                }
+                if (_stamps[i] < _stamps[victim]) {
+                    victim = i;
+                }
+            }
+            _tags[victim] = tag;
+            _stamps[victim] = _clock;
+            return false;
+        }
+
+    private:
+        size_t _sets;
+        size_t _ways;
+        std::vector<uint64_t> _tags;
+        std::vector<uint64_t> _stamps;
+        uint64_t _clock;
+};
+
+struct TlbGeometry {
+    char structure[16];
+    size_t entries;
+    size_t ways;
+    // the page sizes of a TLB, by their indices
+    bool page_sizes[PAGE_SIZES];
+};
+
+/*
+ * Parses a row of the TLB configuration.
+ * Returns 0 on success, or -1 if the row is invalid.
+ */
+static int ParseGeometry(const char *line, TlbGeometry *geometry) {
+    char page_sizes[256] = {0};
+    memset(geometry, 0, sizeof(*geometry));
+    if (sscanf(line, "%15[^,],%zu,%zu,%255s", geometry->structure,
+               &geometry->entries, &geometry->ways, page_sizes) < 3 ||
+        geometry->ways == 0 || geometry->entries % geometry->ways != 0) {
+        return -1;
+    }
+    bool is_tlb = (strcmp(geometry->structure, "l1") == 0 ||
+                   strcmp(geometry->structure, "l2") == 0);
+    if (!is_tlb) {
+        return (strcmp(geometry->structure, "pml4") == 0 ||
+                strcmp(geometry->structure, "pdpte") == 0 ||
+                strcmp(geometry->structure, "pde") == 0) ? 0 : -1;
+    }
+    for (char *token = strtok(page_sizes, ":"); token != NULL;
+         token = strtok(NULL, ":")) {
+        int index = GetPageSizeIndex((PageSize)strtoull(token, NULL, 10));
+        if (index < 0) {
+            return -1;
+        }
+        geometry->page_sizes[index] = true;
+    }
+    return 0;
+}
+
+static int ReadGeometries(const char *path,
+                          std::vector<TlbGeometry> &geometries) {
+    TlbGeometry geometry;
+    if (path == nullptr) {
+        for (auto line : DEFAULT_TLB_CONFIGURATION) {
+            ParseGeometry(line, &geometry);
+            geometries.push_back(geometry);
+        }
+        return 0;
+    }
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    char line[MAX_LINE_LENGTH];
+    // skip the header line
+    bool is_valid = (fgets(line, sizeof(line), file) != NULL);
+    while (is_valid && fgets(line, sizeof(line), file) != NULL) {
+        if (line[0] == '\n') {
+            continue;
+        }
+        is_valid = (ParseGeometry(line, &geometry) == 0);
+        geometries.push_back(geometry);
+    }
+    fclose(file);
+    if (!is_valid) {
+        fprintf(stderr, "%s: invalid TLB configuration\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+struct PoolBases {
+    const char *name;
+    uint64_t start;
+};
+
+/*
+ * Reads the bases of the mmap, brk and stack pools from the row of @pid (or
+ * the last row if @pid is 0) of pools_base_pointers.out.
+ * Returns 0 on success, or -1 if there is no such row.
+ */
+static int ReadPoolBases(const char *path, long pid,
+                         std::vector<PoolBases> &pools) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    char line[MAX_LINE_LENGTH];
+    char row[MAX_LINE_LENGTH] = {0};
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (line[0] >= '0' && line[0] <= '9' &&
+            (pid == 0 || strtol(line, NULL, 10) == pid)) {
+            strcpy(row, line);
+        }
+    }
+    fclose(file);
+    if (row[0] == 0) {
+        fprintf(stderr, "%s: no pools were found\n", path);
+        return -1;
+    }
+    // pid,tid,anon-mmap-start,anon-mmap-end,brk-start,brk-end,
+    // file-mmap-start,file-mmap-end,stack-mmap-start,stack-mmap-end
+    // ("(nil)" for the pools that do not exist)
+    uint64_t fields[10] = {0};
+    char *field = row;
+    for (int i = 0; i < 10 && field != NULL; i++) {
+        fields[i] = strtoull(field, NULL, (i < 2) ? 10 : 16);
+        field = strchr(field, ',');
+        field = (field != NULL) ? field + 1 : NULL;
+    }
+    pools.push_back({"mmap", fields[2]});
+    pools.push_back({"brk", fields[4]});
+    pools.push_back({"stack", fields[8]});
+    return 0;
+}
+
+struct PageRange {
+    uint64_t start;
+    uint64_t end;
+    int page_size;
+};
+
+/*
+ * Simulates the TLBs of a layout.
+ */
+class TlbSimulator {
+    public:
+        TlbSimulator(const char *layout_file,
+                     const std::vector<TlbGeometry> &geometries,
+                     uint64_t reference_cycles);
+
+        void AddPool(const PoolBases &pool);
+        void Access(uint64_t addr, uint64_t size);
+        void Print(uint64_t instructions);
+
+    private:
+        int FindPageSize(uint64_t addr);
+        void Translate(uint64_t addr, int page_size);
+        uint64_t Walk(uint64_t addr, int page_size);
+
+        const char *_layout_file;
+        uint64_t _reference_cycles;
+        std::vector<PageRange> _ranges;
+        size_t _last_range;
+        std::vector<TagCache> _tlbs;
+        // the indices of the TLBs of each page size
+        std::vector<size_t> _l1[PAGE_SIZES];
+        std::vector<size_t> _l2[PAGE_SIZES];
+        std::vector<TagCache> _pml4_caches;
+        std::vector<TagCache> _pdpte_caches;
+        std::vector<TagCache> _pde_caches;
+
+        uint64_t _accesses[PAGE_SIZES];
+        uint64_t _l1_misses;
+        uint64_t _l2_misses;
+        uint64_t _walk_references;
+};
+
+TlbSimulator::TlbSimulator(const char *layout_file,
+                           const std::vector<TlbGeometry> &geometries,
+                           uint64_t reference_cycles) :
+    _layout_file(layout_file),
+    _reference_cycles(reference_cycles),
+    _last_range(0),
+    _l1_misses(0),
+    _l2_misses(0),
+    _walk_references(0) {
+        memset(_accesses, 0, sizeof(_accesses));
+        for (auto &geometry : geometries) {
+            TagCache cache(geometry.entries, geometry.ways);
+            bool is_l1 = (strcmp(geometry.structure, "l1") == 0);
+            if (is_l1 || strcmp(geometry.structure, "l2") == 0) {
+                // a TLB may be shared by several page sizes
+                _tlbs.push_back(cache);
+                for (int i = 0; i < PAGE_SIZES; i++) {
+                    if (geometry.page_sizes[i]) {
+                        (is_l1 ? _l1 : _l2)[i].push_back(_tlbs.size() - 1);
+                    }
+                }
+            } else if (strcmp(geometry.structure, "pml4") == 0) {
+                _pml4_caches.push_back(cache);
+            } else if (strcmp(geometry.structure, "pdpte") == 0) {
+                _pdpte_caches.push_back(cache);
+            } else if (strcmp(geometry.structure, "pde") == 0) {
+                _pde_caches.push_back(cache);
+            }
+        }
+    }
+
+/*
+ * Adds the intervals of @pool in the layout; the ranges of the pools do not
+ * overlap, since they were reserved by the same process.
+ */
+void TlbSimulator::AddPool(const PoolBases &pool) {
+    if (pool.start == 0) {
+        return;
+    }
+    PoolConfigurationData configuration_data;
+    int intervals_size = parseCsv::GetConfigFileMaxWindows(_layout_file) * 2
+        + 1;
+    configuration_data.intervalList.Initialize(GlibcMmap, GlibcMunmap,
+                                               intervals_size);
+    parseCsv::ParseCsv(configuration_data, _layout_file, pool.name);
+    MemoryIntervalList &intervals = configuration_data.intervalList;
+    for (size_t i = 0; i < intervals.GetLength(); i++) {
+        MemoryInterval &interval = intervals.At(i);
+        _ranges.push_back({pool.start + interval._start_offset,
+                           pool.start + interval._end_offset,
+                           GetPageSizeIndex(interval._page_size)});
+    }
+    std::sort(_ranges.begin(), _ranges.end(),
+              [](const PageRange &a, const PageRange &b) {
+                  return a.start < b.start;
+              });
+}
+
+int TlbSimulator::FindPageSize(uint64_t addr) {
+    if (_ranges.empty()) {
+        return 0;
+    }
+    // the accesses are mostly local, so the last range is checked first
+    PageRange &last = _ranges[_last_range];
+    if (addr >= last.start && addr < last.end) {
+        return last.page_size;
+    }
+    auto it = std::upper_bound(_ranges.begin(), _ranges.end(), addr,
+                               [](uint64_t a, const PageRange &range) {
+                                   return a < range.start;
+                               });
+    if (it == _ranges.begin()) {
+        return 0;
+    }
+    --it;
+    if (addr >= it->end) {
+        return 0;
+    }
+    _last_range = it - _ranges.begin();
+    return it->page_size;
+}
+
+/*
+ * Walks the page table, and returns the levels that were referenced: each
+ * paging-structure cache that holds the entry of an upper level skips the
+ * levels above it.
+ */
+uint64_t TlbSimulator::Walk(uint64_t addr, int page_size) {
+    int levels = WALK_LEVELS[page_size];
+    bool is_pde_hit = false;
+    bool is_pdpte_hit = false;
+    bool is_pml4_hit = false;
+    // the entries of the leaf levels are not cached by these caches
+    if (page_size == 0) {
+        for (auto &cache : _pde_caches) {
+            is_pde_hit |= cache.Access(addr >> 21);
+        }
+    }
+    if (page_size <= 1) {
+        for (auto &cache : _pdpte_caches) {
+            is_pdpte_hit |= cache.Access(addr >> 30);
+        }
+    }
+    for (auto &cache : _pml4_caches) {
+        is_pml4_hit |= cache.Access(addr >> 39);
+    }
+    if (is_pde_hit) {
+        return 1;
+    }
+    if (is_pdpte_hit) {
+        return levels - 2;
+    }
+    if (is_pml4_hit) {
+        return levels - 1;
+    }
+    return levels;
+}
+
+void TlbSimulator::Translate(uint64_t addr, int page_size) {
+    uint64_t page = addr >> PAGE_SHIFTS[page_size];
+    // the page sizes are tagged, since the L2 TLBs may be shared by them
+    uint64_t tag = (page << 2) | (uint64_t)page_size;
+    _accesses[page_size]++;
+    bool is_hit = false;
+    for (auto index : _l1[page_size]) {
+        is_hit |= _tlbs[index].Access(tag);
+    }
+    if (is_hit) {
+        return;
+    }
+    _l1_misses++;
+    for (auto index : _l2[page_size]) {
+        is_hit |= _tlbs[index].Access(tag);
+    }
+    if (is_hit) {
+        return;
+    }
+    _l2_misses++;
+    _walk_references += Walk(addr, page_size);
+}
+
+void TlbSimulator::Access(uint64_t addr, uint64_t size) {
+    int page_size = FindPageSize(addr);
+    Translate(addr, page_size);
+    // an access that crosses a page boundary translates both pages
+    uint64_t last = addr + ((size > 0) ? size - 1 : 0);
+    if ((last >> PAGE_SHIFTS[page_size]) != (addr >> PAGE_SHIFTS[page_size])) {
+        Translate(last, FindPageSize(last));
+    }
+}
+
+void TlbSimulator::Print(uint64_t instructions) {
+    uint64_t accesses = _accesses[0] + _accesses[1] + _accesses[2];
+    printf("%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%.3f\n", _layout_file,
+           (unsigned long)instructions, (unsigned long)accesses,
+           (unsigned long)_accesses[0], (unsigned long)_accesses[1],
+           (unsigned long)_accesses[2], (unsigned long)_l1_misses,
+           (unsigned long)_l2_misses, (unsigned long)_walk_references,
+           (unsigned long)(_walk_references * _reference_cycles),
+           (instructions == 0) ? 0.0 :
+           (double)_l2_misses * 1000 / instructions);
+}
+
+/*
+ * Parses a data access of lackey (" L addr,size", " S addr,size" or
+ * " M addr,size", where M modifies the data with a single translation).
+ * Returns 0 on success, or -1 if the line is not a data access.
+ */
+static int ParseAccess(const char *line, uint64_t *addr, uint64_t *size) {
+    if (line[0] != ' ' || line[2] != ' ' ||
+        (line[1] != 'L' && line[1] != 'S' && line[1] != 'M')) {
+        return -1;
+    }
+    char *end = NULL;
+    *addr = strtoull(line + 3, &end, 16);
+    if (end == line + 3 || *end != ',') {
+        return -1;
+    }
+    *size = strtoull(end + 1, NULL, 10);
+    return 0;
+}
+
+static void PrintUsage(const char *program) {
+    fprintf(stderr, "usage: %s [-c tlb.csv] [-p pid] [-r reference-cycles] "
+            "pools_base_pointers.out trace-file layout.csv...\n", program);
+}
+
+int main(int argc, char *argv[]) {
+    const char *tlb_file = nullptr;
+    long pid = 0;
+    uint64_t reference_cycles = DEFAULT_REFERENCE_CYCLES;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:p:r:")) != -1) {
+        switch (opt) {
+            case 'c':
+                tlb_file = optarg;
+                break;
+            case 'p':
+                pid = strtol(optarg, nullptr, 10);
+                break;
+            case 'r':
+                reference_cycles = strtoull(optarg, nullptr, 10);
+                break;
+            default:
+                PrintUsage(argv[0]);
+                return 1;
+        }
+    }
+    if (argc - optind < 3) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    std::vector<TlbGeometry> geometries;
+    std::vector<PoolBases> pools;
+    if (ReadGeometries(tlb_file, geometries) != 0 ||
+        ReadPoolBases(argv[optind], pid, pools) != 0) {
+        return 1;
+    }
+    const char *trace_path = argv[optind + 1];
+    FILE *trace = (strcmp(trace_path, "-") == 0) ? stdin :
+        fopen(trace_path, "r");
+    if (trace == NULL) {
+        perror(trace_path);
+        return 1;
+    }
+
+    std::vector<TlbSimulator*> simulators;
+    for (int i = optind + 2; i < argc; i++) {
+        TlbSimulator *simulator = new TlbSimulator(argv[i], geometries,
+                                                   reference_cycles);
+        for (auto &pool : pools) {
+            simulator->AddPool(pool);
+        }
+        simulators.push_back(simulator);
+    }
+
+    // the instructions are counted for the misses per kilo-instruction
+    uint64_t instructions = 0;
+    char line[MAX_LINE_LENGTH];
+    while (fgets(line, sizeof(line), trace) != NULL) {
+        uint64_t addr;
+        uint64_t size;
+        if (line[0] == 'I') {
+            instructions++;
+        } else if (ParseAccess(line, &addr, &size) == 0) {
+            for (auto simulator : simulators) {
+                simulator->Access(addr, size);
+            }
+        }
+    }
+    if (trace != stdin) {
+        fclose(trace);
+    }
+
+    printf("layout,instructions,accesses,accesses-4kb,accesses-2mb,"
+           "accesses-1gb,l1-misses,l2-misses,walk-references,walk-cycles,"
+           "l2-mpki\n");
+    for (auto simulator : simulators) {
+        simulator->Print(instructions);
+        delete simulator;
+    }
+    return 0;
+}
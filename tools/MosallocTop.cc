@@ -0,0 +1,329 @@
+//
+// mosalloc-top: displays the live statistics of the processes that run with
+// Mosalloc and HPC_STATISTICS=1 (see mosalloc_stats.h). Each refresh shows,
+// per process, the rates of the hooked calls, the waiting times for the
+// locks, and the sizes and rates of the pools.
+//
+// usage: mosalloc-top [-p pid] [-d delay-in-seconds] [-n iterations]
+//
+// Segments of processes that exited without removing them are removed.
+//
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mosalloc_stats.h"
+
+#define MAX_PROCESSES (64)
+#define SHM_DIRECTORY "/dev/shm"
+
+struct Process {
+    pid_t pid;
+    struct mosalloc_stats *stats;
+    struct mosalloc_stats previous;
+    bool has_previous;
+    bool is_seen;
+};
+
+static const char *CALL_NAMES[MOSALLOC_STATS_CALLS] = {
+    "mmap", "munmap", "mremap", "mprotect", "madvise", "brk", "sbrk"
+};
+
+static Process processes[MAX_PROCESSES];
+static int processes_count = 0;
+
+static double GetSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *FormatSize(double size, char *buffer, size_t length) {
+    const char *units[] = {"B", "K", "M", "G", "T"};
+    int unit = 0;
+    while (size >= 1024 && unit < 4) {
+        size /= 1024;
+        unit++;
+    }
+    snprintf(buffer, length, (unit == 0) ? "%.0f%s" : "%.1f%s",
+             size, units[unit]);
+    return buffer;
+}
+
+// a process may exec another program without removing its segment, so the
+// segment is live only if the process still maps it
+static bool IsMappedBy(pid_t pid, const char *name) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/maps", (int)pid);
+    FILE *maps = fopen(path, "r");
+    if (maps == NULL) {
+        return false;
+    }
+    char line[512];
+    bool is_mapped = false;
+    while (!is_mapped && fgets(line, sizeof(line), maps) != NULL) {
+        // the name must not be a prefix of another name (e.g., of pid 12
+        // in pid 123)
+        char *match = strstr(line, name);
+        is_mapped = (match != NULL && match > line && match[-1] == '/' &&
+                     (match[strlen(name)] == '\n' ||
+                      match[strlen(name)] == ' '));
+    }
+    fclose(maps);
+    return is_mapped;
+}
+
+static Process *FindProcess(pid_t pid) {
+    for (int i = 0; i < processes_count; i++) {
+        if (processes[i].pid == pid) {
+            return &processes[i];
+        }
+    }
+    return NULL;
+}
+
+static struct mosalloc_stats *Attach(const char *name) {
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    void *ptr = mmap(NULL, sizeof(struct mosalloc_stats),
+                     PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        return NULL;
+    }
+    struct mosalloc_stats *stats = (struct mosalloc_stats *)ptr;
+    if (__atomic_load_n(&stats->magic, __ATOMIC_ACQUIRE) !=
+            MOSALLOC_STATS_MAGIC ||
+        stats->version != MOSALLOC_STATS_VERSION) {
+        munmap(ptr, sizeof(struct mosalloc_stats));
+        return NULL;
+    }
+    return stats;
+}
+
+static void Detach(Process *process) {
+    munmap(process->stats, sizeof(struct mosalloc_stats));
+    *process = processes[--processes_count];
+}
+
+// attaches to the new segments and detaches from the removed ones
+static void ScanSegments(pid_t only_pid) {
+    for (int i = 0; i < processes_count; i++) {
+        processes[i].is_seen = false;
+    }
+    DIR *directory = opendir(SHM_DIRECTORY);
+    if (directory == NULL) {
+        perror(SHM_DIRECTORY);
+        exit(1);
+    }
+    const char *prefix = MOSALLOC_STATS_NAME_PREFIX + 1;
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != NULL) {
+        if (strncmp(entry->d_name, prefix, strlen(prefix)) != 0) {
+            continue;
+        }
+        pid_t pid = (pid_t)atoi(entry->d_name + strlen(prefix));
+        if (only_pid != 0 && pid != only_pid) {
+            continue;
+        }
+        char name[sizeof(entry->d_name) + 1];
+        snprintf(name, sizeof(name), "/%s", entry->d_name);
+        if (kill(pid, 0) != 0 && errno == ESRCH) {
+            shm_unlink(name);
+            continue;
+        }
+        if (!IsMappedBy(pid, entry->d_name)) {
+            continue;
+        }
+        Process *process = FindProcess(pid);
+        if (process == NULL && processes_count < MAX_PROCESSES) {
+            struct mosalloc_stats *stats = Attach(name);
+            if (stats == NULL) {
+                continue;
+            }
+            process = &processes[processes_count++];
+            process->pid = pid;
+            process->stats = stats;
+            process->has_previous = false;
+        }
+        if (process != NULL) {
+            process->is_seen = true;
+        }
+    }
+    closedir(directory);
+    for (int i = processes_count - 1; i >= 0; i--) {
+        if (!processes[i].is_seen) {
+            Detach(&processes[i]);
+        }
+    }
+}
+
+static void RequestRefresh() {
+    for (int i = 0; i < processes_count; i++) {
+        __atomic_fetch_add(&processes[i].stats->refresh_requests, 1,
+                           __ATOMIC_RELAXED);
+    }
+}
+
+static double Rate(uint64_t current, uint64_t previous, double seconds) {
+    return (current - previous) / seconds;
+}
+
+static void PrintLock(const char *name, const struct mosalloc_lock_stats *lock,
+                      const struct mosalloc_lock_stats *previous,
+                      double seconds) {
+    uint64_t acquisitions = lock->acquisitions - previous->acquisitions;
+    uint64_t contentions = lock->contentions - previous->contentions;
+    printf("  %s lock: %.0f/s, %.1f%% contended, %.1fms/s waiting\n", name,
+           acquisitions / seconds,
+           acquisitions ? 100.0 * contentions / acquisitions : 0.0,
+           (lock->wait_ns - previous->wait_ns) / 1e6 / seconds);
+}
+
+static void PrintProcess(Process *process, double seconds) {
+    struct mosalloc_stats current;
+    memcpy(&current, process->stats, sizeof(current));
+    // the first snapshot shows the averages since the process started
+    if (!process->has_previous) {
+        memset(&process->previous, 0, sizeof(process->previous));
+        seconds = time(NULL) - current.start_time;
+        if (seconds < 1) {
+            seconds = 1;
+        }
+    }
+    const struct mosalloc_stats *previous = &process->previous;
+    char b1[16], b2[16], b3[16], b4[16], b5[16], b6[16], b7[16];
+
+    printf("pid %d (%s), up %lus\n", current.pid, current.command,
+           (unsigned long)(time(NULL) - current.start_time));
+    printf("  calls/s:");
+    for (int c = 0; c < MOSALLOC_STATS_CALLS; c++) {
+        printf(" %s %.0f", CALL_NAMES[c],
+               Rate(current.calls[c], previous->calls[c], seconds));
+    }
+    printf("\n");
+    PrintLock("mmap hooks", &current.mmap_hooks_lock,
+              &previous->mmap_hooks_lock, seconds);
+    PrintLock("brk hooks", &current.brk_hooks_lock,
+              &previous->brk_hooks_lock, seconds);
+
+    printf("  %-12s %8s %8s %8s %9s %8s %8s %8s %8s %8s %5s %5s %9s %11s "
+           "%9s\n",
+           "pool", "capacity", "mapped", "peak", "committed", "allocs/s",
+           "frees/s", "4KB/s", "2MB/s", "1GB/s", "ext/s", "shr/s",
+           "down/fail", "ffa-nodes", "wait-ms/s");
+    uint32_t pools_count = current.pools_count;
+    if (pools_count > MOSALLOC_STATS_MAX_POOLS) {
+        pools_count = MOSALLOC_STATS_MAX_POOLS;
+    }
+    for (uint32_t i = 0; i < pools_count; i++) {
+        const struct mosalloc_pool_stats *pool = &current.pools[i];
+        const struct mosalloc_pool_stats *old = &previous->pools[i];
+        char nodes[32];
+        snprintf(nodes, sizeof(nodes), "%lu/%lu",
+                 (unsigned long)pool->ffa_used_nodes,
+                 (unsigned long)pool->ffa_capacity);
+        // the intervals that fell back to smaller pages, and the failed
+        // extensions (see HPC_HUGE_PAGES_FALLBACK)
+        char fallbacks[32];
+        snprintf(fallbacks, sizeof(fallbacks), "%lu/%lu",
+                 (unsigned long)pool->downgrades,
+                 (unsigned long)pool->fallback_failures);
+        printf("  %-12.12s %8s %8s %8s %9s %8.0f %8.0f %8s %8s %8s "
+               "%5.0f %5.0f %9s %11s %9.2f\n",
+               pool->name,
+               FormatSize(pool->capacity, b1, sizeof(b1)),
+               FormatSize(pool->mapped_size, b2, sizeof(b2)),
+               FormatSize(pool->peak_mapped_size, b3, sizeof(b3)),
+               FormatSize(pool->committed_size, b4, sizeof(b4)),
+               Rate(pool->allocations, old->allocations, seconds),
+               Rate(pool->deallocations, old->deallocations, seconds),
+               FormatSize(Rate(pool->allocated_bytes[MOSALLOC_STATS_4KB],
+                               old->allocated_bytes[MOSALLOC_STATS_4KB],
+                               seconds), b5, sizeof(b5)),
+               FormatSize(Rate(pool->allocated_bytes[MOSALLOC_STATS_2MB],
+                               old->allocated_bytes[MOSALLOC_STATS_2MB],
+                               seconds), b6, sizeof(b6)),
+               FormatSize(Rate(pool->allocated_bytes[MOSALLOC_STATS_1GB],
+                               old->allocated_bytes[MOSALLOC_STATS_1GB],
+                               seconds), b7, sizeof(b7)),
+               Rate(pool->extends, old->extends, seconds),
+               Rate(pool->shrinks, old->shrinks, seconds),
+               fallbacks, nodes,
+               (pool->lock.wait_ns - old->lock.wait_ns) / 1e6 / seconds);
+    }
+    printf("\n");
+    process->previous = current;
+    process->has_previous = true;
+}
+
+static void Usage(const char *program) {
+    fprintf(stderr, "usage: %s [-p pid] [-d delay-in-seconds] "
+                    "[-n iterations]\n", program);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    pid_t only_pid = 0;
+    double delay = 1;
+    long iterations = -1;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:d:n:")) != -1) {
+        switch (opt) {
+            case 'p':
+                only_pid = (pid_t)atoi(optarg);
+                break;
+            case 'd':
+                delay = atof(optarg);
+                break;
+            case 'n':
+                iterations = atol(optarg);
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+    if (delay <= 0) {
+        Usage(argv[0]);
+    }
+
+    bool is_terminal = isatty(STDOUT_FILENO);
+    double last_time = GetSeconds();
+    ScanSegments(only_pid);
+    RequestRefresh();
+    for (long i = 0; iterations < 0 || i < iterations; i++) {
+        if (i > 0) {
+            struct timespec sleep_time;
+            sleep_time.tv_sec = (time_t)delay;
+            sleep_time.tv_nsec = (long)((delay - sleep_time.tv_sec) * 1e9);
+            nanosleep(&sleep_time, NULL);
+        }
+        double now = GetSeconds();
+        double seconds = now - last_time;
+        last_time = now;
+
+        if (is_terminal) {
+            printf("\033[H\033[2J");
+        }
+        printf("mosalloc-top: %d process(es)\n\n", processes_count);
+        for (int p = 0; p < processes_count; p++) {
+            PrintProcess(&processes[p], seconds);
+        }
+        fflush(stdout);
+        // the list nodes are published on the next mmap or brk call of the
+        // processes, so they are requested one refresh ahead
+        ScanSegments(only_pid);
+        RequestRefresh();
+    }
+    return 0;
+}
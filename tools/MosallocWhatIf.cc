@@ -0,0 +1,564 @@
+//
+// mosalloc-whatif: evaluates layouts offline against a trace that was
+// recorded with HPC_TRACE_FILE (see mosalloc_trace.h). The calls of the trace
+// are fed through the pools of each layout (the first-fit allocators and the
+// huge-page backed regions of the library) on top of a simulated kernel, so
+// a layout can be evaluated without running the application again, and
+// without the huge pages that it needs. A row is printed per layout and pool:
+//
+// layout,pool,size,peak-size,peak-committed-4kb,peak-committed-2mb,
+// peak-committed-1gb,hugepages-2mb,hugepages-1gb,extends,shrinks,failed,
+// mmaps,munmaps,mprotects,madvises,mremaps
+//
+// where the hugepages columns are the huge pages that the pool needs at its
+// peak, failed counts the calls that succeeded in the trace but failed with
+// the layout, and the last columns count the calls that the pool made to the
+// (simulated) kernel.
+// With -t, the live allocated bytes of each pool by their page sizes are
+// written every interval (of the time of the trace) to a timeline file:
+//
+// layout,time-sec,pool,size,allocated-4kb,allocated-2mb,allocated-1gb
+//
+// usage: mosalloc-whatif [-i interval-ms] [-t timeline.csv] trace-file
+//                        layout.csv...
+//
+// The layouts have the format of the configuration file; a pool of the trace
+// that a layout does not configure keeps the capacity that it had in the
+// trace, with 4KB pages only. The calls are routed to the pools that served
+// them in the trace; the calls that the pools did not serve in the trace
+// (e.g., that failed or were forwarded to the kernel) and the file pool
+// (which is not backed by the layouts) are not simulated.
+// The first-fit lists have the sizes of the environment, as in the library
+// (HPC_MMAP_FIRST_FIT_LIST_SIZE and HPC_STACK_FIRST_FIT_LIST_SIZE).
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <vector>
+
+#include "MemoryAllocator.h"
+#include "TraceMappings.h"
+
+#define DEFAULT_INTERVAL_MS (1000)
+#define DEFAULT_FFA_LIST_SIZE (1048576)
+#define DEFAULT_STACK_FFA_LIST_SIZE (10240)
+
+enum KernelCall {
+    KERNEL_MMAP,
+    KERNEL_MUNMAP,
+    KERNEL_MPROTECT,
+    KERNEL_MADVISE,
+    KERNEL_MREMAP,
+    KERNEL_CALLS
+};
+
+// the kernel calls of the pool that serves the current call
+static uint64_t *current_kernel_calls = nullptr;
+
+static void CountKernelCall(enum KernelCall call) {
+    if (current_kernel_calls != nullptr) {
+        current_kernel_calls[call]++;
+    }
+}
+
+/*
+ * The simulated kernel: the fixed mappings of the pools are only counted,
+ * so the pages of the regions are never backed. The other mappings (the
+ * reservations of the regions and the memory of their lists) are real, but
+ * are not backed with huge pages and are committed only when they are
+ * touched (e.g., when the pages of huge-page intervals are moved). They are
+ * never unmapped, so the reserved regions are not reused.
+ */
+static void *SimulatedMmap(void *addr, size_t length, int prot, int flags,
+                           int fd, off_t offset) {
+    (void)prot;
+    if (flags & MAP_FIXED) {
+        CountKernelCall(KERNEL_MMAP);
+        return addr;
+    }
+    flags &= ~(MAP_HUGETLB | MAP_HUGE_2MB | MAP_HUGE_1GB);
+    return mmap(addr, length, PROT_READ | PROT_WRITE, flags | MAP_NORESERVE,
+                fd, offset);
+}
+
+static int SimulatedMunmap(void *addr, size_t length) {
+    (void)addr;
+    (void)length;
+    CountKernelCall(KERNEL_MUNMAP);
+    return 0;
+}
+
+static int SimulatedMprotect(void *addr, size_t length, int prot) {
+    (void)addr;
+    (void)length;
+    (void)prot;
+    CountKernelCall(KERNEL_MPROTECT);
+    return 0;
+}
+
+static int SimulatedMadvise(void *addr, size_t length, int advice) {
+    (void)addr;
+    (void)length;
+    (void)advice;
+    CountKernelCall(KERNEL_MADVISE);
+    return 0;
+}
+
+static void *SimulatedMremap(void *old_address, size_t old_size,
+                             size_t new_size, int flags, void *new_address) {
+    (void)old_size;
+    (void)new_size;
+    CountKernelCall(KERNEL_MREMAP);
+    return (flags & MREMAP_FIXED) ? new_address : old_address;
+}
+
+static size_t GetFfaListSize(const char *name) {
+    bool is_stack = (strcmp(name, STACK_POOL_TYPE) == 0);
+    const char *value = getenv(is_stack ? "HPC_STACK_FIRST_FIT_LIST_SIZE" :
+                               "HPC_MMAP_FIRST_FIT_LIST_SIZE");
+    if (value != nullptr) {
+        return strtoul(value, nullptr, 10);
+    }
+    return is_stack ? DEFAULT_STACK_FFA_LIST_SIZE : DEFAULT_FFA_LIST_SIZE;
+}
+
+struct SimulatedPool {
+    const char *name;
+    // the anonymous pools are simulated by MemoryPool, and the brk pool by
+    // its region only (as in MemoryAllocator)
+    MemoryPool *pool;
+    HugePageBackedRegion *region;
+    size_t size;
+    struct mosalloc_pool_stats stats;
+    size_t peak_committed[MOSALLOC_STATS_PAGE_SIZES];
+    uint64_t failed;
+    uint64_t kernel_calls[KERNEL_CALLS];
+};
+
+/*
+ * Simulates the calls of a trace with the pools of a layout.
+ */
+class LayoutSimulator {
+    public:
+        LayoutSimulator(const struct mosalloc_trace_header &header,
+                        const char *layout_file, FILE *timeline_file,
+                        uint64_t interval_ns);
+
+        void Initialize();
+        void Simulate(const std::vector<struct mosalloc_trace_record> &records);
+        void Print();
+
+    private:
+        void AddPool(uint32_t index);
+        SimulatedPool *FindPool(uint64_t addr, uint64_t length);
+        void Begin(SimulatedPool *pool);
+        void End(SimulatedPool *pool, bool is_failed);
+        void SimulateMmap(const struct mosalloc_trace_record &record);
+        void SimulateRanges(const struct mosalloc_trace_record &record);
+        void SimulateMremap(const struct mosalloc_trace_record &record);
+        void SimulateBrk(uint64_t new_break);
+        void Simulate(const struct mosalloc_trace_record &record);
+        void WriteTimeline(uint64_t time_ns);
+
+        const struct mosalloc_trace_header &_header;
+        const char *_layout_file;
+        FILE *_timeline_file;
+        uint64_t _interval_ns;
+        TraceMappings _mappings;
+        MemoryIntervalsValidator _validator;
+        // the simulated pools, by the indices of the pools of the header
+        SimulatedPool *_pools[MOSALLOC_TRACE_MAX_POOLS];
+        int _brk_index;
+};
+
+LayoutSimulator::LayoutSimulator(const struct mosalloc_trace_header &header,
+                                 const char *layout_file,
+                                 FILE *timeline_file, uint64_t interval_ns) :
+    _header(header),
+    _layout_file(layout_file),
+    _timeline_file(timeline_file),
+    _interval_ns(interval_ns),
+    _mappings(header),
+    _brk_index(-1) {
+        memset(_pools, 0, sizeof(_pools));
+    }
+
+/*
+ * Configures the pool at @index of the header from the layout, like
+ * MemoryAllocator::SetIntervalConfigList.
+ */
+void LayoutSimulator::AddPool(uint32_t index) {
+    const char *name = _header.names[index];
+    PoolConfigurationData configuration_data;
+    int intervals_size = parseCsv::GetConfigFileMaxWindows(_layout_file) * 2
+        + 1;
+    configuration_data.intervalList.Initialize(GlibcMmap, GlibcMunmap,
+                                               intervals_size);
+    parseCsv::ParseCsv(configuration_data, _layout_file, name);
+    if (_validator.Validate(configuration_data.intervalList) !=
+        ValidatorErrorMessage::SUCCESS) {
+        THROW_EXCEPTION("interval list is invalid");
+    }
+    if (configuration_data.size == 0) {
+        configuration_data.size = _header.capacities[index];
+        if (configuration_data.intervalList.GetLength() != 0) {
+            THROW_EXCEPTION("pool size is missing");
+        }
+    }
+    if (configuration_data.intervalList.FindMaxEndOffset() >
+        (off_t)configuration_data.size) {
+        THROW_EXCEPTION("pool size does not match given offsets");
+    }
+
+    SimulatedPool *pool = new SimulatedPool();
+    memset(pool, 0, sizeof(*pool));
+    pool->name = name;
+    pool->size = configuration_data.size;
+    if (strcmp(name, "brk") == 0) {
+        pool->region = new HugePageBackedRegion();
+        pool->region->Initialize(configuration_data.size,
+                                 configuration_data.intervalList,
+                                 SimulatedMmap, SimulatedMunmap, nullptr,
+                                 SimulatedMprotect, SimulatedMadvise,
+                                 SimulatedMremap);
+        pool->region->Resize(0);
+        _brk_index = (int)index;
+    } else {
+        pool->pool = new MemoryPool();
+        pool->pool->Initialize(configuration_data, GetFfaListSize(name),
+                               SimulatedMmap, SimulatedMunmap,
+                               SimulatedMprotect, SimulatedMadvise,
+                               SimulatedMremap);
+        pool->pool->ResetRegion();
+        pool->pool->SetStatistics(&pool->stats);
+        pool->region = &pool->pool->GetRegion();
+    }
+    _mappings.SetPoolBase(index, (uint64_t)pool->region->GetRegionBase());
+    _pools[index] = pool;
+}
+
+void LayoutSimulator::Initialize() {
+    for (uint32_t i = 0; i < _header.pools_count; i++) {
+        if (strcmp(_header.names[i], "file") != 0) {
+            AddPool(i);
+        }
+    }
+}
+
+// returns the simulated pool of the range [@addr, @addr + @length) (of the
+// simulation), or nullptr if it is not inside a pool
+SimulatedPool *LayoutSimulator::FindPool(uint64_t addr, uint64_t length) {
+    for (uint32_t i = 0; i < _header.pools_count; i++) {
+        SimulatedPool *pool = _pools[i];
+        if (pool != nullptr && pool->pool != nullptr &&
+            pool->pool->ContainsRange((void*)addr, length)) {
+            return pool;
+        }
+    }
+    return nullptr;
+}
+
+void LayoutSimulator::Begin(SimulatedPool *pool) {
+    current_kernel_calls = pool->kernel_calls;
+}
+
+void LayoutSimulator::End(SimulatedPool *pool, bool is_failed) {
+    current_kernel_calls = nullptr;
+    pool->failed += is_failed;
+    static const PageSize page_sizes[MOSALLOC_STATS_PAGE_SIZES] = {
+        PageSize::BASE_4KB, PageSize::HUGE_2MB, PageSize::HUGE_1GB
+    };
+    for (int i = 0; i < MOSALLOC_STATS_PAGE_SIZES; i++) {
+        size_t committed = pool->region->GetCommittedSize(page_sizes[i]);
+        if (pool->peak_committed[i] < committed) {
+            pool->peak_committed[i] = committed;
+        }
+    }
+}
+
+// the mapping is simulated by the pool that served it in the trace
+void LayoutSimulator::SimulateMmap(const struct mosalloc_trace_record &record) {
+    int index = _mappings.FindPool(record.result);
+    if (record.fd >= 0 || index < 0 || _pools[index] == nullptr ||
+        _pools[index]->pool == nullptr) {
+        return;
+    }
+    SimulatedPool *pool = _pools[index];
+    uint64_t length = ROUND_UP(record.length, PageSize::BASE_4KB);
+    uint64_t addr = _mappings.Translate(record.addr);
+    bool is_fixed = (record.flags & (MAP_FIXED | MAP_FIXED_NOREPLACE)) != 0;
+    Begin(pool);
+    void *res = MAP_FAILED;
+    if (!is_fixed || pool->pool->ContainsRange((void*)addr, length)) {
+        res = pool->pool->Allocate((void*)addr, length, record.prot,
+                                   record.flags);
+    }
+    End(pool, res == MAP_FAILED);
+    if (res != MAP_FAILED) {
+        _mappings.Add(record.result, record.length, (uint64_t)res);
+    }
+}
+
+// simulates munmap, mprotect and madvise
+void LayoutSimulator::SimulateRanges(
+        const struct mosalloc_trace_record &record) {
+    std::vector<TraceMappings::Piece> pieces;
+    _mappings.GetReplayedPieces(record.addr, record.length, pieces);
+    for (auto &piece : pieces) {
+        uint64_t length = ROUND_UP(piece.length, PageSize::BASE_4KB);
+        SimulatedPool *pool = FindPool(piece.addr, length);
+        if (pool == nullptr) {
+            continue;
+        }
+        Begin(pool);
+        int res = 0;
+        if (record.call == MOSALLOC_TRACE_MUNMAP) {
+            res = pool->pool->Deallocate((void*)piece.addr, length);
+        } else if (record.call == MOSALLOC_TRACE_MPROTECT) {
+            res = pool->pool->Protect((void*)piece.addr, length, record.prot);
+        } else {
+            res = pool->pool->Advise((void*)piece.addr, length, record.prot);
+        }
+        End(pool, res != 0);
+    }
+    if (record.call == MOSALLOC_TRACE_MUNMAP) {
+        _mappings.Remove(record.addr, record.length);
+    }
+}
+
+void LayoutSimulator::SimulateMremap(
+        const struct mosalloc_trace_record &record) {
+    uint64_t old_address = _mappings.Translate(record.addr);
+    uint64_t old_size = ROUND_UP(record.length, PageSize::BASE_4KB);
+    SimulatedPool *pool = FindPool(old_address, old_size);
+    if (pool == nullptr) {
+        return;
+    }
+    Begin(pool);
+    void *res = pool->pool->Remap((void*)old_address, old_size,
+                                  ROUND_UP(record.new_length,
+                                           PageSize::BASE_4KB),
+                                  record.flags);
+    End(pool, res == MAP_FAILED);
+    if (res != MAP_FAILED) {
+        _mappings.Remove(record.addr, record.length);
+        _mappings.Add(record.result, record.new_length, (uint64_t)res);
+    }
+}
+
+/*
+ * Moves the program break to @new_break (of the trace), and counts the
+ * change like MemoryAllocator::PublishBrkStatistics.
+ */
+void LayoutSimulator::SimulateBrk(uint64_t new_break) {
+    if (_brk_index < 0 || new_break < _header.bases[_brk_index]) {
+        return;
+    }
+    SimulatedPool *pool = _pools[_brk_index];
+    HugePageBackedRegion *region = pool->region;
+    size_t old_size = region->GetRegionSize();
+    Begin(pool);
+    int res = region->Resize(new_break - _header.bases[_brk_index]);
+    End(pool, res != 0);
+
+    size_t new_size = region->GetRegionSize();
+    void *base = region->GetRegionBase();
+    if (new_size > old_size) {
+        pool->stats.allocations++;
+        pool->stats.extends++;
+        StatisticsSegment::AddBackedSizes(pool->stats.allocated_bytes,
+                                          *region, PTR_ADD(base, old_size),
+                                          new_size - old_size);
+    } else if (new_size < old_size) {
+        pool->stats.deallocations++;
+        pool->stats.shrinks++;
+        StatisticsSegment::AddBackedSizes(pool->stats.freed_bytes,
+                                          *region, PTR_ADD(base, new_size),
+                                          old_size - new_size);
+    }
+    pool->stats.mapped_size = new_size;
+    if (pool->stats.peak_mapped_size < new_size) {
+        pool->stats.peak_mapped_size = new_size;
+    }
+}
+
+void LayoutSimulator::Simulate(const struct mosalloc_trace_record &record) {
+    // the failed calls did not change the pools, and the calls that were
+    // made inside other calls are simulated by their outer calls
+    if (record.error != 0 || record.depth > 0) {
+        return;
+    }
+    switch (record.call) {
+        case MOSALLOC_TRACE_MMAP:
+            SimulateMmap(record);
+            break;
+        case MOSALLOC_TRACE_MUNMAP:
+        case MOSALLOC_TRACE_MPROTECT:
+        case MOSALLOC_TRACE_MADVISE:
+            SimulateRanges(record);
+            break;
+        case MOSALLOC_TRACE_MREMAP:
+            SimulateMremap(record);
+            break;
+        case MOSALLOC_TRACE_BRK:
+            SimulateBrk(record.addr);
+            break;
+        case MOSALLOC_TRACE_SBRK:
+            // sbrk returns the old program break
+            SimulateBrk(record.result + (int64_t)record.length);
+            break;
+    }
+}
+
+void LayoutSimulator::WriteTimeline(uint64_t time_ns) {
+    for (uint32_t i = 0; i < _header.pools_count; i++) {
+        SimulatedPool *pool = _pools[i];
+        if (pool == nullptr) {
+            continue;
+        }
+        fprintf(_timeline_file, "%s,%.3f,%s,%lu", _layout_file,
+                time_ns / 1e9, pool->name,
+                (unsigned long)pool->region->GetRegionSize());
+        for (int j = 0; j < MOSALLOC_STATS_PAGE_SIZES; j++) {
+            fprintf(_timeline_file, ",%lu",
+                    (unsigned long)(pool->stats.allocated_bytes[j] -
+                                    pool->stats.freed_bytes[j]));
+        }
+        fprintf(_timeline_file, "\n");
+    }
+}
+
+void LayoutSimulator::Simulate(
+        const std::vector<struct mosalloc_trace_record> &records) {
+    uint64_t next_sample_ns = 0;
+    for (auto &record : records) {
+        while (_timeline_file != nullptr && record.time_ns >= next_sample_ns) {
+            WriteTimeline(next_sample_ns);
+            next_sample_ns += _interval_ns;
+        }
+        Simulate(record);
+    }
+    if (_timeline_file != nullptr && !records.empty()) {
+        WriteTimeline(records.back().time_ns);
+    }
+}
+
+void LayoutSimulator::Print() {
+    for (uint32_t i = 0; i < _header.pools_count; i++) {
+        SimulatedPool *pool = _pools[i];
+        if (pool == nullptr) {
+            continue;
+        }
+        printf("%s,%s,%lu,%lu", _layout_file, pool->name,
+               (unsigned long)pool->size,
+               (unsigned long)pool->stats.peak_mapped_size);
+        for (int j = 0; j < MOSALLOC_STATS_PAGE_SIZES; j++) {
+            printf(",%lu", (unsigned long)pool->peak_committed[j]);
+        }
+        printf(",%lu,%lu,%lu,%lu,%lu",
+               (unsigned long)ROUND_UP(pool->peak_committed[1],
+                                       PageSize::HUGE_2MB) /
+               (unsigned long)PageSize::HUGE_2MB,
+               (unsigned long)ROUND_UP(pool->peak_committed[2],
+                                       PageSize::HUGE_1GB) /
+               (unsigned long)PageSize::HUGE_1GB,
+               (unsigned long)pool->stats.extends,
+               (unsigned long)pool->stats.shrinks,
+               (unsigned long)pool->failed);
+        for (int j = 0; j < KERNEL_CALLS; j++) {
+            printf(",%lu", (unsigned long)pool->kernel_calls[j]);
+        }
+        printf("\n");
+    }
+}
+
+static void PrintUsage(const char *program) {
+    fprintf(stderr, "usage: %s [-i interval-ms] [-t timeline.csv] "
+            "trace-file layout.csv...\n", program);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long interval_ms = DEFAULT_INTERVAL_MS;
+    const char *timeline_path = nullptr;
+    int opt;
+    while ((opt = getopt(argc, argv, "i:t:")) != -1) {
+        switch (opt) {
+            case 'i':
+                interval_ms = strtoul(optarg, nullptr, 10);
+                break;
+            case 't':
+                timeline_path = optarg;
+                break;
+            default:
+                PrintUsage(argv[0]);
+                return 1;
+        }
+    }
+    if (argc - optind < 2 || interval_ms == 0) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    struct mosalloc_trace_header header;
+    std::vector<struct mosalloc_trace_record> records;
+    if (ReadTrace(argv[optind], &header, records) != 0) {
+        return 1;
+    }
+    FILE *timeline_file = nullptr;
+    if (timeline_path != nullptr) {
+        timeline_file = fopen(timeline_path, "w");
+        if (timeline_file == nullptr) {
+            perror(timeline_path);
+            return 1;
+        }
+        fprintf(timeline_file, "layout,time-sec,pool,size,allocated-4kb,"
+                "allocated-2mb,allocated-1gb\n");
+    }
+
+    printf("layout,pool,size,peak-size,peak-committed-4kb,"
+           "peak-committed-2mb,peak-committed-1gb,hugepages-2mb,"
+           "hugepages-1gb,extends,shrinks,failed,mmaps,munmaps,mprotects,"
+           "madvises,mremaps\n");
+    int status = 0;
+    for (int i = optind + 1; i < argc; i++) {
+        // each layout is simulated in a child process, since the pools are
+        // never freed and an invalid layout (or a pool that runs out of
+        // memory) ends the process
+        fflush(stdout);
+        if (timeline_file != nullptr) {
+            fflush(timeline_file);
+        }
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0) {
+            LayoutSimulator simulator(header, argv[i], timeline_file,
+                                      interval_ms * 1000000ull);
+            simulator.Initialize();
+            simulator.Simulate(records);
+            simulator.Print();
+            fflush(stdout);
+            if (timeline_file != nullptr) {
+                fflush(timeline_file);
+            }
+            _exit(0);
+        }
+        int child_status;
+        while (waitpid(pid, &child_status, 0) < 0 && errno == EINTR) {
+        }
+        if (!WIFEXITED(child_status) || WEXITSTATUS(child_status) != 0) {
+            fprintf(stderr, "%s: the simulation failed\n", argv[i]);
+            status = 1;
+        }
+    }
+    if (timeline_file != nullptr) {
+        fclose(timeline_file);
+    }
+    return status;
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "TraceMappings.h"
+
+int ReadTrace(const char *path, struct mosalloc_trace_header *header,
+              std::vector<struct mosalloc_trace_record> &records) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    if (fread(header, sizeof(*header), 1, file) != 1 ||
+        header->magic != MOSALLOC_TRACE_MAGIC ||
+        header->version != MOSALLOC_TRACE_VERSION ||
+        header->record_size != sizeof(struct mosalloc_trace_record) ||
+        header->pools_count > MOSALLOC_TRACE_MAX_POOLS) {
+        fprintf(stderr, "%s: not a trace file\n", path);
+        fclose(file);
+        return -1;
+    }
+    bool is_closed = false;
+    struct mosalloc_trace_record record;
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+        if (record.call == MOSALLOC_TRACE_END) {
+            is_closed = true;
+            if (record.result != 0) {
+                fprintf(stderr, "%s: %lu calls were not recorded\n", path,
+                        (unsigned long)record.result);
+            }
+            continue;
+        }
+        if (record.call < MOSALLOC_TRACE_END) {
+            records.push_back(record);
+        }
+    }
+    fclose(file);
+    if (!is_closed) {
+        // e.g., the process was killed, so the buffered calls are missing
+        fprintf(stderr, "%s: the trace was not closed\n", path);
+    }
+    std::sort(records.begin(), records.end(),
+              [](const struct mosalloc_trace_record &a,
+                 const struct mosalloc_trace_record &b) {
+                  return a.sequence < b.sequence;
+              });
+    return 0;
+}
+
+TraceMappings::TraceMappings(const struct mosalloc_trace_header &header) :
+    _header(header) {
+        memset(_replayed_bases, 0, sizeof(_replayed_bases));
+    }
+
+void TraceMappings::SetPoolBase(uint32_t index, uint64_t base) {
+    _replayed_bases[index] = base;
+}
+
+int TraceMappings::FindPool(uint64_t addr) {
+    for (uint32_t i = 0; i < _header.pools_count; i++) {
+        if (addr >= _header.bases[i] &&
+            addr < _header.bases[i] + _header.capacities[i]) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+uint64_t TraceMappings::Translate(uint64_t addr) {
+    auto it = _mappings.upper_bound(addr);
+    if (it != _mappings.begin()) {
+        --it;
+        if (addr < it->first + it->second.length) {
+            return it->second.replayed + (addr - it->first);
+        }
+    }
+    int pool = FindPool(addr);
+    if (pool < 0 || _replayed_bases[pool] == 0) {
+        return addr;
+    }
+    return _replayed_bases[pool] + (addr - _header.bases[pool]);
+}
+
+void TraceMappings::GetReplayedPieces(uint64_t addr, uint64_t length,
+                                      std::vector<Piece> &pieces) {
+    uint64_t end = addr + length;
+    auto it = _mappings.upper_bound(addr);
+    if (it != _mappings.begin()) {
+        --it;
+    }
+    for (; it != _mappings.end() && it->first < end; ++it) {
+        uint64_t mapping_end = it->first + it->second.length;
+        if (mapping_end <= addr) {
+            continue;
+        }
+        uint64_t start = std::max(addr, it->first);
+        uint64_t stop = std::min(end, mapping_end);
+        pieces.push_back({it->second.replayed + (start - it->first),
+                          stop - start});
+    }
+    if (pieces.empty()) {
+        pieces.push_back({Translate(addr), length});
+    }
+}
+
+void TraceMappings::Remove(uint64_t addr, uint64_t length) {
+    uint64_t end = addr + length;
+    auto it = _mappings.upper_bound(addr);
+    if (it != _mappings.begin()) {
+        --it;
+    }
+    while (it != _mappings.end() && it->first < end) {
+        uint64_t start = it->first;
+        Mapping mapping = it->second;
+        uint64_t mapping_end = start + mapping.length;
+        if (mapping_end <= addr) {
+            ++it;
+            continue;
+        }
+        it = _mappings.erase(it);
+        if (start < addr) {
+            _mappings[start] = {addr - start, mapping.replayed};
+        }
+        if (mapping_end > end) {
+            _mappings[end] = {mapping_end - end,
+                              mapping.replayed + (end - start)};
+        }
+    }
+}
+
+void TraceMappings::Add(uint64_t addr, uint64_t length, uint64_t replayed) {
+    Remove(addr, length);
+    _mappings[addr] = {length, replayed};
+}
@@ -0,0 +1,71 @@
+#ifndef _TRACE_MAPPINGS_H_
+#define _TRACE_MAPPINGS_H_
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+
+#include "mosalloc_trace.h"
+
+/*
+ * Reads the header and the records of the trace at @path, sorted by their
+ * sequence numbers (without the end record).
+ * Returns 0 on success, or -1 if the file is not a trace.
+ */
+int ReadTrace(const char *path, struct mosalloc_trace_header *header,
+              std::vector<struct mosalloc_trace_record> &records);
+
+/*
+ * Translates the addresses of a trace to the addresses of the pools that the
+ * trace is replayed against: the replayed mappings are kept by their
+ * addresses in the trace, and the addresses that are not in any replayed
+ * mapping (e.g., the program break) are translated by their offsets in their
+ * pools.
+ */
+class TraceMappings {
+    public:
+        struct Piece {
+            uint64_t addr;
+            uint64_t length;
+        };
+
+        explicit TraceMappings(const struct mosalloc_trace_header &header);
+
+        // sets the replayed base of the pool at @index of the header
+        void SetPoolBase(uint32_t index, uint64_t base);
+        // returns the index of the pool of the header that contains @addr,
+        // or -1 if there is no such pool
+        int FindPool(uint64_t addr);
+
+        /*
+         * Translates an address of the trace through the replayed mappings,
+         * or by its offset in its pool; the addresses outside the pools are
+         * kept.
+         */
+        uint64_t Translate(uint64_t addr);
+        /*
+         * Returns the replayed parts of the range of the trace [@addr,
+         * @addr + @length); if no mapping overlaps it, the range is
+         * translated as a whole.
+         */
+        void GetReplayedPieces(uint64_t addr, uint64_t length,
+                               std::vector<Piece> &pieces);
+        // removes [@addr, @addr + @length) of the trace from the mappings
+        void Remove(uint64_t addr, uint64_t length);
+        void Add(uint64_t addr, uint64_t length, uint64_t replayed);
+
+    private:
+        struct Mapping {
+            uint64_t length;
+            uint64_t replayed;
+        };
+
+        const struct mosalloc_trace_header &_header;
+        // the replayed bases of the pools of the header (0 if the pool is
+        // not replayed)
+        uint64_t _replayed_bases[MOSALLOC_TRACE_MAX_POOLS];
+        // the mappings of the trace, by their addresses in the trace
+        std::map<uint64_t, Mapping> _mappings;
+};
+
+#endif //_TRACE_MAPPINGS_H_